@@ -70,11 +70,24 @@
 #define CAEN_FELIB_VERSION_STRING			CAEN_FELIB_STR(CAEN_FELIB_VERSION_MAJOR) "." CAEN_FELIB_STR(CAEN_FELIB_VERSION_MINOR) "." CAEN_FELIB_STR(CAEN_FELIB_VERSION_PATCH)
 /*! @} */
 
+/*!
+* @defgroup StatsMacros Statistics macros
+* @brief Macros to identify the shared memory segment created by CAEN_FELib_EnableStatistics().
+* @{ */
+#define CAEN_FELIB_STATS_MAGIC				UINT32_C(0xcae05747)	//!< Value of CAEN_FELib_StatsHeader_t::magic
+#define CAEN_FELIB_STATS_VERSION			1						//!< Value of CAEN_FELib_StatsHeader_t::version, incremented on layout changes
+/*! @} */
+
 /**
 * @defgroup Enums Enumerations
 * @brief Application enumerations.
 */
 
+/**
+* @defgroup Types Types
+* @brief Application types.
+*/
+
 /**
 * @defgroup Functions API
 * @brief Application programming interface.
@@ -106,6 +119,7 @@ typedef enum {
 	CAEN_FELib_Disabled						= -13,	//!< Disabled function
 	CAEN_FELib_BadLibraryVersion			= -14,	//!< Returned by CAEN_FELib_Open() in case of library version not supported by the server
 	CAEN_FELib_CommunicationError			= -15,	//!< Communication error
+	CAEN_FELib_Interrupted					= -16,	//!< Returned by CAEN_FELib_ReadData() and CAEN_FELib_HasData() when interrupted by CAEN_FELib_Interrupt()
 } CAEN_FELib_ErrorCode;
 
 /**
@@ -132,6 +146,377 @@ typedef enum {
 	CAEN_FELib_HV_RANGE		= 14,		//!< HV Range
 } CAEN_FELib_NodeType_t;
 
+/**
+ * @brief Keys indexed on event files, see CAEN_FELib_FindEvent().
+ *
+ * @ingroup Enums
+ */
+typedef enum {
+	CAEN_FELib_KEY_TIME			= 0,	//!< Time of the event since the beginning of the capture, in nanoseconds
+	CAEN_FELib_KEY_TIMESTAMP	= 1,	//!< Value of the `TIMESTAMP` field
+	CAEN_FELib_KEY_TRIGGER_ID	= 2,	//!< Value of the `TRIGGER_ID` field
+} CAEN_FELib_EventKey_t;
+
+/**
+ * @brief Information about a dispatched call, passed to trace hooks.
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	const char*		function;			//!< API name (static null-terminated string, e.g. "CAEN_FELib_ReadData")
+	uint64_t		handle;				//!< handle passed to the API (zero if not applicable)
+	const char*		path;				//!< path or URL passed to the API (can be null; valid only during the hook)
+	int				ret;				//!< return code (valid only on post hook)
+	uint64_t		begin;				//!< timestamp of call begin in nanoseconds, from a monotonic clock
+	uint64_t		end;				//!< timestamp of call end in nanoseconds, from a monotonic clock (valid only on post hook)
+} CAEN_FELib_TraceInfo_t;
+
+/**
+ * @brief Trace hook, invoked by the thread that performs the call.
+ *
+ * @ingroup Types
+ */
+typedef void (CAEN_FELIB_API* CAEN_FELib_TraceHook_t)(const CAEN_FELib_TraceInfo_t* info, void* ctx);
+
+/**
+ * @brief Header of the shared memory segment created by CAEN_FELib_EnableStatistics().
+ *
+ * The segment contains this header followed by CAEN_FELib_StatsHeader_t::capacity entries of
+ * type CAEN_FELib_StatsEntry_t, each CAEN_FELib_StatsHeader_t::entrySize bytes long. Only the
+ * first CAEN_FELib_StatsHeader_t::used entries are meaningful.
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint32_t		magic;				//!< ::CAEN_FELIB_STATS_MAGIC
+	uint32_t		version;			//!< ::CAEN_FELIB_STATS_VERSION
+	uint32_t		headerSize;			//!< size of this header, in bytes
+	uint32_t		entrySize;			//!< size of each entry, in bytes
+	uint32_t		capacity;			//!< number of entries
+	uint32_t		used;				//!< number of entries in use (written with release semantics)
+	int64_t			pid;				//!< process identifier
+	uint64_t		creationTime;		//!< creation time, in nanoseconds since Unix epoch
+	uint8_t			reserved[24];		//!< reserved for future use
+} CAEN_FELib_StatsHeader_t;
+
+/**
+ * @brief Statistics of an endpoint, in the shared memory segment created by CAEN_FELib_EnableStatistics().
+ *
+ * Each entry is protected by a sequence lock and updated only by the thread that reads the endpoint.
+ * To get a consistent snapshot readers must:
+ * 1. load CAEN_FELib_StatsEntry_t::seq with acquire semantics, and retry if it is odd;
+ * 2. copy the entry;
+ * 3. issue an acquire fence and load again CAEN_FELib_StatsEntry_t::seq, and retry if it changed.
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint32_t		seq;				//!< sequence lock, odd while the entry is being updated
+	uint32_t		flags;				//!< bit 0 is set while the connection is open
+	uint64_t		handle;				//!< endpoint handle
+	uint64_t		readData;			//!< number of successful CAEN_FELib_ReadData() calls
+	uint64_t		hasData;			//!< number of successful CAEN_FELib_HasData() calls
+	uint64_t		timeouts;			//!< number of ::CAEN_FELib_Timeout and ::CAEN_FELib_Interrupted returned by CAEN_FELib_ReadData() and CAEN_FELib_HasData()
+	uint64_t		stops;				//!< number of ::CAEN_FELib_Stop returned by CAEN_FELib_ReadData() and CAEN_FELib_HasData()
+	uint64_t		errors;				//!< number of other errors returned by CAEN_FELib_ReadData() and CAEN_FELib_HasData()
+	uint64_t		bytes;				//!< payload bytes returned by CAEN_FELib_ReadData() (zero if the format size cannot be resolved)
+	uint64_t		lastEventTime;		//!< time of last successful CAEN_FELib_ReadData(), in nanoseconds since Unix epoch
+	char			name[120];			//!< connection argument and endpoint path (null-terminated string)
+} CAEN_FELib_StatsEntry_t;
+
+/**
+ * @brief Status of a recording started with CAEN_FELib_StartRecording().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint64_t		events;				//!< number of events recorded
+	uint64_t		stops;				//!< number of ::CAEN_FELib_Stop recorded
+	uint64_t		bytesRecorded;		//!< bytes serialized to the buffers
+	uint64_t		bytesWritten;		//!< bytes written to file
+	uint64_t		backlog;			//!< bytes serialized and not yet written
+	uint64_t		capacity;			//!< total size of the buffers, in bytes: the readout stalls if the backlog gets close to it
+	uint64_t		stalls;				//!< number of times the readout waited for the writer or for compression
+	uint64_t		fsyncs;				//!< number of periodic syncs to disk
+	double			throughput;			//!< write throughput in the last period of about one second, in bytes/s
+	uint64_t		bytesCompressed;	//!< bytes passed to compression (0 if not enabled)
+	uint64_t		bytesCompressedOut;	//!< bytes produced by compression
+	double			compressionThroughput;	//!< compression throughput of all threads in the last period of about one second, in uncompressed bytes/s
+	int				error;				//!< ::CAEN_FELib_Success, or the error that stopped the recording
+} CAEN_FELib_RecordingStatus_t;
+
+/**
+ * @brief Event file opened with CAEN_FELib_OpenEventFile() (opaque type).
+ *
+ * @ingroup Types
+ */
+typedef struct CAEN_FELib_EventFile CAEN_FELib_EventFile_t;
+
+/**
+ * @brief Information about an event file.
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint64_t		nEvents;			//!< number of events
+	uint64_t		creationTime;		//!< creation time, in nanoseconds since Unix epoch
+	char			source[128];		//!< connection argument of the device (null-terminated string)
+	char			endpoint[256];		//!< path of the endpoint (null-terminated string)
+	int				indexed;			//!< 1 if the file has been closed properly, 0 if the index has been rebuilt on open
+} CAEN_FELib_EventFileInfo_t;
+
+/**
+ * @brief Information about a histogram, filled by CAEN_FELib_GetHistogram().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	size_t			binsX;				//!< number of bins on x axis
+	size_t			binsY;				//!< number of bins on y axis (1 on 1D histograms)
+	double			minX;				//!< lower edge of x axis
+	double			maxX;				//!< upper edge of x axis
+	double			minY;				//!< lower edge of y axis (0 on 1D histograms)
+	double			maxY;				//!< upper edge of y axis (0 on 1D histograms)
+	uint64_t		entries;			//!< number of entries in range
+	uint64_t		outOfRange;			//!< number of entries out of range
+} CAEN_FELib_HistogramInfo_t;
+
+/**
+ * @brief Statistics of the data reduction of an endpoint, filled by CAEN_FELib_GetDataReductionStats().
+ *
+ * The reduction ratio is @p samplesIn / @p samplesOut.
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint64_t		events;				//!< number of events reduced
+	uint64_t		samplesIn;			//!< number of samples before the reduction
+	uint64_t		samplesOut;			//!< number of samples after the reduction
+	uint64_t		suppressed;			//!< number of channel waveforms suppressed
+} CAEN_FELib_ReductionStats_t;
+
+/**
+ * @brief Statistics of the waits of an endpoint, filled by CAEN_FELib_GetWaitStats().
+ *
+ * Only the waits of CAEN_FELib_ReadDataUs() and CAEN_FELib_HasDataUs() are accounted.
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint64_t		spinNs;				//!< time spent spinning, in nanoseconds
+	uint64_t		blockNs;			//!< time spent blocked in the implementation library, in nanoseconds
+	uint64_t		spinHits;			//!< number of events found while spinning
+	uint64_t		blockHits;			//!< number of events found while blocked
+	uint64_t		timeouts;			//!< number of waits expired
+	uint64_t		spinBudgetNs;		//!< current spin budget, in nanoseconds
+	uint64_t		interArrivalNs;		//!< mean inter-arrival time of the events, in nanoseconds (zero if unknown)
+} CAEN_FELib_WaitStats_t;
+
+/**
+ * @brief Result of a command on a board, filled by CAEN_FELib_SendCommandMany().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	int				ret;				//!< result of the command on the board (::CAEN_FELib_Success or a negative error code specified in #CAEN_FELib_ErrorCode)
+	uint64_t		skewNs;				//!< issue time relative to the first board, in nanoseconds
+	uint64_t		durationNs;			//!< time to complete the command on the board, in nanoseconds
+} CAEN_FELib_CommandResult_t;
+
+/**
+ * @brief Structured record of the last error occurred on the current thread, filled by CAEN_FELib_GetLastErrorInfo().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	int				code;				//!< error code returned by the function, see #CAEN_FELib_ErrorCode (::CAEN_FELib_Success if no error, ::CAEN_FELib_GenericError if @p function is empty)
+	char			library[16];		//!< name of the underlying library that raised the error (empty if raised by this library)
+	const char*		function;			//!< API name (static null-terminated string, e.g. "CAEN_FELib_ReadData"; empty if not operating on a device handle)
+	uint64_t		handle;				//!< handle passed to the API (zero if not applicable)
+	uint64_t		connection;			//!< handle of the device owning @p handle, as returned by CAEN_FELib_Open() (zero if not applicable)
+} CAEN_FELib_ErrorInfo_t;
+
+/**
+ * @brief Node of a subtree, filled by CAEN_FELib_WalkTree().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint64_t				handle;				//!< handle of the node
+	uint64_t				parent;				//!< handle of the parent node (zero for the root of the walk)
+	char					name[32];			//!< name of the node (null-terminated string)
+	CAEN_FELib_NodeType_t	type;				//!< type of the node
+	uint32_t				depth;				//!< depth with respect to the root of the walk (zero for the root)
+} CAEN_FELib_TreeNode_t;
+
+/**
+ * @brief Watch of parameters, created with CAEN_FELib_Watch() (opaque type).
+ *
+ * @ingroup Types
+ */
+typedef struct CAEN_FELib_Watch CAEN_FELib_Watch_t;
+
+/**
+ * @brief Change of a watched parameter, passed to watch callbacks.
+ *
+ * Pointers are valid only during the callback.
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	size_t					index;				//!< index of the parameter on the paths passed to CAEN_FELib_Watch()
+	uint64_t				handle;				//!< handle passed to CAEN_FELib_Watch()
+	const char*				path;				//!< path of the parameter
+	const char*				value;				//!< new value (null-terminated string, empty if @p ret is not ::CAEN_FELib_Success)
+	int						ret;				//!< result of CAEN_FELib_GetValue() on the parameter
+	uint64_t				timestamp;			//!< time of the sample in nanoseconds since Epoch
+} CAEN_FELib_WatchEvent_t;
+
+/**
+ * @brief Watch callback, invoked by the scheduler thread with the parameters changed since the previous invocation.
+ *
+ * @ingroup Types
+ */
+typedef void (CAEN_FELIB_API* CAEN_FELib_WatchCallback_t)(const CAEN_FELib_WatchEvent_t* events, size_t n, void* ctx);
+
+/**
+ * @brief Event of a file opened with CAEN_FELib_OpenEventFile().
+ *
+ * Pointers refer to the mapped file and are valid until CAEN_FELib_CloseEventFile().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint64_t		index;				//!< index of the event
+	uint64_t		time;				//!< time of the event since the beginning of the capture, in nanoseconds
+	const char*		format;				//!< read data format of the event, as passed to CAEN_FELib_SetReadDataFormat() (null-terminated string)
+	const void*		payload;			//!< serialized event
+	size_t			size;				//!< size of @p payload, in bytes
+	uint64_t		reserved[2];		//!< position on the file, used internally
+} CAEN_FELib_Event_t;
+
+/**
+ * @brief Reader of a fan-out, opened with CAEN_FELib_OpenFanout() (opaque type).
+ *
+ * @ingroup Types
+ */
+typedef struct CAEN_FELib_FanoutReader CAEN_FELib_FanoutReader_t;
+
+/**
+ * @brief Status of a fan-out reader, filled by CAEN_FELib_GetFanoutStatus().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint64_t		read;				//!< number of events returned by CAEN_FELib_ReadFanoutEvent()
+	uint64_t		lost;				//!< number of events overwritten before being read, or with a format replaced before being read
+	uint64_t		skipped;			//!< number of events skipped by sampling
+	uint64_t		published;			//!< number of events and end of runs published by the owner
+	uint64_t		dropped;			//!< number of events and end of runs not published by the owner, because the ring was full of events not yet read by readers with `block` policy, or too large
+	uint64_t		backlog;			//!< bytes published and not yet read by this reader
+	int64_t			pid;				//!< process identifier of the owner
+	int				closed;				//!< 1 if the owner has stopped the fan-out, 0 otherwise
+} CAEN_FELib_FanoutStatus_t;
+
+/**
+ * @brief Pool of preallocated event buffers, created with CAEN_FELib_CreateEventPool() (opaque type).
+ *
+ * @ingroup Types
+ */
+typedef struct CAEN_FELib_EventPool CAEN_FELib_EventPool_t;
+
+/**
+ * @brief Slot of an event pool, filled by CAEN_FELib_ReadDataSlot().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	void* const*	fields;				//!< a pointer per field of the read data format, as would be passed to CAEN_FELib_ReadData()
+	size_t			nFields;			//!< number of fields
+	size_t			index;				//!< index of the slot in the pool
+} CAEN_FELib_EventSlot_t;
+
+/**
+ * @brief Time-ordered merge of several endpoints, created with CAEN_FELib_CreateMerger() (opaque type).
+ *
+ * @ingroup Types
+ */
+typedef struct CAEN_FELib_Merger CAEN_FELib_Merger_t;
+
+/**
+ * @brief Event returned by CAEN_FELib_MergerReadData() and CAEN_FELib_MergerReadGroup().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	size_t					board;		//!< index of the endpoint on the handles passed to CAEN_FELib_CreateMerger()
+	uint64_t				handle;		//!< endpoint handle
+	uint64_t				timestamp;	//!< value of the `TIMESTAMP` field plus the offset of the endpoint
+	CAEN_FELib_EventSlot_t*	slot;		//!< the event, with the read data format of the endpoint
+} CAEN_FELib_MergedEvent_t;
+
+/**
+ * @brief Arrow C data interface, used by CAEN_FELib_ReadBatch().
+ *
+ * Definitions of the [Arrow C data interface](https://arrow.apache.org/docs/format/CDataInterface.html),
+ * skipped if already provided by another header.
+ *
+ * @ingroup Types
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED	1
+#define ARROW_FLAG_NULLABLE				2
+#define ARROW_FLAG_MAP_KEYS_SORTED		4
+
+struct ArrowSchema {
+	const char*				format;
+	const char*				name;
+	const char*				metadata;
+	int64_t					flags;
+	int64_t					n_children;
+	struct ArrowSchema**	children;
+	struct ArrowSchema*		dictionary;
+	void					(*release)(struct ArrowSchema*);
+	void*					private_data;
+};
+
+struct ArrowArray {
+	int64_t					length;
+	int64_t					null_count;
+	int64_t					offset;
+	int64_t					n_buffers;
+	int64_t					n_children;
+	const void**			buffers;
+	struct ArrowArray**		children;
+	struct ArrowArray*		dictionary;
+	void					(*release)(struct ArrowArray*);
+	void*					private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+/**
+ * @brief Columnar reader of an endpoint, created with CAEN_FELib_CreateBatch() (opaque type).
+ *
+ * @ingroup Types
+ */
+typedef struct CAEN_FELib_Batch CAEN_FELib_Batch_t;
+
+/**
+ * @brief Parameters of CAEN_FELib_ConvertWaveform().
+ *
+ * @ingroup Types
+ */
+typedef struct {
+	uint16_t		mask;				//!< mask applied to raw samples to drop flag bits, e.g. 0x3FFF for 14-bit ADCs (0 for none)
+	size_t			preTrigger;			//!< number of leading samples averaged to estimate the baseline, or 0 to use @p baseline
+	float			baseline;			//!< baseline, in ADC counts, used if @p preTrigger is 0
+	float			gain;				//!< gain applied to baseline-subtracted samples
+	size_t			decimation;			//!< number of samples averaged on each output sample (0 or 1 for none)
+} CAEN_FELib_WaveformConversion_t;
+
 /**
  * @brief Get a JSON string that contains informations about this library, like version, supported devices, etc.
  *
@@ -174,12 +559,27 @@ CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetErrorDescription(CAEN_FELib_E
 /**
  * @brief Get the detailed description of the last error occurred on the current thread for a device.
  *
+ * The description of errors raised by the underlying library is retrieved from it only on this call, so
+ * that failures returned routinely, like ::CAEN_FELib_Timeout on CAEN_FELib_ReadData(), do not copy any
+ * string. The last error is then reset.
+ *
  * @param[out] description		last error description (null-terminated string) [max size: 1024 bytes]
  * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
  * @ingroup Functions
  */
 CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetLastError(char description[1024]);
 
+/**
+ * @brief Get the structured record of the last error occurred on the current thread.
+ *
+ * Cheaper than CAEN_FELib_GetLastError(): the description is not retrieved, and the last error is not reset.
+ *
+ * @param[out] info				error record
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetLastErrorInfo(CAEN_FELib_ErrorInfo_t* info);
+
 /**
  * @brief Discover the connected devices that can be managed by the library.
  *
@@ -209,8 +609,12 @@ CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_Open(const char* url, uint64_t*
  * @brief Close the connection with device.
  * @nodetype ::CAEN_FELib_DIGITIZER
  * 
+ * Recordings, captures and histograms of the device are stopped. Mergers, watches and batches,
+ * that keep using the connection after their creation, are not: the connection is not closed
+ * while any of them exists.
+ *
  * @param[in] handle			handle
- * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode; ::CAEN_FELib_CommandError if a merger, a watch or a batch on the device has not been destroyed
  * @warning CAEN_FELib_Open() and CAEN_FELib_Close() modify a static variable: are not thread safe.
  * @warning CAEN_FELib_Close() should never be called if there are pending calls on handles related to the device that is going to be closed.
  * @ingroup Functions
@@ -297,6 +701,24 @@ CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetPath(uint64_t handle, char pa
  */
 CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetNodeProperties(uint64_t handle, const char* path, char name[32], CAEN_FELib_NodeType_t* type);
 
+/**
+ * @brief Get handle, name, type and parent of all the nodes of a subtree.
+ *
+ * Nodes are returned in depth-first order, starting from the root of the walk. If the underlying
+ * library does not support walks in a single call, the walk is performed with CAEN_FELib_GetChildHandles()
+ * and CAEN_FELib_GetNodeProperties() on each node.
+ *
+ * @param[in] handle			handle
+ * @param[in] path				relative path of the root of the walk with respect to @p handle (either a null-terminated string or a null pointer that is interpreted as an empty string)
+ * @param[in] maxDepth			maximum depth of returned nodes (zero for the root only, negative for no limit)
+ * @param[out] nodes			nodes of the subtree (can be null if @p size is zero)
+ * @param[in] size				size of @p nodes array
+ * @return						number of nodes that would have been written for a sufficiently large @p nodes if successful, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @note The output @p nodes has been completely written if and only if the returned value is in range [0, @p size]
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_WalkTree(uint64_t handle, const char* path, int maxDepth, CAEN_FELib_TreeNode_t* nodes, size_t size);
+
 /**
  * @brief Get the value of a readable node.
  * @nodetype ::CAEN_FELib_PARAMETER ::CAEN_FELib_ATTRIBUTE ::CAEN_FELib_FEATURE
@@ -356,6 +778,26 @@ CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SetUserRegister(uint64_t handle,
  */
 CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SendCommand(uint64_t handle, const char* path);
 
+/**
+ * @brief Send the same command on several boards in parallel.
+ * @nodetype ::CAEN_FELib_COMMAND
+ *
+ * Commands are issued by a pool of worker threads, started by the first invocation and kept until
+ * library unload. Workers wait on a barrier, released once all of them are ready to issue their
+ * command: runs of several boards, armed and started with this function, start together. The
+ * issue skew achieved on each board is reported on @p results.
+ *
+ * Group commands are serialized: a second invocation waits for the completion of the first one.
+ *
+ * @param[in] handles			array of handles, one per board, without repetitions
+ * @param[in] n					number of handles (at most 128)
+ * @param[in] path				relative path of a node with respect to each handle (either a null-terminated string or a null pointer that is interpreted as an empty string)
+ * @param[out] results			array of @p n results, one per handle (can be null)
+ * @return						::CAEN_FELib_Success (0) if the command succeeded on every board, or the error code of the first board that failed (see @p results for the others)
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SendCommandMany(const uint64_t* handles, size_t n, const char* path, CAEN_FELib_CommandResult_t* results);
+
 /**
  * @brief Set the format for the ReadData function to a endpoint node.
  * @nodetype ::CAEN_FELib_ENDPOINT
@@ -407,6 +849,895 @@ CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ReadDataV(uint64_t handle, int t
  */
 CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_HasData(uint64_t handle, int timeout);
 
+/**
+ * @brief Interrupt a blocking read on an endpoint.
+ *
+ * The CAEN_FELib_ReadData() or CAEN_FELib_HasData() pending on @p handle, or the next one if none
+ * is pending, returns ::CAEN_FELib_Interrupted immediately, without reading any event. More
+ * interrupts before that are coalesced in a single one. Readout loops can then wait with long
+ * or infinite timeouts, and be stopped by another thread.
+ *
+ * Can be invoked from any thread, also while a call on @p handle is pending.
+ *
+ * The reader threads of recordings and mergers, and of the proxy daemon, treat the interrupt
+ * like a timeout: they are woken up, and continue reading.
+ *
+ * @param[in] handle			endpoint handle
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode; ::CAEN_FELib_NotImplemented if not supported by the implementation library
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_Interrupt(uint64_t handle);
+
+/**
+ * @brief Read the data provided by an endpoint node, with timeout in microseconds.
+ * @nodetype ::CAEN_FELib_ENDPOINT
+ *
+ * Same as CAEN_FELib_ReadData(), but the wait for an event follows the wait policy of the
+ * endpoint (see CAEN_FELib_SetWaitPolicy()): a short spin on the implementation library, to
+ * avoid the wake-up latency of blocking when events are close, and then a blocking wait.
+ * Implementation libraries without CAEN_FELib_HasData() support fall back to
+ * CAEN_FELib_ReadData(), with the timeout rounded up to milliseconds.
+ *
+ * @param[in] handle			handle
+ * @param[in] timeoutUs			timeout of the function in microseconds; if this value is -1 the function is blocking with infinite timeout
+ * @param[out] ...				sequence of pointers to variable specified by a previous call to CAEN_FELib_SetReadDataFormat()
+ * @retval						::CAEN_FELib_Success (0) in case of success
+ * @retval						::CAEN_FELib_Timeout in case of timeout
+ * @retval						::CAEN_FELib_Stop once after the last event of a run (if available; see endpoint documentation)
+ * @retval						or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning There can be only one pending call of CAEN_FELib_HasData() and CAEN_FELib_ReadData() on the same handle; an error is returned by the second invocation.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ReadDataUs(uint64_t handle, int64_t timeoutUs, ...);
+
+/**
+ * @brief Read the data provided by an endpoint node, with timeout in microseconds.
+ *
+ * Identical to CAEN_FELib_ReadDataUs(), using variable argument list.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ReadDataVUs(uint64_t handle, int64_t timeoutUs, va_list args);
+
+/**
+ * @brief Check if an endpoint node has data, with timeout in microseconds.
+ * @nodetype ::CAEN_FELib_ENDPOINT
+ *
+ * Same as CAEN_FELib_HasData(), with the wait policy of CAEN_FELib_ReadDataUs().
+ *
+ * @param[in] handle			handle
+ * @param[in] timeoutUs			timeout of the function in microseconds; if this value is -1 the function is blocking with infinite timeout
+ * @retval						::CAEN_FELib_Success (0) in case of success
+ * @retval						::CAEN_FELib_Timeout in case of timeout
+ * @retval						::CAEN_FELib_Stop once after the last event of a run (if available; see endpoint documentation)
+ * @retval						or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning There can be only one pending call of CAEN_FELib_HasData() and CAEN_FELib_ReadData() on the same handle; an error is returned by the second invocation.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_HasDataUs(uint64_t handle, int64_t timeoutUs);
+
+/**
+ * @brief Set the wait policy of CAEN_FELib_ReadDataUs() and CAEN_FELib_HasDataUs() on an endpoint.
+ *
+ * Implementation libraries wait with millisecond timeouts. Each wait is split in a spin phase,
+ * polling without timeout for at most the spin budget, then a blocking phase in whole
+ * milliseconds, and a final spin on the sub-millisecond remainder of the timeout. When adaptive,
+ * the spin budget is twice the mean inter-arrival time of the events, up to the maximum, or zero
+ * if the mean exceeds the maximum: spinning is only worthwhile when the next event is expected soon.
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `mode`: `"busy"` (poll back to back), `"yield"` (yield the processor between polls) or
+ *   `"block"` (never spin, the sub-millisecond remainder is rounded up) (default `"yield"`)
+ * - `max_spin_us`: maximum spin budget in microseconds (default 50)
+ * - `adaptive`: adapt the spin budget to the inter-arrival time of the events; if false, the
+ *   budget is always the maximum (default true)
+ *
+ * The default policy is used if this function is not invoked.
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] options			JSON options (null-terminated string), or a null pointer to restore the default policy
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning Must not be invoked while a CAEN_FELib_ReadDataUs() or CAEN_FELib_HasDataUs() is pending on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SetWaitPolicy(uint64_t handle, const char* options);
+
+/**
+ * @brief Get the statistics of the waits of an endpoint, to tune its wait policy.
+ *
+ * Can be invoked from any thread, also while events are being read.
+ *
+ * @param[in] handle			endpoint handle
+ * @param[out] stats			statistics since CAEN_FELib_SetWaitPolicy(), or since the first wait
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetWaitStats(uint64_t handle, CAEN_FELib_WaitStats_t* stats);
+
+/**
+ * @brief Install hooks invoked before and after every dispatched call.
+ *
+ * All the functions that involve a device, including CAEN_FELib_DevicesDiscovery(), CAEN_FELib_Open()
+ * and CAEN_FELib_Close(), are traced. Hooks are invoked by the calling thread, so they must be
+ * thread safe and as fast as possible. When neither hooks nor trace buffer are enabled, the
+ * overhead of a traced call is a single predictable branch.
+ *
+ * @param[in] pre				hook invoked before the call (can be null)
+ * @param[in] post				hook invoked after the call (can be null)
+ * @param[in] ctx				user context passed to the hooks (can be null)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning CAEN_FELib_SetTraceHook() modify a static variable: is not thread safe and should not be invoked while other functions are pending.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SetTraceHook(CAEN_FELib_TraceHook_t pre, CAEN_FELib_TraceHook_t post, void* ctx);
+
+/**
+ * @brief Enable the built-in trace buffer.
+ *
+ * Each thread that invokes a traced function records the last @p size calls in its own ring
+ * buffer, without any lock. Buffers can be saved with CAEN_FELib_DumpTrace().
+ *
+ * @param[in] size				number of calls recorded per thread; if this value is 0 the trace buffer is disabled and released
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning CAEN_FELib_SetTraceBuffer() modify a static variable: is not thread safe and should not be invoked while other functions are pending.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SetTraceBuffer(size_t size);
+
+/**
+ * @brief Save the content of the trace buffers to a file, in Chrome trace event JSON format.
+ *
+ * The output can be opened with `chrome://tracing` or https://ui.perfetto.dev.
+ *
+ * @param[in] filename			output file name (null-terminated string)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @note Calls recorded while dumping may appear incomplete on the output.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_DumpTrace(const char* filename);
+
+/**
+ * @brief Publish readout statistics on a named shared memory segment.
+ *
+ * Counters of each endpoint are updated on CAEN_FELib_ReadData() and CAEN_FELib_HasData() and can be
+ * read by external processes, without any interaction with this process. See CAEN_FELib_StatsHeader_t
+ * and CAEN_FELib_StatsEntry_t for the layout.
+ *
+ * @param[in] name				name of the segment, as in `shm_open()` (null-terminated string, or a null pointer that is interpreted as "/caen_felib.<pid>")
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning CAEN_FELib_EnableStatistics() modify a static variable: is not thread safe and should not be invoked while other functions are pending.
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_EnableStatistics(const char* name);
+
+/**
+ * @brief Stop publishing readout statistics, and remove the shared memory segment.
+ *
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning CAEN_FELib_DisableStatistics() modify a static variable: is not thread safe and should not be invoked while other functions are pending.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_DisableStatistics(void);
+
+/**
+ * @brief Start capturing the events read from an endpoint to a file.
+ *
+ * Every event returned by CAEN_FELib_ReadData() on @p handle is appended to the file, together with
+ * the read data formats set with CAEN_FELib_SetReadDataFormat() and the end of runs (::CAEN_FELib_Stop).
+ * Captured files can be played back opening the URL `replay://<filename>`.
+ *
+ * The size of arrays is taken from the other fields of the format, using the naming convention of
+ * CAEN implementation libraries (e.g. `WAVEFORM_SIZE` for `WAVEFORM`, `SIZE` for `DATA`).
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] filename			output file name (null-terminated string)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on @p handle.
+ * @warning Must not be invoked while a CAEN_FELib_ReadData() is pending on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StartCapture(uint64_t handle, const char* filename);
+
+/**
+ * @brief Stop a capture started with CAEN_FELib_StartCapture().
+ *
+ * Captures are also stopped by CAEN_FELib_Close().
+ *
+ * @param[in] handle			endpoint handle
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode, also if the capture has been aborted by an error while reading
+ * @warning Must not be invoked while a CAEN_FELib_ReadData() is pending on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StopCapture(uint64_t handle);
+
+/**
+ * @brief Start filling online histograms with the events read from an endpoint.
+ *
+ * Histograms are filled by the threads that read events from @p handle: CAEN_FELib_ReadData()
+ * callers, the readout threads of CAEN_FELib_StartRecording(), CAEN_FELib_ReadDataSlot() callers
+ * and mergers. Each thread fills its own partial histograms, summed by CAEN_FELib_GetHistogram().
+ *
+ * @p options is a JSON object with the following members:
+ * - `histograms`: array of up to 16 histograms, each an object with:
+ *   - `name`: unique name
+ *   - `x`: x axis
+ *   - `y`: y axis, for 2D histograms (optional)
+ * - `channels`: number of channels (default 64 if the format has a scalar `CHANNEL` field, 1 otherwise)
+ *
+ * Each axis is an object with:
+ * - `field`: name of a scalar field of the read data format (e.g. `ENERGY`)
+ * - `bins`: number of bins
+ * - `min`, `max`: range
+ * - `delta`: if true, the difference from the previous event of the same channel is used, e.g. for timestamp deltas (default false)
+ *
+ * A set of histograms is filled for each channel, taken from the `CHANNEL` field if present; events
+ * of channels not lower than `channels` are ignored.
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] options			JSON options (null-terminated string)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on @p handle.
+ * @warning Must not be invoked while a CAEN_FELib_ReadData() is pending on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StartHistograms(uint64_t handle, const char* options);
+
+/**
+ * @brief Stop the histograms started with CAEN_FELib_StartHistograms().
+ *
+ * Histograms are also stopped by CAEN_FELib_Close().
+ *
+ * @param[in] handle			endpoint handle
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode, also if filling has been aborted by an error while reading
+ * @warning Must not be invoked while a CAEN_FELib_ReadData() or other histogram functions are pending on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StopHistograms(uint64_t handle);
+
+/**
+ * @brief Get a snapshot of a histogram.
+ *
+ * Can be invoked from any thread, also while events are being read. Bins of 2D histograms are
+ * stored with x index varying fastest, i.e. `bins[y * binsX + x]`.
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] name				histogram name (null-terminated string)
+ * @param[in] channel			channel
+ * @param[out] bins				bin contents (can be a null pointer to get only @p info)
+ * @param[in] size				size of @p bins array
+ * @param[out] info				histogram information (can be a null pointer)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetHistogram(uint64_t handle, const char* name, size_t channel, uint64_t* bins, size_t size, CAEN_FELib_HistogramInfo_t* info);
+
+/**
+ * @brief Clear all the histograms of an endpoint.
+ *
+ * Can be invoked from any thread, also while events are being read.
+ *
+ * @param[in] handle			endpoint handle
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ResetHistograms(uint64_t handle);
+
+/**
+ * @brief Enable the data reduction of the waveforms read from an endpoint.
+ *
+ * Waveforms are reduced in place on the buffers passed to CAEN_FELib_ReadData(), before they are
+ * returned to the caller, recorded, captured or histogrammed, and their size fields are updated.
+ * Steps are applied in this order, on each channel:
+ * 1. region of interest: the waveform is cropped to the samples from `start`, at most `length`
+ * 2. zero suppression: the waveform is dropped (size set to 0) if no sample of the region of
+ *    interest is farther from the baseline than the threshold, on the side given by the polarity
+ * 3. decimation: each N consecutive samples are replaced by their rounded mean, an incomplete tail is dropped
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `fields`: array of the names of the fields to reduce, arrays of type `U16` (default `["WAVEFORM"]`);
+ *   fields sharing a size field must be reduced together, and a channel is dropped only if none of them is over threshold
+ * - `roi`: object with `start` (default 0) and `length` members
+ * - `zero_suppression`: object with `threshold` (in ADC counts), `polarity` (`"positive"`,
+ *   `"negative"` or `"both"`, default `"both"`) and either `baseline` (fixed, in ADC counts)
+ *   or `baseline_samples` (number of leading samples averaged to estimate the baseline, default 16)
+ * - `decimation`: decimation factor N (default 1)
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] options			JSON options (null-terminated string), or a null pointer to disable the data reduction
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on @p handle.
+ * @warning Must not be invoked while a CAEN_FELib_ReadData() is pending on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SetDataReduction(uint64_t handle, const char* options);
+
+/**
+ * @brief Get the statistics of the data reduction of an endpoint, to compute the reduction ratio.
+ *
+ * Can be invoked from any thread, also while events are being read.
+ *
+ * @param[in] handle			endpoint handle
+ * @param[out] stats			statistics since CAEN_FELib_SetDataReduction()
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetDataReductionStats(uint64_t handle, CAEN_FELib_ReductionStats_t* stats);
+
+/**
+ * @brief Start recording the events of an endpoint to file, on background threads.
+ *
+ * A thread owned by the library reads the events from @p handle with the format set by
+ * CAEN_FELib_SetReadDataFormat() and serializes them on a ring of large aligned buffers, that are
+ * written to file by another thread. The file is opened with direct I/O, where supported, and synced
+ * to disk periodically. The layout is the same of CAEN_FELib_StartCapture(): recorded files can be
+ * played back opening the URL `replay://<filename>`.
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `buffer_size`: size of each buffer, in bytes (default 8 MiB, rounded up to 4 KiB)
+ * - `buffers`: number of buffers (default 2)
+ * - `fsync_period`: period of syncs to disk, in milliseconds; 0 to sync only at the end (default 1000)
+ * - `direct_io`: bypass the page cache, if supported by the file system (default true)
+ * - `max_array_size`: size of the buffer of each array field (and of each channel of dim 2 fields),
+ *   in bytes (default the value of the device parameter `MaxRawDataSize`, if any, or 1 MiB)
+ * - `compression`: `"none"`, `"lz4"` or `"zstd"`, if supported by the build (default `"none"`).
+ *   Chunks of events are compressed independently by a pool of threads, and decompressed
+ *   transparently by CAEN_FELib_OpenEventFile() and by the replay library.
+ * - `compression_level`: negative values are faster, higher values compress more (default 1 for
+ *   lz4, 3 for zstd)
+ * - `compression_threads`: number of compression threads (default 2)
+ * - `hugepages`: `"none"`, `"transparent"` (advise the kernel to back the buffers with transparent
+ *   hugepages, if enabled) or `"explicit"` (fail if not enough hugepages are reserved, see
+ *   `/proc/sys/vm/nr_hugepages`) (default `"none"`)
+ * - `numa_node`: NUMA node of the buffers; -1 for the default policy (default -1)
+ * - `prefault`: touch the buffers before the run (default false)
+ * - `mlock`: lock the buffers on RAM, subject to `RLIMIT_MEMLOCK` (default false)
+ * - `cpu_affinity`: CPUs of the reader, writer and compression threads, as a list like `"0-3,8"`
+ *   (default the affinity set by CAEN_FELib_SetThreadAffinity(), if any)
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] filename			output file name (null-terminated string)
+ * @param[in] options			JSON options (null-terminated string, or a null pointer for default values)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on @p handle.
+ * @warning CAEN_FELib_ReadData() and CAEN_FELib_HasData() must not be invoked on @p handle until CAEN_FELib_StopRecording().
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StartRecording(uint64_t handle, const char* filename, const char* options);
+
+/**
+ * @brief Get the status of a recording started with CAEN_FELib_StartRecording().
+ *
+ * Can be invoked while the recording is in progress, from any thread, to monitor the backlog.
+ *
+ * @param[in] handle			endpoint handle
+ * @param[out] status			status of the recording
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetRecordingStatus(uint64_t handle, CAEN_FELib_RecordingStatus_t* status);
+
+/**
+ * @brief Stop a recording started with CAEN_FELib_StartRecording(), waiting for pending buffers to be written.
+ *
+ * Recordings are also stopped by CAEN_FELib_Close().
+ *
+ * @param[in] handle			endpoint handle
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode, also if the recording has been aborted by an error
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StopRecording(uint64_t handle);
+
+/**
+ * @brief Merge the events of several endpoints in a single stream ordered by timestamp.
+ *
+ * A thread per endpoint reads the events on an event pool (see CAEN_FELib_CreateEventPool()), and
+ * CAEN_FELib_MergerReadData() returns them in order of `TIMESTAMP`, that must be a scalar field of
+ * the read data format of every endpoint. Events of each endpoint must have non decreasing timestamps.
+ *
+ * An event is returned as soon as every endpoint has a pending event. To bound the latency when an
+ * endpoint is quiet, an event is also returned if older than the most recent timestamp by at least
+ * the reorder window, or if it has been pending for the maximum latency: a late event of a quiet
+ * endpoint can then be returned out of order.
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `offsets`: array with the offset added to the timestamps of each endpoint (default 0)
+ * - `window`: reorder window, in timestamp units (default 0, to wait for every endpoint or for the maximum latency)
+ * - `max_latency`: maximum latency, in milliseconds (default 100)
+ * - `slots`: number of slots of the event pool of each endpoint (default 64)
+ * - `coincidence`: coincidence filter, see CAEN_FELib_MergerReadGroup() (default none)
+ * - any option of CAEN_FELib_CreateEventPool(), applied to the pools
+ *
+ * Reader threads have the affinity set by CAEN_FELib_SetThreadAffinity() on the connection of each endpoint.
+ *
+ * Reader threads are stopped only by CAEN_FELib_DestroyMerger(): until then, CAEN_FELib_Close() fails
+ * with ::CAEN_FELib_CommandError on the devices of the endpoints.
+ *
+ * @param[in] handles			endpoint handles
+ * @param[in] n					number of endpoints
+ * @param[in] options			JSON options (null-terminated string, or a null pointer for default values)
+ * @param[out] merger			the merger
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on every endpoint, and not invoked again until CAEN_FELib_DestroyMerger().
+ * @warning CAEN_FELib_ReadData() and CAEN_FELib_HasData() must not be invoked on the endpoints until CAEN_FELib_DestroyMerger().
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_CreateMerger(const uint64_t* handles, size_t n, const char* options, CAEN_FELib_Merger_t** merger);
+
+/**
+ * @brief Stop the reader threads and destroy a merger, and invalidate its events.
+ *
+ * @param[in] merger			the merger
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning Must not be invoked while other functions are pending on @p merger.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_DestroyMerger(CAEN_FELib_Merger_t* merger);
+
+/**
+ * @brief Get the next event of a merger.
+ *
+ * ::CAEN_FELib_Stop is returned once all the endpoints have reached the end of run, after their events.
+ *
+ * @param[in] merger			the merger
+ * @param[in] timeout			timeout of the function in milliseconds; if this value is -1 the function is blocking with infinite timeout
+ * @param[out] event			the event, to be released with CAEN_FELib_MergerReleaseEvent() (set only on ::CAEN_FELib_Success)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode, also if a reader thread failed
+ * @pre The merger must have been created without the `coincidence` option.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_MergerReadData(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* event);
+
+/**
+ * @brief Get the next group of coincident events of a merger.
+ *
+ * The `coincidence` option of CAEN_FELib_CreateMerger() is a JSON object with the following optional members:
+ * - `window`: coincidence window, in timestamp units (default 0)
+ * - `multiplicity`: minimum number of distinct sources of a group (default 2)
+ * - `channels`: array with, for each endpoint, an array of the channels taking part in the coincidence, or null for all of them (default all)
+ *
+ * A source is a channel of an endpoint, taken from the `CHANNEL` field if it is a scalar field of
+ * the read data format, otherwise an endpoint is a single source with channel 0. A group is made
+ * of the oldest pending event and of the following events with timestamp within the window; if
+ * it has at least the multiplicity, it is returned, otherwise its oldest event is discarded and the
+ * next one opens a new group. Discarded events, and events of the excluded channels, are released
+ * internally without crossing the API.
+ * An event returned out of order by the merger closes the group: the reorder window of the merger
+ * should be large enough to make them rare.
+ *
+ * @param[in] merger			the merger
+ * @param[in] timeout			timeout of the function in milliseconds; if this value is -1 the function is blocking with infinite timeout
+ * @param[out] events			array of @p size events, to be released with CAEN_FELib_MergerReleaseEvent()
+ * @param[in] size				size of @p events; the tail of a larger group is evaluated again as a new group
+ * @param[out] count			number of events of the group (set only on ::CAEN_FELib_Success)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode, also if a reader thread failed
+ * @pre The merger must have been created with the `coincidence` option.
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_MergerReadGroup(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* events, size_t size, size_t* count);
+
+/**
+ * @brief Give back the slot of an event to the reader thread of its endpoint.
+ *
+ * Can be invoked from any thread.
+ *
+ * @param[in] merger			the merger
+ * @param[in] event				an event returned by CAEN_FELib_MergerReadData() or CAEN_FELib_MergerReadGroup() on @p merger
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_MergerReleaseEvent(CAEN_FELib_Merger_t* merger, const CAEN_FELib_MergedEvent_t* event);
+
+/**
+ * @brief Convert raw waveform samples to baseline-subtracted and calibrated samples.
+ *
+ * Each output sample is `(mean(samples & mask) - baseline) * gain`, where the mean is over
+ * @p decimation consecutive samples; an incomplete tail is dropped. The baseline is the mean of
+ * the first `preTrigger` masked samples, if not zero.
+ *
+ * The kernel is selected at runtime according to the CPU (AVX-512, AVX2 or SSE2 on x86, a scalar
+ * version otherwise); the result does not depend on the kernel. Can be invoked from any thread,
+ * for example on the waveform buffers filled by CAEN_FELib_ReadData().
+ *
+ * @param[in] samples			raw samples
+ * @param[in] n					number of samples
+ * @param[in] conversion		conversion parameters
+ * @param[out] out				converted samples, of size at least `n / decimation`
+ * @param[out] outSize			number of converted samples
+ * @param[out] baseline			baseline used for the conversion (can be a null pointer)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ConvertWaveform(const uint16_t* samples, size_t n, const CAEN_FELib_WaveformConversion_t* conversion, float* out, size_t* outSize, float* baseline);
+
+/**
+ * @brief Set the CPU affinity of the threads created by this library for a connection.
+ *
+ * Applies to the threads started afterwards on any endpoint of the connection, like those of
+ * CAEN_FELib_StartRecording(), unless overridden by their options, and of CAEN_FELib_CreateMerger().
+ *
+ * @param[in] handle			handle of any node of the connection
+ * @param[in] cpuList			list of CPUs like `"0-3,8"` (null-terminated string, or a null pointer or an empty string to restore the default affinity)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @note Supported only on Linux.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SetThreadAffinity(uint64_t handle, const char* cpuList);
+
+/**
+ * @brief Watch parameters, getting notified of their changes.
+ *
+ * Parameters are sampled with CAEN_FELib_GetValue() by a single scheduler thread, shared by
+ * all the watches, and @p callback is invoked only with the values changed since the previous
+ * invocation; the first invocation has the current values of all the parameters. Watches of the
+ * same handle and path share the same sample, taken at the shortest period among them. Due
+ * samples of different connections are interleaved, and the total number of calls per second
+ * is limited by CAEN_FELib_SetWatchBudget().
+ *
+ * @param[in] handle			handle
+ * @param[in] paths				relative paths of the parameters with respect to @p handle (null-terminated strings)
+ * @param[in] n					number of @p paths
+ * @param[in] periodMs			sampling period in milliseconds
+ * @param[in] callback			callback invoked by the scheduler thread
+ * @param[in] ctx				user context passed to @p callback (can be null)
+ * @param[out] watch			the watch
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning CAEN_FELib_Unwatch() must be invoked before closing the device of @p handle: until then, CAEN_FELib_Close() fails with ::CAEN_FELib_CommandError.
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_Watch(uint64_t handle, const char* const* paths, size_t n, int periodMs, CAEN_FELib_WatchCallback_t callback, void* ctx, CAEN_FELib_Watch_t** watch);
+
+/**
+ * @brief Remove a watch.
+ *
+ * When invoked from a thread other than the scheduler, waits for the callbacks and the samples
+ * in progress. Can be invoked from callbacks.
+ *
+ * @param[in] watch				the watch
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_Unwatch(CAEN_FELib_Watch_t* watch);
+
+/**
+ * @brief Set the maximum number of CAEN_FELib_GetValue() calls per second performed by the watch scheduler.
+ *
+ * Due parameters exceeding the budget are sampled later, the most overdue first.
+ *
+ * @param[in] callsPerSecond	maximum number of calls per second (0 for no limit, the default)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_SetWatchBudget(uint32_t callsPerSecond);
+
+/**
+ * @brief Open a file written by CAEN_FELib_StartCapture() or CAEN_FELib_StartRecording().
+ *
+ * The file is memory mapped: events are accessed in place, without copies, and can be looked up
+ * by index or by key using the index written when the file is closed. If the file has not been
+ * closed properly, the index is rebuilt scanning the file.
+ *
+ * Functions on an event file can be invoked concurrently by different threads.
+ *
+ * @param[in] filename			file name (null-terminated string)
+ * @param[out] file				the event file
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_OpenEventFile(const char* filename, CAEN_FELib_EventFile_t** file);
+
+/**
+ * @brief Close an event file, and invalidate its events.
+ *
+ * @param[in] file				the event file
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_CloseEventFile(CAEN_FELib_EventFile_t* file);
+
+/**
+ * @brief Get information about an event file.
+ *
+ * @param[in] file				the event file
+ * @param[out] info				the information
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetEventFileInfo(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventFileInfo_t* info);
+
+/**
+ * @brief Get an event by index.
+ *
+ * @param[in] file				the event file
+ * @param[in] index				index of the event, less than CAEN_FELib_EventFileInfo_t::nEvents
+ * @param[out] event			the event
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetEvent(CAEN_FELib_EventFile_t* file, uint64_t index, CAEN_FELib_Event_t* event);
+
+/**
+ * @brief Move an event to the next one, for sequential access.
+ *
+ * @param[in] file				the event file
+ * @param[in,out] event			an event returned by CAEN_FELib_GetEvent(), CAEN_FELib_GetNextEvent() or CAEN_FELib_FindEvent()
+ * @return						::CAEN_FELib_Success (0) in case of success, ::CAEN_FELib_Stop after the last event, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetNextEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_Event_t* event);
+
+/**
+ * @brief Find the first event with a key greater than or equal to a value.
+ *
+ * Keys are assumed to be non decreasing along the file, as usual for times and timestamps. To read
+ * a range, find its beginning and then use CAEN_FELib_GetNextEvent() until the end of the range.
+ *
+ * @param[in] file				the event file
+ * @param[in] key				the key
+ * @param[in] value				the value
+ * @param[out] event			the event
+ * @return						::CAEN_FELib_Success (0) in case of success, ::CAEN_FELib_Stop if not found, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_FindEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventKey_t key, uint64_t value, CAEN_FELib_Event_t* event);
+
+/**
+ * @brief Get a field of an event, without copies.
+ *
+ * Data has the type declared on CAEN_FELib_Event_t::format and is aligned to its size (up to 8 bytes).
+ *
+ * @param[in] file				the event file
+ * @param[in] event				the event
+ * @param[in] name				name of the field (null-terminated string)
+ * @param[in] channel			channel, for fields with `dim` 2 (ignored otherwise)
+ * @param[out] data				pointer to the field in the mapped file
+ * @param[out] count			number of elements (1 for fields with `dim` 0)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetEventField(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count);
+
+/**
+ * @brief Start publishing the events read from an endpoint to other local processes.
+ *
+ * Every event returned by CAEN_FELib_ReadData() on @p handle, and every end of run, is serialized
+ * on a ring in a POSIX shared memory segment, in the same layout of event files, by the thread that
+ * reads it. Other processes can read the events with CAEN_FELib_OpenFanout() and the related functions,
+ * each with its own cursor. The thread that reads the events never waits for readers: when the ring is
+ * full the oldest events are overwritten, unless they have not been read yet by a reader with `block`
+ * policy, in which case the new event is not published.
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `size`: size of the ring in bytes, rounded up to a power of 2 (default 64 MiB); events larger than half of the ring are not published
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] name				name of the shared memory segment, starting with `/` (null-terminated string); an existing segment with the same name is replaced
+ * @param[in] options			JSON options (null-terminated string, can be null)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on @p handle.
+ * @warning Must not be invoked while a CAEN_FELib_ReadData() is pending on @p handle.
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StartFanout(uint64_t handle, const char* name, const char* options);
+
+/**
+ * @brief Stop a fan-out started with CAEN_FELib_StartFanout(), and remove its shared memory segment.
+ *
+ * Readers get ::CAEN_FELib_Disabled once they have read the events already published. Fan-outs are
+ * also stopped by CAEN_FELib_Close().
+ *
+ * @param[in] handle			endpoint handle
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning Must not be invoked while a CAEN_FELib_ReadData() is pending on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_StopFanout(uint64_t handle);
+
+/**
+ * @brief Open a reader of a fan-out started by another process with CAEN_FELib_StartFanout().
+ *
+ * The ring is mapped read-only: readers cannot slow down the owner, nor affect each other, except
+ * for readers with `block` policy, that prevent the owner from publishing new events when the ring is
+ * full of events they have not read yet. Readers get only the events published after the open. Up
+ * to 16 readers can be open at the same time on a fan-out.
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `policy`: `drop_oldest` (default) to skip the events overwritten before being read, or `block` to read every event
+ * - `sampling`: return only 1 every `sampling` events, skipping the others without copies (default 1); end of runs are always returned
+ *
+ * @param[in] name				name passed to CAEN_FELib_StartFanout() (null-terminated string)
+ * @param[in] options			JSON options (null-terminated string, can be null)
+ * @param[out] reader			the reader
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @note Not supported on Windows.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_OpenFanout(const char* name, const char* options, CAEN_FELib_FanoutReader_t** reader);
+
+/**
+ * @brief Close a fan-out reader.
+ *
+ * @param[in] reader			the reader
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_CloseFanout(CAEN_FELib_FanoutReader_t* reader);
+
+/**
+ * @brief Read the next event of a fan-out.
+ *
+ * The event is copied to a buffer of the reader, valid until the next call on the same reader.
+ * CAEN_FELib_Event_t::index is the index of the event on the fan-out, and CAEN_FELib_Event_t::time
+ * the time of publication in nanoseconds since Epoch. Functions on the same reader must not be
+ * invoked concurrently.
+ *
+ * @param[in] reader			the reader
+ * @param[in] timeout			timeout of the function in milliseconds; if this value is -1 the function is blocking with infinite timeout
+ * @param[out] event			the event
+ * @retval						::CAEN_FELib_Success (0) in case of success
+ * @retval						::CAEN_FELib_Timeout in case of timeout
+ * @retval						::CAEN_FELib_Stop at the end of a run, without payload
+ * @retval						::CAEN_FELib_Disabled if the fan-out has been stopped or its owner has terminated
+ * @retval						or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ReadFanoutEvent(CAEN_FELib_FanoutReader_t* reader, int timeout, CAEN_FELib_Event_t* event);
+
+/**
+ * @brief Get a field of the last event returned by CAEN_FELib_ReadFanoutEvent(), without copies.
+ *
+ * Identical to CAEN_FELib_GetEventField(), for fan-out readers.
+ *
+ * @param[in] reader			the reader
+ * @param[in] event				the event
+ * @param[in] name				name of the field (null-terminated string)
+ * @param[in] channel			channel, for fields with `dim` 2 (ignored otherwise)
+ * @param[out] data				pointer to the field in the buffer of the reader
+ * @param[out] count			number of elements (1 for fields with `dim` 0)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetFanoutEventField(CAEN_FELib_FanoutReader_t* reader, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count);
+
+/**
+ * @brief Get the status of a fan-out reader.
+ *
+ * @param[in] reader			the reader
+ * @param[out] status			the status
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_GetFanoutStatus(CAEN_FELib_FanoutReader_t* reader, CAEN_FELib_FanoutStatus_t* status);
+
+/**
+ * @brief Create a pool of preallocated event buffers, for a readout without allocations.
+ *
+ * Buffers of all the slots are sized for the read data format set with CAEN_FELib_SetReadDataFormat()
+ * and allocated at once, in a single arena. Slots are acquired by CAEN_FELib_ReadDataSlot() and
+ * recycled with CAEN_FELib_ReleaseSlot() through a lock-free list, so that events can be processed
+ * and released by other threads while the readout goes on.
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `record_length`: number of elements of array fields, except byte arrays (default the maximum of
+ *   the channel parameter `ChRecordLengthS`, or the device parameter `RecordLengthS`, if any)
+ * - `max_array_size`: size of byte arrays (like `DATA` of the RAW endpoint), and of arrays whose
+ *   record length is unknown, in bytes (default the value of the device parameter `MaxRawDataSize`,
+ *   if any, or 1 MiB)
+ * - `hugepages`, `numa_node` and `mlock`: as in CAEN_FELib_StartRecording(), applied to the arena
+ * - `prefault`: touch the arena on creation (default true)
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] nSlots			number of slots
+ * @param[in] options			JSON options (null-terminated string, or a null pointer for default values)
+ * @param[out] pool				the pool
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on @p handle.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_CreateEventPool(uint64_t handle, size_t nSlots, const char* options, CAEN_FELib_EventPool_t** pool);
+
+/**
+ * @brief Destroy an event pool, and invalidate its slots.
+ *
+ * @param[in] pool				the pool
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning Must not be invoked while other functions are pending on @p pool.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_DestroyEventPool(CAEN_FELib_EventPool_t* pool);
+
+/**
+ * @brief Read an event on a free slot of a pool.
+ *
+ * Same as CAEN_FELib_ReadData() on the endpoint of the pool, with the buffers of the slot. Apart
+ * from the call to the implementation library, no memory is allocated.
+ *
+ * @param[in] pool				the pool
+ * @param[in] timeout			timeout of the function in milliseconds; if this value is -1 the function is blocking with infinite timeout
+ * @param[out] slot				the slot, to be released with CAEN_FELib_ReleaseSlot() (set only on ::CAEN_FELib_Success)
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode; ::CAEN_FELib_CommandError if no slot is free or if the read data format has changed since CAEN_FELib_CreateEventPool()
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ReadDataSlot(CAEN_FELib_EventPool_t* pool, int timeout, CAEN_FELib_EventSlot_t** slot);
+
+/**
+ * @brief Give back a slot to its pool.
+ *
+ * Can be invoked from any thread, concurrently with CAEN_FELib_ReadDataSlot().
+ *
+ * @param[in] pool				the pool
+ * @param[in] slot				a slot returned by CAEN_FELib_ReadDataSlot() on @p pool
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ReleaseSlot(CAEN_FELib_EventPool_t* pool, CAEN_FELib_EventSlot_t* slot);
+
+/**
+ * @brief Create a columnar reader of an endpoint, exporting batches of events as Arrow arrays.
+ *
+ * Events are read directly into a column per field of the read data format set with
+ * CAEN_FELib_SetReadDataFormat(), and exported by CAEN_FELib_ReadBatch() as a struct array of the
+ * Arrow C data interface, with a child per field, with the same name. Scalars are primitive
+ * columns; arrays are list columns (`+l`) of their valid elements, and dim 2 arrays are fixed-size
+ * lists (`+w`) of a list per channel. Arrays of dim 1 with an element per channel, and arrays
+ * whose number of valid elements is not provided by another field, are fixed-size lists. Fields of
+ * type `BOOL` are exported as `uint8`; fields of type `LONG DOUBLE` are not supported.
+ *
+ * Column buffers are allocated on creation, and recycled when the exported arrays are released.
+ *
+ * @p options is a JSON object with the following optional members:
+ * - `record_length` and `max_array_size`: as in CAEN_FELib_CreateEventPool(), maximum number of
+ *   elements of the arrays of an event
+ * - `lists`: `"variable"` (default) for list columns, or `"fixed"` to export all arrays as
+ *   fixed-size lists of the maximum number of elements, padded with unspecified values
+ *
+ * @param[in] handle			endpoint handle
+ * @param[in] capacity			maximum number of events of a batch
+ * @param[in] options			JSON options (null-terminated string, or a null pointer for default values)
+ * @param[out] batch			the reader
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @pre CAEN_FELib_SetReadDataFormat() must have been invoked on @p handle.
+ * @warning CAEN_FELib_DestroyBatch() must be invoked before closing the device of @p handle: until then, CAEN_FELib_Close() fails with ::CAEN_FELib_CommandError.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_CreateBatch(uint64_t handle, size_t capacity, const char* options, CAEN_FELib_Batch_t** batch);
+
+/**
+ * @brief Destroy a columnar reader.
+ *
+ * Arrays already exported by CAEN_FELib_ReadBatch() remain valid until released.
+ *
+ * @param[in] batch				the reader
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode
+ * @warning Must not be invoked while other functions are pending on @p batch.
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_DestroyBatch(CAEN_FELib_Batch_t* batch);
+
+/**
+ * @brief Read a batch of events, as an Arrow struct array.
+ *
+ * Events are read until the capacity of the batch is reached, or until @p timeout expires. If a
+ * stop, or an error, occurs after the first event, the events already read are returned, and the
+ * error code is returned by the next invocation.
+ *
+ * The release callback of @p array, and of @p schema, must be invoked by the consumer, from any
+ * thread; the buffers of the batch are recycled only after release.
+ *
+ * @param[in] batch				the reader
+ * @param[in] timeout			timeout of the batch in milliseconds; if this value is -1 the function waits until the batch is full
+ * @param[out] array			the events (set only on ::CAEN_FELib_Success)
+ * @param[out] schema			the schema of @p array (set only on ::CAEN_FELib_Success), or a null pointer
+ * @return						::CAEN_FELib_Success (0) in case of success, or a negative error code specified in #CAEN_FELib_ErrorCode; ::CAEN_FELib_Timeout if no event has been read, ::CAEN_FELib_CommandError if the read data format has changed since CAEN_FELib_CreateBatch()
+ * @ingroup Functions
+ */
+CAEN_FELIB_DLLAPI int CAEN_FELIB_API CAEN_FELib_ReadBatch(CAEN_FELib_Batch_t* batch, int timeout, struct ArrowArray* array, struct ArrowSchema* schema);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -55,40 +56,56 @@
 #include <unistd.h> // getcwd
 #endif
 
+#include "batch.h"
+#include "capture.h"
 #include "definitions.h"
+#include "endpoint.h"
+#include "evreader.h"
+#include "group.h"
+#include "histogram.h"
+#include "merger.h"
+#include "pool.h"
+#include "probes.h"
+#include "recording.h"
+#include "reduction.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
+#include "wait.h"
+#include "watch.h"
+#include "waveform.h"
 
 #define MAX_NUM_CONNECTION			128		// max number of devices that can be opened at the same time
 #define MAX_NUM_LIBRARY				8		// max number of libraries (internal use, no specific size requirements)
 #define HANDLE_PREFIX				UINT64_C(0xcae0)
 
-// _Thread_local is C11 with thread support
-#if (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
-#define THREAD_LOCAL				_Thread_local
-#elif defined(_WIN32)
-#define THREAD_LOCAL				__declspec(thread)
-#elif defined(__GNUC__)
-#define THREAD_LOCAL				__thread
-#else
-#error unsupported compiler
-#endif
-
-// _Static_assert is C11
-#if (__STDC_VERSION__ >= 201112L)
-#define STATIC_ASSERT(COND, MSG)	_Static_assert(COND, CAEN_FELIB_STR(MSG))
-#else
-#define STATIC_ASSERT(COND, MSG)	typedef char _static_assertion_##MSG[(COND) ? 1 : -1]
-#endif
+static struct connection_descr connectionDescr[MAX_NUM_CONNECTION];
+static struct library_descr* libDescr[MAX_NUM_LIBRARY];
+static uint32_t libGeneration[MAX_NUM_LIBRARY];	// incremented on each allocation of the slot, to detect its reuse
 
-#define ARRAY_SIZE(x)				(sizeof(x)/sizeof((x)[0]))
+/*
+ * Last error of the thread. The description of errors raised by the underlying libraries is
+ * retrieved lazily from lib, so that routine failures like timeouts do not copy strings.
+ */
+struct last_error {
+	char							description[1024];
+	bool							pending;			// description to be queried to the library at lHandle
+	uint_fast8_t					lHandle;
+	uint32_t						generation;			// of the slot at lHandle, to check the library is still loaded
+	int								code;
+	char							library[16];
+	const char*						function;
+	uint64_t						handle;
+	uint64_t						connection;
+};
 
-static struct connection_descr* connectionDescr[MAX_NUM_CONNECTION];
-static struct library_descr* libDescr[MAX_NUM_LIBRARY];
-static THREAD_LOCAL char lastError[1024];
+static THREAD_LOCAL struct last_error lastError;
 
 STATIC_ASSERT(ARRAY_SIZE(connectionDescr) <= UINT16_MAX, invalid_connection_size);		// connection index must be stored in 16 bits
 STATIC_ASSERT(ARRAY_SIZE(connectionDescr) < UINT_FAST16_MAX, invalid_connection_type);	// UINT_FAST16_MAX index is reserved for invalid connection handle
 STATIC_ASSERT(ARRAY_SIZE(libDescr) < UINT_FAST8_MAX, invalid_lib_type);					// UINT_FAST8_MAX index is reserved for invalid library handle
 STATIC_ASSERT(ARRAY_SIZE(libDescr) <= ARRAY_SIZE(connectionDescr), invalid_descr_size);	// at most there can be a library for each connection
+STATIC_ASSERT(sizeof(connectionDescr[0]) % CACHE_LINE_SIZE == 0, invalid_connection_descr_size);	// no false sharing between connections
 STATIC_ASSERT(ARRAY_SIZE(CAEN_FELIB_VERSION_STRING) <= 16, invalid_version_size);		// required by CAEN_FELib_GetLibVersion
 
 // The format of loaded library filenames depends on the filesystem
@@ -110,23 +127,26 @@ STATIC_ASSERT(ARRAY_SIZE(CAEN_FELIB_VERSION_STRING) <= 16, invalid_version_size)
 // The format of loaded libraries API is fixed
 #define CAEN_IMPL_API_PREFIX		"CAEN%s_"
 
-static bool _allocateConnectionDescr(uint_fast16_t i) {
-	if (i >= ARRAY_SIZE(connectionDescr))
-		return false;
-	struct connection_descr* descr = malloc(sizeof(*connectionDescr[i]));
-	if (descr == NULL)
+static bool _allocateConnectionDescr(uint_fast16_t i, uint_fast8_t lHandle) {
+	if (i >= ARRAY_SIZE(connectionDescr) || lHandle >= ARRAY_SIZE(libDescr))
 		return false;
+	struct connection_descr* const descr = &connectionDescr[i];
+	descr->lib = libDescr[lHandle];
+	descr->handle = 0;
+	descr->lHandle = lHandle;
 	descr->arg[0] = '\0';
-	descr->lHandle = UINT_FAST8_MAX;
-	connectionDescr[i] = descr;
+	descr->endpoints = NULL;
+	memset(&descr->cpus, 0, sizeof(descr->cpus));
+	descr->users = 0;
 	return true;
 }
 
 static bool _resetConnectionDescr(uint_fast16_t i) {
 	if (i >= ARRAY_SIZE(connectionDescr))
 		return false;
-	free(connectionDescr[i]);
-	connectionDescr[i] = NULL;
+	if (connectionDescr[i].lib != NULL)
+		endpoint_releaseAll(&connectionDescr[i].endpoints);
+	connectionDescr[i].lib = NULL;
 	return true;
 }
 
@@ -159,8 +179,11 @@ static bool _allocateLibDescr(uint_fast8_t i) {
 	descr->SetReadDataFormat = NULL;
 	descr->ReadDataV = NULL;
 	descr->HasData = NULL;
+	descr->WalkTree = NULL;
+	descr->Interrupt = NULL;
 	descr->name[0] = '\0';
 	libDescr[i] = descr;
+	libGeneration[i]++;
 	return true;
 }
 
@@ -239,7 +262,7 @@ static void _loadLibraryError(char* message, size_t message_size) {
 
 static dlHandle_t _loadLibrary(const char* libFileName) {
 #ifdef _WIN32
-	return LoadLibraryA((LPCSTR)libFileName);
+	const dlHandle_t handle = LoadLibraryA((LPCSTR)libFileName);
 #else
 	dlerror(); // clear any existing error
 	/*
@@ -248,11 +271,14 @@ static dlHandle_t _loadLibrary(const char* libFileName) {
 	 * passed to the linker.
 	 * See https://stackoverflow.com/a/51253734/3287591
 	 */
-	return dlopen(libFileName, RTLD_LAZY);
+	const dlHandle_t handle = dlopen(libFileName, RTLD_LAZY);
 #endif
+	PROBE_LIBRARY_LOAD(libFileName, (void*)handle);
+	return handle;
 }
 
 static bool _closeLibrary(dlHandle_t handle) {
+	PROBE_LIBRARY_UNLOAD((void*)handle);
 #ifdef _WIN32
 	return FreeLibrary(handle);
 #else
@@ -378,7 +404,7 @@ static struct hturi _scanURI(char* const name) {
  */
 
 static bool _isValid(uint_fast16_t cHandle) {
-	return (cHandle < ARRAY_SIZE(connectionDescr)) && (connectionDescr[cHandle] != NULL);
+	return (cHandle < ARRAY_SIZE(connectionDescr)) && (connectionDescr[cHandle].lib != NULL);
 }
 
 // connection handle
@@ -396,9 +422,19 @@ static uint64_t _handle(uint_fast16_t cHandle, uint32_t rHandle) {
 	return (HANDLE_PREFIX << 48) | ((uint64_t)cHandle << 32) | (uint64_t)rHandle;
 }
 
+// a single load on the connection slot, NULL if the slot is free
 static struct library_descr* _getLibDescr(uint64_t handle) {
 	const uint_fast16_t cHandle = _cHandle(handle);
-	return _isValid(cHandle) ? libDescr[connectionDescr[cHandle]->lHandle] : NULL;
+	return LIKELY(cHandle < ARRAY_SIZE(connectionDescr)) ? connectionDescr[cHandle].lib : NULL;
+}
+
+// objects that keep using a connection after their creation, possibly from other threads
+static void _acquireConnection(uint64_t handle) {
+	ATOMIC_FETCH_ADD(&connectionDescr[_cHandle(handle)].users, 1);
+}
+
+static void _releaseConnection(uint64_t handle) {
+	ATOMIC_FETCH_ADD(&connectionDescr[_cHandle(handle)].users, UINT32_MAX);
 }
 
 static int _loadAPIv0(struct library_descr* descr) {
@@ -529,23 +565,100 @@ static int _loadAPIv1(struct library_descr* descr) {
 	return CAEN_FELib_Success;
 }
 
+static int _loadAPIv2(struct library_descr* descr) {
+	char apiName[64];
+	const size_t apiNameSize = ARRAY_SIZE(apiName);
+	const dlHandle_t dlHandle = descr->dlHandle;
+	const char* const name = descr->name;
+
+	assert(descr->APIVersion == LibraryAPIv1);
+
+	snprintf(apiName, apiNameSize, CAEN_IMPL_API_PREFIX"WalkTree", name);
+	descr->WalkTree = (fpWalkTree_t)_getFunction(dlHandle, apiName);
+	if (descr->WalkTree == NULL) {
+		return CAEN_FELib_GenericError;
+	}
+
+	descr->APIVersion = LibraryAPIv2;
+
+	return CAEN_FELib_Success;
+}
+
+// optional functions, available on any API version
+static void _loadOptional(struct library_descr* descr) {
+	char apiName[64];
+	const size_t apiNameSize = ARRAY_SIZE(apiName);
+	const dlHandle_t dlHandle = descr->dlHandle;
+	const char* const name = descr->name;
+
+	snprintf(apiName, apiNameSize, CAEN_IMPL_API_PREFIX"Interrupt", name);
+	descr->Interrupt = (fpInterrupt_t)_getFunction(dlHandle, apiName);
+}
+
+// set by dispatched functions on failure, after the description; NULL function if unknown
+static void _setLastErrorCall(const char* function, uint64_t handle, int code) {
+	lastError.code = code;
+	lastError.function = function;
+	lastError.handle = handle;
+	const uint_fast16_t cHandle = _cHandle(handle);
+	lastError.connection = _isValid(cHandle) ? connectionDescr[cHandle].handle : 0;
+}
+
 static void _getLastLocalError(char description[1024]) {
-	strncpy(description, lastError, 1024);
+	if (lastError.pending) {
+		lastError.pending = false;
+		const uint_fast8_t lHandle = lastError.lHandle;
+		// the slot may have been reused by another library, even at the same address
+		if (lHandle < ARRAY_SIZE(libDescr) && libDescr[lHandle] != NULL && libGeneration[lHandle] == lastError.generation)
+			libDescr[lHandle]->GetLastError(lastError.description);
+		else
+			snprintf(lastError.description, ARRAY_SIZE(lastError.description), "%s library unloaded: error description not available", lastError.library);
+	}
+	strncpy(description, lastError.description, 1024);
 	description[1024 - 1] = '\0';
 }
 
 static void _resetLastLocalError(void) {
-	lastError[0] = '\0';
+	lastError.description[0] = '\0';
+	lastError.pending = false;
+	lastError.code = CAEN_FELib_Success;
+	lastError.library[0] = '\0';
+	lastError.function = NULL;
+	lastError.handle = 0;
+	lastError.connection = 0;
 }
 
-static void _setLastLocalError(const char* description, ...) {
+void _setLastLocalError(const char* description, ...) {
 	va_list args;
 	va_start(args, description);
 	// cppcheck-suppress sizeofDivisionMemfunc
-	vsnprintf(lastError, ARRAY_SIZE(lastError), description, args);
+	vsnprintf(lastError.description, ARRAY_SIZE(lastError.description), description, args);
 	va_end(args);
+	lastError.pending = false;
+	lastError.library[0] = '\0';
+	_setLastErrorCall(NULL, 0, CAEN_FELib_GenericError);
+}
+
+// description is retrieved from the library on CAEN_FELib_GetLastError
+static void _setLastLibraryError(struct library_descr* descr, uint64_t handle) {
+	const uint_fast8_t lHandle = connectionDescr[_cHandle(handle)].lHandle;
+	lastError.pending = true;
+	lastError.lHandle = lHandle;
+	lastError.generation = libGeneration[lHandle];
+	memcpy(lastError.library, descr->name, sizeof(lastError.library));
+	_setLastErrorCall(NULL, 0, CAEN_FELib_GenericError);
+}
+
+// description is retrieved immediately, as the library is going to be closed
+static void _saveLastLibraryError(fpGetLastError_t getLastError, const char* library) {
+	getLastError(lastError.description);
+	lastError.pending = false;
+	strncpy(lastError.library, library, ARRAY_SIZE(lastError.library));
+	lastError.library[ARRAY_SIZE(lastError.library) - 1] = '\0';
+	_setLastErrorCall(NULL, 0, CAEN_FELib_GenericError);
 }
 
+
 static int _invalidHandle(void) {
 	_setLastLocalError("invalid handle");
 	return CAEN_FELib_InvalidHandle;
@@ -565,6 +678,31 @@ static bool _checkAPI(struct library_descr* descr, enum library_api version) {
 	return descr->APIVersion >= version;
 }
 
+/*
+ * Return the result of CALL, invoking trace hooks if enabled. When tracing is
+ * disabled the overhead is a single predictable branch (plus the USDT probes,
+ * that are nops when no tracer is attached). On failure (negative values, as some
+ * functions return a count), the function and the handle are stored in the last
+ * error record.
+ */
+#define TRACED_CALL(NAME, HANDLE, PATH, CALL) \
+do { \
+	int _ret; \
+	PROBE_CALL_ENTRY(#NAME, HANDLE, PATH); \
+	if (!trace_isActive()) { \
+		_ret = CALL; \
+	} else { \
+		CAEN_FELib_TraceInfo_t _info; \
+		trace_begin(&_info, #NAME, HANDLE, PATH); \
+		_ret = CALL; \
+		trace_end(&_info, _ret); \
+	} \
+	if (UNLIKELY(_ret < 0)) \
+		_setLastErrorCall(#NAME, HANDLE, _ret); \
+	PROBE_CALL_RETURN(#NAME, HANDLE, _ret); \
+	return _ret; \
+} while (0)
+
 int CAEN_FELIB_API CAEN_FELib_GetLibInfo(char* jsonString, size_t size) {
 	return _notImplemented();
 }
@@ -689,6 +827,12 @@ static int _getError(CAEN_FELib_ErrorCode errorCode, char error[32], char descri
 			"Communication error"
 		);
 		break;
+	case CAEN_FELib_Interrupted:
+		GET_ERROR_CASE(
+			"INTERRUPTED",
+			"Returned by CAEN_FELib_ReadData() and CAEN_FELib_HasData() when interrupted by CAEN_FELib_Interrupt()"
+		);
+		break;
 	default:
 		_setLastLocalError("unknown error code '%d'", errorCode);
 		return CAEN_FELib_InvalidParam;
@@ -712,7 +856,20 @@ int CAEN_FELIB_API CAEN_FELib_GetLastError(char description[1024]) {
 	return CAEN_FELib_Success;
 }
 
-int CAEN_FELIB_API CAEN_FELib_DevicesDiscovery(char* jsonString, size_t size, int timeout) {
+int CAEN_FELIB_API CAEN_FELib_GetLastErrorInfo(CAEN_FELib_ErrorInfo_t* info) {
+	if (info == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	info->code = lastError.code;
+	memcpy(info->library, lastError.library, sizeof(info->library));
+	info->function = (lastError.function != NULL) ? lastError.function : "";
+	info->handle = lastError.handle;
+	info->connection = lastError.connection;
+	return CAEN_FELib_Success;
+}
+
+static int _devicesDiscovery(char* jsonString, size_t size, int timeout) {
 	char buff[FILENAME_MAX];
 	struct dirent* entry;
 	char* cd = getcwd(buff, FILENAME_MAX);
@@ -750,7 +907,7 @@ int CAEN_FELIB_API CAEN_FELib_DevicesDiscovery(char* jsonString, size_t size, in
 			// TODO adjust how to concatenate multiple responses
 			int res = devicesDiscovery(p, lsize, timeout);
 			if (res != CAEN_FELib_Success) {
-				getLastError(lastError); // save shared library last error before to close it
+				_saveLastLibraryError(getLastError, libName); // save shared library last error before to close it
 				_closeLibrary(dlHandle);
 				closedir(dir);
 				return res;
@@ -765,7 +922,11 @@ int CAEN_FELIB_API CAEN_FELib_DevicesDiscovery(char* jsonString, size_t size, in
 	return CAEN_FELib_Success;
 }
 
-int CAEN_FELIB_API CAEN_FELib_Open(const char* url, uint64_t* handle) {
+int CAEN_FELIB_API CAEN_FELib_DevicesDiscovery(char* jsonString, size_t size, int timeout) {
+	TRACED_CALL(CAEN_FELib_DevicesDiscovery, 0, NULL, _devicesDiscovery(jsonString, size, timeout));
+}
+
+static int _openConnection(const char* url, uint64_t* handle) {
 	int errCode;
 	uint_fast16_t ch;
 	uint_fast8_t lh;
@@ -836,7 +997,7 @@ int CAEN_FELIB_API CAEN_FELib_Open(const char* url, uint64_t* handle) {
 
 	// find unused lh
 	for (ch = 0; ch < ARRAY_SIZE(connectionDescr); ++ch)
-		if (connectionDescr[ch] == NULL)
+		if (!_isValid(ch))
 			break;
 
 	if (ch == ARRAY_SIZE(connectionDescr)) {
@@ -878,7 +1039,9 @@ int CAEN_FELIB_API CAEN_FELib_Open(const char* url, uint64_t* handle) {
 		lib_descr->dlHandle = _loadLibrary(libFileName);
 		if (lib_descr->dlHandle == NULL) {
 			_resetLibDescr(lh);
-			_loadLibraryError(lastError, ARRAY_SIZE(lastError));
+			char message[ARRAY_SIZE(lastError.description)];
+			_loadLibraryError(message, ARRAY_SIZE(message));
+			_setLastLocalError("%s", message);
 			return CAEN_FELib_DeviceLibraryNotAvailable;
 		}
 
@@ -890,12 +1053,16 @@ int CAEN_FELIB_API CAEN_FELib_Open(const char* url, uint64_t* handle) {
 		errCode = _loadAPIv0(lib_descr);
 		if (errCode != CAEN_FELib_Success) {
 			_closeLibraryAndResetDevDescrIfLast(lh);
-			_loadLibraryError(lastError, ARRAY_SIZE(lastError));
+			char message[ARRAY_SIZE(lastError.description)];
+			_loadLibraryError(message, ARRAY_SIZE(message));
+			_setLastLocalError("%s", message);
 			return errCode;
 		}
 
-		// load APIv1 (optional)
-		_loadAPIv1(lib_descr);
+		// load APIv1 and APIv2 (optional)
+		if (_loadAPIv1(lib_descr) == CAEN_FELib_Success)
+			_loadAPIv2(lib_descr);
+		_loadOptional(lib_descr);
 
 	} else {
 
@@ -908,54 +1075,69 @@ int CAEN_FELIB_API CAEN_FELib_Open(const char* url, uint64_t* handle) {
 	errCode = lib_descr->Open(lDescr.arg, &rh);
 
 	if (errCode != CAEN_FELib_Success)
-		lib_descr->GetLastError(lastError); // save error before close lib
+		_saveLastLibraryError(lib_descr->GetLastError, lib_descr->name); // save error before close lib
 
 	if (errCode != CAEN_FELib_Success && errCode != CAEN_FELib_BadLibraryVersion) {
 		_closeLibraryAndResetDevDescrIfLast(lh);
 		return errCode;
 	}
 
-	if (!_allocateConnectionDescr(ch)) {
+	if (!_allocateConnectionDescr(ch, lh)) {
 		_closeLibraryAndResetDevDescrIfLast(lh);
 		_setLastLocalError("_allocateConnectionDescr failed");
 		return CAEN_FELib_InternalError;
 	}
 
-	struct connection_descr* conn_descr = connectionDescr[ch];
-
-	assert(conn_descr != NULL);
+	struct connection_descr* conn_descr = &connectionDescr[ch];
 
 	strncpy(conn_descr->arg, lDescr.arg, ARRAY_SIZE(conn_descr->arg));
 	conn_descr->arg[ARRAY_SIZE(conn_descr->arg) - 1] = '\0';
-	conn_descr->lHandle = lh;
 
 	lib_descr->nRef++;
 
 	*handle = _handle(ch, rh);
+	conn_descr->handle = *handle;
 
 	return errCode;
 }
 
-int CAEN_FELIB_API CAEN_FELib_Close(uint64_t handle) {
+int CAEN_FELIB_API CAEN_FELib_Open(const char* url, uint64_t* handle) {
+	TRACED_CALL(CAEN_FELib_Open, 0, url, _openConnection(url, handle));
+}
+
+static int _closeConnection(uint64_t handle) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
 	if (!_checkAPI(descr, LibraryAPIv0))
 		return _notSupported();
+	const uint32_t users = ATOMIC_LOAD_ACQUIRE(&connectionDescr[_cHandle(handle)].users);
+	if (users != 0) {
+		_setLastLocalError("connection in use by %"PRIu32" mergers, watches or batches: they must be destroyed before", users);
+		return CAEN_FELib_CommandError;
+	}
 	const uint32_t rHandle = _rHandle(handle);
+	// recordings must not read during close; errors are lost, as the handle is going to be invalid
+	endpoint_stopRecordings(&connectionDescr[_cHandle(handle)].endpoints);
 	const int ret = descr->Close(rHandle);
 	if (ret == CAEN_FELib_Success) {
 		descr->nRef--;
 		const uint_fast16_t cHandle = _cHandle(handle);
-		_closeLibraryAndResetDevDescrIfLast(connectionDescr[cHandle]->lHandle);
+		const uint_fast8_t lHandle = connectionDescr[cHandle].lHandle;
+		// endpoint threads must be joined before the library is unloaded
 		_resetConnectionDescr(cHandle);
+		_closeLibraryAndResetDevDescrIfLast(lHandle);
 	} else {
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	}
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetImplLibVersion(uint64_t handle, char version[16]) {
+int CAEN_FELIB_API CAEN_FELib_Close(uint64_t handle) {
+	TRACED_CALL(CAEN_FELib_Close, handle, NULL, _closeConnection(handle));
+}
+
+static int _getImplLibVersion(uint64_t handle, char version[16]) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -963,11 +1145,15 @@ int CAEN_FELIB_API CAEN_FELib_GetImplLibVersion(uint64_t handle, char version[16
 		return _notSupported();
 	const int ret = descr->GetLibVersion(version);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetDeviceTree(uint64_t handle, char* jsonString, size_t size) {
+int CAEN_FELIB_API CAEN_FELib_GetImplLibVersion(uint64_t handle, char version[16]) {
+	TRACED_CALL(CAEN_FELib_GetImplLibVersion, handle, NULL, _getImplLibVersion(handle, version));
+}
+
+static int _getDeviceTree(uint64_t handle, char* jsonString, size_t size) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -976,11 +1162,15 @@ int CAEN_FELIB_API CAEN_FELib_GetDeviceTree(uint64_t handle, char* jsonString, s
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->GetDeviceTree(rHandle, jsonString, size);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetChildHandles(uint64_t handle, const char* path, uint64_t* handles, size_t size) {
+int CAEN_FELIB_API CAEN_FELib_GetDeviceTree(uint64_t handle, char* jsonString, size_t size) {
+	TRACED_CALL(CAEN_FELib_GetDeviceTree, handle, NULL, _getDeviceTree(handle, jsonString, size));
+}
+
+static int _getChildHandles(uint64_t handle, const char* path, uint64_t* handles, size_t size) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1011,12 +1201,16 @@ int CAEN_FELIB_API CAEN_FELib_GetChildHandles(uint64_t handle, const char* path,
 		for (size_t i = minSize; i--;)
 			handles[i] = _handle(cHandle, tHandles[i]);
 	} else {
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	}
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetHandle(uint64_t handle, const char* path, uint64_t* pathHandle) {
+int CAEN_FELIB_API CAEN_FELib_GetChildHandles(uint64_t handle, const char* path, uint64_t* handles, size_t size) {
+	TRACED_CALL(CAEN_FELib_GetChildHandles, handle, path, _getChildHandles(handle, path, handles, size));
+}
+
+static int _getHandle(uint64_t handle, const char* path, uint64_t* pathHandle) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1029,12 +1223,16 @@ int CAEN_FELIB_API CAEN_FELib_GetHandle(uint64_t handle, const char* path, uint6
 		const uint_fast16_t cHandle = _cHandle(handle);
 		*pathHandle = _handle(cHandle, tHandle);
 	} else {
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	}
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetParentHandle(uint64_t handle, const char* path, uint64_t* parentHandle) {
+int CAEN_FELIB_API CAEN_FELib_GetHandle(uint64_t handle, const char* path, uint64_t* pathHandle) {
+	TRACED_CALL(CAEN_FELib_GetHandle, handle, path, _getHandle(handle, path, pathHandle));
+}
+
+static int _getParentHandle(uint64_t handle, const char* path, uint64_t* parentHandle) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1047,12 +1245,16 @@ int CAEN_FELIB_API CAEN_FELib_GetParentHandle(uint64_t handle, const char* path,
 		const uint_fast16_t cHandle = _cHandle(handle);
 		*parentHandle = _handle(cHandle, tHandle);
 	} else {
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	}
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetPath(uint64_t handle, char path[256]) {
+int CAEN_FELIB_API CAEN_FELib_GetParentHandle(uint64_t handle, const char* path, uint64_t* parentHandle) {
+	TRACED_CALL(CAEN_FELib_GetParentHandle, handle, path, _getParentHandle(handle, path, parentHandle));
+}
+
+static int _getPath(uint64_t handle, char path[256]) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1061,11 +1263,15 @@ int CAEN_FELIB_API CAEN_FELib_GetPath(uint64_t handle, char path[256]) {
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->GetPath(rHandle, path);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetNodeProperties(uint64_t handle, const char* path, char name[32], CAEN_FELib_NodeType_t*type) {
+int CAEN_FELIB_API CAEN_FELib_GetPath(uint64_t handle, char path[256]) {
+	TRACED_CALL(CAEN_FELib_GetPath, handle, NULL, _getPath(handle, path));
+}
+
+static int _getNodeProperties(uint64_t handle, const char* path, char name[32], CAEN_FELib_NodeType_t*type) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1074,11 +1280,100 @@ int CAEN_FELIB_API CAEN_FELib_GetNodeProperties(uint64_t handle, const char* pat
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->GetNodeProperties(rHandle, path, name, type);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetValue(uint64_t handle, const char* path, char value[256]) {
+int CAEN_FELIB_API CAEN_FELib_GetNodeProperties(uint64_t handle, const char* path, char name[32], CAEN_FELib_NodeType_t*type) {
+	TRACED_CALL(CAEN_FELib_GetNodeProperties, handle, path, _getNodeProperties(handle, path, name, type));
+}
+
+// walk for libraries without WalkTree, with library handles like WalkTree; count is incremented also if nodes is full
+static int _walkTreeNode(struct library_descr* descr, uint64_t handle, uint32_t rHandle, uint32_t rParent, uint32_t depth, int maxDepth, CAEN_FELib_TreeNode_t* nodes, size_t size, size_t* count) {
+	const size_t index = (*count)++;
+	if (index < size) {
+		CAEN_FELib_TreeNode_t* const node = &nodes[index];
+		node->handle = rHandle;
+		node->parent = rParent;
+		node->depth = depth;
+		const int ret = descr->GetNodeProperties(rHandle, "", node->name, &node->type);
+		if (ret != CAEN_FELib_Success) {
+			_setLastLibraryError(descr, handle);
+			return ret;
+		}
+	}
+	if (maxDepth >= 0 && depth >= (uint32_t)maxDepth)
+		return CAEN_FELib_Success;
+	const int nChildren = descr->GetChildHandles(rHandle, "", NULL, 0);
+	if (nChildren <= 0) {
+		if (nChildren < 0)
+			_setLastLibraryError(descr, handle);
+		return nChildren;
+	}
+	uint32_t* const children = malloc((size_t)nChildren * sizeof(*children));
+	if (children == NULL) {
+		_setLastLocalError("malloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	int ret = descr->GetChildHandles(rHandle, "", children, (size_t)nChildren);
+	if (ret < 0) {
+		_setLastLibraryError(descr, handle);
+	} else {
+		const size_t n = ((size_t)ret < (size_t)nChildren) ? (size_t)ret : (size_t)nChildren;
+		ret = CAEN_FELib_Success;
+		for (size_t i = 0; i < n && ret == CAEN_FELib_Success; ++i)
+			ret = _walkTreeNode(descr, handle, children[i], rHandle, depth + 1, maxDepth, nodes, size, count);
+	}
+	free(children);
+	return ret;
+}
+
+static int _walkTree(uint64_t handle, const char* path, int maxDepth, CAEN_FELib_TreeNode_t* nodes, size_t size) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (nodes == NULL && size != 0) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint32_t rHandle = _rHandle(handle);
+	int ret;
+	if (_checkAPI(descr, LibraryAPIv2)) {
+		ret = descr->WalkTree(rHandle, path, maxDepth, nodes, size);
+		if (ret < 0)
+			_setLastLibraryError(descr, handle);
+	} else {
+		uint32_t rRoot;
+		ret = descr->GetHandle(rHandle, path, &rRoot);
+		if (ret != CAEN_FELib_Success) {
+			_setLastLibraryError(descr, handle);
+			return ret;
+		}
+		size_t count = 0;
+		ret = _walkTreeNode(descr, handle, rRoot, 0, 0, maxDepth, nodes, size, &count);
+		if (ret == CAEN_FELib_Success)
+			ret = (count <= INT_MAX) ? (int)count : INT_MAX;
+	}
+	if (ret >= 0) {
+		// library handles to user handles, parent of the root of the walk is zero
+		const size_t retSize = (size_t)ret;
+		const size_t minSize = (retSize < size) ? retSize : size;
+		const uint_fast16_t cHandle = _cHandle(handle);
+		for (size_t i = 0; i < minSize; ++i) {
+			nodes[i].handle = _handle(cHandle, (uint32_t)nodes[i].handle);
+			nodes[i].parent = (nodes[i].depth != 0) ? _handle(cHandle, (uint32_t)nodes[i].parent) : 0;
+		}
+	}
+	return ret;
+}
+
+int CAEN_FELIB_API CAEN_FELib_WalkTree(uint64_t handle, const char* path, int maxDepth, CAEN_FELib_TreeNode_t* nodes, size_t size) {
+	TRACED_CALL(CAEN_FELib_WalkTree, handle, path, _walkTree(handle, path, maxDepth, nodes, size));
+}
+
+static int _getValue(uint64_t handle, const char* path, char value[256]) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1087,11 +1382,15 @@ int CAEN_FELIB_API CAEN_FELib_GetValue(uint64_t handle, const char* path, char v
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->GetValue(rHandle, path, value);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_SetValue(uint64_t handle, const char* path, const char* value) {
+int CAEN_FELIB_API CAEN_FELib_GetValue(uint64_t handle, const char* path, char value[256]) {
+	TRACED_CALL(CAEN_FELib_GetValue, handle, path, _getValue(handle, path, value));
+}
+
+static int _setValue(uint64_t handle, const char* path, const char* value) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1100,11 +1399,15 @@ int CAEN_FELIB_API CAEN_FELib_SetValue(uint64_t handle, const char* path, const
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->SetValue(rHandle, path, value);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_SendCommand(uint64_t handle, const char* path) {
+int CAEN_FELIB_API CAEN_FELib_SetValue(uint64_t handle, const char* path, const char* value) {
+	TRACED_CALL(CAEN_FELib_SetValue, handle, path, _setValue(handle, path, value));
+}
+
+static int _sendCommand(uint64_t handle, const char* path) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1113,11 +1416,37 @@ int CAEN_FELIB_API CAEN_FELib_SendCommand(uint64_t handle, const char* path) {
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->SendCommand(rHandle, path);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_GetUserRegister(uint64_t handle, uint32_t address, uint32_t* value) {
+int CAEN_FELIB_API CAEN_FELib_SendCommand(uint64_t handle, const char* path) {
+	TRACED_CALL(CAEN_FELib_SendCommand, handle, path, _sendCommand(handle, path));
+}
+
+static int _sendCommandMany(const uint64_t* handles, size_t n, const char* path, CAEN_FELib_CommandResult_t* results) {
+	if (handles == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	if (n == 0) {
+		_setLastLocalError("no boards");
+		return CAEN_FELib_InvalidParam;
+	}
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < i; ++j)
+			if (handles[i] == handles[j]) {
+				_setLastLocalError("handle %zu is repeated", i);
+				return CAEN_FELib_InvalidParam;
+			}
+	return group_sendCommand(handles, n, path, _sendCommand, results);
+}
+
+int CAEN_FELIB_API CAEN_FELib_SendCommandMany(const uint64_t* handles, size_t n, const char* path, CAEN_FELib_CommandResult_t* results) {
+	TRACED_CALL(CAEN_FELib_SendCommandMany, 0, path, _sendCommandMany(handles, n, path, results));
+}
+
+static int _getUserRegister(uint64_t handle, uint32_t address, uint32_t* value) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1126,11 +1455,15 @@ int CAEN_FELIB_API CAEN_FELib_GetUserRegister(uint64_t handle, uint32_t address,
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->GetUserRegister(rHandle, address, value);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_SetUserRegister(uint64_t handle, uint32_t address, uint32_t value) {
+int CAEN_FELIB_API CAEN_FELib_GetUserRegister(uint64_t handle, uint32_t address, uint32_t* value) {
+	TRACED_CALL(CAEN_FELib_GetUserRegister, handle, NULL, _getUserRegister(handle, address, value));
+}
+
+static int _setUserRegister(uint64_t handle, uint32_t address, uint32_t value) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1139,11 +1472,70 @@ int CAEN_FELIB_API CAEN_FELib_SetUserRegister(uint64_t handle, uint32_t address,
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->SetUserRegister(rHandle, address, value);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_SetReadDataFormat(uint64_t handle, const char* jsonString) {
+int CAEN_FELIB_API CAEN_FELib_SetUserRegister(uint64_t handle, uint32_t address, uint32_t value) {
+	TRACED_CALL(CAEN_FELib_SetUserRegister, handle, NULL, _setUserRegister(handle, address, value));
+}
+
+/*
+ * Keep a parsed copy of the read data format, used to compute the size of
+ * events. The format has already been accepted by the implementation library:
+ * failures here are not reported to the caller, but the endpoint is simply
+ * excluded from the byte count.
+ */
+static void _updateEndpointFormat(struct library_descr* descr, uint64_t handle, const char* jsonString) {
+	const uint32_t rHandle = _rHandle(handle);
+	struct endpoint_descr* const ep = endpoint_get(&connectionDescr[_cHandle(handle)].endpoints, rHandle);
+	if (ep == NULL) {
+		_resetLastLocalError();
+		return;
+	}
+	format_clear(&ep->format);
+	++ep->formatGeneration;
+	if (format_parse(&ep->format, jsonString, 0) != CAEN_FELib_Success)
+		_resetLastLocalError();
+	// endpoints are at /endpoint/<name>
+	for (size_t i = 0; i < ep->format.nFields; ++i) {
+		if (ep->format.fields[i].dim == 2) {
+			char value[256];
+			if (descr->GetValue(rHandle, "../../par/NumCh", value) == CAEN_FELib_Success)
+				ep->format.nChannels = (size_t)strtoul(value, NULL, 0);
+			break;
+		}
+	}
+	if (ep->capture != NULL)
+		capture_onFormat(ep->capture, &ep->format);
+	if (ep->fanout != NULL)
+		fanout_onFormat(ep->fanout, &ep->format);
+	if (ep->histogram != NULL)
+		histogram_onFormat(ep->histogram, &ep->format);
+	if (ep->reduction != NULL)
+		reduction_onFormat(ep->reduction, &ep->format);
+}
+
+// get the statistics entry of an endpoint, allocating a new one if statistics have been (re)enabled
+static CAEN_FELib_StatsEntry_t* _getEndpointStats(struct library_descr* descr, uint64_t handle) {
+	const uint_fast16_t cHandle = _cHandle(handle);
+	const uint32_t rHandle = _rHandle(handle);
+	struct endpoint_descr* const ep = endpoint_get(&connectionDescr[cHandle].endpoints, rHandle);
+	if (ep == NULL)
+		return NULL;
+	if (LIKELY(ep->statsGeneration == statsGeneration))
+		return ep->stats;
+	char path[256];
+	char name[ARRAY_SIZE(ep->stats->name)];
+	if (descr->GetPath(rHandle, path) != CAEN_FELib_Success)
+		path[0] = '\0';
+	snprintf(name, ARRAY_SIZE(name), "%s:%s", connectionDescr[cHandle].arg, path);
+	ep->stats = stats_newEntry(handle, name);
+	ep->statsGeneration = statsGeneration;
+	return ep->stats;
+}
+
+static int _setReadDataFormat(uint64_t handle, const char* jsonString) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
@@ -1152,10 +1544,16 @@ int CAEN_FELIB_API CAEN_FELib_SetReadDataFormat(uint64_t handle, const char* jso
 	const uint32_t rHandle = _rHandle(handle);
 	const int ret = descr->SetReadDataFormat(rHandle, jsonString);
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
+	else
+		_updateEndpointFormat(descr, handle, jsonString);
 	return ret;
 }
 
+int CAEN_FELIB_API CAEN_FELib_SetReadDataFormat(uint64_t handle, const char* jsonString) {
+	TRACED_CALL(CAEN_FELib_SetReadDataFormat, handle, NULL, _setReadDataFormat(handle, jsonString));
+}
+
 int CAEN_FELIB_API CAEN_FELib_ReadData(uint64_t handle, int timeout, ...) {
 	va_list args;
 	va_start(args, timeout);
@@ -1164,51 +1562,976 @@ int CAEN_FELIB_API CAEN_FELib_ReadData(uint64_t handle, int timeout, ...) {
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_ReadDataV(uint64_t handle, int timeout, va_list args) {
+static int _readDataVImpl(struct library_descr* descr, uint64_t handle, int timeout, va_list args) {
+	const uint32_t rHandle = _rHandle(handle);
+	const int ret = descr->ReadDataV(rHandle, timeout, args);
+	switch (ret) {
+	case CAEN_FELib_Success:
+		break;
+	case CAEN_FELib_Timeout:
+		PROBE_READDATA_TIMEOUT(handle, timeout);
+		_setLastLibraryError(descr, handle);
+		break;
+	case CAEN_FELib_Stop:
+		PROBE_READDATA_STOP(handle);
+		_setLastLibraryError(descr, handle);
+		break;
+	default:
+		_setLastLibraryError(descr, handle);
+		break;
+	}
+	return ret;
+}
+
+static inline bool _readDataHooksActive(void) {
+	return stats_isActive() || capture_isActive() || fanout_isActive() || histogram_isActive() || reduction_isActive();
+}
+
+// inspect the result of a read; args are the arguments of the read, not consumed
+static void _readDataHooks(struct library_descr* descr, uint64_t handle, int ret, va_list args) {
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	struct format_args fargs;
+	const bool hasEvent = (ret == CAEN_FELib_Success && ep != NULL && ep->format.nFields != 0);
+	if (hasEvent)
+		format_getArgs(&ep->format, args, &fargs);
+	// before any other consumer, that must see the reduced event
+	if (hasEvent && ep->reduction != NULL)
+		reduction_onEvent(ep->reduction, &ep->format, &fargs);
+	if (stats_isActive()) {
+		CAEN_FELib_StatsEntry_t* const entry = _getEndpointStats(descr, handle);
+		stats_onReadData(entry, ret, hasEvent ? format_eventSize(&ep->format, &fargs) : 0);
+	}
+	if (ep != NULL && ep->capture != NULL) {
+		// errors are reported by CAEN_FELib_StopCapture()
+		if (hasEvent)
+			capture_onEvent(ep->capture, &ep->format, &fargs);
+		else if (ret == CAEN_FELib_Stop)
+			capture_onStop(ep->capture);
+	}
+	if (ep != NULL && ep->fanout != NULL) {
+		if (hasEvent)
+			fanout_onEvent(ep->fanout, &ep->format, &fargs);
+		else if (ret == CAEN_FELib_Stop)
+			fanout_onStop(ep->fanout);
+	}
+	if (hasEvent && ep->histogram != NULL)
+		histogram_onEvent(ep->histogram, &fargs);
+}
+
+// slow path, to inspect the event after the read
+static int _readDataVWithHooks(struct library_descr* descr, uint64_t handle, int timeout, va_list args) {
+	// args are consumed by the implementation library: a copy is required to inspect the event
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	const int ret = _readDataVImpl(descr, handle, timeout, args);
+	_readDataHooks(descr, handle, ret, argsCopy);
+	va_end(argsCopy);
+	return ret;
+}
+
+static int _readDataV(uint64_t handle, int timeout, va_list args) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
 	if (!_checkAPI(descr, LibraryAPIv0))
 		return _notSupported();
-	const uint32_t rHandle = _rHandle(handle);
-	const int ret = descr->ReadDataV(rHandle, timeout, args);
-	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+	if (_readDataHooksActive())
+		return _readDataVWithHooks(descr, handle, timeout, args);
+	return _readDataVImpl(descr, handle, timeout, args);
+}
+
+int CAEN_FELIB_API CAEN_FELib_ReadDataV(uint64_t handle, int timeout, va_list args) {
+	TRACED_CALL(CAEN_FELib_ReadDataV, handle, NULL, _readDataV(handle, timeout, args));
+}
+
+// account the result of a wait on the implementation library
+static int _onHasData(struct library_descr* descr, uint64_t handle, int timeout, int ret) {
+	if (stats_isActive())
+		stats_onHasData(_getEndpointStats(descr, handle), ret);
+	switch (ret) {
+	case CAEN_FELib_Success:
+		break;
+	case CAEN_FELib_Timeout:
+		PROBE_HASDATA_TIMEOUT(handle, timeout);
+		_setLastLibraryError(descr, handle);
+		break;
+	case CAEN_FELib_Stop:
+		PROBE_HASDATA_STOP(handle);
+		_setLastLibraryError(descr, handle);
+		break;
+	default:
+		_setLastLibraryError(descr, handle);
+		break;
+	}
 	return ret;
 }
 
-int CAEN_FELIB_API CAEN_FELib_HasData(uint64_t handle, int timeout) {
+static int _hasData(uint64_t handle, int timeout) {
 	struct library_descr* const descr = _getLibDescr(handle);
 	if (descr == NULL)
 		return _invalidHandle();
 	if (!_checkAPI(descr, LibraryAPIv1))
 		return _notSupported();
-	const uint32_t rHandle = _rHandle(handle);
-	const int ret = descr->HasData(rHandle, timeout);
+	const int ret = descr->HasData(_rHandle(handle), timeout);
+	return _onHasData(descr, handle, timeout, ret);
+}
+
+int CAEN_FELIB_API CAEN_FELib_HasData(uint64_t handle, int timeout) {
+	TRACED_CALL(CAEN_FELib_HasData, handle, NULL, _hasData(handle, timeout));
+}
+
+static int _interrupt(uint64_t handle) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (descr->Interrupt == NULL) {
+		_setLastLocalError("interrupt not supported by the %s library", descr->name);
+		return CAEN_FELib_NotImplemented;
+	}
+	const int ret = descr->Interrupt(_rHandle(handle));
 	if (ret != CAEN_FELib_Success)
-		descr->GetLastError(lastError);
+		_setLastLibraryError(descr, handle);
 	return ret;
 }
 
-// perform here any library initialization.
-static void init_library(void) {
-	for (uint_fast16_t i = 0; i < ARRAY_SIZE(connectionDescr); ++i)
-		connectionDescr[i] = NULL;
-	for (uint_fast8_t i = 0; i < ARRAY_SIZE(libDescr); ++i)
-		libDescr[i] = NULL;
+int CAEN_FELIB_API CAEN_FELib_Interrupt(uint64_t handle) {
+	TRACED_CALL(CAEN_FELib_Interrupt, handle, NULL, _interrupt(handle));
 }
 
-// perform here any library deinitialization.
-static void deinit_library(void) {
-	for (uint_fast16_t i = 0; i < ARRAY_SIZE(connectionDescr); ++i) {
-		if (_isValid(i)) {
-			const uint_fast8_t lHandle = connectionDescr[i]->lHandle;
-			libDescr[lHandle]->nRef--;
-			_closeLibraryAndResetDevDescrIfLast(lHandle);
-			_resetConnectionDescr(i);
+// millisecond timeout equivalent to a microsecond one, rounded up
+static int _usToMs(int64_t timeoutUs) {
+	if (timeoutUs < 0)
+		return -1;
+	const int64_t ms = timeoutUs / 1000 + (timeoutUs % 1000 != 0);
+	return (ms > INT_MAX) ? INT_MAX : (int)ms;
+}
+
+// wait policy of an endpoint, created with defaults on first use
+static struct wait_policy* _getWaitPolicy(uint64_t handle) {
+	struct endpoint_descr* const ep = endpoint_get(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL) {
+		_setLastLocalError("calloc failed");
+		return NULL;
+	}
+	if (ep->wait == NULL && wait_create(&ep->wait, NULL) != CAEN_FELib_Success)
+		return NULL;
+	return ep->wait;
+}
+
+static int _readDataVUs(uint64_t handle, int64_t timeoutUs, va_list args) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv1))
+		return _readDataV(handle, _usToMs(timeoutUs), args);
+	struct wait_policy* const policy = _getWaitPolicy(handle);
+	if (policy == NULL)
+		return CAEN_FELib_InternalError;
+	const int ret = wait_data(policy, descr->HasData, _rHandle(handle), timeoutUs);
+	switch (ret) {
+	case CAEN_FELib_Success:
+	case CAEN_FELib_Timeout:
+		// a timeout is read as well, to be accounted like the one of CAEN_FELib_ReadData()
+		return _readDataV(handle, 0, args);
+	case CAEN_FELib_Stop:
+		PROBE_READDATA_STOP(handle);
+		break;
+	default:
+		break;
+	}
+	// the end of run has been consumed by the wait: hooks must see it here
+	if (_readDataHooksActive())
+		_readDataHooks(descr, handle, ret, args);
+	_setLastLibraryError(descr, handle);
+	return ret;
+}
+
+int CAEN_FELIB_API CAEN_FELib_ReadDataVUs(uint64_t handle, int64_t timeoutUs, va_list args) {
+	TRACED_CALL(CAEN_FELib_ReadDataVUs, handle, NULL, _readDataVUs(handle, timeoutUs, args));
+}
+
+int CAEN_FELIB_API CAEN_FELib_ReadDataUs(uint64_t handle, int64_t timeoutUs, ...) {
+	va_list args;
+	va_start(args, timeoutUs);
+	const int ret = CAEN_FELib_ReadDataVUs(handle, timeoutUs, args);
+	va_end(args);
+	return ret;
+}
+
+static int _hasDataUs(uint64_t handle, int64_t timeoutUs) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv1))
+		return _notSupported();
+	struct wait_policy* const policy = _getWaitPolicy(handle);
+	if (policy == NULL)
+		return CAEN_FELib_InternalError;
+	const int ret = wait_data(policy, descr->HasData, _rHandle(handle), timeoutUs);
+	return _onHasData(descr, handle, _usToMs(timeoutUs), ret);
+}
+
+int CAEN_FELIB_API CAEN_FELib_HasDataUs(uint64_t handle, int64_t timeoutUs) {
+	TRACED_CALL(CAEN_FELib_HasDataUs, handle, NULL, _hasDataUs(handle, timeoutUs));
+}
+
+static int _setWaitPolicy(uint64_t handle, const char* options) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (options == NULL) {
+		struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+		if (ep != NULL)
+			wait_destroy(&ep->wait);
+		return CAEN_FELib_Success;
+	}
+	struct endpoint_descr* const ep = endpoint_get(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	return wait_create(&ep->wait, options);
+}
+
+int CAEN_FELIB_API CAEN_FELib_SetWaitPolicy(uint64_t handle, const char* options) {
+	TRACED_CALL(CAEN_FELib_SetWaitPolicy, handle, NULL, _setWaitPolicy(handle, options));
+}
+
+static int _getWaitStats(uint64_t handle, CAEN_FELib_WaitStats_t* stats) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (stats == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->wait == NULL) {
+		_setLastLocalError("no wait policy: neither CAEN_FELib_SetWaitPolicy nor microsecond waits have been invoked");
+		return CAEN_FELib_CommandError;
+	}
+	wait_getStats(ep->wait, stats);
+	return CAEN_FELib_Success;
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetWaitStats(uint64_t handle, CAEN_FELib_WaitStats_t* stats) {
+	TRACED_CALL(CAEN_FELib_GetWaitStats, handle, NULL, _getWaitStats(handle, stats));
+}
+
+int CAEN_FELIB_API CAEN_FELib_EnableStatistics(const char* name) {
+	return stats_enable(name);
+}
+
+int CAEN_FELIB_API CAEN_FELib_DisableStatistics(void) {
+	return stats_disable();
+}
+
+static int _startCapture(uint64_t handle, const char* filename) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (filename == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint_fast16_t cHandle = _cHandle(handle);
+	const uint32_t rHandle = _rHandle(handle);
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[cHandle].endpoints, rHandle);
+	if (ep == NULL || ep->format.nFields == 0) {
+		_setLastLocalError("read data format not set: CAEN_FELib_SetReadDataFormat must be invoked before the capture");
+		return CAEN_FELib_InvalidParam;
+	}
+	char path[256];
+	const int ret = descr->GetPath(rHandle, path);
+	if (ret != CAEN_FELib_Success) {
+		_setLastLibraryError(descr, handle);
+		return ret;
+	}
+	return capture_start(&ep->capture, filename, connectionDescr[cHandle].arg, path, &ep->format);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StartCapture(uint64_t handle, const char* filename) {
+	TRACED_CALL(CAEN_FELib_StartCapture, handle, filename, _startCapture(handle, filename));
+}
+
+static int _stopCapture(uint64_t handle) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->capture == NULL) {
+		_setLastLocalError("no capture in progress");
+		return CAEN_FELib_CommandError;
+	}
+	return capture_stop(&ep->capture);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StopCapture(uint64_t handle) {
+	TRACED_CALL(CAEN_FELib_StopCapture, handle, NULL, _stopCapture(handle));
+}
+
+static int _startHistograms(uint64_t handle, const char* options) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (options == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->format.nFields == 0) {
+		_setLastLocalError("read data format not set: CAEN_FELib_SetReadDataFormat must be invoked before the histograms");
+		return CAEN_FELib_InvalidParam;
+	}
+	return histogram_start(&ep->histogram, &ep->format, options);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StartHistograms(uint64_t handle, const char* options) {
+	TRACED_CALL(CAEN_FELib_StartHistograms, handle, NULL, _startHistograms(handle, options));
+}
+
+// endpoint with histograms in progress, NULL and set last error if not found
+static struct endpoint_descr* _getHistogramEndpoint(uint64_t handle) {
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->histogram == NULL) {
+		_setLastLocalError("no histograms in progress");
+		return NULL;
+	}
+	return ep;
+}
+
+static int _stopHistograms(uint64_t handle) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	struct endpoint_descr* const ep = _getHistogramEndpoint(handle);
+	if (ep == NULL)
+		return CAEN_FELib_CommandError;
+	return histogram_stop(&ep->histogram);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StopHistograms(uint64_t handle) {
+	TRACED_CALL(CAEN_FELib_StopHistograms, handle, NULL, _stopHistograms(handle));
+}
+
+static int _getHistogram(uint64_t handle, const char* name, size_t channel, uint64_t* bins, size_t size, CAEN_FELib_HistogramInfo_t* info) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (name == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct endpoint_descr* const ep = _getHistogramEndpoint(handle);
+	if (ep == NULL)
+		return CAEN_FELib_CommandError;
+	return histogram_get(ep->histogram, name, channel, bins, size, info);
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetHistogram(uint64_t handle, const char* name, size_t channel, uint64_t* bins, size_t size, CAEN_FELib_HistogramInfo_t* info) {
+	TRACED_CALL(CAEN_FELib_GetHistogram, handle, name, _getHistogram(handle, name, channel, bins, size, info));
+}
+
+static int _resetHistograms(uint64_t handle) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	struct endpoint_descr* const ep = _getHistogramEndpoint(handle);
+	if (ep == NULL)
+		return CAEN_FELib_CommandError;
+	histogram_reset(ep->histogram);
+	return CAEN_FELib_Success;
+}
+
+int CAEN_FELIB_API CAEN_FELib_ResetHistograms(uint64_t handle) {
+	TRACED_CALL(CAEN_FELib_ResetHistograms, handle, NULL, _resetHistograms(handle));
+}
+
+static int _setDataReduction(uint64_t handle, const char* options) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (options == NULL) {
+		if (ep != NULL)
+			reduction_destroy(&ep->reduction);
+		return CAEN_FELib_Success;
+	}
+	if (ep == NULL || ep->format.nFields == 0) {
+		_setLastLocalError("read data format not set: CAEN_FELib_SetReadDataFormat must be invoked before the data reduction");
+		return CAEN_FELib_InvalidParam;
+	}
+	return reduction_create(&ep->reduction, &ep->format, options);
+}
+
+int CAEN_FELIB_API CAEN_FELib_SetDataReduction(uint64_t handle, const char* options) {
+	TRACED_CALL(CAEN_FELib_SetDataReduction, handle, NULL, _setDataReduction(handle, options));
+}
+
+static int _getDataReductionStats(uint64_t handle, CAEN_FELib_ReductionStats_t* stats) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (stats == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->reduction == NULL) {
+		_setLastLocalError("data reduction not enabled");
+		return CAEN_FELib_CommandError;
+	}
+	reduction_getStats(ep->reduction, stats);
+	return CAEN_FELib_Success;
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetDataReductionStats(uint64_t handle, CAEN_FELib_ReductionStats_t* stats) {
+	TRACED_CALL(CAEN_FELib_GetDataReductionStats, handle, NULL, _getDataReductionStats(handle, stats));
+}
+
+static int _readDataVA(uint64_t handle, int timeout, ...) {
+	va_list args;
+	va_start(args, timeout);
+	const int ret = _readDataV(handle, timeout, args);
+	va_end(args);
+	return ret;
+}
+
+// read callback of recordings: arguments exceeding the format fields are ignored by the implementation library
+static int _readDataArgs(uint64_t handle, int timeout, const struct format_args* args) {
+#define ARGS_8(I)	args->ptr[I], args->ptr[I + 1], args->ptr[I + 2], args->ptr[I + 3], args->ptr[I + 4], args->ptr[I + 5], args->ptr[I + 6], args->ptr[I + 7]
+	STATIC_ASSERT(ARRAY_SIZE(args->ptr) == 64, invalid_format_args_size);
+	return _readDataVA(handle, timeout, ARGS_8(0), ARGS_8(8), ARGS_8(16), ARGS_8(24), ARGS_8(32), ARGS_8(40), ARGS_8(48), ARGS_8(56));
+#undef ARGS_8
+}
+
+static int _startRecording(uint64_t handle, const char* filename, const char* options) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (filename == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint_fast16_t cHandle = _cHandle(handle);
+	const uint32_t rHandle = _rHandle(handle);
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[cHandle].endpoints, rHandle);
+	if (ep == NULL || ep->format.nFields == 0) {
+		_setLastLocalError("read data format not set: CAEN_FELib_SetReadDataFormat must be invoked before the recording");
+		return CAEN_FELib_InvalidParam;
+	}
+	char path[256];
+	int ret = descr->GetPath(rHandle, path);
+	if (ret != CAEN_FELib_Success) {
+		_setLastLibraryError(descr, handle);
+		return ret;
+	}
+	// default size of array buffers, overridden by options
+	char value[256];
+	size_t maxArraySize = RECORDING_DEFAULT_MAX_ARRAY_SIZE;
+	if (descr->GetValue(rHandle, "../../par/MaxRawDataSize", value) == CAEN_FELib_Success)
+		maxArraySize = (size_t)strtoull(value, NULL, 0);
+	if (maxArraySize == 0)
+		maxArraySize = RECORDING_DEFAULT_MAX_ARRAY_SIZE;
+	return recording_start(&ep->recording, handle, _readDataArgs, filename, connectionDescr[cHandle].arg, path, &ep->format, maxArraySize, &connectionDescr[cHandle].cpus, options);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StartRecording(uint64_t handle, const char* filename, const char* options) {
+	TRACED_CALL(CAEN_FELib_StartRecording, handle, filename, _startRecording(handle, filename, options));
+}
+
+static struct endpoint_descr* _getRecordingEndpoint(uint64_t handle) {
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->recording == NULL) {
+		_setLastLocalError("no recording in progress");
+		return NULL;
+	}
+	return ep;
+}
+
+static int _stopRecording(uint64_t handle) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	struct endpoint_descr* const ep = _getRecordingEndpoint(handle);
+	if (ep == NULL)
+		return CAEN_FELib_CommandError;
+	return recording_stop(&ep->recording);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StopRecording(uint64_t handle) {
+	TRACED_CALL(CAEN_FELib_StopRecording, handle, NULL, _stopRecording(handle));
+}
+
+static int _getRecordingStatus(uint64_t handle, CAEN_FELib_RecordingStatus_t* status) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (status == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct endpoint_descr* const ep = _getRecordingEndpoint(handle);
+	if (ep == NULL)
+		return CAEN_FELib_CommandError;
+	recording_getStatus(ep->recording, status);
+	return CAEN_FELib_Success;
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetRecordingStatus(uint64_t handle, CAEN_FELib_RecordingStatus_t* status) {
+	TRACED_CALL(CAEN_FELib_GetRecordingStatus, handle, NULL, _getRecordingStatus(handle, status));
+}
+
+static int _setThreadAffinity(uint64_t handle, const char* cpuList) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	struct numa_cpus cpus;
+	const int ret = numa_parseCpus(&cpus, cpuList);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	connectionDescr[_cHandle(handle)].cpus = cpus;
+	return CAEN_FELib_Success;
+}
+
+int CAEN_FELIB_API CAEN_FELib_SetThreadAffinity(uint64_t handle, const char* cpuList) {
+	TRACED_CALL(CAEN_FELib_SetThreadAffinity, handle, cpuList, _setThreadAffinity(handle, cpuList));
+}
+
+static int _watch(uint64_t handle, const char* const* paths, size_t n, int periodMs, CAEN_FELib_WatchCallback_t callback, void* ctx, CAEN_FELib_Watch_t** watch) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (paths == NULL || callback == NULL || watch == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const int ret = watch_create(watch, handle, paths, n, periodMs, callback, ctx);
+	if (ret == CAEN_FELib_Success)
+		_acquireConnection(handle);
+	return ret;
+}
+
+int CAEN_FELIB_API CAEN_FELib_Watch(uint64_t handle, const char* const* paths, size_t n, int periodMs, CAEN_FELib_WatchCallback_t callback, void* ctx, CAEN_FELib_Watch_t** watch) {
+	TRACED_CALL(CAEN_FELib_Watch, handle, NULL, _watch(handle, paths, n, periodMs, callback, ctx, watch));
+}
+
+int CAEN_FELIB_API CAEN_FELib_Unwatch(CAEN_FELib_Watch_t* watch) {
+	if (watch == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint64_t handle = watch_getHandle(watch);
+	const int ret = watch_destroy(watch);
+	if (ret == CAEN_FELib_Success)
+		_releaseConnection(handle);
+	return ret;
+}
+
+int CAEN_FELIB_API CAEN_FELib_SetWatchBudget(uint32_t callsPerSecond) {
+	return watch_setBudget(callsPerSecond);
+}
+
+int CAEN_FELIB_API CAEN_FELib_OpenEventFile(const char* filename, CAEN_FELib_EventFile_t** file) {
+	return evreader_open(filename, file);
+}
+
+int CAEN_FELIB_API CAEN_FELib_CloseEventFile(CAEN_FELib_EventFile_t* file) {
+	return evreader_close(file);
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetEventFileInfo(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventFileInfo_t* info) {
+	return evreader_getInfo(file, info);
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetEvent(CAEN_FELib_EventFile_t* file, uint64_t index, CAEN_FELib_Event_t* event) {
+	return evreader_getEvent(file, index, event);
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetNextEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_Event_t* event) {
+	return evreader_getNextEvent(file, event);
+}
+
+int CAEN_FELIB_API CAEN_FELib_FindEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventKey_t key, uint64_t value, CAEN_FELib_Event_t* event) {
+	return evreader_findEvent(file, key, value, event);
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetEventField(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count) {
+	return evreader_getField(file, event, name, channel, data, count);
+}
+
+static int _startFanout(uint64_t handle, const char* name, const char* options) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (name == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint_fast16_t cHandle = _cHandle(handle);
+	const uint32_t rHandle = _rHandle(handle);
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[cHandle].endpoints, rHandle);
+	if (ep == NULL || ep->format.nFields == 0) {
+		_setLastLocalError("read data format not set: CAEN_FELib_SetReadDataFormat must be invoked before the fan-out");
+		return CAEN_FELib_InvalidParam;
+	}
+	char path[256];
+	const int ret = descr->GetPath(rHandle, path);
+	if (ret != CAEN_FELib_Success) {
+		_setLastLibraryError(descr, handle);
+		return ret;
+	}
+	return fanout_start(&ep->fanout, name, connectionDescr[cHandle].arg, path, &ep->format, options);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StartFanout(uint64_t handle, const char* name, const char* options) {
+	TRACED_CALL(CAEN_FELib_StartFanout, handle, name, _startFanout(handle, name, options));
+}
+
+static int _stopFanout(uint64_t handle) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->fanout == NULL) {
+		_setLastLocalError("no fan-out in progress");
+		return CAEN_FELib_CommandError;
+	}
+	return fanout_stop(&ep->fanout);
+}
+
+int CAEN_FELIB_API CAEN_FELib_StopFanout(uint64_t handle) {
+	TRACED_CALL(CAEN_FELib_StopFanout, handle, NULL, _stopFanout(handle));
+}
+
+int CAEN_FELIB_API CAEN_FELib_OpenFanout(const char* name, const char* options, CAEN_FELib_FanoutReader_t** reader) {
+	return fanout_open(name, options, reader);
+}
+
+int CAEN_FELIB_API CAEN_FELib_CloseFanout(CAEN_FELib_FanoutReader_t* reader) {
+	return fanout_close(reader);
+}
+
+int CAEN_FELIB_API CAEN_FELib_ReadFanoutEvent(CAEN_FELib_FanoutReader_t* reader, int timeout, CAEN_FELib_Event_t* event) {
+	return fanout_read(reader, timeout, event);
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetFanoutEventField(CAEN_FELib_FanoutReader_t* reader, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count) {
+	return fanout_getField(reader, event, name, channel, data, count);
+}
+
+int CAEN_FELIB_API CAEN_FELib_GetFanoutStatus(CAEN_FELib_FanoutReader_t* reader, CAEN_FELib_FanoutStatus_t* status) {
+	return fanout_getStatus(reader, status);
+}
+
+// maximum record length of the channels, or of the device, used to size the arrays of event pools
+static size_t _getRecordLength(struct library_descr* descr, uint32_t rHandle, size_t nChannels) {
+	char value[256];
+	size_t recordLength = 0;
+	for (size_t ch = 0; ch < nChannels; ++ch) {
+		char path[64];
+		snprintf(path, sizeof(path), "../../ch/%zu/par/ChRecordLengthS", ch);
+		if (descr->GetValue(rHandle, path, value) != CAEN_FELib_Success)
+			break;
+		const size_t chRecordLength = (size_t)strtoull(value, NULL, 0);
+		if (chRecordLength > recordLength)
+			recordLength = chRecordLength;
+	}
+	if (recordLength == 0 && descr->GetValue(rHandle, "../../par/RecordLengthS", value) == CAEN_FELib_Success)
+		recordLength = (size_t)strtoull(value, NULL, 0);
+	return recordLength;
+}
+
+static int _createEventPool(uint64_t handle, size_t nSlots, const char* options, CAEN_FELib_EventPool_t** pool) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (pool == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint32_t rHandle = _rHandle(handle);
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, rHandle);
+	if (ep == NULL || ep->format.nFields == 0) {
+		_setLastLocalError("read data format not set: CAEN_FELib_SetReadDataFormat must be invoked before the creation of the pool");
+		return CAEN_FELib_InvalidParam;
+	}
+	// default size of array buffers, overridden by options
+	char value[256];
+	size_t maxArraySize = RECORDING_DEFAULT_MAX_ARRAY_SIZE;
+	if (descr->GetValue(rHandle, "../../par/MaxRawDataSize", value) == CAEN_FELib_Success)
+		maxArraySize = (size_t)strtoull(value, NULL, 0);
+	if (maxArraySize == 0)
+		maxArraySize = RECORDING_DEFAULT_MAX_ARRAY_SIZE;
+	const size_t recordLength = _getRecordLength(descr, rHandle, ep->format.nChannels);
+	return pool_create(pool, handle, ep->formatGeneration, &ep->format, nSlots, recordLength, maxArraySize, options);
+}
+
+int CAEN_FELIB_API CAEN_FELib_CreateEventPool(uint64_t handle, size_t nSlots, const char* options, CAEN_FELib_EventPool_t** pool) {
+	TRACED_CALL(CAEN_FELib_CreateEventPool, handle, NULL, _createEventPool(handle, nSlots, options, pool));
+}
+
+int CAEN_FELIB_API CAEN_FELib_DestroyEventPool(CAEN_FELib_EventPool_t* pool) {
+	if (pool == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	pool_destroy(pool);
+	return CAEN_FELib_Success;
+}
+
+static int _readDataSlot(CAEN_FELib_EventPool_t* pool, int timeout, CAEN_FELib_EventSlot_t** slot) {
+	const uint64_t handle = pool_getHandle(pool);
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	const struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->formatGeneration != pool_getFormatGeneration(pool)) {
+		_setLastLocalError("read data format changed since the creation of the pool");
+		return CAEN_FELib_CommandError;
+	}
+	CAEN_FELib_EventSlot_t* const s = pool_acquire(pool);
+	if (s == NULL) {
+		_setLastLocalError("no free slot: CAEN_FELib_ReleaseSlot must be invoked on processed events");
+		return CAEN_FELib_CommandError;
+	}
+	const int ret = _readDataArgs(handle, timeout, pool_getArgs(s));
+	if (ret != CAEN_FELib_Success) {
+		pool_release(pool, s);
+		return ret;
+	}
+	*slot = s;
+	return CAEN_FELib_Success;
+}
+
+int CAEN_FELIB_API CAEN_FELib_ReadDataSlot(CAEN_FELib_EventPool_t* pool, int timeout, CAEN_FELib_EventSlot_t** slot) {
+	if (pool == NULL || slot == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	TRACED_CALL(CAEN_FELib_ReadDataSlot, pool_getHandle(pool), NULL, _readDataSlot(pool, timeout, slot));
+}
+
+static int _createBatch(uint64_t handle, size_t capacity, const char* options, CAEN_FELib_Batch_t** batch) {
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	if (!_checkAPI(descr, LibraryAPIv0))
+		return _notSupported();
+	if (batch == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint32_t rHandle = _rHandle(handle);
+	struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, rHandle);
+	if (ep == NULL || ep->format.nFields == 0) {
+		_setLastLocalError("read data format not set: CAEN_FELib_SetReadDataFormat must be invoked before the creation of the batch");
+		return CAEN_FELib_InvalidParam;
+	}
+	// default size of arrays, as for event pools
+	char value[256];
+	size_t maxArraySize = RECORDING_DEFAULT_MAX_ARRAY_SIZE;
+	if (descr->GetValue(rHandle, "../../par/MaxRawDataSize", value) == CAEN_FELib_Success)
+		maxArraySize = (size_t)strtoull(value, NULL, 0);
+	if (maxArraySize == 0)
+		maxArraySize = RECORDING_DEFAULT_MAX_ARRAY_SIZE;
+	const size_t recordLength = _getRecordLength(descr, rHandle, ep->format.nChannels);
+	const int ret = batch_create(batch, handle, ep->formatGeneration, &ep->format, capacity, recordLength, maxArraySize, options);
+	if (ret == CAEN_FELib_Success)
+		_acquireConnection(handle);
+	return ret;
+}
+
+int CAEN_FELIB_API CAEN_FELib_CreateBatch(uint64_t handle, size_t capacity, const char* options, CAEN_FELib_Batch_t** batch) {
+	TRACED_CALL(CAEN_FELib_CreateBatch, handle, NULL, _createBatch(handle, capacity, options, batch));
+}
+
+int CAEN_FELIB_API CAEN_FELib_DestroyBatch(CAEN_FELib_Batch_t* batch) {
+	if (batch == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	_releaseConnection(batch_getHandle(batch));
+	batch_destroy(batch);
+	return CAEN_FELib_Success;
+}
+
+static int _readBatch(CAEN_FELib_Batch_t* batch, int timeout, struct ArrowArray* array, struct ArrowSchema* schema) {
+	const uint64_t handle = batch_getHandle(batch);
+	struct library_descr* const descr = _getLibDescr(handle);
+	if (descr == NULL)
+		return _invalidHandle();
+	const struct endpoint_descr* const ep = endpoint_find(&connectionDescr[_cHandle(handle)].endpoints, _rHandle(handle));
+	if (ep == NULL || ep->formatGeneration != batch_getFormatGeneration(batch)) {
+		_setLastLocalError("read data format changed since the creation of the batch");
+		return CAEN_FELib_CommandError;
+	}
+	return batch_read(batch, _readDataArgs, timeout, array, schema);
+}
+
+int CAEN_FELIB_API CAEN_FELib_ReadBatch(CAEN_FELib_Batch_t* batch, int timeout, struct ArrowArray* array, struct ArrowSchema* schema) {
+	if (batch == NULL || array == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	TRACED_CALL(CAEN_FELib_ReadBatch, batch_getHandle(batch), NULL, _readBatch(batch, timeout, array, schema));
+}
+
+int CAEN_FELIB_API CAEN_FELib_ReleaseSlot(CAEN_FELib_EventPool_t* pool, CAEN_FELib_EventSlot_t* slot) {
+	if (pool == NULL || slot == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	return pool_release(pool, slot);
+}
+
+static int _createMerger(const uint64_t* handles, size_t n, const char* options, CAEN_FELib_Merger_t** merger) {
+	if (handles == NULL || merger == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	if (n == 0) {
+		_setLastLocalError("no endpoints");
+		return CAEN_FELib_InvalidParam;
+	}
+	size_t nSlots;
+	int ret = merger_parseSlots(options, &nSlots);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < i; ++j)
+			if (handles[i] == handles[j]) {
+				_setLastLocalError("endpoint %zu is repeated", i);
+				return CAEN_FELib_InvalidParam;
+			}
+	struct merger_source* const sources = calloc(n, sizeof(*sources));
+	if (sources == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	// pool options are a subset of merger options
+	for (size_t i = 0; i < n; ++i) {
+		ret = _createEventPool(handles[i], nSlots, options, &sources[i].pool);
+		if (ret != CAEN_FELib_Success) {
+			while (i-- != 0)
+				pool_destroy(sources[i].pool);
+			free(sources);
+			return ret;
+		}
+		sources[i].handle = handles[i];
+		sources[i].cpus = connectionDescr[_cHandle(handles[i])].cpus;
+	}
+	ret = merger_create(merger, sources, n, _readDataArgs, options);
+	free(sources);
+	if (ret == CAEN_FELib_Success)
+		for (size_t i = 0; i < n; ++i)
+			_acquireConnection(handles[i]);
+	return ret;
+}
+
+int CAEN_FELIB_API CAEN_FELib_CreateMerger(const uint64_t* handles, size_t n, const char* options, CAEN_FELib_Merger_t** merger) {
+	TRACED_CALL(CAEN_FELib_CreateMerger, 0, NULL, _createMerger(handles, n, options, merger));
+}
+
+int CAEN_FELIB_API CAEN_FELib_DestroyMerger(CAEN_FELib_Merger_t* merger) {
+	if (merger == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	// reader threads are joined before the connections are released
+	merger_stop(merger);
+	for (size_t i = 0; i < merger_getSize(merger); ++i)
+		_releaseConnection(merger_getHandle(merger, i));
+	merger_destroy(merger);
+	return CAEN_FELib_Success;
+}
+
+int CAEN_FELIB_API CAEN_FELib_MergerReadData(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* event) {
+	if (merger == NULL || event == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	TRACED_CALL(CAEN_FELib_MergerReadData, 0, NULL, merger_readData(merger, timeout, event));
+}
+
+int CAEN_FELIB_API CAEN_FELib_MergerReadGroup(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* events, size_t size, size_t* count) {
+	if (merger == NULL || events == NULL || count == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	TRACED_CALL(CAEN_FELib_MergerReadGroup, 0, NULL, merger_readGroup(merger, timeout, events, size, count));
+}
+
+int CAEN_FELIB_API CAEN_FELib_MergerReleaseEvent(CAEN_FELib_Merger_t* merger, const CAEN_FELib_MergedEvent_t* event) {
+	if (merger == NULL || event == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	return merger_release(merger, event);
+}
+
+int CAEN_FELIB_API CAEN_FELib_ConvertWaveform(const uint16_t* samples, size_t n, const CAEN_FELib_WaveformConversion_t* conversion, float* out, size_t* outSize, float* baseline) {
+	if ((samples == NULL && n != 0) || conversion == NULL || (out == NULL && n != 0) || outSize == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	return waveform_convert(samples, n, conversion, out, outSize, baseline);
+}
+
+int CAEN_FELIB_API CAEN_FELib_SetTraceHook(CAEN_FELib_TraceHook_t pre, CAEN_FELib_TraceHook_t post, void* ctx) {
+	return trace_setHook(pre, post, ctx);
+}
+
+int CAEN_FELIB_API CAEN_FELib_SetTraceBuffer(size_t size) {
+	return trace_setBuffer(size);
+}
+
+int CAEN_FELIB_API CAEN_FELib_DumpTrace(const char* filename) {
+	return trace_dump(filename);
+}
+
+// perform here any library initialization.
+static void init_library(void) {
+	for (uint_fast16_t i = 0; i < ARRAY_SIZE(connectionDescr); ++i)
+		connectionDescr[i].lib = NULL;
+	for (uint_fast8_t i = 0; i < ARRAY_SIZE(libDescr); ++i)
+		libDescr[i] = NULL;
+}
+
+// perform here any library deinitialization.
+static void deinit_library(void) {
+	// watches sample values from open connections
+	watch_deinit();
+	group_deinit();
+	// endpoint threads (recordings, captures, fanouts, histograms) call the libraries: join them before unloading
+	for (uint_fast16_t i = 0; i < ARRAY_SIZE(connectionDescr); ++i)
+		if (_isValid(i))
+			endpoint_releaseAll(&connectionDescr[i].endpoints);
+	for (uint_fast16_t i = 0; i < ARRAY_SIZE(connectionDescr); ++i) {
+		if (_isValid(i)) {
+			const uint_fast8_t lHandle = connectionDescr[i].lHandle;
+			libDescr[lHandle]->nRef--;
+			_resetConnectionDescr(i);
+			_closeLibraryAndResetDevDescrIfLast(lHandle);
 		}
 	}
 	// at this poing libDescr has already been cleared.
+	stats_disable();
+	trace_deinit();
 }
 
 #ifdef _WIN32
@@ -0,0 +1,635 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		batch.c
+*	\brief		Columnar reader exported through the Arrow C data interface
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "batch.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc
+#endif
+
+#include "json.h"
+#include "utils.h"
+
+#define BATCH_MAX_CAPACITY		(UINT32_C(1) << 24)
+#define BATCH_MAX_NODES			(3 * FORMAT_MAX_FIELDS)	// up to three nested arrays per column
+#define BATCH_FORMAT_SIZE		24
+
+enum batch_layout {
+	BatchScalar,			// primitive array
+	BatchFixed,				// fixed-size list of count elements
+	BatchList,				// list of up to count elements
+	BatchChannelFixed,		// fixed-size list of a fixed-size list of count elements per channel
+	BatchChannelList,		// fixed-size list of a list of up to count elements per channel
+};
+
+struct batch_column {
+	enum batch_layout				layout;
+	size_t							count;		// maximum number of elements of an array
+	size_t							values;		// offset of the values on the arena data
+	size_t							offsets;	// offset of the int32 list offsets on the arena data
+	void**							channels;	// pointers passed to the read function, dim 2 only
+};
+
+/*
+ * Shared by the reader and by the exported arenas, so that arrays can be released after the
+ * destruction of the reader. A single spare arena is kept: arenas are exchanged only by the
+ * reading thread and by the releases of the consumer.
+ */
+struct batch_core {
+	uint32_t						refs;
+	struct batch_arena*				spare;
+	size_t							arenaSize;
+};
+
+struct batch_arena {
+	struct batch_core*				core;
+	uint32_t						refs;		// exported arrays not released yet
+	size_t							nNodes;
+	size_t							nPointers;
+	size_t							nBuffers;
+	struct ArrowArray				nodes[BATCH_MAX_NODES];
+	struct ArrowArray*				pointers[BATCH_MAX_NODES];
+	const void*						buffers[2 * BATCH_MAX_NODES + 1];
+};
+
+struct batch_schema {
+	uint32_t						refs;		// exported schemas not released yet
+	size_t							nNodes;
+	size_t							nPointers;
+	struct ArrowSchema				nodes[BATCH_MAX_NODES];
+	struct ArrowSchema*				pointers[BATCH_MAX_NODES];
+	char							formats[BATCH_MAX_NODES + 1][BATCH_FORMAT_SIZE];
+	char							names[FORMAT_MAX_FIELDS][FORMAT_NAME_SIZE];
+};
+
+struct CAEN_FELib_Batch {
+	uint64_t						handle;
+	uint32_t						formatGeneration;
+	struct format					fmt;
+	size_t							nChannels;
+	size_t							recordLength;
+	size_t							maxArraySize;
+	size_t							capacity;
+	struct batch_column				columns[FORMAT_MAX_FIELDS];
+	void**							channels;	// storage of the channel pointers of dim 2 columns
+	struct batch_core*				core;
+	int								pending;	// error code to return on the next read
+};
+
+static void* _alignedAlloc(size_t size) {
+#ifdef _WIN32
+	return _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+	void* p;
+	return (posix_memalign(&p, CACHE_LINE_SIZE, size) == 0) ? p : NULL;
+#endif
+}
+
+static void _alignedFree(void* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static size_t _align(size_t size) {
+	return (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+static size_t _min(size_t a, size_t b) {
+	return (a < b) ? a : b;
+}
+
+static const char* _arrowFormat(enum format_type type) {
+	switch (type) {
+	case FormatTypeU8:			return "C";
+	case FormatTypeU16:			return "S";
+	case FormatTypeU32:			return "I";
+	case FormatTypeU64:			return "L";
+	case FormatTypeI8:			return "c";
+	case FormatTypeI16:			return "s";
+	case FormatTypeI32:			return "i";
+	case FormatTypeI64:			return "l";
+	case FormatTypeChar:		return "c";
+	case FormatTypeBool:		return "C"; // Arrow booleans are bit-packed
+	case FormatTypeSizeT:		return (sizeof(size_t) == 8) ? "L" : "I";
+	case FormatTypePtrdiffT:	return (sizeof(ptrdiff_t) == 8) ? "l" : "i";
+	case FormatTypeFloat:		return "f";
+	case FormatTypeDouble:		return "g";
+	default:					return NULL;
+	}
+}
+
+static size_t _arrayCount(const CAEN_FELib_Batch_t* b, const struct format_field* f) {
+	if (f->dim == 1 && f->sizeField == FORMAT_SIZE_NCHANNELS)
+		return b->nChannels;
+	if (f->typeSize == 1 || b->recordLength == 0)
+		return b->maxArraySize / f->typeSize;
+	return b->recordLength;
+}
+
+static size_t _nArrays(const CAEN_FELib_Batch_t* b, const struct batch_column* c) {
+	return (c->layout == BatchChannelFixed || c->layout == BatchChannelList) ? b->nChannels : 1;
+}
+
+static bool _isList(const struct batch_column* c) {
+	return c->layout == BatchList || c->layout == BatchChannelList;
+}
+
+/*
+ * Layout of the columns on the arena data, each buffer aligned to a cache line. Return the size
+ * of the data, or 0 if too large.
+ */
+static size_t _layout(CAEN_FELib_Batch_t* b, bool fixed) {
+	size_t offset = 0;
+	for (size_t i = 0; i < b->fmt.nFields; ++i) {
+		const struct format_field* const f = &b->fmt.fields[i];
+		struct batch_column* const c = &b->columns[i];
+		switch (f->dim) {
+		case 0:
+			c->layout = BatchScalar;
+			c->count = 1;
+			break;
+		case 1:
+			// sizeField is negative also for arrays with an element per channel
+			c->layout = (fixed || f->sizeField < 0) ? BatchFixed : BatchList;
+			c->count = _arrayCount(b, f);
+			break;
+		default:
+			c->layout = (fixed || f->sizeField < 0) ? BatchChannelFixed : BatchChannelList;
+			c->count = _arrayCount(b, f);
+			break;
+		}
+		const size_t nArrays = b->capacity * _nArrays(b, c);
+		if (nArrays == 0 || c->count == 0 || c->count > (SIZE_MAX / 4) / nArrays / f->typeSize)
+			return 0;
+		// list offsets are int32
+		if (_isList(c) && nArrays * c->count > INT32_MAX)
+			return 0;
+		c->values = offset;
+		offset += _align(nArrays * c->count * f->typeSize);
+		if (_isList(c)) {
+			c->offsets = offset;
+			offset += _align((nArrays + 1) * sizeof(int32_t));
+		}
+		if (offset > SIZE_MAX / 4)
+			return 0;
+	}
+	return offset;
+}
+
+static int _parseOptions(const char* options, size_t* recordLength, size_t* maxArraySize, bool* fixed) {
+	if (options == NULL)
+		return CAEN_FELib_Success;
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid batch options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	const double r = json_number(json_get(root, "record_length"), (double)*recordLength);
+	const double m = json_number(json_get(root, "max_array_size"), (double)*maxArraySize);
+	const char* const lists = json_string(json_get(root, "lists"), "variable");
+	int ret = CAEN_FELib_Success;
+	if (strcmp(lists, "fixed") == 0) {
+		*fixed = true;
+	} else if (strcmp(lists, "variable") != 0) {
+		_setLastLocalError("invalid batch options: lists '%s' unknown", lists);
+		ret = CAEN_FELib_InvalidParam;
+	}
+	json_free(root);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (!(r >= 0 && r <= (double)(SIZE_MAX / 16)) || !(m >= 1 && m <= (double)(SIZE_MAX / 2))) {
+		_setLastLocalError("invalid batch options: value out of range");
+		return CAEN_FELib_InvalidParam;
+	}
+	*recordLength = (size_t)r;
+	*maxArraySize = (size_t)m;
+	return CAEN_FELib_Success;
+}
+
+static void _freeCore(struct batch_core* core) {
+	if (ATOMIC_FETCH_ADD(&core->refs, (uint32_t)-1) != 1)
+		return;
+	_alignedFree(core->spare);
+	free(core);
+}
+
+static struct batch_arena* _takeArena(struct batch_core* core) {
+	struct batch_arena* a = ATOMIC_LOAD_ACQUIRE(&core->spare);
+	while (a != NULL && !ATOMIC_CAS_WEAK(&core->spare, &a, NULL));
+	if (a == NULL) {
+		a = _alignedAlloc(core->arenaSize);
+		if (a == NULL)
+			return NULL;
+		a->core = core;
+	}
+	a->refs = 0;
+	a->nNodes = 0;
+	a->nPointers = 0;
+	a->nBuffers = 0;
+	return a;
+}
+
+// keep a as spare, or free it if there is already one
+static void _putArena(struct batch_arena* a) {
+	struct batch_core* const core = a->core;
+	struct batch_arena* expected = NULL;
+	while (!ATOMIC_CAS_WEAK(&core->spare, &expected, a)) {
+		if (expected != NULL) {
+			_alignedFree(a);
+			break;
+		}
+	}
+}
+
+static char* _arenaData(struct batch_arena* a) {
+	return (char*)a + _align(sizeof(*a));
+}
+
+int batch_create(CAEN_FELib_Batch_t** batch, uint64_t handle, uint32_t formatGeneration, const struct format* fmt, size_t capacity, size_t recordLength, size_t maxArraySize, const char* options) {
+	if (capacity == 0 || capacity > BATCH_MAX_CAPACITY) {
+		_setLastLocalError("invalid capacity %zu", capacity);
+		return CAEN_FELib_InvalidParam;
+	}
+	for (size_t i = 0; i < fmt->nFields; ++i) {
+		if (_arrowFormat(fmt->fields[i].type) == NULL) {
+			_setLastLocalError("type of field %s not supported by the Arrow format", fmt->fields[i].name);
+			return CAEN_FELib_InvalidParam;
+		}
+	}
+	bool fixed = false;
+	int ret = _parseOptions(options, &recordLength, &maxArraySize, &fixed);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	CAEN_FELib_Batch_t* const b = calloc(1, sizeof(*b));
+	if (b == NULL) {
+		_setLastLocalError("allocation failed");
+		return CAEN_FELib_InternalError;
+	}
+	b->handle = handle;
+	b->formatGeneration = formatGeneration;
+	b->nChannels = fmt->nChannels;
+	b->recordLength = recordLength;
+	b->maxArraySize = maxArraySize;
+	b->capacity = capacity;
+	b->pending = CAEN_FELib_Success;
+	ret = format_parse(&b->fmt, fmt->json, fmt->nChannels);
+	if (ret != CAEN_FELib_Success) {
+		free(b);
+		return ret;
+	}
+	const size_t dataSize = _layout(b, fixed);
+	if (dataSize == 0) {
+		_setLastLocalError("batch too large");
+		batch_destroy(b);
+		return CAEN_FELib_InvalidParam;
+	}
+	b->channels = calloc(b->fmt.nFields * b->nChannels + 1, sizeof(void*));
+	b->core = calloc(1, sizeof(*b->core));
+	if (b->channels == NULL || b->core == NULL) {
+		_setLastLocalError("allocation failed");
+		batch_destroy(b);
+		return CAEN_FELib_InternalError;
+	}
+	for (size_t i = 0; i < b->fmt.nFields; ++i)
+		b->columns[i].channels = b->channels + i * b->nChannels;
+	b->core->refs = 1;
+	b->core->arenaSize = _align(sizeof(struct batch_arena)) + dataSize;
+	// allocate the first arena now, to fail early
+	struct batch_arena* const a = _takeArena(b->core);
+	if (a == NULL) {
+		_setLastLocalError("allocation failed");
+		batch_destroy(b);
+		return CAEN_FELib_InternalError;
+	}
+	_putArena(a);
+	*batch = b;
+	return CAEN_FELib_Success;
+}
+
+void batch_destroy(CAEN_FELib_Batch_t* batch) {
+	if (batch == NULL)
+		return;
+	if (batch->core != NULL)
+		_freeCore(batch->core);
+	free(batch->channels);
+	format_clear(&batch->fmt);
+	free(batch);
+}
+
+uint64_t batch_getHandle(const CAEN_FELib_Batch_t* batch) {
+	return batch->handle;
+}
+
+uint32_t batch_getFormatGeneration(const CAEN_FELib_Batch_t* batch) {
+	return batch->formatGeneration;
+}
+
+// pointers to the buffers of the event at row
+static void _setArgs(const CAEN_FELib_Batch_t* b, char* data, size_t row, struct format_args* args) {
+	for (size_t i = 0; i < b->fmt.nFields; ++i) {
+		const struct batch_column* const c = &b->columns[i];
+		const size_t typeSize = b->fmt.fields[i].typeSize;
+		char* const values = data + c->values;
+		const int32_t* const offsets = (const int32_t*)(data + c->offsets);
+		size_t first;
+		switch (c->layout) {
+		case BatchScalar:
+		case BatchFixed:
+			args->ptr[i] = values + row * c->count * typeSize;
+			break;
+		case BatchList:
+			args->ptr[i] = values + (size_t)offsets[row] * typeSize;
+			break;
+		case BatchChannelFixed:
+		case BatchChannelList:
+			first = (c->layout == BatchChannelList) ? (size_t)offsets[row * b->nChannels] : row * b->nChannels * c->count;
+			for (size_t ch = 0; ch < b->nChannels; ++ch)
+				c->channels[ch] = values + (first + ch * c->count) * typeSize;
+			args->ptr[i] = c->channels;
+			break;
+		}
+	}
+}
+
+// set the list offsets of the event at row; the arrays of dim 2 lists are compacted in place
+static void _commitRow(const CAEN_FELib_Batch_t* b, char* data, size_t row, const struct format_args* args) {
+	for (size_t i = 0; i < b->fmt.nFields; ++i) {
+		const struct batch_column* const c = &b->columns[i];
+		const size_t typeSize = b->fmt.fields[i].typeSize;
+		char* const values = data + c->values;
+		int32_t* const offsets = (int32_t*)(data + c->offsets);
+		if (c->layout == BatchList) {
+			offsets[row + 1] = offsets[row] + (int32_t)_min(format_count(&b->fmt, args, i, 0), c->count);
+		} else if (c->layout == BatchChannelList) {
+			const size_t first = (size_t)offsets[row * b->nChannels];
+			for (size_t ch = 0; ch < b->nChannels; ++ch) {
+				const size_t n = _min(format_count(&b->fmt, args, i, ch), c->count);
+				const size_t src = first + ch * c->count;
+				const size_t dst = (size_t)offsets[row * b->nChannels + ch];
+				if (n != 0 && dst != src)
+					memmove(values + dst * typeSize, values + src * typeSize, n * typeSize);
+				offsets[row * b->nChannels + ch + 1] = (int32_t)(dst + n);
+			}
+		}
+	}
+}
+
+static void _releaseArray(struct ArrowArray* array) {
+	for (int64_t i = 0; i < array->n_children; ++i) {
+		struct ArrowArray* const child = array->children[i];
+		// children moved by the consumer have already a NULL release
+		if (child->release != NULL)
+			child->release(child);
+	}
+	struct batch_arena* const a = array->private_data;
+	array->release = NULL;
+	if (ATOMIC_FETCH_ADD(&a->refs, (uint32_t)-1) != 1)
+		return;
+	struct batch_core* const core = a->core;
+	_putArena(a);
+	_freeCore(core);
+}
+
+static void _initArray(struct batch_arena* a, struct ArrowArray* node, size_t length, const void* buffer, int64_t nChildren) {
+	memset(node, 0, sizeof(*node));
+	node->length = (int64_t)length;
+	node->buffers = &a->buffers[a->nBuffers];
+	// no validity bitmap: events have no null values
+	a->buffers[a->nBuffers++] = NULL;
+	node->n_buffers = 1;
+	if (buffer != NULL) {
+		a->buffers[a->nBuffers++] = buffer;
+		node->n_buffers = 2;
+	}
+	node->n_children = nChildren;
+	if (nChildren != 0) {
+		node->children = &a->pointers[a->nPointers];
+		a->nPointers += (size_t)nChildren;
+	}
+	node->release = _releaseArray;
+	node->private_data = a;
+	++a->refs;
+}
+
+static struct ArrowArray* _childArray(struct batch_arena* a, struct ArrowArray* parent, size_t index) {
+	struct ArrowArray* const child = &a->nodes[a->nNodes++];
+	parent->children[index] = child;
+	return child;
+}
+
+static void _exportArray(const CAEN_FELib_Batch_t* b, struct batch_arena* a, size_t rows, struct ArrowArray* array) {
+	char* const data = _arenaData(a);
+	struct ArrowArray root;
+	_initArray(a, &root, rows, NULL, (int64_t)b->fmt.nFields);
+	for (size_t i = 0; i < b->fmt.nFields; ++i) {
+		const struct batch_column* const c = &b->columns[i];
+		const void* const values = data + c->values;
+		const int32_t* const offsets = (const int32_t*)(data + c->offsets);
+		struct ArrowArray* const column = _childArray(a, &root, i);
+		struct ArrowArray* channels;
+		switch (c->layout) {
+		case BatchScalar:
+			_initArray(a, column, rows, values, 0);
+			break;
+		case BatchFixed:
+			_initArray(a, column, rows, NULL, 1);
+			_initArray(a, _childArray(a, column, 0), rows * c->count, values, 0);
+			break;
+		case BatchList:
+			_initArray(a, column, rows, offsets, 1);
+			_initArray(a, _childArray(a, column, 0), (size_t)offsets[rows], values, 0);
+			break;
+		case BatchChannelFixed:
+			_initArray(a, column, rows, NULL, 1);
+			channels = _childArray(a, column, 0);
+			_initArray(a, channels, rows * b->nChannels, NULL, 1);
+			_initArray(a, _childArray(a, channels, 0), rows * b->nChannels * c->count, values, 0);
+			break;
+		case BatchChannelList:
+			_initArray(a, column, rows, NULL, 1);
+			channels = _childArray(a, column, 0);
+			_initArray(a, channels, rows * b->nChannels, offsets, 1);
+			_initArray(a, _childArray(a, channels, 0), (size_t)offsets[rows * b->nChannels], values, 0);
+			break;
+		}
+	}
+	// release of the arena is possible only after the initialization of all the arrays
+	ATOMIC_FENCE_RELEASE();
+	*array = root;
+}
+
+static void _releaseSchema(struct ArrowSchema* schema) {
+	for (int64_t i = 0; i < schema->n_children; ++i) {
+		struct ArrowSchema* const child = schema->children[i];
+		if (child->release != NULL)
+			child->release(child);
+	}
+	struct batch_schema* const s = schema->private_data;
+	schema->release = NULL;
+	if (ATOMIC_FETCH_ADD(&s->refs, (uint32_t)-1) == 1)
+		free(s);
+}
+
+static void _initSchema(struct batch_schema* s, struct ArrowSchema* node, const char* name, int64_t nChildren, const char* format, ...) {
+	char* const f = s->formats[s->refs];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(f, BATCH_FORMAT_SIZE, format, args);
+	va_end(args);
+	memset(node, 0, sizeof(*node));
+	node->format = f;
+	node->name = name;
+	node->n_children = nChildren;
+	if (nChildren != 0) {
+		node->children = &s->pointers[s->nPointers];
+		s->nPointers += (size_t)nChildren;
+	}
+	node->release = _releaseSchema;
+	node->private_data = s;
+	++s->refs;
+}
+
+static struct ArrowSchema* _childSchema(struct batch_schema* s, struct ArrowSchema* parent, size_t index) {
+	struct ArrowSchema* const child = &s->nodes[s->nNodes++];
+	parent->children[index] = child;
+	return child;
+}
+
+static int _exportSchema(const CAEN_FELib_Batch_t* b, struct ArrowSchema* schema) {
+	struct batch_schema* const s = calloc(1, sizeof(*s));
+	if (s == NULL) {
+		_setLastLocalError("allocation failed");
+		return CAEN_FELib_InternalError;
+	}
+	struct ArrowSchema root;
+	_initSchema(s, &root, "", (int64_t)b->fmt.nFields, "+s");
+	for (size_t i = 0; i < b->fmt.nFields; ++i) {
+		const struct batch_column* const c = &b->columns[i];
+		const char* const format = _arrowFormat(b->fmt.fields[i].type);
+		char* const name = s->names[i];
+		strcpy(name, b->fmt.fields[i].name);
+		struct ArrowSchema* const column = _childSchema(s, &root, i);
+		struct ArrowSchema* channels;
+		switch (c->layout) {
+		case BatchScalar:
+			_initSchema(s, column, name, 0, "%s", format);
+			break;
+		case BatchFixed:
+			_initSchema(s, column, name, 1, "+w:%zu", c->count);
+			_initSchema(s, _childSchema(s, column, 0), "item", 0, "%s", format);
+			break;
+		case BatchList:
+			_initSchema(s, column, name, 1, "+l");
+			_initSchema(s, _childSchema(s, column, 0), "item", 0, "%s", format);
+			break;
+		case BatchChannelFixed:
+		case BatchChannelList:
+			_initSchema(s, column, name, 1, "+w:%zu", b->nChannels);
+			channels = _childSchema(s, column, 0);
+			if (c->layout == BatchChannelFixed)
+				_initSchema(s, channels, "item", 1, "+w:%zu", c->count);
+			else
+				_initSchema(s, channels, "item", 1, "+l");
+			_initSchema(s, _childSchema(s, channels, 0), "item", 0, "%s", format);
+			break;
+		}
+	}
+	ATOMIC_FENCE_RELEASE();
+	*schema = root;
+	return CAEN_FELib_Success;
+}
+
+int batch_read(CAEN_FELib_Batch_t* batch, batch_read_t read, int timeout, struct ArrowArray* array, struct ArrowSchema* schema) {
+	if (batch->pending != CAEN_FELib_Success) {
+		const int ret = batch->pending;
+		batch->pending = CAEN_FELib_Success;
+		return ret;
+	}
+	struct batch_arena* const a = _takeArena(batch->core);
+	if (a == NULL) {
+		_setLastLocalError("allocation failed");
+		return CAEN_FELib_InternalError;
+	}
+	char* const data = _arenaData(a);
+	for (size_t i = 0; i < batch->fmt.nFields; ++i)
+		if (_isList(&batch->columns[i]))
+			*(int32_t*)(data + batch->columns[i].offsets) = 0;
+	const uint64_t deadline = utils_now() + (uint64_t)timeout * UINT64_C(1000000);
+	struct format_args args;
+	size_t rows = 0;
+	int ret = CAEN_FELib_Success;
+	while (rows < batch->capacity) {
+		int t = timeout;
+		if (rows != 0 && timeout > 0) {
+			// the remaining time, then only the events already available
+			const uint64_t now = utils_now();
+			t = (now < deadline) ? (int)((deadline - now) / UINT64_C(1000000)) : 0;
+		}
+		_setArgs(batch, data, rows, &args);
+		ret = read(batch->handle, t, &args);
+		if (ret != CAEN_FELib_Success)
+			break;
+		_commitRow(batch, data, rows, &args);
+		++rows;
+	}
+	if (rows == 0) {
+		_putArena(a);
+		return ret;
+	}
+	if (ret != CAEN_FELib_Success && ret != CAEN_FELib_Timeout)
+		batch->pending = ret;
+	if (schema != NULL) {
+		ret = _exportSchema(batch, schema);
+		if (ret != CAEN_FELib_Success) {
+			// events are lost
+			_putArena(a);
+			return ret;
+		}
+	}
+	ATOMIC_FETCH_ADD(&batch->core->refs, 1);
+	_exportArray(batch, a, rows, array);
+	return CAEN_FELib_Success;
+}
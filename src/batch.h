@@ -0,0 +1,70 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		batch.h
+*	\brief		Columnar reader exported through the Arrow C data interface
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_BATCH_H_
+#define CAEN_INCLUDE_BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "format.h"
+
+/*
+ * Columnar reader: events are read directly into a structure of arrays, a column per field, and
+ * exported as an Arrow struct array (Arrow C data interface). Column buffers are allocated in an
+ * arena per batch; arenas are recycled when all the exported arrays have been released, possibly
+ * by another thread and after the destruction of the reader.
+ */
+
+// read an event on the buffers of args, with the semantic of CAEN_FELib_ReadData()
+typedef int (*batch_read_t)(uint64_t handle, int timeout, const struct format_args* args);
+
+/*
+ * Columns are sized for capacity events, with arrays sized as the buffers of an event pool (see
+ * pool_create()). recordLength and maxArraySize are defaults, overridden by the JSON options (see
+ * CAEN_FELib_CreateBatch()). Return a CAEN_FELib_ErrorCode, set last error on failure.
+ */
+int batch_create(CAEN_FELib_Batch_t** batch, uint64_t handle, uint32_t formatGeneration, const struct format* fmt, size_t capacity, size_t recordLength, size_t maxArraySize, const char* options);
+void batch_destroy(CAEN_FELib_Batch_t* batch);
+
+uint64_t batch_getHandle(const CAEN_FELib_Batch_t* batch);
+uint32_t batch_getFormatGeneration(const CAEN_FELib_Batch_t* batch);
+
+// see CAEN_FELib_ReadBatch(); schema can be NULL
+int batch_read(CAEN_FELib_Batch_t* batch, batch_read_t read, int timeout, struct ArrowArray* array, struct ArrowSchema* schema);
+
+#endif /* CAEN_INCLUDE_BATCH_H_ */
@@ -0,0 +1,204 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		capture.c
+*	\brief		Capture of read data to file
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "capture.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CAEN_FELib.h"
+#include "evfile.h"
+
+#define CAPTURE_FILE_BUFFER_SIZE	(UINT32_C(1) << 20)
+struct capture {
+	FILE*							file;
+	char*							fileBuffer;
+	uint64_t						startTime;
+	uint64_t						offset;				// file offset of the next record
+	const struct format*			fmt;				// last format, owned by the endpoint
+	struct evfile_index				index;
+	void*							buffer;				// event serialization buffer
+	size_t							bufferSize;
+	int								error;				// first error, the capture is aborted
+	char							errorDescription[256];
+};
+
+uint_fast32_t captureCount;
+
+static int _abort(struct capture* capture, int error, const char* description) {
+	capture->error = error;
+	snprintf(capture->errorDescription, ARRAY_SIZE(capture->errorDescription), "capture aborted: %s", description);
+	return error;
+}
+
+static int _write(struct capture* capture, enum evfile_record_type type, const void* payload1, size_t size1, const void* payload2, size_t size2) {
+	static const char zeros[EVFILE_ALIGNMENT];
+	if (capture->error != CAEN_FELib_Success)
+		return capture->error;
+	const size_t size = size1 + size2;
+	if (size > UINT32_MAX)
+		return _abort(capture, CAEN_FELib_GenericError, "event too large");
+	const struct evfile_record record = {
+		.type = (uint32_t)type,
+		.size = (uint32_t)size,
+		.time = utils_now() - capture->startTime,
+	};
+	const size_t padding = evfile_padding(size);
+	if (fwrite(&record, sizeof(record), 1, capture->file) != 1 ||
+		(size1 != 0 && fwrite(payload1, size1, 1, capture->file) != 1) ||
+		(size2 != 0 && fwrite(payload2, size2, 1, capture->file) != 1) ||
+		(padding != 0 && fwrite(zeros, padding, 1, capture->file) != 1))
+		return _abort(capture, CAEN_FELib_GenericError, strerror(errno));
+	if (type != EvfileRecordIndex && !evfile_indexOnRecord(&capture->index, capture->offset, &record, capture->fmt, payload1))
+		return _abort(capture, CAEN_FELib_InternalError, "index allocation failed");
+	capture->offset += sizeof(record) + size + padding;
+	return CAEN_FELib_Success;
+}
+
+// index and trailer, see evfile.h
+static int _writeIndex(struct capture* capture) {
+	const struct evfile_trailer trailer = {
+		.indexOffset = capture->offset,
+		.nChunks = capture->index.nChunks,
+		.magic = EVFILE_TRAILER_MAGIC,
+	};
+	const int ret = _write(capture, EvfileRecordIndex, capture->index.chunks, capture->index.nChunks * sizeof(struct evfile_chunk), NULL, 0);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (fwrite(&trailer, sizeof(trailer), 1, capture->file) != 1)
+		return _abort(capture, CAEN_FELib_GenericError, strerror(errno));
+	return CAEN_FELib_Success;
+}
+
+static void _free(struct capture* capture) {
+	evfile_indexClear(&capture->index);
+	free(capture->fileBuffer);
+	free(capture->buffer);
+	free(capture);
+}
+
+int capture_start(struct capture** capture, const char* filename, const char* source, const char* endpoint, const struct format* fmt) {
+	if (*capture != NULL) {
+		_setLastLocalError("capture already in progress");
+		return CAEN_FELib_CommandError;
+	}
+	struct capture* const c = calloc(1, sizeof(*c));
+	if (c == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	evfile_indexInit(&c->index);
+	c->file = fopen(filename, "wb");
+	if (c->file == NULL) {
+		_setLastLocalError("cannot open '%s': %s", filename, strerror(errno));
+		_free(c);
+		return CAEN_FELib_InvalidParam;
+	}
+	c->fileBuffer = malloc(CAPTURE_FILE_BUFFER_SIZE);
+	if (c->fileBuffer != NULL)
+		setvbuf(c->file, c->fileBuffer, _IOFBF, CAPTURE_FILE_BUFFER_SIZE);
+	c->startTime = utils_now();
+	struct evfile_header header;
+	evfile_initHeader(&header, source, endpoint);
+	int ret = CAEN_FELib_Success;
+	if (fwrite(&header, sizeof(header), 1, c->file) != 1)
+		ret = _abort(c, CAEN_FELib_GenericError, strerror(errno));
+	c->offset = sizeof(header);
+	if (ret == CAEN_FELib_Success)
+		ret = capture_onFormat(c, fmt);
+	if (ret != CAEN_FELib_Success) {
+		_setLastLocalError("%s", c->errorDescription);
+		fclose(c->file);
+		_free(c);
+		remove(filename);
+		return ret;
+	}
+	*capture = c;
+	ATOMIC_FETCH_ADD(&captureCount, 1);
+	return CAEN_FELib_Success;
+}
+
+int capture_stop(struct capture** capture) {
+	struct capture* const c = *capture;
+	if (c == NULL)
+		return CAEN_FELib_Success;
+	*capture = NULL;
+	ATOMIC_FETCH_ADD(&captureCount, (uint_fast32_t)-1);
+	int ret = c->error;
+	if (ret == CAEN_FELib_Success)
+		ret = _writeIndex(c);
+	if (ret != CAEN_FELib_Success) {
+		_setLastLocalError("%s", c->errorDescription);
+		fclose(c->file);
+	} else if (fclose(c->file) != 0) {
+		_setLastLocalError("capture close failed: %s", strerror(errno));
+		ret = CAEN_FELib_GenericError;
+	}
+	_free(c);
+	return ret;
+}
+
+int capture_onFormat(struct capture* capture, const struct format* fmt) {
+	if (fmt->nFields == 0 || !format_isSizeable(fmt))
+		return _abort(capture, CAEN_FELib_InvalidParam, "size of arrays of the read data format cannot be determined");
+	const struct evfile_format payload = {
+		.nChannels = (uint32_t)fmt->nChannels,
+	};
+	capture->fmt = fmt;
+	evfile_indexOnFormat(&capture->index, capture->offset, fmt);
+	return _write(capture, EvfileRecordFormat, &payload, sizeof(payload), fmt->json, strlen(fmt->json) + 1);
+}
+
+int capture_onEvent(struct capture* capture, const struct format* fmt, const struct format_args* args) {
+	if (capture->error != CAEN_FELib_Success)
+		return capture->error;
+	const size_t size = evfile_packedSize(fmt, args);
+	if (size > capture->bufferSize) {
+		void* const buffer = realloc(capture->buffer, size);
+		if (buffer == NULL)
+			return _abort(capture, CAEN_FELib_InternalError, "realloc failed");
+		capture->buffer = buffer;
+		capture->bufferSize = size;
+	}
+	evfile_pack(fmt, args, capture->buffer);
+	return _write(capture, EvfileRecordEvent, capture->buffer, size, NULL, 0);
+}
+
+int capture_onStop(struct capture* capture) {
+	return _write(capture, EvfileRecordStop, NULL, 0, NULL, 0);
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		capture.h
+*	\brief		Capture of read data to file
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_CAPTURE_H_
+#define CAEN_INCLUDE_CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "format.h"
+#include "utils.h"
+
+// number of captures in progress
+extern uint_fast32_t captureCount;
+
+static inline bool capture_isActive(void) {
+	return UNLIKELY(ATOMIC_LOAD_RELAXED(&captureCount) != 0);
+}
+
+struct capture;
+
+// return a CAEN_FELib_ErrorCode, set last error on failure
+int capture_start(struct capture** capture, const char* filename, const char* source, const char* endpoint, const struct format* fmt);
+int capture_stop(struct capture** capture);
+
+/*
+ * Functions invoked on the reading thread. Errors do not set last error: the capture is aborted
+ * and the error is returned by capture_stop().
+ */
+int capture_onFormat(struct capture* capture, const struct format* fmt);
+int capture_onEvent(struct capture* capture, const struct format* fmt, const struct format_args* args);
+int capture_onStop(struct capture* capture);
+
+#endif /* CAEN_INCLUDE_CAPTURE_H_ */
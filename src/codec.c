@@ -0,0 +1,194 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		codec.c
+*	\brief		Compression codecs of event files
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "codec.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#include "utils.h"
+
+struct codec {
+	enum codec_type			type;
+	int						level;
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx*				zstd;
+#endif
+};
+
+static const char* const names[] = {
+	[CodecNone]				= "none",
+	[CodecLz4]				= "lz4",
+	[CodecZstd]				= "zstd",
+};
+
+int codec_fromName(const char* name) {
+	for (size_t i = 0; i < ARRAY_SIZE(names); ++i)
+		if (strcmp(name, names[i]) == 0)
+			return (int)i;
+	return -1;
+}
+
+const char* codec_name(enum codec_type type) {
+	return ((size_t)type < ARRAY_SIZE(names)) ? names[type] : "unknown";
+}
+
+bool codec_isAvailable(enum codec_type type) {
+	switch (type) {
+	case CodecNone:
+		return true;
+#ifdef HAVE_LZ4
+	case CodecLz4:
+		return true;
+#endif
+#ifdef HAVE_ZSTD
+	case CodecZstd:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+int codec_defaultLevel(enum codec_type type) {
+	switch (type) {
+	case CodecZstd:
+		return 3; // ZSTD_CLEVEL_DEFAULT
+	default:
+		return 1;
+	}
+}
+
+struct codec* codec_create(enum codec_type type, int level) {
+	struct codec* const codec = calloc(1, sizeof(*codec));
+	if (codec == NULL)
+		return NULL;
+	codec->type = type;
+	codec->level = level;
+#ifdef HAVE_ZSTD
+	if (type == CodecZstd && (codec->zstd = ZSTD_createCCtx()) == NULL) {
+		free(codec);
+		return NULL;
+	}
+#endif
+	return codec;
+}
+
+void codec_destroy(struct codec* codec) {
+	if (codec == NULL)
+		return;
+#ifdef HAVE_ZSTD
+	ZSTD_freeCCtx(codec->zstd);
+#endif
+	free(codec);
+}
+
+size_t codec_bound(const struct codec* codec, size_t size) {
+	switch (codec->type) {
+#ifdef HAVE_LZ4
+	case CodecLz4:
+		return (size <= LZ4_MAX_INPUT_SIZE) ? (size_t)LZ4_compressBound((int)size) : 0;
+#endif
+#ifdef HAVE_ZSTD
+	case CodecZstd:
+		return ZSTD_compressBound(size);
+#endif
+	default:
+		return size;
+	}
+}
+
+size_t codec_compress(struct codec* codec, const void* src, size_t size, void* dst, size_t capacity) {
+	switch (codec->type) {
+#ifdef HAVE_LZ4
+	case CodecLz4: {
+		if (size > LZ4_MAX_INPUT_SIZE)
+			return 0;
+		const int dstCapacity = (capacity > INT_MAX) ? INT_MAX : (int)capacity;
+		int ret;
+		// levels below LZ4HC_CLEVEL_MIN use the fast compressor, with acceleration for negative levels
+		if (codec->level >= LZ4HC_CLEVEL_MIN)
+			ret = LZ4_compress_HC(src, dst, (int)size, dstCapacity, codec->level);
+		else
+			ret = LZ4_compress_fast(src, dst, (int)size, dstCapacity, (codec->level < 1) ? 1 - codec->level : 1);
+		return (ret > 0) ? (size_t)ret : 0;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case CodecZstd: {
+		const size_t ret = ZSTD_compressCCtx(codec->zstd, dst, capacity, src, size, codec->level);
+		return ZSTD_isError(ret) ? 0 : ret;
+	}
+#endif
+	default:
+		// parameters are unused if no codec is available
+		(void)src;
+		(void)size;
+		(void)dst;
+		(void)capacity;
+		return 0;
+	}
+}
+
+bool codec_decompress(enum codec_type type, const void* src, size_t size, void* dst, size_t rawSize) {
+	switch (type) {
+#ifdef HAVE_LZ4
+	case CodecLz4:
+		if (size > INT_MAX || rawSize > INT_MAX)
+			return false;
+		return LZ4_decompress_safe(src, dst, (int)size, (int)rawSize) == (int)rawSize;
+#endif
+#ifdef HAVE_ZSTD
+	case CodecZstd:
+		return ZSTD_decompress(dst, rawSize, src, size) == rawSize;
+#endif
+	default:
+		(void)src;
+		(void)size;
+		(void)dst;
+		(void)rawSize;
+		return false;
+	}
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		codec.h
+*	\brief		Compression codecs of event files
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_CODEC_H_
+#define CAEN_INCLUDE_CODEC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Compression codecs of event files, available if the library has been built with the
+ * corresponding dependency (see configure --without-zstd and --without-lz4).
+ */
+
+enum codec_type {
+	CodecNone				= 0,
+	CodecLz4				= 1,
+	CodecZstd				= 2,
+};
+
+struct codec;
+
+// return -1 if unknown
+int codec_fromName(const char* name);
+const char* codec_name(enum codec_type type);
+bool codec_isAvailable(enum codec_type type);
+int codec_defaultLevel(enum codec_type type);
+
+/*
+ * Compressor with its own state, to be used by a thread at a time. Negative levels are faster,
+ * higher levels compress more. Return NULL on allocation failure.
+ */
+struct codec* codec_create(enum codec_type type, int level);
+void codec_destroy(struct codec* codec);
+
+// maximum compressed size of size bytes
+size_t codec_bound(const struct codec* codec, size_t size);
+
+// return the compressed size, 0 on failure
+size_t codec_compress(struct codec* codec, const void* src, size_t size, void* dst, size_t capacity);
+
+// return false unless exactly rawSize bytes are decompressed
+bool codec_decompress(enum codec_type type, const void* src, size_t size, void* dst, size_t rawSize);
+
+#endif /* CAEN_INCLUDE_CODEC_H_ */
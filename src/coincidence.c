@@ -0,0 +1,224 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		coincidence.c
+*	\brief		Coincidence filter on time-ordered events
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "coincidence.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define COINCIDENCE_SCAN_BLOCK		16
+
+struct coincidence {
+	uint64_t						window;			// timestamp units
+	size_t							multiplicity;
+	size_t							nBoards;
+	uint64_t*						masks;			// channels of each board
+	uint64_t*						seen;			// sources of the group being evaluated, a bit per channel of each board
+	// pending events: timestamps are on a separate array, contiguous for the window scan
+	CAEN_FELib_MergedEvent_t*		events;
+	uint64_t*						timestamps;
+	uint64_t*						channels;
+	size_t							size;
+	size_t							capacity;
+	size_t*							sizes;			// pending events of each board
+};
+
+static bool _parseMask(const struct json* channels, uint64_t* mask) {
+	if (channels == NULL || channels->type == JsonNull) {
+		*mask = UINT64_MAX;
+		return true;
+	}
+	if (channels->type != JsonArray)
+		return false;
+	*mask = 0;
+	for (const struct json* ch = channels->child; ch != NULL; ch = ch->next) {
+		if (ch->type != JsonNumber || !(ch->number >= 0 && ch->number < COINCIDENCE_MAX_CHANNELS))
+			return false;
+		*mask |= UINT64_C(1) << (unsigned)ch->number;
+	}
+	return true;
+}
+
+int coincidence_create(struct coincidence** coincidence, const struct json* options, size_t nBoards, size_t capacity) {
+	*coincidence = NULL;
+	if (options == NULL)
+		return CAEN_FELib_Success;
+	if (options->type != JsonObject) {
+		_setLastLocalError("invalid merger options: coincidence is not an object");
+		return CAEN_FELib_InvalidParam;
+	}
+	const double window = json_number(json_get(options, "window"), 0.);
+	const double multiplicity = json_number(json_get(options, "multiplicity"), 2.);
+	if (!(window >= 0 && window < (double)UINT64_MAX) || !(multiplicity >= 1 && multiplicity <= (double)(nBoards * COINCIDENCE_MAX_CHANNELS))) {
+		_setLastLocalError("invalid merger options: coincidence value out of range");
+		return CAEN_FELib_InvalidParam;
+	}
+	const struct json* const channels = json_get(options, "channels");
+	if (channels != NULL && (channels->type != JsonArray || json_size(channels) != nBoards)) {
+		_setLastLocalError("invalid merger options: coincidence channels must be an array of a list of channels per endpoint");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct coincidence* const c = calloc(1, sizeof(*c));
+	if (c == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	c->window = (uint64_t)window;
+	c->multiplicity = (size_t)multiplicity;
+	c->nBoards = nBoards;
+	c->capacity = capacity;
+	c->masks = calloc(nBoards, sizeof(*c->masks));
+	c->seen = calloc(nBoards, sizeof(*c->seen));
+	c->sizes = calloc(nBoards, sizeof(*c->sizes));
+	c->events = calloc(capacity, sizeof(*c->events));
+	c->timestamps = calloc(capacity, sizeof(*c->timestamps));
+	c->channels = calloc(capacity, sizeof(*c->channels));
+	if (c->masks == NULL || c->seen == NULL || c->sizes == NULL || c->events == NULL || c->timestamps == NULL || c->channels == NULL) {
+		coincidence_destroy(c);
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	const struct json* board = (channels != NULL) ? channels->child : NULL;
+	for (size_t i = 0; i < nBoards; ++i) {
+		if (!_parseMask(board, &c->masks[i])) {
+			coincidence_destroy(c);
+			_setLastLocalError("invalid merger options: invalid coincidence channels of endpoint %zu", i);
+			return CAEN_FELib_InvalidParam;
+		}
+		if (board != NULL)
+			board = board->next;
+	}
+	*coincidence = c;
+	return CAEN_FELib_Success;
+}
+
+void coincidence_destroy(struct coincidence* coincidence) {
+	if (coincidence == NULL)
+		return;
+	free(coincidence->masks);
+	free(coincidence->seen);
+	free(coincidence->sizes);
+	free(coincidence->events);
+	free(coincidence->timestamps);
+	free(coincidence->channels);
+	free(coincidence);
+}
+
+bool coincidence_accepts(const struct coincidence* coincidence, size_t board, uint64_t channel) {
+	return channel < COINCIDENCE_MAX_CHANNELS && (coincidence->masks[board] & (UINT64_C(1) << channel));
+}
+
+void coincidence_push(struct coincidence* coincidence, const CAEN_FELib_MergedEvent_t* event, uint64_t channel) {
+	const size_t i = coincidence->size++;
+	coincidence->events[i] = *event;
+	coincidence->timestamps[i] = event->timestamp;
+	coincidence->channels[i] = channel;
+	++coincidence->sizes[event->board];
+}
+
+/*
+ * Number of leading timestamps within the window from the first one: an older timestamp, possible
+ * if the merger returned an event out of order, wraps around and closes the window. The scan is
+ * done on blocks without branches, so that compilers can vectorize it, and stops at the first
+ * block past the window.
+ */
+static size_t _countWithin(const uint64_t* timestamps, size_t n, uint64_t window) {
+	const uint64_t first = timestamps[0];
+	size_t i = 0;
+	while (i < n) {
+		const size_t size = (n - i < COINCIDENCE_SCAN_BLOCK) ? n - i : COINCIDENCE_SCAN_BLOCK;
+		size_t block = 0;
+		for (size_t j = 0; j < size; ++j)
+			block += (timestamps[i + j] - first <= window);
+		if (block != size)
+			break;
+		i += size;
+	}
+	while (i < n && timestamps[i] - first <= window)
+		++i;
+	return i;
+}
+
+static size_t _countSources(struct coincidence* coincidence, size_t n) {
+	size_t sources = 0;
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t* const seen = &coincidence->seen[coincidence->events[i].board];
+		const uint64_t bit = UINT64_C(1) << coincidence->channels[i];
+		sources += ((*seen & bit) == 0);
+		*seen |= bit;
+	}
+	for (size_t i = 0; i < n; ++i)
+		coincidence->seen[coincidence->events[i].board] = 0;
+	return sources;
+}
+
+enum coincidence_result coincidence_next(struct coincidence* coincidence, bool flush, size_t* count) {
+	const size_t size = coincidence->size;
+	if (size == 0)
+		return CoincidenceNeedMore;
+	const size_t n = _countWithin(coincidence->timestamps, size, coincidence->window);
+	// the window is complete if a later event is pending
+	if (n == size && !flush)
+		return CoincidenceNeedMore;
+	if (_countSources(coincidence, n) < coincidence->multiplicity)
+		return CoincidenceReject;
+	*count = n;
+	return CoincidenceMatch;
+}
+
+const CAEN_FELib_MergedEvent_t* coincidence_events(const struct coincidence* coincidence) {
+	return coincidence->events;
+}
+
+size_t coincidence_size(const struct coincidence* coincidence) {
+	return coincidence->size;
+}
+
+size_t coincidence_sizeOf(const struct coincidence* coincidence, size_t board) {
+	return coincidence->sizes[board];
+}
+
+void coincidence_consume(struct coincidence* coincidence, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		--coincidence->sizes[coincidence->events[i].board];
+	const size_t left = coincidence->size - count;
+	memmove(coincidence->events, coincidence->events + count, left * sizeof(*coincidence->events));
+	memmove(coincidence->timestamps, coincidence->timestamps + count, left * sizeof(*coincidence->timestamps));
+	memmove(coincidence->channels, coincidence->channels + count, left * sizeof(*coincidence->channels));
+	coincidence->size = left;
+}
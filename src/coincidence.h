@@ -0,0 +1,88 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		coincidence.h
+*	\brief		Coincidence filter on time-ordered events
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_COINCIDENCE_H_
+#define CAEN_INCLUDE_COINCIDENCE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "json.h"
+
+/*
+ * Coincidence filter on a stream of events sorted by timestamp. A group is opened by the oldest
+ * pending event and contains the following events within the window; it matches if its events
+ * come from at least multiplicity distinct sources, where a source is a channel of a board (or
+ * a board, if the format has no CHANNEL field). If a group does not match, only the event that
+ * opened it is rejected, and the next event opens a new group.
+ */
+
+#define COINCIDENCE_MAX_CHANNELS	64
+
+enum coincidence_result {
+	CoincidenceNeedMore,		// the window of the oldest event is not complete
+	CoincidenceMatch,			// the oldest events are a matching group
+	CoincidenceReject,			// the oldest event does not open a matching group
+};
+
+struct coincidence;
+
+/*
+ * Parse the "coincidence" member of merger options, set *coincidence to NULL if not present.
+ * capacity is the maximum number of pending events. Return a CAEN_FELib_ErrorCode, set last error on failure.
+ */
+int coincidence_create(struct coincidence** coincidence, const struct json* options, size_t nBoards, size_t capacity);
+void coincidence_destroy(struct coincidence* coincidence);
+
+// false if the channel of the board is excluded by the channel masks
+bool coincidence_accepts(const struct coincidence* coincidence, size_t board, uint64_t channel);
+
+void coincidence_push(struct coincidence* coincidence, const CAEN_FELib_MergedEvent_t* event, uint64_t channel);
+
+// if flush is true, the window of the oldest event is considered complete; count is set on CoincidenceMatch
+enum coincidence_result coincidence_next(struct coincidence* coincidence, bool flush, size_t* count);
+
+// pending events, oldest first
+const CAEN_FELib_MergedEvent_t* coincidence_events(const struct coincidence* coincidence);
+size_t coincidence_size(const struct coincidence* coincidence);
+size_t coincidence_sizeOf(const struct coincidence* coincidence, size_t board);
+
+// remove the oldest count events
+void coincidence_consume(struct coincidence* coincidence, size_t count);
+
+#endif /* CAEN_INCLUDE_COINCIDENCE_H_ */
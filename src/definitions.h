@@ -47,6 +47,8 @@
 #endif
 
 #include "CAEN_FELib.h"
+#include "numa.h"
+#include "utils.h"
 
 typedef int (CAEN_FELIB_API* fpGetLibInfo_t)(char* jsonString, size_t size);
 typedef int (CAEN_FELIB_API* fpGetLibVersion_t)(char version[16]);
@@ -68,6 +70,14 @@ typedef int (CAEN_FELIB_API* fpSetUserRegister_t)(uint32_t handle, uint32_t addr
 typedef int (CAEN_FELIB_API* fpSetReadDataFormat_t)(uint32_t handle, const char* jsonString);
 typedef int (CAEN_FELIB_API* fpReadDataV_t)(uint32_t handle, int timeout, va_list args);
 typedef int (CAEN_FELIB_API* fpHasData_t)(uint32_t handle, int timeout);
+// API v2, handles of nodes are library handles stored in 64-bit fields
+typedef int (CAEN_FELIB_API* fpWalkTree_t)(uint32_t handle, const char* path, int maxDepth, CAEN_FELib_TreeNode_t* nodes, size_t size);
+/*
+ * Optional on any API version: the ReadDataV or HasData pending on handle, or the next one if
+ * none, returns CAEN_FELib_Interrupted without consuming its arguments. Interrupts not consumed
+ * yet are coalesced, as on an eventfd. Must be callable from any thread.
+ */
+typedef int (CAEN_FELIB_API* fpInterrupt_t)(uint32_t handle);
 
 #ifdef _WIN32
 typedef HMODULE						dlHandle_t;
@@ -77,22 +87,37 @@ typedef	void*						dlHandle_t;
 typedef void*						dlSymbol_t;
 #endif
 
+struct endpoint_descr;
+
+/*
+ * Slot of an open connection. Members used on dispatch are on the first cache line,
+ * the slot is aligned and sized to cache lines.
+ */
 struct connection_descr {
-	char							arg[128];
+	ALIGNED(CACHE_LINE_SIZE) struct library_descr*	lib;	// function table, NULL if the slot is free
+	uint64_t						handle;				// handle returned by CAEN_FELib_Open
 	uint_fast8_t					lHandle;
+	char							arg[128];
+	struct endpoint_descr*			endpoints;			// see endpoint.h
+	struct numa_cpus				cpus;				// affinity of threads created for the connection, see CAEN_FELib_SetThreadAffinity
+	uint32_t						users;				// mergers, watches and batches on the connection, that prevent CAEN_FELib_Close
 };
 
 enum library_api {
 	LibraryAPIUnknown,
 	LibraryAPIv0,
 	LibraryAPIv1,
+	LibraryAPIv2,
 };
 
+/*
+ * Function table of a loaded library, not modified while connections refer to it
+ * (except nRef, on open and close). Members used by the readout loop come first.
+ */
 struct library_descr {
-	char							name[16];
 	enum library_api				APIVersion;
-	uint_fast16_t					nRef;
-	dlHandle_t						dlHandle;
+	fpReadDataV_t					ReadDataV;
+	fpHasData_t						HasData;			// API v1
 	// API v0
 	fpGetLibInfo_t					GetLibInfo;
 	fpGetLibVersion_t				GetLibVersion;
@@ -112,9 +137,13 @@ struct library_descr {
 	fpGetUserRegister_t				GetUserRegister;
 	fpSetUserRegister_t				SetUserRegister;
 	fpSetReadDataFormat_t			SetReadDataFormat;
-	fpReadDataV_t					ReadDataV;
-	// API v1
-	fpHasData_t						HasData;
+	// API v2
+	fpWalkTree_t					WalkTree;
+	// optional, NULL if not exported
+	fpInterrupt_t					Interrupt;
+	char							name[16];
+	uint_fast16_t					nRef;
+	dlHandle_t						dlHandle;
 };
 
 #endif /* CAEN_INCLUDE_DEFINITIONS_H_ */
@@ -0,0 +1,98 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		endpoint.c
+*	\brief		Per-endpoint state
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "endpoint.h"
+
+#include <stdlib.h>
+
+#include "stats.h"
+#include "utils.h"
+
+static mutex_t endpointMutex = MUTEX_INITIALIZER;
+
+struct endpoint_descr* endpoint_find(struct endpoint_descr* const* list, uint32_t rHandle) {
+	for (struct endpoint_descr* ep = ATOMIC_LOAD_ACQUIRE(list); ep != NULL; ep = ep->next)
+		if (ep->rHandle == rHandle)
+			return ep;
+	return NULL;
+}
+
+struct endpoint_descr* endpoint_get(struct endpoint_descr** list, uint32_t rHandle) {
+	struct endpoint_descr* ep = endpoint_find(list, rHandle);
+	if (LIKELY(ep != NULL))
+		return ep;
+	mutex_lock(&endpointMutex);
+	// check again, another thread could have created it
+	ep = endpoint_find(list, rHandle);
+	if (ep == NULL) {
+		ep = calloc(1, sizeof(*ep));
+		if (ep != NULL) {
+			ep->rHandle = rHandle;
+			ep->next = *list;
+			ATOMIC_STORE_RELEASE(list, ep);
+		}
+	}
+	mutex_unlock(&endpointMutex);
+	if (ep == NULL)
+		_setLastLocalError("endpoint allocation failed");
+	return ep;
+}
+
+void endpoint_stopRecordings(struct endpoint_descr* const* list) {
+	for (struct endpoint_descr* ep = ATOMIC_LOAD_ACQUIRE(list); ep != NULL; ep = ep->next)
+		recording_stop(&ep->recording);
+}
+
+void endpoint_releaseAll(struct endpoint_descr** list) {
+	mutex_lock(&endpointMutex);
+	struct endpoint_descr* ep = *list;
+	*list = NULL;
+	mutex_unlock(&endpointMutex);
+	while (ep != NULL) {
+		struct endpoint_descr* const next = ep->next;
+		if (ep->statsGeneration == statsGeneration)
+			stats_onClose(ep->stats);
+		recording_stop(&ep->recording);
+		capture_stop(&ep->capture);
+		fanout_stop(&ep->fanout);
+		histogram_stop(&ep->histogram);
+		reduction_destroy(&ep->reduction);
+		wait_destroy(&ep->wait);
+		format_clear(&ep->format);
+		free(ep);
+		ep = next;
+	}
+}
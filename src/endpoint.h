@@ -0,0 +1,86 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		endpoint.h
+*	\brief		Per-endpoint state
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_ENDPOINT_H_
+#define CAEN_INCLUDE_ENDPOINT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "capture.h"
+#include "fanout.h"
+#include "format.h"
+#include "histogram.h"
+#include "recording.h"
+#include "reduction.h"
+#include "wait.h"
+
+/*
+ * Per-handle state of handles used with CAEN_FELib_SetReadDataFormat(),
+ * CAEN_FELib_ReadData() and CAEN_FELib_HasData().
+ *
+ * Descriptors are stored on a per-connection list: they are created once and
+ * released only by CAEN_FELib_Close(), so lookups do not require any lock.
+ * Fields of a descriptor are accessed only by the thread that is using the
+ * endpoint, as only one pending call is allowed on the same handle.
+ */
+struct endpoint_descr {
+	struct endpoint_descr*			next;
+	uint32_t						rHandle;
+	struct format					format;				// nFields is zero if unknown
+	uint32_t						formatGeneration;	// incremented on every CAEN_FELib_SetReadDataFormat()
+	CAEN_FELib_StatsEntry_t*		stats;
+	uint_fast32_t					statsGeneration;
+	struct capture*					capture;			// NULL if no capture in progress
+	struct histogram*				histogram;			// NULL if no histograms in progress
+	struct reduction*				reduction;			// NULL if data reduction is disabled
+	struct recording*				recording;			// NULL if no recording in progress
+	struct fanout*					fanout;				// NULL if no fan-out in progress
+	struct wait_policy*				wait;				// NULL until the first microsecond wait or CAEN_FELib_SetWaitPolicy()
+};
+
+struct endpoint_descr* endpoint_find(struct endpoint_descr* const* list, uint32_t rHandle);
+
+// find or create, return NULL on allocation failure
+struct endpoint_descr* endpoint_get(struct endpoint_descr** list, uint32_t rHandle);
+
+// stop recordings, that read from the endpoints on background threads
+void endpoint_stopRecordings(struct endpoint_descr* const* list);
+
+void endpoint_releaseAll(struct endpoint_descr** list);
+
+#endif /* CAEN_INCLUDE_ENDPOINT_H_ */
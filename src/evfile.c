@@ -0,0 +1,382 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		evfile.c
+*	\brief		Event file format
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "evfile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+#include "utils.h"
+
+void evfile_initHeader(struct evfile_header* header, const char* source, const char* endpoint) {
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, EVFILE_MAGIC, sizeof(EVFILE_MAGIC));
+	header->version = EVFILE_VERSION;
+	header->headerSize = sizeof(*header);
+	header->creationTime = utils_realtime();
+	strncat(header->source, source, ARRAY_SIZE(header->source) - 1);
+	strncat(header->endpoint, endpoint, ARRAY_SIZE(header->endpoint) - 1);
+}
+
+// offset aligned to the natural alignment of elements of typeSize bytes (at most EVFILE_ALIGNMENT)
+static size_t _align(size_t offset, size_t typeSize) {
+	const size_t alignment = (typeSize < EVFILE_ALIGNMENT) ? typeSize : EVFILE_ALIGNMENT;
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+size_t evfile_packedSize(const struct format* fmt, const struct format_args* args) {
+	size_t size = 0;
+	for (size_t i = 0; i < fmt->nFields; ++i) {
+		const struct format_field* const f = &fmt->fields[i];
+		switch (f->dim) {
+		case 0:
+			size = _align(size, f->typeSize) + f->typeSize;
+			break;
+		case 1:
+			size = _align(_align(size, sizeof(uint64_t)) + sizeof(uint64_t), f->typeSize) + format_count(fmt, args, i, 0) * f->typeSize;
+			break;
+		case 2:
+			for (size_t ch = 0; ch < fmt->nChannels; ++ch)
+				size = _align(_align(size, sizeof(uint64_t)) + sizeof(uint64_t), f->typeSize) + format_count(fmt, args, i, ch) * f->typeSize;
+			break;
+		}
+	}
+	return size;
+}
+
+// p is relative to base, to compute alignment
+static char* _pad(char* base, char* p, size_t typeSize) {
+	char* const aligned = base + _align((size_t)(p - base), typeSize);
+	memset(p, 0, (size_t)(aligned - p));
+	return aligned;
+}
+
+static char* _packArray(char* base, char* p, const void* src, size_t count, size_t typeSize) {
+	const uint64_t n = count;
+	p = _pad(base, p, sizeof(n));
+	memcpy(p, &n, sizeof(n));
+	p = _pad(base, p + sizeof(n), typeSize);
+	if (count != 0 && src != NULL)
+		memcpy(p, src, count * typeSize);
+	else
+		memset(p, 0, count * typeSize);
+	return p + count * typeSize;
+}
+
+void evfile_pack(const struct format* fmt, const struct format_args* args, void* dst) {
+	char* const base = dst;
+	char* p = base;
+	for (size_t i = 0; i < fmt->nFields; ++i) {
+		const struct format_field* const f = &fmt->fields[i];
+		const void* const src = args->ptr[i];
+		switch (f->dim) {
+		case 0:
+			p = _pad(base, p, f->typeSize);
+			if (src != NULL)
+				memcpy(p, src, f->typeSize);
+			else
+				memset(p, 0, f->typeSize);
+			p += f->typeSize;
+			break;
+		case 1:
+			p = _packArray(base, p, src, format_count(fmt, args, i, 0), f->typeSize);
+			break;
+		case 2:
+			for (size_t ch = 0; ch < fmt->nChannels; ++ch)
+				p = _packArray(base, p, (src != NULL) ? ((void* const*)src)[ch] : NULL, format_count(fmt, args, i, ch), f->typeSize);
+			break;
+		}
+	}
+}
+
+static void _convert(void* dst, const struct format_field* dstField, const char* src, const struct format_field* srcField, size_t count) {
+	if (dstField->type == srcField->type) {
+		memcpy(dst, src, count * srcField->typeSize);
+		return;
+	}
+	char* d = dst;
+	for (size_t i = 0; i < count; ++i)
+		format_storeUnsigned(d + i * dstField->typeSize, dstField->type, format_loadUnsigned(src + i * srcField->typeSize, srcField->type));
+}
+
+/*
+ * Cursor on a serialized event, with bounds checks. Offsets are relative to the payload,
+ * that is aligned to EVFILE_ALIGNMENT.
+ */
+struct cursor {
+	const char*						base;
+	size_t							offset;
+	size_t							size;
+};
+
+static const char* _take(struct cursor* c, size_t typeSize, size_t count) {
+	const size_t offset = _align(c->offset, typeSize);
+	if (offset > c->size || count > (c->size - offset) / typeSize)
+		return NULL;
+	c->offset = offset + count * typeSize;
+	return c->base + offset;
+}
+
+static const char* _takeArray(struct cursor* c, size_t typeSize, size_t* count) {
+	const char* const n = _take(c, sizeof(uint64_t), 1);
+	if (n == NULL)
+		return NULL;
+	uint64_t value;
+	memcpy(&value, n, sizeof(value));
+	if (value > SIZE_MAX)
+		return NULL;
+	*count = (size_t)value;
+	return _take(c, typeSize, *count);
+}
+
+bool evfile_unpack(const struct format* srcFmt, const void* src, size_t size, const int* map, const struct format* dstFmt, const struct format_args* dst) {
+	struct cursor c = { .base = src, .offset = 0, .size = size };
+	for (size_t i = 0; i < srcFmt->nFields; ++i) {
+		const struct format_field* const f = &srcFmt->fields[i];
+		const int j = map[i];
+		const struct format_field* const df = (j >= 0) ? &dstFmt->fields[j] : NULL;
+		void* const d = (j >= 0) ? dst->ptr[j] : NULL;
+		const char* p;
+		size_t count;
+		switch (f->dim) {
+		case 0:
+			if ((p = _take(&c, f->typeSize, 1)) == NULL)
+				return false;
+			if (d != NULL)
+				_convert(d, df, p, f, 1);
+			break;
+		case 1:
+			if ((p = _takeArray(&c, f->typeSize, &count)) == NULL)
+				return false;
+			if (d != NULL)
+				_convert(d, df, p, f, count);
+			break;
+		case 2:
+			for (size_t ch = 0; ch < srcFmt->nChannels; ++ch) {
+				if ((p = _takeArray(&c, f->typeSize, &count)) == NULL)
+					return false;
+				if (d != NULL && ch < dstFmt->nChannels && ((void**)d)[ch] != NULL)
+					_convert(((void**)d)[ch], df, p, f, count);
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+bool evfile_field(const struct format* fmt, const void* src, size_t size, size_t field, size_t ch, const void** data, size_t* count) {
+	struct cursor c = { .base = src, .offset = 0, .size = size };
+	for (size_t i = 0; i <= field; ++i) {
+		const struct format_field* const f = &fmt->fields[i];
+		const char* p = NULL;
+		size_t n = 1;
+		switch (f->dim) {
+		case 0:
+			p = _take(&c, f->typeSize, 1);
+			break;
+		case 1:
+			p = _takeArray(&c, f->typeSize, &n);
+			break;
+		case 2:
+			if (i == field && ch >= fmt->nChannels)
+				return false;
+			for (size_t k = 0; k < fmt->nChannels; ++k) {
+				const char* const q = _takeArray(&c, f->typeSize, &n);
+				if (q == NULL)
+					return false;
+				if (i == field && k == ch) {
+					p = q;
+					break;
+				}
+			}
+			break;
+		}
+		if (p == NULL)
+			return false;
+		if (i == field) {
+			*data = p;
+			*count = n;
+		}
+	}
+	return true;
+}
+
+bool evfile_key(const struct format* fmt, const void* src, size_t size, int field, uint64_t* value) {
+	const void* data;
+	size_t count;
+	if (field < 0 || !evfile_field(fmt, src, size, (size_t)field, 0, &data, &count))
+		return false;
+	*value = format_loadUnsigned(data, fmt->fields[field].type);
+	return true;
+}
+
+size_t evfile_findIndex(const void* map, size_t size, const struct evfile_chunk** chunks, size_t* nChunks) {
+	const char* const p = map;
+	struct evfile_trailer trailer;
+	*chunks = NULL;
+	*nChunks = 0;
+	if (size < sizeof(struct evfile_header) + sizeof(trailer))
+		return size;
+	memcpy(&trailer, p + size - sizeof(trailer), sizeof(trailer));
+	if (memcmp(trailer.magic, EVFILE_TRAILER_MAGIC, sizeof(EVFILE_TRAILER_MAGIC)) != 0)
+		return size;
+	const size_t available = size - sizeof(trailer);
+	if (trailer.indexOffset % EVFILE_ALIGNMENT != 0 || trailer.indexOffset > available || available - trailer.indexOffset < sizeof(struct evfile_record))
+		return size;
+	const struct evfile_record* const record = (const struct evfile_record*)(p + trailer.indexOffset);
+	if (record->type != EvfileRecordIndex || trailer.nChunks > (available - trailer.indexOffset - sizeof(*record)) / sizeof(struct evfile_chunk) || record->size != trailer.nChunks * sizeof(struct evfile_chunk))
+		return size;
+	*chunks = (const struct evfile_chunk*)(record + 1);
+	*nChunks = (size_t)trailer.nChunks;
+	return (size_t)trailer.indexOffset;
+}
+
+static const char* const keyNames[EvfileKeyCount] = {
+	[EvfileKeyTime]			= NULL, // record time
+	[EvfileKeyTimestamp]	= "TIMESTAMP",
+	[EvfileKeyTriggerId]	= "TRIGGER_ID",
+};
+
+int evfile_keyField(const struct format* fmt, enum evfile_key key) {
+	const int field = (keyNames[key] != NULL) ? format_find(fmt, keyNames[key]) : -1;
+	return (field >= 0 && fmt->fields[field].dim == 0) ? field : -1;
+}
+
+void evfile_indexInit(struct evfile_index* index) {
+	memset(index, 0, sizeof(*index));
+	for (size_t k = 0; k < EvfileKeyCount; ++k)
+		index->keyFields[k] = -1;
+}
+
+void evfile_indexClear(struct evfile_index* index) {
+	free(index->chunks);
+	evfile_indexInit(index);
+}
+
+void evfile_indexOnFormat(struct evfile_index* index, uint64_t offset, const struct format* fmt) {
+	// a chunk has a single format, so readers can start from formatOffset
+	index->open = false;
+	index->formatOffset = offset;
+	for (size_t k = 0; k < EvfileKeyCount; ++k)
+		index->keyFields[k] = evfile_keyField(fmt, (enum evfile_key)k);
+}
+
+static void _updateKey(struct evfile_chunk* chunk, enum evfile_key key, uint64_t value) {
+	if (value < chunk->min[key])
+		chunk->min[key] = value;
+	if (value > chunk->max[key])
+		chunk->max[key] = value;
+}
+
+static struct evfile_chunk* _openChunk(struct evfile_index* index, uint64_t offset) {
+	if (index->nChunks == index->capacity) {
+		const size_t capacity = (index->capacity == 0) ? 64 : index->capacity * 2;
+		struct evfile_chunk* const chunks = realloc(index->chunks, capacity * sizeof(*chunks));
+		if (chunks == NULL)
+			return NULL;
+		index->chunks = chunks;
+		index->capacity = capacity;
+	}
+	struct evfile_chunk* const chunk = &index->chunks[index->nChunks++];
+	memset(chunk, 0, sizeof(*chunk));
+	chunk->offset = offset;
+	chunk->formatOffset = index->formatOffset;
+	chunk->firstEvent = index->nEvents;
+	for (size_t k = 0; k < EvfileKeyCount; ++k)
+		chunk->min[k] = UINT64_MAX;
+	index->open = true;
+	return chunk;
+}
+
+static void _addRecord(struct evfile_index* index, struct evfile_chunk* chunk, const struct evfile_record* record, const struct format* fmt, const void* payload) {
+	if (record->type != EvfileRecordEvent)
+		return;
+	++index->nEvents;
+	++chunk->nEvents;
+	_updateKey(chunk, EvfileKeyTime, record->time);
+	for (size_t k = 0; k < EvfileKeyCount; ++k) {
+		uint64_t value;
+		if (index->keyFields[k] >= 0 && evfile_key(fmt, payload, record->size, index->keyFields[k], &value))
+			_updateKey(chunk, (enum evfile_key)k, value);
+	}
+}
+
+bool evfile_indexOnRecord(struct evfile_index* index, uint64_t offset, const struct evfile_record* record, const struct format* fmt, const void* payload) {
+	struct evfile_chunk* const chunk = index->open ? &index->chunks[index->nChunks - 1] : _openChunk(index, offset);
+	if (chunk == NULL)
+		return false;
+	chunk->size = offset - chunk->offset + sizeof(*record) + record->size + evfile_padding(record->size);
+	_addRecord(index, chunk, record, fmt, payload);
+	if (chunk->nEvents == EVFILE_CHUNK_EVENTS || chunk->size >= EVFILE_CHUNK_SIZE)
+		index->open = false;
+	return true;
+}
+
+bool evfile_indexOnCompressed(struct evfile_index* index, uint64_t offset, const struct evfile_record* record, const void* records, size_t rawSize, const struct format* fmt) {
+	index->open = false;
+	struct evfile_chunk* const chunk = _openChunk(index, offset);
+	if (chunk == NULL)
+		return false;
+	index->open = false;
+	chunk->size = sizeof(*record) + record->size + evfile_padding(record->size);
+	for (size_t pos = 0; pos != rawSize;) {
+		const struct evfile_record* const r = (const struct evfile_record*)((const char*)records + pos);
+		if (rawSize - pos < sizeof(*r) || r->size + evfile_padding(r->size) > rawSize - pos - sizeof(*r))
+			return false;
+		if (r->type != EvfileRecordEvent && r->type != EvfileRecordStop)
+			return false;
+		_addRecord(index, chunk, r, fmt, r + 1);
+		pos += sizeof(*r) + r->size + evfile_padding(r->size);
+	}
+	return true;
+}
+
+void* evfile_decompress(const struct evfile_record* record, size_t* rawSize) {
+	const struct evfile_compressed* const c = (const struct evfile_compressed*)(record + 1);
+	if (record->type != EvfileRecordCompressed || record->size < sizeof(*c) || c->rawSize > SIZE_MAX - 1)
+		return NULL;
+	// at least a byte, as malloc(0) may return NULL
+	void* const records = malloc((size_t)c->rawSize + 1);
+	if (records == NULL)
+		return NULL;
+	if (!codec_decompress((enum codec_type)c->codec, c + 1, record->size - sizeof(*c), records, (size_t)c->rawSize)) {
+		free(records);
+		return NULL;
+	}
+	*rawSize = (size_t)c->rawSize;
+	return records;
+}
@@ -0,0 +1,208 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		evfile.h
+*	\brief		Event file format
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_EVFILE_H_
+#define CAEN_INCLUDE_EVFILE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "format.h"
+
+/*
+ * Event file, written by CAEN_FELib_StartCapture() and CAEN_FELib_StartRecording(), read by the
+ * replay implementation library and by CAEN_FELib_OpenEventFile().
+ *
+ * Layout (little endian, as the host):
+ * - struct evfile_header
+ * - sequence of records, each made of struct evfile_record and a payload padded to 8 bytes
+ * - if the file has been closed properly, struct evfile_trailer
+ *
+ * Payloads:
+ * - EvfileRecordFormat: struct evfile_format followed by the JSON passed to SetReadDataFormat (null-terminated)
+ * - EvfileRecordEvent: fields in the order of the last format; dim 0 fields are stored as they are,
+ *   dim 1 fields as a uint64_t element count followed by the elements, dim 2 fields as a sequence of
+ *   dim 1 fields, one per channel. Counts and elements are aligned to their size (at most 8 bytes)
+ *   from the beginning of the payload, so they can be accessed in place.
+ * - EvfileRecordStop: empty, ReadData returned CAEN_FELib_Stop
+ * - EvfileRecordIndex: array of struct evfile_chunk, written at the end
+ * - EvfileRecordCompressed: struct evfile_compressed followed by the event and stop records of a
+ *   whole chunk, in the layout above, compressed independently of other chunks
+ *
+ * Events are grouped in chunks of consecutive records, with the same format: the index stores their
+ * offsets and the ranges of time and of some well known fields, to seek without scanning the file.
+ * A compressed chunk is made of a single EvfileRecordCompressed record.
+ */
+
+#define EVFILE_MAGIC				"CAENEVF"
+#define EVFILE_TRAILER_MAGIC		"CAENIDX"
+#define EVFILE_VERSION				2
+#define EVFILE_ALIGNMENT			8
+#define EVFILE_CHUNK_EVENTS			1024				// maximum number of events per chunk
+#define EVFILE_CHUNK_SIZE			(UINT32_C(1) << 20)	// chunks are closed after this size, in bytes
+
+enum evfile_record_type {
+	EvfileRecordFormat				= 1,
+	EvfileRecordEvent				= 2,
+	EvfileRecordStop				= 3,
+	EvfileRecordIndex				= 4,
+	EvfileRecordCompressed			= 5,
+};
+
+// indexed keys, see CAEN_FELib_EventKey_t
+enum evfile_key {
+	EvfileKeyTime,
+	EvfileKeyTimestamp,
+	EvfileKeyTriggerId,
+	EvfileKeyCount,
+};
+
+struct evfile_header {
+	char							magic[8];			// EVFILE_MAGIC, null-terminated
+	uint32_t						version;
+	uint32_t						headerSize;
+	uint64_t						creationTime;		// realtime, in nanoseconds since Epoch
+	char							source[128];		// connection argument, e.g. the host name
+	char							endpoint[256];		// path of the endpoint
+};
+
+struct evfile_record {
+	uint32_t						type;				// enum evfile_record_type
+	uint32_t						size;				// payload size, without padding
+	uint64_t						time;				// nanoseconds since the beginning of the capture
+};
+
+struct evfile_format {
+	uint32_t						nChannels;			// number of arrays of dim 2 fields
+	uint32_t						reserved;
+};
+
+struct evfile_compressed {
+	uint32_t						codec;				// enum codec_type
+	uint32_t						reserved;
+	uint64_t						rawSize;			// size of the decompressed records
+};
+
+struct evfile_chunk {
+	uint64_t						offset;				// offset of the first record
+	uint64_t						size;				// size of the records, in bytes
+	uint64_t						formatOffset;		// offset of the format record in effect at the first record
+	uint64_t						firstEvent;			// index of the first event
+	uint64_t						nEvents;
+	uint64_t						min[EvfileKeyCount];	// UINT64_MAX if no event has the key
+	uint64_t						max[EvfileKeyCount];	// 0 if no event has the key
+};
+
+struct evfile_trailer {
+	uint64_t						indexOffset;		// offset of the EvfileRecordIndex record
+	uint64_t						nChunks;
+	char							magic[8];			// EVFILE_TRAILER_MAGIC, null-terminated
+};
+
+/*
+ * Index built while writing. Offsets are provided by the writer.
+ */
+struct evfile_index {
+	struct evfile_chunk*			chunks;
+	size_t							nChunks;			// including the open one, if any
+	size_t							capacity;
+	bool							open;				// last chunk can receive events
+	uint64_t						nEvents;
+	uint64_t						formatOffset;
+	int								keyFields[EvfileKeyCount];	// field of the format with the key, -1 if not found
+};
+
+static inline size_t evfile_padding(size_t size) {
+	return (EVFILE_ALIGNMENT - (size % EVFILE_ALIGNMENT)) % EVFILE_ALIGNMENT;
+}
+
+// fill a header for a new file
+void evfile_initHeader(struct evfile_header* header, const char* source, const char* endpoint);
+
+// size of an event serialized with evfile_pack
+size_t evfile_packedSize(const struct format* fmt, const struct format_args* args);
+
+// serialize an event to dst, that must be evfile_packedSize bytes long and aligned to EVFILE_ALIGNMENT
+void evfile_pack(const struct format* fmt, const struct format_args* args, void* dst);
+
+/*
+ * Deserialize an event to the buffers of another format, with conversion of types.
+ * map[i] is the field of dstFmt that receives the field i of srcFmt, or -1 to skip it.
+ * Return false if src is corrupted.
+ */
+bool evfile_unpack(const struct format* srcFmt, const void* src, size_t size, const int* map, const struct format* dstFmt, const struct format_args* dst);
+
+/*
+ * Locate a field on a serialized event, without copying. For dim 2 fields ch selects the channel.
+ * Return false if src is corrupted or ch is out of range.
+ */
+bool evfile_field(const struct format* fmt, const void* src, size_t size, size_t field, size_t ch, const void** data, size_t* count);
+
+// read a dim 0 integer field of a serialized event as key, return false if not found
+bool evfile_key(const struct format* fmt, const void* src, size_t size, int field, uint64_t* value);
+
+/*
+ * Validate the trailer of a mapped file. On success return the offset of the index record, that is
+ * the end of the other records, and set chunks; otherwise return size and set chunks to NULL.
+ */
+size_t evfile_findIndex(const void* map, size_t size, const struct evfile_chunk** chunks, size_t* nChunks);
+
+// field of the format with the key, -1 if not found or if the key is not a field
+int evfile_keyField(const struct format* fmt, enum evfile_key key);
+
+void evfile_indexInit(struct evfile_index* index);
+void evfile_indexClear(struct evfile_index* index);
+
+// to be invoked on each format record
+void evfile_indexOnFormat(struct evfile_index* index, uint64_t offset, const struct format* fmt);
+
+// to be invoked on each record, return false on allocation failure
+bool evfile_indexOnRecord(struct evfile_index* index, uint64_t offset, const struct evfile_record* record, const struct format* fmt, const void* payload);
+
+/*
+ * To be invoked on each EvfileRecordCompressed record, with its decompressed records: the record
+ * becomes a chunk on its own. Return false on allocation failure or if records are corrupted.
+ */
+bool evfile_indexOnCompressed(struct evfile_index* index, uint64_t offset, const struct evfile_record* record, const void* records, size_t rawSize, const struct format* fmt);
+
+/*
+ * Decompress the records of an EvfileRecordCompressed record to a buffer allocated with malloc.
+ * Return NULL if corrupted, compressed with a codec not available or on allocation failure.
+ */
+void* evfile_decompress(const struct evfile_record* record, size_t* rawSize);
+
+#endif /* CAEN_INCLUDE_EVFILE_H_ */
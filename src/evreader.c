@@ -0,0 +1,564 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		evreader.c
+*	\brief		Memory mapped reader of event files
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "evreader.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h> // open
+#include <pthread.h>
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // close
+#endif
+
+#include "evfile.h"
+#include "format.h"
+#include "utils.h"
+
+#ifndef _WIN32
+
+#define NO_FORMAT	SIZE_MAX
+
+struct reader_format {
+	uint64_t						offset;		// offset of the format record
+	struct format					fmt;
+	int								keyFields[EvfileKeyCount];
+};
+
+// decompressed records of a compressed chunk
+struct reader_chunk {
+	char*							data;		// NULL until the first access
+	size_t							size;
+};
+
+// position of a record
+struct reader_position {
+	size_t							chunk;
+	const char*						data;		// records of the chunk
+	size_t							size;
+	size_t							pos;		// offset of the record on data
+	size_t							format;
+};
+
+struct CAEN_FELib_EventFile {
+	const char*						map;
+	size_t							mapSize;
+	size_t							end;		// end of the event records
+	const struct evfile_header*		header;
+	const struct evfile_chunk*		chunks;		// on the map, or on rebuilt
+	size_t							nChunks;
+	struct evfile_index				rebuilt;	// used if the file has not been closed properly
+	struct reader_format*			formats;	// sorted by offset
+	size_t							nFormats;
+	uint64_t						nEvents;
+	bool							indexed;
+	struct reader_chunk*			decompressed;	// one per chunk
+	pthread_mutex_t					mutex;			// protects decompressed
+};
+
+static bool _checkArgs(const void* p1, const void* p2) {
+	if (p1 == NULL || p2 == NULL) {
+		_setLastLocalError("NULL argument");
+		return false;
+	}
+	return true;
+}
+
+static int _corrupted(void) {
+	_setLastLocalError("corrupted event file");
+	return CAEN_FELib_GenericError;
+}
+
+// NULL if the record at offset is not complete
+static const struct evfile_record* _record(const CAEN_FELib_EventFile_t* file, uint64_t offset) {
+	if (offset > file->end || file->end - offset < sizeof(struct evfile_record))
+		return NULL;
+	const struct evfile_record* const record = (const struct evfile_record*)(file->map + offset);
+	if (record->size + evfile_padding(record->size) > file->end - offset - sizeof(*record))
+		return NULL;
+	return record;
+}
+
+static size_t _recordSize(const struct evfile_record* record) {
+	return sizeof(*record) + record->size + evfile_padding(record->size);
+}
+
+static size_t _findFormat(const CAEN_FELib_EventFile_t* file, uint64_t offset) {
+	size_t first = 0;
+	size_t last = file->nFormats;
+	while (first < last) {
+		const size_t mid = first + (last - first) / 2;
+		if (file->formats[mid].offset < offset)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	return (first < file->nFormats && file->formats[first].offset == offset) ? first : NO_FORMAT;
+}
+
+static int _addFormat(CAEN_FELib_EventFile_t* file, uint64_t offset) {
+	const struct evfile_record* const record = _record(file, offset);
+	if (record == NULL || record->type != EvfileRecordFormat || record->size < sizeof(struct evfile_format))
+		return _corrupted();
+	const struct evfile_format* const f = (const struct evfile_format*)(record + 1);
+	const char* const json = (const char*)(f + 1);
+	if (memchr(json, '\0', record->size - sizeof(*f)) == NULL)
+		return _corrupted();
+	struct reader_format* const formats = realloc(file->formats, (file->nFormats + 1) * sizeof(*formats));
+	if (formats == NULL) {
+		_setLastLocalError("realloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	file->formats = formats;
+	struct reader_format* const rf = &formats[file->nFormats];
+	const int ret = format_parse(&rf->fmt, json, f->nChannels);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	rf->offset = offset;
+	for (size_t k = 0; k < EvfileKeyCount; ++k)
+		rf->keyFields[k] = evfile_keyField(&rf->fmt, (enum evfile_key)k);
+	++file->nFormats;
+	return CAEN_FELib_Success;
+}
+
+// use the index written on close
+static int _loadIndex(CAEN_FELib_EventFile_t* file) {
+	for (size_t i = 0; i < file->nChunks; ++i) {
+		const struct evfile_chunk* const chunk = &file->chunks[i];
+		if (chunk->offset < file->header->headerSize || chunk->offset > file->end || chunk->size > file->end - chunk->offset)
+			return _corrupted();
+		if (chunk->formatOffset == 0 || (file->nFormats != 0 && file->formats[file->nFormats - 1].offset == chunk->formatOffset))
+			continue;
+		const int ret = _addFormat(file, chunk->formatOffset);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+	}
+	if (file->nChunks != 0)
+		file->nEvents = file->chunks[file->nChunks - 1].firstEvent + file->chunks[file->nChunks - 1].nEvents;
+	return CAEN_FELib_Success;
+}
+
+// rebuild the index scanning the file, ignoring any truncated record at the end
+static int _rebuildIndex(CAEN_FELib_EventFile_t* file) {
+	const struct format* fmt = NULL;
+	uint64_t offset = file->header->headerSize;
+	const struct evfile_record* record;
+	while ((record = _record(file, offset)) != NULL) {
+		if (record->type == EvfileRecordFormat) {
+			const int ret = _addFormat(file, offset);
+			if (ret != CAEN_FELib_Success)
+				return ret;
+			fmt = &file->formats[file->nFormats - 1].fmt;
+			evfile_indexOnFormat(&file->rebuilt, offset, fmt);
+		}
+		if (record->type == EvfileRecordCompressed) {
+			size_t rawSize;
+			void* const records = evfile_decompress(record, &rawSize);
+			if (records == NULL)
+				return _corrupted();
+			const bool ok = evfile_indexOnCompressed(&file->rebuilt, offset, record, records, rawSize, fmt);
+			free(records);
+			if (!ok)
+				return _corrupted();
+		} else if (!evfile_indexOnRecord(&file->rebuilt, offset, record, fmt, record + 1)) {
+			_setLastLocalError("index allocation failed");
+			return CAEN_FELib_InternalError;
+		}
+		offset += _recordSize(record);
+	}
+	file->end = (size_t)offset;
+	file->chunks = file->rebuilt.chunks;
+	file->nChunks = file->rebuilt.nChunks;
+	file->nEvents = file->rebuilt.nEvents;
+	return CAEN_FELib_Success;
+}
+
+int evreader_open(const char* filename, CAEN_FELib_EventFile_t** file) {
+	if (!_checkArgs(filename, file))
+		return CAEN_FELib_InvalidParam;
+	const int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		_setLastLocalError("cannot open '%s': %s", filename, strerror(errno));
+		return CAEN_FELib_InvalidParam;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct evfile_header)) {
+		_setLastLocalError("invalid file '%s'", filename);
+		close(fd);
+		return CAEN_FELib_InvalidParam;
+	}
+	CAEN_FELib_EventFile_t* const f = calloc(1, sizeof(*f));
+	if (f == NULL) {
+		_setLastLocalError("calloc failed");
+		close(fd);
+		return CAEN_FELib_InternalError;
+	}
+	evfile_indexInit(&f->rebuilt);
+	pthread_mutex_init(&f->mutex, NULL);
+	f->mapSize = (size_t)st.st_size;
+	void* const map = mmap(NULL, f->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		_setLastLocalError("mmap failed: %s", strerror(errno));
+		pthread_mutex_destroy(&f->mutex);
+		free(f);
+		return CAEN_FELib_InternalError;
+	}
+	f->map = map;
+	f->header = map;
+	int ret;
+	if (memcmp(f->header->magic, EVFILE_MAGIC, sizeof(EVFILE_MAGIC)) != 0 || f->header->version != EVFILE_VERSION || f->header->headerSize > f->mapSize || f->header->headerSize % EVFILE_ALIGNMENT != 0) {
+		_setLastLocalError("'%s' is not a supported event file", filename);
+		ret = CAEN_FELib_InvalidParam;
+	} else {
+		f->end = evfile_findIndex(f->map, f->mapSize, &f->chunks, &f->nChunks);
+		f->indexed = (f->chunks != NULL);
+		ret = f->indexed ? _loadIndex(f) : _rebuildIndex(f);
+	}
+	if (ret == CAEN_FELib_Success && (f->decompressed = calloc(f->nChunks + 1, sizeof(*f->decompressed))) == NULL) {
+		_setLastLocalError("calloc failed");
+		ret = CAEN_FELib_InternalError;
+	}
+	if (ret != CAEN_FELib_Success) {
+		evreader_close(f);
+		return ret;
+	}
+	*file = f;
+	return CAEN_FELib_Success;
+}
+
+int evreader_close(CAEN_FELib_EventFile_t* file) {
+	if (file == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	for (size_t i = 0; i < file->nFormats; ++i)
+		format_clear(&file->formats[i].fmt);
+	free(file->formats);
+	if (file->decompressed != NULL)
+		for (size_t i = 0; i < file->nChunks; ++i)
+			free(file->decompressed[i].data);
+	free(file->decompressed);
+	evfile_indexClear(&file->rebuilt);
+	pthread_mutex_destroy(&file->mutex);
+	munmap((void*)file->map, file->mapSize);
+	free(file);
+	return CAEN_FELib_Success;
+}
+
+int evreader_getInfo(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventFileInfo_t* info) {
+	if (!_checkArgs(file, info))
+		return CAEN_FELib_InvalidParam;
+	memset(info, 0, sizeof(*info));
+	info->nEvents = file->nEvents;
+	info->creationTime = file->header->creationTime;
+	// header strings may fill the field without terminator: the last byte of info is left zero
+	STATIC_ASSERT(sizeof(info->source) == sizeof(file->header->source), invalid_source_size);
+	STATIC_ASSERT(sizeof(info->endpoint) == sizeof(file->header->endpoint), invalid_endpoint_size);
+	memcpy(info->source, file->header->source, ARRAY_SIZE(info->source) - 1);
+	memcpy(info->endpoint, file->header->endpoint, ARRAY_SIZE(info->endpoint) - 1);
+	info->indexed = file->indexed;
+	return CAEN_FELib_Success;
+}
+
+// compressed chunks are decompressed on first access, concurrently, and kept until close
+static const char* _decompressed(CAEN_FELib_EventFile_t* file, size_t c, const struct evfile_record* record, size_t* size) {
+	struct reader_chunk* const rc = &file->decompressed[c];
+	pthread_mutex_lock(&file->mutex);
+	char* data = rc->data;
+	*size = rc->size;
+	pthread_mutex_unlock(&file->mutex);
+	if (data != NULL)
+		return data;
+	data = evfile_decompress(record, size);
+	if (data == NULL)
+		return NULL;
+	pthread_mutex_lock(&file->mutex);
+	if (rc->data == NULL) {
+		rc->data = data;
+		rc->size = *size;
+	} else {
+		free(data);
+		data = rc->data;
+	}
+	pthread_mutex_unlock(&file->mutex);
+	return data;
+}
+
+static int _loadChunk(CAEN_FELib_EventFile_t* file, size_t c, struct reader_position* p) {
+	const struct evfile_chunk* const chunk = &file->chunks[c];
+	const struct evfile_record* const record = _record(file, chunk->offset);
+	if (record == NULL)
+		return _corrupted();
+	p->chunk = c;
+	p->pos = 0;
+	p->format = _findFormat(file, chunk->formatOffset);
+	if (record->type == EvfileRecordCompressed) {
+		p->data = _decompressed(file, c, record, &p->size);
+		if (p->data == NULL)
+			return _corrupted();
+	} else {
+		p->data = file->map + chunk->offset;
+		p->size = (size_t)chunk->size;
+	}
+	return CAEN_FELib_Success;
+}
+
+// NULL if there is no complete record at the position
+static const struct evfile_record* _at(const struct reader_position* p) {
+	if (p->size - p->pos < sizeof(struct evfile_record))
+		return NULL;
+	const struct evfile_record* const record = (const struct evfile_record*)(p->data + p->pos);
+	if (record->size + evfile_padding(record->size) > p->size - p->pos - sizeof(*record))
+		return NULL;
+	return record;
+}
+
+/*
+ * Move to the first event record at or after the position, also on the following chunks.
+ * Return CAEN_FELib_Stop at the end of the file.
+ */
+static int _seekEvent(CAEN_FELib_EventFile_t* file, struct reader_position* p) {
+	for (;;) {
+		const struct evfile_record* const record = _at(p);
+		if (record == NULL) {
+			if (p->pos != p->size)
+				return _corrupted();
+			if (p->chunk + 1 >= file->nChunks)
+				return CAEN_FELib_Stop;
+			const int ret = _loadChunk(file, p->chunk + 1, p);
+			if (ret != CAEN_FELib_Success)
+				return ret;
+			continue;
+		}
+		if (record->type == EvfileRecordEvent)
+			return (p->format != NO_FORMAT) ? CAEN_FELib_Success : _corrupted();
+		p->pos += _recordSize(record);
+	}
+}
+
+static void _fillEvent(const CAEN_FELib_EventFile_t* file, const struct reader_position* p, uint64_t index, CAEN_FELib_Event_t* event) {
+	const struct evfile_record* const record = _at(p);
+	event->index = index;
+	event->time = record->time;
+	event->format = file->formats[p->format].fmt.json;
+	event->payload = record + 1;
+	event->size = record->size;
+	event->reserved[0] = p->chunk;
+	event->reserved[1] = p->pos;
+}
+
+// position of an event returned to the user
+static int _getPosition(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, struct reader_position* p) {
+	if (event->reserved[0] >= file->nChunks) {
+		_setLastLocalError("invalid event");
+		return CAEN_FELib_InvalidParam;
+	}
+	const int ret = _loadChunk(file, (size_t)event->reserved[0], p);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	p->pos = (event->reserved[1] < p->size) ? (size_t)event->reserved[1] : p->size;
+	const struct evfile_record* const record = _at(p);
+	if (record == NULL || record->type != EvfileRecordEvent || p->format == NO_FORMAT) {
+		_setLastLocalError("invalid event");
+		return CAEN_FELib_InvalidParam;
+	}
+	return CAEN_FELib_Success;
+}
+
+// last chunk starting at or before the event, that is the one containing it
+static size_t _findChunk(const CAEN_FELib_EventFile_t* file, uint64_t index) {
+	size_t first = 0;
+	size_t last = file->nChunks;
+	while (first < last) {
+		const size_t mid = first + (last - first) / 2;
+		if (file->chunks[mid].firstEvent <= index)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	return first - 1;
+}
+
+int evreader_getEvent(CAEN_FELib_EventFile_t* file, uint64_t index, CAEN_FELib_Event_t* event) {
+	if (!_checkArgs(file, event))
+		return CAEN_FELib_InvalidParam;
+	if (index >= file->nEvents) {
+		_setLastLocalError("event %"PRIu64" out of range (%"PRIu64" events)", index, file->nEvents);
+		return CAEN_FELib_InvalidParam;
+	}
+	const size_t c = _findChunk(file, index);
+	struct reader_position p;
+	int ret = _loadChunk(file, c, &p);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	for (uint64_t i = file->chunks[c].firstEvent;; ++i) {
+		ret = _seekEvent(file, &p);
+		if (ret == CAEN_FELib_Stop)
+			return _corrupted();
+		if (ret != CAEN_FELib_Success)
+			return ret;
+		if (i == index)
+			break;
+		p.pos += _recordSize(_at(&p));
+	}
+	_fillEvent(file, &p, index, event);
+	return CAEN_FELib_Success;
+}
+
+int evreader_getNextEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_Event_t* event) {
+	if (!_checkArgs(file, event))
+		return CAEN_FELib_InvalidParam;
+	struct reader_position p;
+	int ret = _getPosition(file, event, &p);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	p.pos += _recordSize(_at(&p));
+	ret = _seekEvent(file, &p);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	_fillEvent(file, &p, event->index + 1, event);
+	return CAEN_FELib_Success;
+}
+
+static bool _getKey(const CAEN_FELib_EventFile_t* file, const struct reader_position* p, enum evfile_key key, uint64_t* value) {
+	const struct evfile_record* const record = _at(p);
+	if (key == EvfileKeyTime) {
+		*value = record->time;
+		return true;
+	}
+	const struct reader_format* const rf = &file->formats[p->format];
+	return evfile_key(&rf->fmt, record + 1, record->size, rf->keyFields[key], value);
+}
+
+int evreader_findEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventKey_t key, uint64_t value, CAEN_FELib_Event_t* event) {
+	if (!_checkArgs(file, event))
+		return CAEN_FELib_InvalidParam;
+	if ((unsigned)key >= EvfileKeyCount) {
+		_setLastLocalError("invalid key %d", (int)key);
+		return CAEN_FELib_InvalidParam;
+	}
+	for (size_t c = 0; c < file->nChunks; ++c) {
+		const struct evfile_chunk* const chunk = &file->chunks[c];
+		// skip chunks without the key, or with smaller keys
+		if (chunk->nEvents == 0 || chunk->min[key] > chunk->max[key] || chunk->max[key] < value)
+			continue;
+		struct reader_position p;
+		int ret = _loadChunk(file, c, &p);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+		for (uint64_t i = chunk->firstEvent; i < chunk->firstEvent + chunk->nEvents; ++i) {
+			ret = _seekEvent(file, &p);
+			if (ret == CAEN_FELib_Stop)
+				return _corrupted();
+			if (ret != CAEN_FELib_Success)
+				return ret;
+			uint64_t v;
+			if (_getKey(file, &p, (enum evfile_key)key, &v) && v >= value) {
+				_fillEvent(file, &p, i, event);
+				return CAEN_FELib_Success;
+			}
+			p.pos += _recordSize(_at(&p));
+		}
+	}
+	return CAEN_FELib_Stop;
+}
+
+int evreader_getField(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count) {
+	if (!_checkArgs(file, event) || !_checkArgs(name, data) || !_checkArgs(count, event))
+		return CAEN_FELib_InvalidParam;
+	struct reader_position p;
+	const int ret = _getPosition(file, event, &p);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const struct evfile_record* const record = _at(&p);
+	const struct format* const fmt = &file->formats[p.format].fmt;
+	const int field = format_find(fmt, name);
+	if (field < 0) {
+		_setLastLocalError("field %s not found", name);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (fmt->fields[field].dim == 2 && channel >= fmt->nChannels) {
+		_setLastLocalError("channel %zu out of range (%zu channels)", channel, fmt->nChannels);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (!evfile_field(fmt, record + 1, record->size, (size_t)field, channel, data, count))
+		return _corrupted();
+	return CAEN_FELib_Success;
+}
+
+#else
+
+static int _notSupported(void) {
+	_setLastLocalError("event files not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+int evreader_open(const char* filename, CAEN_FELib_EventFile_t** file) {
+	return _notSupported();
+}
+
+int evreader_close(CAEN_FELib_EventFile_t* file) {
+	return _notSupported();
+}
+
+int evreader_getInfo(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventFileInfo_t* info) {
+	return _notSupported();
+}
+
+int evreader_getEvent(CAEN_FELib_EventFile_t* file, uint64_t index, CAEN_FELib_Event_t* event) {
+	return _notSupported();
+}
+
+int evreader_getNextEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_Event_t* event) {
+	return _notSupported();
+}
+
+int evreader_findEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventKey_t key, uint64_t value, CAEN_FELib_Event_t* event) {
+	return _notSupported();
+}
+
+int evreader_getField(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count) {
+	return _notSupported();
+}
+
+#endif
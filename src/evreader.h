@@ -0,0 +1,59 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		evreader.h
+*	\brief		Memory mapped reader of event files
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_EVREADER_H_
+#define CAEN_INCLUDE_EVREADER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+
+/*
+ * Reader of event files (see evfile.h). Files are memory mapped and read only, so functions
+ * other than open and close can be invoked concurrently. Return a CAEN_FELib_ErrorCode, set
+ * last error on failure.
+ */
+
+int evreader_open(const char* filename, CAEN_FELib_EventFile_t** file);
+int evreader_close(CAEN_FELib_EventFile_t* file);
+int evreader_getInfo(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventFileInfo_t* info);
+int evreader_getEvent(CAEN_FELib_EventFile_t* file, uint64_t index, CAEN_FELib_Event_t* event);
+int evreader_getNextEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_Event_t* event);
+int evreader_findEvent(CAEN_FELib_EventFile_t* file, CAEN_FELib_EventKey_t key, uint64_t value, CAEN_FELib_Event_t* event);
+int evreader_getField(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count);
+
+#endif /* CAEN_INCLUDE_EVREADER_H_ */
@@ -0,0 +1,896 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		fanout.c
+*	\brief		Shared memory fan-out of events
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "fanout.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h> // O_* constants
+#include <signal.h> // kill
+#include <sys/mman.h> // shm_open, mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // ftruncate, getpid, sysconf
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "evfile.h"
+#include "json.h"
+
+uint_fast32_t fanoutCount;
+
+#ifndef _WIN32
+
+#define FANOUT_MAGIC				UINT32_C(0xcae0fa40)
+#define FANOUT_VERSION				1
+#define FANOUT_NAME_SIZE			64
+#define FANOUT_MAX_READERS			16
+#define FANOUT_MAX_FORMAT_SIZE		16384
+#define FANOUT_DEFAULT_SIZE			(UINT64_C(64) << 20)
+#define FANOUT_MIN_SIZE				(UINT64_C(1) << 16)
+#define FANOUT_MAX_SIZE				(UINT64_C(1) << 40)
+#define FANOUT_CHECK_PERIOD			UINT64_C(100000000)	// ns between checks of dead processes
+#define FANOUT_POLL_PERIOD			UINT64_C(100000)	// ns between polls, where futexes are not available
+
+/*
+ * Layout of the segment:
+ * - struct fanout_header, padded to a multiple of the page size
+ * - ring of fanout_header::size bytes, a power of 2
+ *
+ * Positions on the ring grow monotonically, the offset is the position modulo the size. Records
+ * are made of struct fanout_record and a payload padded to 8 bytes, and never wrap: if the space
+ * left before the end of the ring is not enough, it is filled by a padding record, or skipped if
+ * it is smaller than struct fanout_record. Records between tail and head are complete.
+ */
+
+enum fanout_record_type {
+	FanoutRecordEvent				= 1,	// payload serialized with evfile_pack
+	FanoutRecordStop				= 2,	// empty, ReadData returned CAEN_FELib_Stop
+	FanoutRecordPadding				= 3,	// to be skipped
+};
+
+struct fanout_record {
+	uint32_t						type;				// enum fanout_record_type
+	uint32_t						size;				// payload size, without padding
+	uint64_t						sequence;			// index of the record, excluding padding
+	uint64_t						time;				// realtime, in nanoseconds since Epoch
+	uint32_t						formatGeneration;	// generation of the format of the event
+	uint32_t						reserved;
+};
+
+struct fanout_slot {
+	ALIGNED(CACHE_LINE_SIZE) uint32_t pid;				// process of the reader, zero if free
+	uint32_t						block;				// if not zero, records from cursor are not overwritten
+	uint64_t						cursor;				// position of the next record to be read
+};
+
+struct fanout_header {
+	uint32_t						magic;				// FANOUT_MAGIC, written last
+	uint32_t						version;
+	uint64_t						headerSize;			// offset of the ring
+	uint64_t						size;				// size of the ring
+	int64_t							pid;				// process of the writer
+	uint64_t						creationTime;		// realtime, in nanoseconds since Epoch
+	char							source[128];		// connection argument, e.g. the host name
+	char							endpoint[256];		// path of the endpoint
+	// written by the writer
+	ALIGNED(CACHE_LINE_SIZE) uint64_t head;				// end of the last record
+	uint64_t						tail;				// beginning of the oldest record not overwritten
+	uint64_t						published;			// number of records published
+	uint64_t						dropped;			// number of events not published
+	uint32_t						closed;
+	// readers waiting on notify
+	ALIGNED(CACHE_LINE_SIZE) uint32_t notify;
+	uint32_t						waiters;
+	// current format, protected by a sequence lock
+	ALIGNED(CACHE_LINE_SIZE) uint32_t formatSeq;
+	uint32_t						formatGeneration;	// zero if the format cannot be serialized
+	uint64_t						nChannels;
+	char							format[FANOUT_MAX_FORMAT_SIZE];
+	struct fanout_slot				slots[FANOUT_MAX_READERS];
+};
+
+STATIC_ASSERT(sizeof(struct fanout_record) % EVFILE_ALIGNMENT == 0, invalid_fanout_record_size);
+
+struct fanout {
+	struct fanout_header*			header;
+	char*							ring;
+	size_t							mapSize;
+	uint64_t						size;
+	uint64_t						head;				// local copies of the header
+	uint64_t						tail;
+	uint64_t						sequence;
+	uint64_t						dropped;
+	uint32_t						formatGeneration;
+	bool							formatValid;
+	uint64_t						lastCheck;			// monotonic time of the last check of dead readers
+	char							name[FANOUT_NAME_SIZE];
+};
+
+struct CAEN_FELib_FanoutReader {
+	struct fanout_header*			header;
+	size_t							headerSize;
+	const char*						ring;
+	uint64_t						size;
+	struct fanout_slot*				slot;
+	uint64_t						cursor;
+	bool							block;
+	uint32_t						sampling;			// 1 every sampling events are returned
+	uint32_t						sampleCounter;
+	uint64_t						nextSequence;		// sequence of the next record, to count losses
+	uint32_t						formatGeneration;	// generation of fmt, zero if not parsed
+	struct format					fmt;
+	char*							buffer;				// payload of the last event
+	size_t							bufferSize;
+	uint64_t						lastCheck;			// monotonic time of the last check of the writer
+	uint32_t						interrupted;		// set by fanout_interrupt, consumed by fanout_read
+	uint64_t						read;
+	uint64_t						lost;
+	uint64_t						skipped;
+};
+
+static bool _checkArgs(const void* p1, const void* p2) {
+	if (p1 == NULL || p2 == NULL) {
+		_setLastLocalError("NULL argument");
+		return false;
+	}
+	return true;
+}
+
+static bool _checkName(const char* name) {
+	if (name[0] != '/' || strlen(name) >= FANOUT_NAME_SIZE) {
+		_setLastLocalError("invalid shared memory name '%s'", name);
+		return false;
+	}
+	return true;
+}
+
+static size_t _headerSize(void) {
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	return (sizeof(struct fanout_header) + page - 1) / page * page;
+}
+
+static uint64_t _recordSize(const struct fanout_record* record) {
+	return sizeof(*record) + record->size + evfile_padding(record->size);
+}
+
+static bool _isAlive(int64_t pid) {
+	return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+static void _wakeAll(struct fanout_header* header) {
+	ATOMIC_FETCH_ADD(&header->notify, 1);
+#ifdef __linux__
+	syscall(SYS_futex, &header->notify, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/*
+ * Writer
+ */
+
+static int _parseWriterOptions(const char* options, uint64_t* size) {
+	*size = FANOUT_DEFAULT_SIZE;
+	if (options == NULL)
+		return CAEN_FELib_Success;
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid fan-out options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	const double s = json_number(json_get(root, "size"), (double)*size);
+	json_free(root);
+	if (!(s >= (double)FANOUT_MIN_SIZE && s <= (double)FANOUT_MAX_SIZE)) {
+		_setLastLocalError("invalid fan-out options: value out of range");
+		return CAEN_FELib_InvalidParam;
+	}
+	// rounded up to a power of 2
+	*size = FANOUT_MIN_SIZE;
+	while ((double)*size < s)
+		*size <<= 1;
+	return CAEN_FELib_Success;
+}
+
+// release the slots of readers with block policy terminated without closing the fan-out
+static void _releaseDeadReaders(struct fanout* f) {
+	const uint64_t now = utils_now();
+	if (now - f->lastCheck < FANOUT_CHECK_PERIOD)
+		return;
+	f->lastCheck = now;
+	for (size_t i = 0; i < FANOUT_MAX_READERS; ++i) {
+		struct fanout_slot* const slot = &f->header->slots[i];
+		uint32_t pid = ATOMIC_LOAD_RELAXED(&slot->pid);
+		if (pid == 0 || !ATOMIC_LOAD_RELAXED(&slot->block) || _isAlive(pid))
+			continue;
+		ATOMIC_STORE_RELAXED(&slot->block, 0);
+		ATOMIC_CAS_WEAK(&slot->pid, &pid, 0);
+	}
+}
+
+// lowest cursor of the readers with block policy, UINT64_MAX if none
+static uint64_t _blockLimit(const struct fanout* f) {
+	uint64_t limit = UINT64_MAX;
+	for (size_t i = 0; i < FANOUT_MAX_READERS; ++i) {
+		const struct fanout_slot* const slot = &f->header->slots[i];
+		if (!ATOMIC_LOAD_RELAXED(&slot->block))
+			continue;
+		// acquire: the reader has finished copying the records before the cursor
+		const uint64_t cursor = ATOMIC_LOAD_ACQUIRE(&slot->cursor);
+		if (cursor < limit)
+			limit = cursor;
+	}
+	return limit;
+}
+
+static uint64_t _next(const struct fanout* f, uint64_t position) {
+	const uint64_t left = f->size - (position & (f->size - 1));
+	if (left < sizeof(struct fanout_record))
+		return position + left;
+	return position + _recordSize((const struct fanout_record*)(f->ring + (position & (f->size - 1))));
+}
+
+// move tail so that the ring can be written up to end, return false if unread records of readers with block policy are in the way
+static bool _makeRoom(struct fanout* f, uint64_t end) {
+	if (end - f->tail <= f->size)
+		return true;
+	uint64_t limit = _blockLimit(f);
+	uint64_t tail = f->tail;
+	while (end - tail > f->size) {
+		if (tail >= limit) {
+			_releaseDeadReaders(f);
+			limit = _blockLimit(f);
+			if (tail >= limit)
+				return false;
+		}
+		tail = _next(f, tail);
+	}
+	// readers check tail after copying a record: it must be visible before the record is overwritten
+	f->tail = tail;
+	ATOMIC_STORE_RELAXED(&f->header->tail, tail);
+	ATOMIC_FENCE_RELEASE();
+	return true;
+}
+
+static void _drop(struct fanout* f) {
+	ATOMIC_STORE_RELAXED(&f->header->dropped, ++f->dropped);
+}
+
+// reserve a record with a payload of size bytes, return NULL if dropped
+static struct fanout_record* _begin(struct fanout* f, size_t size) {
+	const uint64_t total = sizeof(struct fanout_record) + size + evfile_padding(size);
+	if (size > UINT32_MAX || total > f->size / 2) {
+		_drop(f);
+		return NULL;
+	}
+	uint64_t position = f->head;
+	const uint64_t left = f->size - (position & (f->size - 1));
+	const uint64_t padding = (left < total) ? left : 0;
+	if (!_makeRoom(f, position + padding + total)) {
+		_drop(f);
+		return NULL;
+	}
+	if (padding >= sizeof(struct fanout_record)) {
+		struct fanout_record* const record = (struct fanout_record*)(f->ring + (position & (f->size - 1)));
+		record->type = FanoutRecordPadding;
+		record->size = (uint32_t)(padding - sizeof(*record));
+	}
+	position += padding;
+	f->head = position;
+	return (struct fanout_record*)(f->ring + (position & (f->size - 1)));
+}
+
+// publish a record reserved by _begin
+static void _commit(struct fanout* f, struct fanout_record* record, enum fanout_record_type type, size_t size) {
+	record->type = type;
+	record->size = (uint32_t)size;
+	record->sequence = f->sequence++;
+	record->time = utils_realtime();
+	record->formatGeneration = f->formatGeneration;
+	record->reserved = 0;
+	f->head += _recordSize(record);
+	struct fanout_header* const header = f->header;
+	ATOMIC_STORE_RELAXED(&header->published, f->sequence);
+	ATOMIC_STORE_RELEASE(&header->head, f->head);
+	// the store of head must be visible before the load of waiters, see _wait
+	ATOMIC_FENCE_SEQ_CST();
+	if (ATOMIC_LOAD_RELAXED(&header->waiters) != 0)
+		_wakeAll(header);
+}
+
+static void _unmap(struct fanout* f) {
+	munmap(f->header, f->mapSize);
+	shm_unlink(f->name);
+	free(f);
+}
+
+int fanout_start(struct fanout** fanout, const char* name, const char* source, const char* endpoint, const struct format* fmt, const char* options) {
+	if (*fanout != NULL) {
+		_setLastLocalError("fan-out already in progress");
+		return CAEN_FELib_CommandError;
+	}
+	if (!_checkName(name))
+		return CAEN_FELib_InvalidParam;
+	if (!format_isSizeable(fmt)) {
+		_setLastLocalError("size of arrays of the read data format cannot be determined");
+		return CAEN_FELib_InvalidParam;
+	}
+	if (strlen(fmt->json) >= FANOUT_MAX_FORMAT_SIZE) {
+		_setLastLocalError("read data format too long for the fan-out");
+		return CAEN_FELib_InvalidParam;
+	}
+	uint64_t size;
+	int ret = _parseWriterOptions(options, &size);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	struct fanout* const f = calloc(1, sizeof(*f));
+	if (f == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	strcpy(f->name, name);
+	const size_t headerSize = _headerSize();
+	f->size = size;
+	f->mapSize = headerSize + (size_t)size;
+	// a new segment, readers of a previous fan-out keep the old one
+	shm_unlink(name);
+	const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+	if (fd == -1) {
+		_setLastLocalError("shm_open failed: %s", strerror(errno));
+		free(f);
+		return CAEN_FELib_GenericError;
+	}
+	if (ftruncate(fd, (off_t)f->mapSize) == -1) {
+		_setLastLocalError("ftruncate failed: %s", strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		free(f);
+		return CAEN_FELib_GenericError;
+	}
+	void* const p = mmap(NULL, f->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		_setLastLocalError("mmap failed: %s", strerror(errno));
+		shm_unlink(name);
+		free(f);
+		return CAEN_FELib_GenericError;
+	}
+	// ftruncate fills the segment with zeros
+	f->header = p;
+	f->ring = (char*)p + headerSize;
+	struct fanout_header* const header = f->header;
+	header->version = FANOUT_VERSION;
+	header->headerSize = headerSize;
+	header->size = size;
+	header->pid = (int64_t)getpid();
+	header->creationTime = utils_realtime();
+	strncat(header->source, source, sizeof(header->source) - 1);
+	strncat(header->endpoint, endpoint, sizeof(header->endpoint) - 1);
+	fanout_onFormat(f, fmt);
+	// magic is written last, readers check it
+	ATOMIC_STORE_RELEASE(&header->magic, FANOUT_MAGIC);
+	*fanout = f;
+	ATOMIC_FETCH_ADD(&fanoutCount, 1);
+	return CAEN_FELib_Success;
+}
+
+int fanout_stop(struct fanout** fanout) {
+	struct fanout* const f = *fanout;
+	if (f == NULL)
+		return CAEN_FELib_Success;
+	*fanout = NULL;
+	ATOMIC_FETCH_ADD(&fanoutCount, (uint_fast32_t)-1);
+	ATOMIC_STORE_RELEASE(&f->header->closed, 1);
+	_wakeAll(f->header);
+	_unmap(f);
+	return CAEN_FELib_Success;
+}
+
+void fanout_onFormat(struct fanout* f, const struct format* fmt) {
+	struct fanout_header* const header = f->header;
+	f->formatValid = (fmt->nFields != 0 && format_isSizeable(fmt) && strlen(fmt->json) < sizeof(header->format));
+	++f->formatGeneration;
+	ATOMIC_STORE_RELAXED(&header->formatSeq, header->formatSeq + 1);
+	ATOMIC_FENCE_RELEASE();
+	header->formatGeneration = f->formatValid ? f->formatGeneration : 0;
+	header->nChannels = fmt->nChannels;
+	if (f->formatValid)
+		strcpy(header->format, fmt->json);
+	else
+		header->format[0] = '\0';
+	ATOMIC_STORE_RELEASE(&header->formatSeq, header->formatSeq + 1);
+}
+
+void fanout_onEvent(struct fanout* f, const struct format* fmt, const struct format_args* args) {
+	if (!f->formatValid) {
+		_drop(f);
+		return;
+	}
+	const size_t size = evfile_packedSize(fmt, args);
+	struct fanout_record* const record = _begin(f, size);
+	if (record == NULL)
+		return;
+	evfile_pack(fmt, args, record + 1);
+	_commit(f, record, FanoutRecordEvent, size);
+}
+
+void fanout_onStop(struct fanout* f) {
+	struct fanout_record* const record = _begin(f, 0);
+	if (record == NULL)
+		return;
+	_commit(f, record, FanoutRecordStop, 0);
+}
+
+/*
+ * Readers
+ */
+
+static int _parseReaderOptions(CAEN_FELib_FanoutReader_t* r, const char* options) {
+	r->block = false;
+	r->sampling = 1;
+	if (options == NULL)
+		return CAEN_FELib_Success;
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid fan-out options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	const char* const policy = json_string(json_get(root, "policy"), "drop_oldest");
+	const double sampling = json_number(json_get(root, "sampling"), 1.);
+	int ret = CAEN_FELib_Success;
+	if (strcmp(policy, "block") == 0) {
+		r->block = true;
+	} else if (strcmp(policy, "drop_oldest") != 0) {
+		_setLastLocalError("invalid fan-out options: policy '%s' unknown", policy);
+		ret = CAEN_FELib_InvalidParam;
+	}
+	json_free(root);
+	if (ret == CAEN_FELib_Success && !(sampling >= 1 && sampling <= UINT32_MAX)) {
+		_setLastLocalError("invalid fan-out options: value out of range");
+		ret = CAEN_FELib_InvalidParam;
+	}
+	r->sampling = (uint32_t)sampling;
+	return ret;
+}
+
+static int _map(CAEN_FELib_FanoutReader_t* r, const char* name) {
+	const int fd = shm_open(name, O_RDWR, 0);
+	if (fd == -1) {
+		_setLastLocalError("shm_open failed: %s", strerror(errno));
+		return (errno == ENOENT) ? CAEN_FELib_DeviceNotFound : CAEN_FELib_GenericError;
+	}
+	struct stat st;
+	const size_t headerSize = _headerSize();
+	if (fstat(fd, &st) == -1 || (uint64_t)st.st_size < headerSize) {
+		_setLastLocalError("invalid fan-out segment");
+		close(fd);
+		return CAEN_FELib_GenericError;
+	}
+	void* const p = mmap(NULL, headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		_setLastLocalError("mmap failed: %s", strerror(errno));
+		close(fd);
+		return CAEN_FELib_GenericError;
+	}
+	r->header = p;
+	r->headerSize = headerSize;
+	const struct fanout_header* const header = r->header;
+	if (ATOMIC_LOAD_ACQUIRE(&header->magic) != FANOUT_MAGIC || header->version != FANOUT_VERSION || header->headerSize != headerSize || (uint64_t)st.st_size != headerSize + header->size) {
+		_setLastLocalError("invalid fan-out segment");
+		close(fd);
+		return CAEN_FELib_GenericError;
+	}
+	r->size = header->size;
+	// the ring is read-only
+	void* const ring = mmap(NULL, (size_t)r->size, PROT_READ, MAP_SHARED, fd, (off_t)headerSize);
+	close(fd);
+	if (ring == MAP_FAILED) {
+		_setLastLocalError("mmap failed: %s", strerror(errno));
+		return CAEN_FELib_GenericError;
+	}
+	r->ring = ring;
+	return CAEN_FELib_Success;
+}
+
+static void _free(CAEN_FELib_FanoutReader_t* r) {
+	if (r->ring != NULL)
+		munmap((void*)r->ring, (size_t)r->size);
+	if (r->header != NULL)
+		munmap(r->header, r->headerSize);
+	format_clear(&r->fmt);
+	free(r->buffer);
+	free(r);
+}
+
+static bool _claimSlot(CAEN_FELib_FanoutReader_t* r) {
+	const uint32_t pid = (uint32_t)getpid();
+	for (size_t i = 0; i < FANOUT_MAX_READERS; ++i) {
+		struct fanout_slot* const slot = &r->header->slots[i];
+		uint32_t expected = 0;
+		while (!ATOMIC_CAS_WEAK(&slot->pid, &expected, pid))
+			if (expected != 0)
+				break;
+		if (expected != 0)
+			continue;
+		r->slot = slot;
+		// new readers get only the events published from now on
+		r->cursor = ATOMIC_LOAD_ACQUIRE(&r->header->head);
+		// loaded after head, it may include records after cursor: losses are never overestimated
+		r->nextSequence = ATOMIC_LOAD_RELAXED(&r->header->published);
+		ATOMIC_STORE_RELAXED(&slot->cursor, r->cursor);
+		ATOMIC_STORE_RELEASE(&slot->block, (uint32_t)r->block);
+		return true;
+	}
+	return false;
+}
+
+int fanout_open(const char* name, const char* options, CAEN_FELib_FanoutReader_t** reader) {
+	if (!_checkArgs(name, reader))
+		return CAEN_FELib_InvalidParam;
+	if (!_checkName(name))
+		return CAEN_FELib_InvalidParam;
+	CAEN_FELib_FanoutReader_t* const r = calloc(1, sizeof(*r));
+	if (r == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	int ret = _parseReaderOptions(r, options);
+	if (ret == CAEN_FELib_Success)
+		ret = _map(r, name);
+	if (ret == CAEN_FELib_Success && !_claimSlot(r)) {
+		_setLastLocalError("too many fan-out readers (maximum %d)", FANOUT_MAX_READERS);
+		ret = CAEN_FELib_CommandError;
+	}
+	if (ret != CAEN_FELib_Success) {
+		_free(r);
+		return ret;
+	}
+	r->lastCheck = utils_now();
+	*reader = r;
+	return CAEN_FELib_Success;
+}
+
+int fanout_close(CAEN_FELib_FanoutReader_t* r) {
+	if (r == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	ATOMIC_STORE_RELEASE(&r->slot->block, 0);
+	uint32_t pid = (uint32_t)getpid();
+	ATOMIC_CAS_WEAK(&r->slot->pid, &pid, 0);
+	_free(r);
+	return CAEN_FELib_Success;
+}
+
+static void _advance(CAEN_FELib_FanoutReader_t* r, uint64_t position) {
+	r->cursor = position;
+	ATOMIC_STORE_RELEASE(&r->slot->cursor, position);
+}
+
+// true if the record at cursor has been overwritten while being copied
+static bool _overwritten(const CAEN_FELib_FanoutReader_t* r) {
+	ATOMIC_FENCE_ACQUIRE();
+	return ATOMIC_LOAD_RELAXED(&r->header->tail) > r->cursor;
+}
+
+// parse the current format, return false if it is not the one of the event
+static bool _loadFormat(CAEN_FELib_FanoutReader_t* r, uint32_t generation) {
+	const struct fanout_header* const header = r->header;
+	char* const json = malloc(FANOUT_MAX_FORMAT_SIZE);
+	if (json == NULL)
+		return false;
+	uint32_t current;
+	uint64_t nChannels;
+	for (;;) {
+		const uint32_t seq = ATOMIC_LOAD_ACQUIRE(&header->formatSeq);
+		if (seq % 2 != 0)
+			continue;
+		current = header->formatGeneration;
+		nChannels = header->nChannels;
+		memcpy(json, header->format, FANOUT_MAX_FORMAT_SIZE);
+		ATOMIC_FENCE_ACQUIRE();
+		if (ATOMIC_LOAD_RELAXED(&header->formatSeq) == seq)
+			break;
+	}
+	json[FANOUT_MAX_FORMAT_SIZE - 1] = '\0';
+	format_clear(&r->fmt);
+	r->formatGeneration = 0;
+	const bool ok = (current == generation && format_parse(&r->fmt, json, (size_t)nChannels) == CAEN_FELib_Success);
+	free(json);
+	if (ok)
+		r->formatGeneration = generation;
+	return ok;
+}
+
+static bool _reserveBuffer(CAEN_FELib_FanoutReader_t* r, size_t size) {
+	if (size <= r->bufferSize)
+		return true;
+	char* const buffer = realloc(r->buffer, size);
+	if (buffer == NULL)
+		return false;
+	r->buffer = buffer;
+	r->bufferSize = size;
+	return true;
+}
+
+static int _corrupted(void) {
+	_setLastLocalError("corrupted fan-out ring");
+	return CAEN_FELib_GenericError;
+}
+
+#define FANOUT_NEXT		1	// record consumed without output, see _readRecord
+
+// read the record at cursor, that is before head: return FANOUT_NEXT to read the next one
+static int _readRecord(CAEN_FELib_FanoutReader_t* r, CAEN_FELib_Event_t* event) {
+	if (ATOMIC_LOAD_ACQUIRE(&r->header->tail) > r->cursor) {
+		// overwritten: records skipped are counted on the next one, using sequences
+		_advance(r, ATOMIC_LOAD_ACQUIRE(&r->header->tail));
+		return FANOUT_NEXT;
+	}
+	const uint64_t offset = r->cursor & (r->size - 1);
+	const uint64_t left = r->size - offset;
+	if (left < sizeof(struct fanout_record)) {
+		_advance(r, r->cursor + left);
+		return FANOUT_NEXT;
+	}
+	struct fanout_record record;
+	memcpy(&record, r->ring + offset, sizeof(record));
+	if (_overwritten(r))
+		return FANOUT_NEXT;
+	const uint64_t total = _recordSize(&record);
+	if (total > left || record.type < FanoutRecordEvent || record.type > FanoutRecordPadding)
+		return _corrupted();
+	if (record.type == FanoutRecordPadding) {
+		_advance(r, r->cursor + total);
+		return FANOUT_NEXT;
+	}
+	if (record.sequence > r->nextSequence)
+		r->lost += record.sequence - r->nextSequence;
+	r->nextSequence = record.sequence + 1;
+	if (record.type == FanoutRecordEvent) {
+		if (++r->sampleCounter < r->sampling) {
+			++r->skipped;
+			_advance(r, r->cursor + total);
+			return FANOUT_NEXT;
+		}
+		r->sampleCounter = 0;
+		// events of a format already replaced cannot be decoded
+		if (record.formatGeneration != r->formatGeneration && !_loadFormat(r, record.formatGeneration)) {
+			++r->lost;
+			_advance(r, r->cursor + total);
+			return FANOUT_NEXT;
+		}
+		if (!_reserveBuffer(r, record.size)) {
+			_setLastLocalError("realloc failed");
+			return CAEN_FELib_InternalError;
+		}
+		memcpy(r->buffer, r->ring + offset + sizeof(record), record.size);
+		if (_overwritten(r)) {
+			++r->lost;
+			return FANOUT_NEXT;
+		}
+	}
+	_advance(r, r->cursor + total);
+	event->index = record.sequence;
+	event->time = record.time;
+	event->format = (r->formatGeneration != 0) ? r->fmt.json : "";
+	event->reserved[0] = r->formatGeneration;
+	event->reserved[1] = 0;
+	if (record.type == FanoutRecordStop) {
+		event->payload = NULL;
+		event->size = 0;
+		return CAEN_FELib_Stop;
+	}
+	event->payload = r->buffer;
+	event->size = record.size;
+	++r->read;
+	return CAEN_FELib_Success;
+}
+
+// wait for new records after head, or until deadline
+static int _wait(CAEN_FELib_FanoutReader_t* r, uint64_t head, uint64_t deadline) {
+	struct fanout_header* const header = r->header;
+	if (ATOMIC_LOAD_ACQUIRE(&header->closed)) {
+		_setLastLocalError("fan-out stopped by the owner");
+		return CAEN_FELib_Disabled;
+	}
+	const uint64_t now = utils_now();
+	if (now - r->lastCheck >= FANOUT_CHECK_PERIOD) {
+		r->lastCheck = now;
+		if (!_isAlive(header->pid)) {
+			_setLastLocalError("fan-out owner terminated");
+			return CAEN_FELib_Disabled;
+		}
+	}
+	if (now >= deadline) {
+		_setLastLocalError("timeout");
+		return CAEN_FELib_Timeout;
+	}
+	uint64_t wait = deadline - now;
+	if (wait > FANOUT_CHECK_PERIOD)
+		wait = FANOUT_CHECK_PERIOD;
+#ifdef __linux__
+	const uint32_t notify = ATOMIC_LOAD_ACQUIRE(&header->notify);
+	ATOMIC_FETCH_ADD(&header->waiters, 1);
+	// the increment of waiters must be visible before the load of head, see _commit
+	if (ATOMIC_LOAD_ACQUIRE(&header->head) == head && !ATOMIC_LOAD_ACQUIRE(&header->closed) && !ATOMIC_LOAD_ACQUIRE(&r->interrupted)) {
+		const struct timespec ts = {
+			.tv_sec = (time_t)(wait / UINT64_C(1000000000)),
+			.tv_nsec = (long)(wait % UINT64_C(1000000000)),
+		};
+		syscall(SYS_futex, &header->notify, FUTEX_WAIT, notify, &ts, NULL, 0);
+	}
+	ATOMIC_FETCH_ADD(&header->waiters, (uint32_t)-1);
+#else
+	if (wait > FANOUT_POLL_PERIOD)
+		wait = FANOUT_POLL_PERIOD;
+	const struct timespec ts = {
+		.tv_sec = 0,
+		.tv_nsec = (long)wait,
+	};
+	nanosleep(&ts, NULL);
+#endif
+	return CAEN_FELib_Success;
+}
+
+int fanout_read(CAEN_FELib_FanoutReader_t* r, int timeout, CAEN_FELib_Event_t* event) {
+	if (!_checkArgs(r, event))
+		return CAEN_FELib_InvalidParam;
+	const uint64_t deadline = (timeout < 0) ? UINT64_MAX : utils_now() + (uint64_t)timeout * UINT64_C(1000000);
+	for (;;) {
+		if (UNLIKELY(ATOMIC_LOAD_ACQUIRE(&r->interrupted))) {
+			ATOMIC_STORE_RELAXED(&r->interrupted, 0);
+			_setLastLocalError("interrupted");
+			return CAEN_FELib_Interrupted;
+		}
+		const uint64_t head = ATOMIC_LOAD_ACQUIRE(&r->header->head);
+		if (r->cursor == head) {
+			const int ret = _wait(r, head, deadline);
+			if (ret != CAEN_FELib_Success)
+				return ret;
+			continue;
+		}
+		const int ret = _readRecord(r, event);
+		if (ret != FANOUT_NEXT)
+			return ret;
+	}
+}
+
+int fanout_interrupt(CAEN_FELib_FanoutReader_t* r) {
+	if (!_checkArgs(r, r))
+		return CAEN_FELib_InvalidParam;
+	ATOMIC_STORE_RELEASE(&r->interrupted, 1);
+	// the increment of notify makes a concurrent futex wait fail, see _wait; other readers wake up spuriously
+	_wakeAll(r->header);
+	return CAEN_FELib_Success;
+}
+
+int fanout_getField(CAEN_FELib_FanoutReader_t* r, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count) {
+	if (!_checkArgs(r, event) || !_checkArgs(name, data) || !_checkArgs(count, event))
+		return CAEN_FELib_InvalidParam;
+	if (event->payload != r->buffer || event->reserved[0] != r->formatGeneration || r->formatGeneration == 0) {
+		_setLastLocalError("event not returned by the last CAEN_FELib_ReadFanoutEvent");
+		return CAEN_FELib_InvalidParam;
+	}
+	const struct format* const fmt = &r->fmt;
+	const int field = format_find(fmt, name);
+	if (field < 0) {
+		_setLastLocalError("field %s not found", name);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (fmt->fields[field].dim == 2 && channel >= fmt->nChannels) {
+		_setLastLocalError("channel %zu out of range (%zu channels)", channel, fmt->nChannels);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (!evfile_field(fmt, event->payload, event->size, (size_t)field, channel, data, count))
+		return _corrupted();
+	return CAEN_FELib_Success;
+}
+
+int fanout_getStatus(CAEN_FELib_FanoutReader_t* r, CAEN_FELib_FanoutStatus_t* status) {
+	if (!_checkArgs(r, status))
+		return CAEN_FELib_InvalidParam;
+	const struct fanout_header* const header = r->header;
+	status->read = r->read;
+	status->lost = r->lost;
+	status->skipped = r->skipped;
+	status->published = ATOMIC_LOAD_RELAXED(&header->published);
+	status->dropped = ATOMIC_LOAD_RELAXED(&header->dropped);
+	status->backlog = ATOMIC_LOAD_ACQUIRE(&header->head) - r->cursor;
+	status->pid = header->pid;
+	status->closed = (int)ATOMIC_LOAD_ACQUIRE(&header->closed);
+	return CAEN_FELib_Success;
+}
+
+const struct format* fanout_getFormat(const CAEN_FELib_FanoutReader_t* r) {
+	return (r->formatGeneration != 0) ? &r->fmt : NULL;
+}
+
+#else
+
+static int _notSupported(void) {
+	_setLastLocalError("fan-out not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+int fanout_start(struct fanout** fanout, const char* name, const char* source, const char* endpoint, const struct format* fmt, const char* options) {
+	return _notSupported();
+}
+
+int fanout_stop(struct fanout** fanout) {
+	return CAEN_FELib_Success;
+}
+
+void fanout_onFormat(struct fanout* fanout, const struct format* fmt) {}
+void fanout_onEvent(struct fanout* fanout, const struct format* fmt, const struct format_args* args) {}
+void fanout_onStop(struct fanout* fanout) {}
+
+int fanout_open(const char* name, const char* options, CAEN_FELib_FanoutReader_t** reader) {
+	return _notSupported();
+}
+
+int fanout_close(CAEN_FELib_FanoutReader_t* reader) {
+	return _notSupported();
+}
+
+int fanout_interrupt(CAEN_FELib_FanoutReader_t* reader) {
+	return _notSupported();
+}
+
+int fanout_read(CAEN_FELib_FanoutReader_t* reader, int timeout, CAEN_FELib_Event_t* event) {
+	return _notSupported();
+}
+
+int fanout_getField(CAEN_FELib_FanoutReader_t* reader, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count) {
+	return _notSupported();
+}
+
+int fanout_getStatus(CAEN_FELib_FanoutReader_t* reader, CAEN_FELib_FanoutStatus_t* status) {
+	return _notSupported();
+}
+
+const struct format* fanout_getFormat(const CAEN_FELib_FanoutReader_t* reader) {
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,90 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		fanout.h
+*	\brief		Shared memory fan-out of events
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_FANOUT_H_
+#define CAEN_INCLUDE_FANOUT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "format.h"
+#include "utils.h"
+
+/*
+ * Fan-out of the events read from an endpoint to other local processes, through a ring on a
+ * POSIX shared memory segment.
+ *
+ * The owner of the connection is the only writer: events are serialized in place on the ring,
+ * in the layout of event files (see evfile.h), by the thread that reads them. The writer never
+ * waits: when the ring is full the oldest records are overwritten, unless they have not been
+ * read yet by a reader with block policy, in which case the new event is dropped.
+ *
+ * Readers map the ring read-only and have independent cursors. Each reader copies a record and
+ * then checks that the writer has not overwritten it in the meantime, as with sequence locks.
+ */
+
+// number of fan-outs in progress
+extern uint_fast32_t fanoutCount;
+
+static inline bool fanout_isActive(void) {
+	return UNLIKELY(ATOMIC_LOAD_RELAXED(&fanoutCount) != 0);
+}
+
+struct fanout;
+
+// writer, return a CAEN_FELib_ErrorCode, set last error on failure
+int fanout_start(struct fanout** fanout, const char* name, const char* source, const char* endpoint, const struct format* fmt, const char* options);
+int fanout_stop(struct fanout** fanout);
+
+// functions invoked on the reading thread, that never block; events that cannot be published are counted as dropped
+void fanout_onFormat(struct fanout* fanout, const struct format* fmt);
+void fanout_onEvent(struct fanout* fanout, const struct format* fmt, const struct format_args* args);
+void fanout_onStop(struct fanout* fanout);
+
+// readers, return a CAEN_FELib_ErrorCode, set last error on failure
+int fanout_open(const char* name, const char* options, CAEN_FELib_FanoutReader_t** reader);
+int fanout_close(CAEN_FELib_FanoutReader_t* reader);
+int fanout_read(CAEN_FELib_FanoutReader_t* reader, int timeout, CAEN_FELib_Event_t* event);
+// the pending or next fanout_read() returns CAEN_FELib_Interrupted; can be called from any thread
+int fanout_interrupt(CAEN_FELib_FanoutReader_t* reader);
+int fanout_getField(CAEN_FELib_FanoutReader_t* reader, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void** data, size_t* count);
+int fanout_getStatus(CAEN_FELib_FanoutReader_t* reader, CAEN_FELib_FanoutStatus_t* status);
+
+// format of the last event read, identified by event->reserved[0]; NULL if it cannot be parsed
+const struct format* fanout_getFormat(const CAEN_FELib_FanoutReader_t* reader);
+
+#endif /* CAEN_INCLUDE_FANOUT_H_ */
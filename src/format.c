@@ -0,0 +1,292 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		format.c
+*	\brief		Read data format
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "format.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CAEN_FELib.h"
+#include "json.h"
+#include "utils.h"
+
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#else
+#include <strings.h> // strcasecmp
+#endif
+
+static const struct {
+	const char*						name;
+	enum format_type				type;
+	size_t							size;
+} formatTypes[] = {
+	{ "U8",				FormatTypeU8,			sizeof(uint8_t) },
+	{ "U16",			FormatTypeU16,			sizeof(uint16_t) },
+	{ "U32",			FormatTypeU32,			sizeof(uint32_t) },
+	{ "U64",			FormatTypeU64,			sizeof(uint64_t) },
+	{ "I8",				FormatTypeI8,			sizeof(int8_t) },
+	{ "I16",			FormatTypeI16,			sizeof(int16_t) },
+	{ "I32",			FormatTypeI32,			sizeof(int32_t) },
+	{ "I64",			FormatTypeI64,			sizeof(int64_t) },
+	{ "CHAR",			FormatTypeChar,			sizeof(char) },
+	{ "BOOL",			FormatTypeBool,			sizeof(bool) },
+	{ "SIZE_T",			FormatTypeSizeT,		sizeof(size_t) },
+	{ "PTRDIFF_T",		FormatTypePtrdiffT,		sizeof(ptrdiff_t) },
+	{ "FLOAT",			FormatTypeFloat,		sizeof(float) },
+	{ "DOUBLE",			FormatTypeDouble,		sizeof(double) },
+	{ "LONG DOUBLE",	FormatTypeLongDouble,	sizeof(long double) },
+};
+
+static bool _isInteger(enum format_type type) {
+	return type != FormatTypeFloat && type != FormatTypeDouble && type != FormatTypeLongDouble;
+}
+
+int format_find(const struct format* fmt, const char* name) {
+	for (size_t i = 0; i < fmt->nFields; ++i)
+		if (strcasecmp(fmt->fields[i].name, name) == 0)
+			return (int)i;
+	return -1;
+}
+
+static int _findSizeField(const struct format* fmt, size_t i) {
+	const struct format_field* const field = &fmt->fields[i];
+	char name[FORMAT_NAME_SIZE + 5];
+	int candidates[3];
+	snprintf(name, ARRAY_SIZE(name), "%s_SIZE", field->name);
+	candidates[0] = format_find(fmt, name);
+	candidates[1] = (strcasecmp(field->name, "DATA") == 0) ? format_find(fmt, "SIZE") : -1;
+	candidates[2] = format_find(fmt, "WAVEFORM_SIZE");
+	for (size_t c = 0; c < ARRAY_SIZE(candidates); ++c) {
+		const int s = candidates[c];
+		if (s < 0 || (size_t)s == i)
+			continue;
+		const struct format_field* const size = &fmt->fields[s];
+		if (_isInteger(size->type) && size->dim + 1 == field->dim)
+			return s;
+	}
+	return -1;
+}
+
+int format_parse(struct format* fmt, const char* json, size_t nChannels) {
+	fmt->nFields = 0;
+	fmt->nChannels = nChannels;
+	fmt->json = NULL;
+	struct json* const root = json_parse(json);
+	if (root == NULL || root->type != JsonArray) {
+		json_free(root);
+		_setLastLocalError("invalid read data format: not a JSON array");
+		return CAEN_FELib_InvalidParam;
+	}
+	for (const struct json* e = root->child; e != NULL; e = e->next) {
+		if (fmt->nFields == ARRAY_SIZE(fmt->fields)) {
+			_setLastLocalError("invalid read data format: too many fields (limited to %zu)", ARRAY_SIZE(fmt->fields));
+			goto error;
+		}
+		const char* const name = json_string(json_get(e, "name"), NULL);
+		const char* const type = json_string(json_get(e, "type"), NULL);
+		const double dim = json_number(json_get(e, "dim"), 0.);
+		if (name == NULL || type == NULL || strlen(name) >= FORMAT_NAME_SIZE) {
+			_setLastLocalError("invalid read data format: invalid field %zu", fmt->nFields);
+			goto error;
+		}
+		if (dim < 0. || dim > 2. || dim != (unsigned)dim) {
+			_setLastLocalError("invalid read data format: unsupported dim of field %s", name);
+			goto error;
+		}
+		struct format_field* const field = &fmt->fields[fmt->nFields];
+		size_t t;
+		for (t = 0; t < ARRAY_SIZE(formatTypes); ++t)
+			if (strcasecmp(formatTypes[t].name, type) == 0)
+				break;
+		if (t == ARRAY_SIZE(formatTypes)) {
+			_setLastLocalError("invalid read data format: unknown type '%s' of field %s", type, name);
+			goto error;
+		}
+		field->name[0] = '\0';
+		strncat(field->name, name, ARRAY_SIZE(field->name) - 1);
+		field->type = formatTypes[t].type;
+		field->typeSize = formatTypes[t].size;
+		field->dim = (unsigned)dim;
+		field->sizeField = -1;
+		++fmt->nFields;
+	}
+	json_free(root);
+	for (size_t i = 0; i < fmt->nFields; ++i)
+		if (fmt->fields[i].dim != 0)
+			fmt->fields[i].sizeField = _findSizeField(fmt, i);
+	for (size_t i = 0; i < fmt->nFields; ++i) {
+		const int s = fmt->fields[i].sizeField;
+		if (fmt->fields[i].dim == 2 && s >= 0 && fmt->fields[s].sizeField < 0)
+			fmt->fields[s].sizeField = FORMAT_SIZE_NCHANNELS;
+	}
+	fmt->json = strdup(json);
+	if (fmt->json == NULL) {
+		_setLastLocalError("strdup failed");
+		fmt->nFields = 0;
+		return CAEN_FELib_InternalError;
+	}
+	return CAEN_FELib_Success;
+error:
+	json_free(root);
+	fmt->nFields = 0;
+	return CAEN_FELib_InvalidParam;
+}
+
+void format_clear(struct format* fmt) {
+	free(fmt->json);
+	fmt->json = NULL;
+	fmt->nFields = 0;
+}
+
+bool format_isSizeable(const struct format* fmt) {
+	for (size_t i = 0; i < fmt->nFields; ++i) {
+		const struct format_field* const field = &fmt->fields[i];
+		if (field->dim != 0 && field->sizeField == -1)
+			return false;
+		if ((field->dim == 2 || field->sizeField == FORMAT_SIZE_NCHANNELS) && fmt->nChannels == 0)
+			return false;
+	}
+	return true;
+}
+
+void format_getArgs(const struct format* fmt, va_list args, struct format_args* out) {
+	for (size_t i = 0; i < fmt->nFields; ++i)
+		out->ptr[i] = va_arg(args, void*);
+}
+
+uint64_t format_loadUnsigned(const void* p, enum format_type type) {
+	switch (type) {
+	case FormatTypeU8:			return *(const uint8_t*)p;
+	case FormatTypeU16:			return *(const uint16_t*)p;
+	case FormatTypeU32:			return *(const uint32_t*)p;
+	case FormatTypeU64:			return *(const uint64_t*)p;
+	case FormatTypeI8:			return (uint64_t)*(const int8_t*)p;
+	case FormatTypeI16:			return (uint64_t)*(const int16_t*)p;
+	case FormatTypeI32:			return (uint64_t)*(const int32_t*)p;
+	case FormatTypeI64:			return (uint64_t)*(const int64_t*)p;
+	case FormatTypeChar:		return (uint64_t)*(const char*)p;
+	case FormatTypeBool:		return *(const bool*)p;
+	case FormatTypeSizeT:		return *(const size_t*)p;
+	case FormatTypePtrdiffT:	return (uint64_t)*(const ptrdiff_t*)p;
+	case FormatTypeFloat:		return (uint64_t)*(const float*)p;
+	case FormatTypeDouble:		return (uint64_t)*(const double*)p;
+	case FormatTypeLongDouble:	return (uint64_t)*(const long double*)p;
+	}
+	return 0;
+}
+
+double format_loadDouble(const void* p, enum format_type type) {
+	switch (type) {
+	case FormatTypeU8:			return *(const uint8_t*)p;
+	case FormatTypeU16:			return *(const uint16_t*)p;
+	case FormatTypeU32:			return *(const uint32_t*)p;
+	case FormatTypeU64:			return (double)*(const uint64_t*)p;
+	case FormatTypeI8:			return *(const int8_t*)p;
+	case FormatTypeI16:			return *(const int16_t*)p;
+	case FormatTypeI32:			return *(const int32_t*)p;
+	case FormatTypeI64:			return (double)*(const int64_t*)p;
+	case FormatTypeChar:		return *(const char*)p;
+	case FormatTypeBool:		return *(const bool*)p;
+	case FormatTypeSizeT:		return (double)*(const size_t*)p;
+	case FormatTypePtrdiffT:	return (double)*(const ptrdiff_t*)p;
+	case FormatTypeFloat:		return *(const float*)p;
+	case FormatTypeDouble:		return *(const double*)p;
+	case FormatTypeLongDouble:	return (double)*(const long double*)p;
+	}
+	return 0.;
+}
+
+void format_storeUnsigned(void* p, enum format_type type, uint64_t value) {
+	switch (type) {
+	case FormatTypeU8:			*(uint8_t*)p = (uint8_t)value; break;
+	case FormatTypeU16:			*(uint16_t*)p = (uint16_t)value; break;
+	case FormatTypeU32:			*(uint32_t*)p = (uint32_t)value; break;
+	case FormatTypeU64:			*(uint64_t*)p = value; break;
+	case FormatTypeI8:			*(int8_t*)p = (int8_t)value; break;
+	case FormatTypeI16:			*(int16_t*)p = (int16_t)value; break;
+	case FormatTypeI32:			*(int32_t*)p = (int32_t)value; break;
+	case FormatTypeI64:			*(int64_t*)p = (int64_t)value; break;
+	case FormatTypeChar:		*(char*)p = (char)value; break;
+	case FormatTypeBool:		*(bool*)p = (value != 0); break;
+	case FormatTypeSizeT:		*(size_t*)p = (size_t)value; break;
+	case FormatTypePtrdiffT:	*(ptrdiff_t*)p = (ptrdiff_t)value; break;
+	case FormatTypeFloat:		*(float*)p = (float)value; break;
+	case FormatTypeDouble:		*(double*)p = (double)value; break;
+	case FormatTypeLongDouble:	*(long double*)p = (long double)value; break;
+	}
+}
+
+size_t format_count(const struct format* fmt, const struct format_args* args, size_t field, size_t ch) {
+	const struct format_field* const f = &fmt->fields[field];
+	if (f->sizeField == FORMAT_SIZE_NCHANNELS)
+		return fmt->nChannels;
+	if (f->sizeField < 0)
+		return 0;
+	const struct format_field* const s = &fmt->fields[f->sizeField];
+	const char* const p = args->ptr[f->sizeField];
+	if (p == NULL)
+		return 0;
+	switch (f->dim) {
+	case 1:
+		return (size_t)format_loadUnsigned(p, s->type);
+	case 2:
+		return (ch < fmt->nChannels) ? (size_t)format_loadUnsigned(p + ch * s->typeSize, s->type) : 0;
+	default:
+		return 0;
+	}
+}
+
+size_t format_eventSize(const struct format* fmt, const struct format_args* args) {
+	size_t size = 0;
+	for (size_t i = 0; i < fmt->nFields; ++i) {
+		const struct format_field* const f = &fmt->fields[i];
+		switch (f->dim) {
+		case 0:
+			size += f->typeSize;
+			break;
+		case 1:
+			size += format_count(fmt, args, i, 0) * f->typeSize;
+			break;
+		case 2:
+			for (size_t ch = 0; ch < fmt->nChannels; ++ch)
+				size += format_count(fmt, args, i, ch) * f->typeSize;
+			break;
+		}
+	}
+	return size;
+}
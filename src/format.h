@@ -0,0 +1,125 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		format.h
+*	\brief		Read data format
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_FORMAT_H_
+#define CAEN_INCLUDE_FORMAT_H_
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Read data format, as passed to CAEN_FELib_SetReadDataFormat().
+ *
+ * Each field of CAEN_FELib_ReadData() is a pointer:
+ * - dim 0: pointer to a scalar
+ * - dim 1: pointer to an array
+ * - dim 2: pointer to an array of pointers to arrays (one per channel)
+ *
+ * The number of valid elements of an array is not part of the format, but it is
+ * provided by another field of the same event, found using the naming convention
+ * of CAEN implementation libraries:
+ * - "<NAME>_SIZE", if present (e.g. WAVEFORM and WAVEFORM_SIZE)
+ * - "SIZE" for "DATA" (RAW endpoint)
+ * - "WAVEFORM_SIZE" for any other array (e.g. DPP probes)
+ * The size field of a dim 2 array must be a dim 1 array with an element per channel.
+ */
+
+#define FORMAT_MAX_FIELDS			64
+#define FORMAT_NAME_SIZE			32
+#define FORMAT_SIZE_NCHANNELS		(-2)	// sizeField of dim 1 fields sizing a dim 2 field: one element per channel
+
+enum format_type {
+	FormatTypeU8,
+	FormatTypeU16,
+	FormatTypeU32,
+	FormatTypeU64,
+	FormatTypeI8,
+	FormatTypeI16,
+	FormatTypeI32,
+	FormatTypeI64,
+	FormatTypeChar,
+	FormatTypeBool,
+	FormatTypeSizeT,
+	FormatTypePtrdiffT,
+	FormatTypeFloat,
+	FormatTypeDouble,
+	FormatTypeLongDouble,
+};
+
+struct format_field {
+	char							name[FORMAT_NAME_SIZE];
+	enum format_type				type;
+	size_t							typeSize;
+	unsigned						dim;
+	int								sizeField;	// index of the field containing the size, FORMAT_SIZE_NCHANNELS or -1 if scalar or not found
+};
+
+struct format {
+	size_t							nFields;
+	size_t							nChannels;	// number of arrays of dim 2 fields
+	char*							json;		// copy of the original string
+	struct format_field				fields[FORMAT_MAX_FIELDS];
+};
+
+// pointers passed to CAEN_FELib_ReadData(), one per field
+struct format_args {
+	void*							ptr[FORMAT_MAX_FIELDS];
+};
+
+// return a CAEN_FELib_ErrorCode, set last error on failure
+int format_parse(struct format* fmt, const char* json, size_t nChannels);
+void format_clear(struct format* fmt);
+int format_find(const struct format* fmt, const char* name);
+
+// true if the size of every array field can be resolved
+bool format_isSizeable(const struct format* fmt);
+
+// consume a copy of the va_list passed to CAEN_FELib_ReadDataV()
+void format_getArgs(const struct format* fmt, va_list args, struct format_args* out);
+
+uint64_t format_loadUnsigned(const void* p, enum format_type type);
+void format_storeUnsigned(void* p, enum format_type type, uint64_t value);
+double format_loadDouble(const void* p, enum format_type type);
+
+// number of valid elements of a dim 1 field, or of the channel ch of a dim 2 field; 0 if unknown
+size_t format_count(const struct format* fmt, const struct format_args* args, size_t field, size_t ch);
+
+// total payload size of an event, in bytes
+size_t format_eventSize(const struct format* fmt, const struct format_args* args);
+
+#endif /* CAEN_INCLUDE_FORMAT_H_ */
@@ -0,0 +1,224 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		group.c
+*	\brief		Group commands on several boards
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "group.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "utils.h"
+
+#ifndef _WIN32
+
+#define GROUP_MAX_BOARDS			128		// as the maximum number of connections
+#define GROUP_SPIN_PAUSES			1024	// polls of the barrier before yielding the processor
+
+struct group_worker {
+	size_t							index;
+	pthread_t						thread;
+	bool							pending;		// job assigned, with mutex locked
+	// result of the last job, written by the worker before completion
+	int								ret;
+	uint64_t						issue;			// monotonic time, ns
+	uint64_t						end;
+	char							description[1024];
+};
+
+static struct {
+	pthread_mutex_t					callMutex;		// held for the whole group command
+	pthread_mutex_t					mutex;			// protects the following fields, except the barrier
+	pthread_cond_t					cond;			// signaled on new jobs and stop requests
+	pthread_cond_t					doneCond;		// signaled on completed jobs
+	struct group_worker*			workers[GROUP_MAX_BOARDS];
+	size_t							nWorkers;
+	size_t							done;
+	bool							stopRequested;
+	// current job, constant while workers are pending
+	const uint64_t*					handles;
+	const char*						path;
+	group_command_t					command;
+	uint_fast32_t					generation;
+	// barrier, spun by workers and caller without mutex
+	uint_fast32_t					arrived;
+	uint_fast32_t					released;		// generation of the last job released
+} group = {
+	.callMutex = PTHREAD_MUTEX_INITIALIZER,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.doneCond = PTHREAD_COND_INITIALIZER,
+};
+
+static void _relax(unsigned spins) {
+	if (spins < GROUP_SPIN_PAUSES)
+		utils_pause();
+	else
+		sched_yield();
+}
+
+static void* _workerMain(void* arg) {
+	struct group_worker* const w = arg;
+	pthread_mutex_lock(&group.mutex);
+	for (;;) {
+		while (!group.stopRequested && !w->pending)
+			pthread_cond_wait(&group.cond, &group.mutex);
+		if (group.stopRequested)
+			break;
+		const uint_fast32_t generation = group.generation;
+		const uint64_t handle = group.handles[w->index];
+		const char* const path = group.path;
+		const group_command_t command = group.command;
+		pthread_mutex_unlock(&group.mutex);
+		ATOMIC_FETCH_ADD(&group.arrived, 1);
+		for (unsigned spins = 0; ATOMIC_LOAD_ACQUIRE(&group.released) != generation; ++spins)
+			_relax(spins);
+		w->issue = utils_now();
+		w->ret = command(handle, path);
+		w->end = utils_now();
+		if (w->ret != CAEN_FELib_Success)
+			CAEN_FELib_GetLastError(w->description);
+		pthread_mutex_lock(&group.mutex);
+		w->pending = false;
+		++group.done;
+		pthread_cond_signal(&group.doneCond);
+	}
+	pthread_mutex_unlock(&group.mutex);
+	return NULL;
+}
+
+// start workers up to n, to be called with mutex locked
+static int _startWorkers(size_t n) {
+	if (group.stopRequested) {
+		_setLastLocalError("group commands stopped");
+		return CAEN_FELib_GenericError;
+	}
+	while (group.nWorkers < n) {
+		struct group_worker* const w = calloc(1, sizeof(*w));
+		if (w == NULL) {
+			_setLastLocalError("calloc failed");
+			return CAEN_FELib_InternalError;
+		}
+		w->index = group.nWorkers;
+		if (pthread_create(&w->thread, NULL, _workerMain, w) != 0) {
+			free(w);
+			_setLastLocalError("group command failed: cannot create threads");
+			return CAEN_FELib_InternalError;
+		}
+		group.workers[group.nWorkers++] = w;
+	}
+	return CAEN_FELib_Success;
+}
+
+int group_sendCommand(const uint64_t* handles, size_t n, const char* path, group_command_t command, CAEN_FELib_CommandResult_t* results) {
+	if (n > GROUP_MAX_BOARDS) {
+		_setLastLocalError("too many boards: at most %d", GROUP_MAX_BOARDS);
+		return CAEN_FELib_InvalidParam;
+	}
+	pthread_mutex_lock(&group.callMutex);
+	pthread_mutex_lock(&group.mutex);
+	int ret = _startWorkers(n);
+	if (ret != CAEN_FELib_Success) {
+		pthread_mutex_unlock(&group.mutex);
+		pthread_mutex_unlock(&group.callMutex);
+		return ret;
+	}
+	group.handles = handles;
+	group.path = path;
+	group.command = command;
+	group.done = 0;
+	const uint_fast32_t generation = ++group.generation;
+	ATOMIC_STORE_RELAXED(&group.arrived, 0);
+	for (size_t i = 0; i < n; ++i)
+		group.workers[i]->pending = true;
+	pthread_cond_broadcast(&group.cond);
+	pthread_mutex_unlock(&group.mutex);
+
+	// release the barrier as soon as all the workers are spinning on it
+	for (unsigned spins = 0; ATOMIC_LOAD_ACQUIRE(&group.arrived) != (uint_fast32_t)n; ++spins)
+		_relax(spins);
+	ATOMIC_STORE_RELEASE(&group.released, generation);
+
+	pthread_mutex_lock(&group.mutex);
+	while (group.done != n)
+		pthread_cond_wait(&group.doneCond, &group.mutex);
+	pthread_mutex_unlock(&group.mutex);
+
+	uint64_t first = UINT64_MAX;
+	for (size_t i = 0; i < n; ++i)
+		if (group.workers[i]->issue < first)
+			first = group.workers[i]->issue;
+	for (size_t i = 0; i < n; ++i) {
+		const struct group_worker* const w = group.workers[i];
+		if (results != NULL) {
+			results[i].ret = w->ret;
+			results[i].skewNs = w->issue - first;
+			results[i].durationNs = w->end - w->issue;
+		}
+		if (ret == CAEN_FELib_Success && w->ret != CAEN_FELib_Success) {
+			ret = w->ret;
+			_setLastLocalError("board %zu: %s", i, w->description);
+		}
+	}
+	pthread_mutex_unlock(&group.callMutex);
+	return ret;
+}
+
+void group_deinit(void) {
+	pthread_mutex_lock(&group.mutex);
+	group.stopRequested = true;
+	pthread_cond_broadcast(&group.cond);
+	pthread_mutex_unlock(&group.mutex);
+	for (size_t i = 0; i < group.nWorkers; ++i) {
+		pthread_join(group.workers[i]->thread, NULL);
+		free(group.workers[i]);
+	}
+	group.nWorkers = 0;
+}
+
+#else
+
+int group_sendCommand(const uint64_t* handles, size_t n, const char* path, group_command_t command, CAEN_FELib_CommandResult_t* results) {
+	_setLastLocalError("group commands not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+void group_deinit(void) {}
+
+#endif
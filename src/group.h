@@ -0,0 +1,61 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		group.h
+*	\brief		Group commands on several boards
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_GROUP_H_
+#define CAEN_INCLUDE_GROUP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+
+/*
+ * Group commands, issued in parallel on several boards by a pool of worker threads, started with
+ * the first group command and kept until library unload. Workers wait on a spinning barrier
+ * released by the caller once all of them are ready, so that the issue skew is not affected by
+ * thread wake-up latency. Group commands are serialized.
+ */
+
+// command issued by each worker: return a CAEN_FELib_ErrorCode, set last error on failure
+typedef int (*group_command_t)(uint64_t handle, const char* path);
+
+// return the result of the first board that failed, set last error on failure; results can be NULL
+int group_sendCommand(const uint64_t* handles, size_t n, const char* path, group_command_t command, CAEN_FELib_CommandResult_t* results);
+
+// stop the workers, invoked at library unload
+void group_deinit(void);
+
+#endif /* CAEN_INCLUDE_GROUP_H_ */
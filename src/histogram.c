@@ -0,0 +1,394 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		histogram.c
+*	\brief		Online histograms
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+#define HISTOGRAM_MAX_HISTOGRAMS	16
+#define HISTOGRAM_MAX_BINS			(UINT32_C(1) << 24)		// per histogram and channel
+#define HISTOGRAM_MAX_CHANNELS		1024
+#define HISTOGRAM_NAME_SIZE			64
+
+struct histogram_axis {
+	char							field[FORMAT_NAME_SIZE];
+	int								index;		// index on the current format, -1 if not a scalar field
+	enum format_type				type;
+	bool							delta;		// difference from the previous event of the same channel
+	double							min;
+	double							max;
+	double							scale;		// bins per unit
+	size_t							bins;
+	// previous value of each channel, for delta axes; accessed only by the reading thread
+	double*							last;
+	bool*							hasLast;
+};
+
+struct histogram_def {
+	char							name[HISTOGRAM_NAME_SIZE];
+	struct histogram_axis			x;
+	struct histogram_axis			y;			// bins is 1 and field is empty on 1D histograms
+	size_t							nBins;
+	size_t							offset;		// first counter on partials
+	size_t							stride;		// counters per channel: out of range count and bins
+};
+
+// counters of a filling thread, written only by that thread
+struct histogram_partial {
+	struct histogram_partial*		next;
+	const void*						owner;
+	uint32_t						generation;	// reset generation of the counters
+	uint64_t						counters[];
+};
+
+struct histogram {
+	struct histogram_def			defs[HISTOGRAM_MAX_HISTOGRAMS];
+	size_t							nDefs;
+	size_t							nChannels;
+	int								channelField;	// -1 if not available
+	enum format_type				channelType;
+	size_t							nCounters;		// per partial
+	struct histogram_partial*		partials;		// lock-free list, only prepended
+	uint32_t						generation;		// incremented on reset
+	int								error;			// first error, histograms are no more filled
+	char							errorDescription[256];
+};
+
+uint_fast32_t histogramCount;
+
+// the address identifies the thread
+static THREAD_LOCAL char threadToken;
+
+static bool _parseAxis(struct histogram_axis* axis, const struct json* json, const struct format* fmt, size_t nChannels) {
+	const char* const field = json_string(json_get(json, "field"), NULL);
+	if (field == NULL || strlen(field) >= ARRAY_SIZE(axis->field))
+		return false;
+	strcpy(axis->field, field);
+	const int index = format_find(fmt, field);
+	if (index < 0 || fmt->fields[index].dim != 0)
+		return false;
+	const double bins = json_number(json_get(json, "bins"), 0.);
+	axis->min = json_number(json_get(json, "min"), 0.);
+	axis->max = json_number(json_get(json, "max"), 0.);
+	axis->delta = json_bool(json_get(json, "delta"), false);
+	if (!(bins >= 1 && bins <= HISTOGRAM_MAX_BINS) || !(axis->max > axis->min))
+		return false;
+	axis->bins = (size_t)bins;
+	axis->scale = (double)axis->bins / (axis->max - axis->min);
+	if (axis->delta) {
+		axis->last = calloc(nChannels, sizeof(*axis->last));
+		axis->hasLast = calloc(nChannels, sizeof(*axis->hasLast));
+	}
+	return true;
+}
+
+static void _free(struct histogram* h) {
+	for (size_t i = 0; i < h->nDefs; ++i) {
+		free(h->defs[i].x.last);
+		free(h->defs[i].x.hasLast);
+		free(h->defs[i].y.last);
+		free(h->defs[i].y.hasLast);
+	}
+	struct histogram_partial* p = h->partials;
+	while (p != NULL) {
+		struct histogram_partial* const next = p->next;
+		free(p);
+		p = next;
+	}
+	free(h);
+}
+
+static int _parseOptions(struct histogram* h, const struct format* fmt, const char* options) {
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid histogram options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	const int channelField = format_find(fmt, "CHANNEL");
+	const bool hasChannel = (channelField >= 0 && fmt->fields[channelField].dim == 0);
+	const double nChannels = json_number(json_get(root, "channels"), hasChannel ? 64. : 1.);
+	const struct json* const histograms = json_get(root, "histograms");
+	if (!(nChannels >= 1 && nChannels <= HISTOGRAM_MAX_CHANNELS) || histograms == NULL || histograms->type != JsonArray || json_size(histograms) == 0 || json_size(histograms) > HISTOGRAM_MAX_HISTOGRAMS) {
+		json_free(root);
+		_setLastLocalError("invalid histogram options: histograms must be an array of 1 to %d objects", HISTOGRAM_MAX_HISTOGRAMS);
+		return CAEN_FELib_InvalidParam;
+	}
+	h->nChannels = (size_t)nChannels;
+	for (const struct json* d = histograms->child; d != NULL; d = d->next) {
+		struct histogram_def* const def = &h->defs[h->nDefs++];
+		const char* const name = json_string(json_get(d, "name"), NULL);
+		const struct json* const y = json_get(d, "y");
+		bool valid = (name != NULL && strlen(name) < ARRAY_SIZE(def->name));
+		for (size_t i = 0; valid && i < h->nDefs - 1; ++i)
+			valid = (strcmp(h->defs[i].name, name) != 0);
+		if (valid) {
+			strcpy(def->name, name);
+			valid = _parseAxis(&def->x, json_get(d, "x"), fmt, h->nChannels);
+		}
+		if (valid && y != NULL) {
+			valid = _parseAxis(&def->y, y, fmt, h->nChannels);
+		} else {
+			def->y.index = -1;
+			def->y.bins = 1;
+		}
+		if (!valid || def->x.bins * def->y.bins > HISTOGRAM_MAX_BINS) {
+			json_free(root);
+			_setLastLocalError("invalid histogram options: histogram %zu must have a unique name and axes on scalar fields of the read data format with valid bins and range", h->nDefs - 1);
+			return CAEN_FELib_InvalidParam;
+		}
+		if ((def->x.delta && def->x.last == NULL) || (def->y.delta && def->y.last == NULL) || (def->x.delta && def->x.hasLast == NULL) || (def->y.delta && def->y.hasLast == NULL)) {
+			json_free(root);
+			_setLastLocalError("calloc failed");
+			return CAEN_FELib_InternalError;
+		}
+		def->nBins = def->x.bins * def->y.bins;
+		def->stride = def->nBins + 1;
+		def->offset = h->nCounters;
+		h->nCounters += def->stride * h->nChannels;
+	}
+	json_free(root);
+	return CAEN_FELib_Success;
+}
+
+int histogram_start(struct histogram** histogram, const struct format* fmt, const char* options) {
+	if (*histogram != NULL) {
+		_setLastLocalError("histograms already in progress");
+		return CAEN_FELib_CommandError;
+	}
+	struct histogram* const h = calloc(1, sizeof(*h));
+	if (h == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	const int ret = _parseOptions(h, fmt, options);
+	if (ret != CAEN_FELib_Success) {
+		_free(h);
+		return ret;
+	}
+	histogram_onFormat(h, fmt);
+	*histogram = h;
+	ATOMIC_FETCH_ADD(&histogramCount, 1);
+	return CAEN_FELib_Success;
+}
+
+int histogram_stop(struct histogram** histogram) {
+	struct histogram* const h = *histogram;
+	if (h == NULL)
+		return CAEN_FELib_Success;
+	*histogram = NULL;
+	ATOMIC_FETCH_ADD(&histogramCount, (uint_fast32_t)-1);
+	const int ret = h->error;
+	if (ret != CAEN_FELib_Success)
+		_setLastLocalError("%s", h->errorDescription);
+	_free(h);
+	return ret;
+}
+
+static const struct histogram_def* _findDef(const struct histogram* h, const char* name) {
+	for (size_t i = 0; i < h->nDefs; ++i)
+		if (strcmp(h->defs[i].name, name) == 0)
+			return &h->defs[i];
+	return NULL;
+}
+
+int histogram_get(struct histogram* histogram, const char* name, size_t channel, uint64_t* bins, size_t size, CAEN_FELib_HistogramInfo_t* info) {
+	const struct histogram_def* const def = _findDef(histogram, name);
+	if (def == NULL) {
+		_setLastLocalError("histogram '%s' not found", name);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (channel >= histogram->nChannels) {
+		_setLastLocalError("invalid channel %zu", channel);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (bins != NULL && size < def->nBins) {
+		_setLastLocalError("size %zu smaller than the number of bins %zu", size, def->nBins);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (bins != NULL)
+		memset(bins, 0, def->nBins * sizeof(*bins));
+	uint64_t entries = 0;
+	uint64_t outOfRange = 0;
+	const uint32_t generation = ATOMIC_LOAD_ACQUIRE(&histogram->generation);
+	for (const struct histogram_partial* p = ATOMIC_LOAD_ACQUIRE(&histogram->partials); p != NULL; p = p->next) {
+		// partials not yet cleared after a reset are ignored
+		if (ATOMIC_LOAD_ACQUIRE(&p->generation) != generation)
+			continue;
+		const uint64_t* const counters = &p->counters[def->offset + channel * def->stride];
+		outOfRange += ATOMIC_LOAD_RELAXED(&counters[0]);
+		for (size_t i = 0; i < def->nBins; ++i) {
+			const uint64_t value = ATOMIC_LOAD_RELAXED(&counters[1 + i]);
+			entries += value;
+			if (bins != NULL)
+				bins[i] += value;
+		}
+	}
+	if (info != NULL) {
+		info->binsX = def->x.bins;
+		info->binsY = def->y.bins;
+		info->minX = def->x.min;
+		info->maxX = def->x.max;
+		info->minY = def->y.min;
+		info->maxY = def->y.max;
+		info->entries = entries;
+		info->outOfRange = outOfRange;
+	}
+	return CAEN_FELib_Success;
+}
+
+void histogram_reset(struct histogram* histogram) {
+	ATOMIC_FETCH_ADD(&histogram->generation, 1);
+}
+
+static void _resolveAxis(struct histogram_axis* axis, const struct format* fmt) {
+	if (axis->field[0] == '\0')
+		return;
+	axis->index = format_find(fmt, axis->field);
+	if (axis->index >= 0 && fmt->fields[axis->index].dim != 0)
+		axis->index = -1;
+	if (axis->index >= 0)
+		axis->type = fmt->fields[axis->index].type;
+}
+
+void histogram_onFormat(struct histogram* histogram, const struct format* fmt) {
+	histogram->channelField = format_find(fmt, "CHANNEL");
+	if (histogram->channelField >= 0 && fmt->fields[histogram->channelField].dim != 0)
+		histogram->channelField = -1;
+	if (histogram->channelField >= 0)
+		histogram->channelType = fmt->fields[histogram->channelField].type;
+	// histograms on fields missing on the new format are not filled
+	for (size_t i = 0; i < histogram->nDefs; ++i) {
+		_resolveAxis(&histogram->defs[i].x, fmt);
+		_resolveAxis(&histogram->defs[i].y, fmt);
+	}
+}
+
+static struct histogram_partial* _getPartial(struct histogram* h) {
+	struct histogram_partial* p = ATOMIC_LOAD_ACQUIRE(&h->partials);
+	for (; p != NULL; p = p->next)
+		if (p->owner == &threadToken)
+			return p;
+	p = calloc(1, sizeof(*p) + h->nCounters * sizeof(*p->counters));
+	if (p == NULL) {
+		h->error = CAEN_FELib_InternalError;
+		snprintf(h->errorDescription, ARRAY_SIZE(h->errorDescription), "histograms aborted: calloc failed");
+		return NULL;
+	}
+	p->owner = &threadToken;
+	p->generation = ATOMIC_LOAD_ACQUIRE(&h->generation);
+	struct histogram_partial* head = ATOMIC_LOAD_RELAXED(&h->partials);
+	do {
+		p->next = head;
+	} while (!ATOMIC_CAS_WEAK(&h->partials, &head, p));
+	return p;
+}
+
+enum histogram_bin {
+	HistogramBinValid,
+	HistogramBinOutOfRange,
+	HistogramBinNone,		// first event of a channel on a delta axis
+};
+
+static enum histogram_bin _axisBin(struct histogram_axis* axis, const struct format_args* args, size_t channel, size_t* bin) {
+	if (axis->field[0] == '\0') {
+		*bin = 0;
+		return HistogramBinValid;
+	}
+	double value = format_loadDouble(args->ptr[axis->index], axis->type);
+	if (axis->delta) {
+		const bool hasLast = axis->hasLast[channel];
+		const double last = axis->last[channel];
+		axis->last[channel] = value;
+		axis->hasLast[channel] = true;
+		if (!hasLast)
+			return HistogramBinNone;
+		value -= last;
+	}
+	if (!(value >= axis->min && value < axis->max))
+		return HistogramBinOutOfRange;
+	*bin = (size_t)((value - axis->min) * axis->scale);
+	// rounding close to max
+	if (*bin >= axis->bins)
+		*bin = axis->bins - 1;
+	return HistogramBinValid;
+}
+
+static void _increment(uint64_t* counter) {
+	ATOMIC_STORE_RELAXED(counter, ATOMIC_LOAD_RELAXED(counter) + 1);
+}
+
+void histogram_onEvent(struct histogram* histogram, const struct format_args* args) {
+	if (histogram->error != CAEN_FELib_Success)
+		return;
+	struct histogram_partial* const p = _getPartial(histogram);
+	if (p == NULL)
+		return;
+	const uint32_t generation = ATOMIC_LOAD_ACQUIRE(&histogram->generation);
+	if (p->generation != generation) {
+		for (size_t i = 0; i < histogram->nCounters; ++i)
+			ATOMIC_STORE_RELAXED(&p->counters[i], 0);
+		ATOMIC_STORE_RELEASE(&p->generation, generation);
+	}
+	size_t channel = 0;
+	if (histogram->channelField >= 0) {
+		const uint64_t value = format_loadUnsigned(args->ptr[histogram->channelField], histogram->channelType);
+		if (value >= histogram->nChannels)
+			return;
+		channel = (size_t)value;
+	}
+	for (size_t i = 0; i < histogram->nDefs; ++i) {
+		struct histogram_def* const def = &histogram->defs[i];
+		if (def->x.index < 0 || (def->y.field[0] != '\0' && def->y.index < 0))
+			continue;
+		uint64_t* const counters = &p->counters[def->offset + channel * def->stride];
+		size_t x;
+		size_t y;
+		// both axes are evaluated, to update the previous values of delta axes
+		const enum histogram_bin binX = _axisBin(&def->x, args, channel, &x);
+		const enum histogram_bin binY = _axisBin(&def->y, args, channel, &y);
+		if (binX == HistogramBinNone || binY == HistogramBinNone)
+			continue;
+		if (binX == HistogramBinValid && binY == HistogramBinValid)
+			_increment(&counters[1 + y * def->x.bins + x]);
+		else
+			_increment(&counters[0]);
+	}
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		histogram.h
+*	\brief		Online histograms
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_HISTOGRAM_H_
+#define CAEN_INCLUDE_HISTOGRAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "format.h"
+#include "utils.h"
+
+/*
+ * Online histograms of scalar fields of the events of an endpoint, filled by the threads reading
+ * the endpoint (CAEN_FELib_ReadData() callers, recording, event pool and merger threads).
+ *
+ * Each filling thread has its own partial histograms, written only by that thread: filling does
+ * not require atomic read-modify-write nor locks, and threads do not contend on counters.
+ * Snapshots sum the partials. Reset is lazy: partials are cleared by their thread on
+ * the next event, and partials not yet cleared are ignored by snapshots.
+ */
+
+// number of histograms in progress
+extern uint_fast32_t histogramCount;
+
+static inline bool histogram_isActive(void) {
+	return UNLIKELY(ATOMIC_LOAD_RELAXED(&histogramCount) != 0);
+}
+
+struct histogram;
+
+// return a CAEN_FELib_ErrorCode, set last error on failure
+int histogram_start(struct histogram** histogram, const struct format* fmt, const char* options);
+int histogram_stop(struct histogram** histogram);
+int histogram_get(struct histogram* histogram, const char* name, size_t channel, uint64_t* bins, size_t size, CAEN_FELib_HistogramInfo_t* info);
+void histogram_reset(struct histogram* histogram);
+
+/*
+ * Functions invoked on the reading thread. Errors do not set last error: histograms are no
+ * more filled and the error is returned by histogram_stop().
+ */
+void histogram_onFormat(struct histogram* histogram, const struct format* fmt);
+void histogram_onEvent(struct histogram* histogram, const struct format_args* args);
+
+#endif /* CAEN_INCLUDE_HISTOGRAM_H_ */
@@ -0,0 +1,321 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		json.c
+*	\brief		Minimal JSON reader
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "json.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_MAX_DEPTH				32
+
+struct json_parser {
+	const char*						p;
+	unsigned						depth;
+};
+
+static struct json* _parseValue(struct json_parser* parser);
+
+static void _skipSpaces(struct json_parser* parser) {
+	while (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n' || *parser->p == '\r')
+		++parser->p;
+}
+
+static bool _consume(struct json_parser* parser, char c) {
+	_skipSpaces(parser);
+	if (*parser->p != c)
+		return false;
+	++parser->p;
+	return true;
+}
+
+static bool _consumeLiteral(struct json_parser* parser, const char* literal) {
+	const size_t len = strlen(literal);
+	if (strncmp(parser->p, literal, len) != 0)
+		return false;
+	parser->p += len;
+	return true;
+}
+
+static struct json* _newNode(enum json_type type) {
+	struct json* node = calloc(1, sizeof(*node));
+	if (node != NULL)
+		node->type = type;
+	return node;
+}
+
+static int _hexDigit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static size_t _encodeUtf8(uint_fast32_t cp, char* out) {
+	if (cp < 0x80) {
+		out[0] = (char)cp;
+		return 1;
+	} else if (cp < 0x800) {
+		out[0] = (char)(0xc0 | (cp >> 6));
+		out[1] = (char)(0x80 | (cp & 0x3f));
+		return 2;
+	} else if (cp < 0x10000) {
+		out[0] = (char)(0xe0 | (cp >> 12));
+		out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		out[2] = (char)(0x80 | (cp & 0x3f));
+		return 3;
+	} else {
+		out[0] = (char)(0xf0 | (cp >> 18));
+		out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+		out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		out[3] = (char)(0x80 | (cp & 0x3f));
+		return 4;
+	}
+}
+
+static bool _parseHex4(struct json_parser* parser, uint_fast32_t* cp) {
+	*cp = 0;
+	for (int i = 0; i < 4; ++i) {
+		const int d = _hexDigit(parser->p[i]);
+		if (d < 0)
+			return false;
+		*cp = (*cp << 4) | (uint_fast32_t)d;
+	}
+	parser->p += 4;
+	return true;
+}
+
+// parser->p must point to the opening quote. Unescaped output is never longer than input.
+static char* _parseString(struct json_parser* parser) {
+	const char* const begin = ++parser->p;
+	const char* end = begin;
+	while (*end != '"') {
+		if (*end == '\0')
+			return NULL;
+		if (*end == '\\' && end[1] != '\0')
+			++end;
+		++end;
+	}
+	char* const str = malloc((size_t)(end - begin) + 1);
+	if (str == NULL)
+		return NULL;
+	char* out = str;
+	while (parser->p != end) {
+		char c = *parser->p++;
+		if (c != '\\') {
+			*out++ = c;
+			continue;
+		}
+		c = *parser->p++;
+		switch (c) {
+		case '"': *out++ = '"'; break;
+		case '\\': *out++ = '\\'; break;
+		case '/': *out++ = '/'; break;
+		case 'b': *out++ = '\b'; break;
+		case 'f': *out++ = '\f'; break;
+		case 'n': *out++ = '\n'; break;
+		case 'r': *out++ = '\r'; break;
+		case 't': *out++ = '\t'; break;
+		case 'u': {
+			uint_fast32_t cp;
+			if (!_parseHex4(parser, &cp))
+				goto error;
+			// surrogate pair, if complete
+			if (cp >= 0xd800 && cp < 0xdc00 && parser->p[0] == '\\' && parser->p[1] == 'u') {
+				uint_fast32_t low;
+				parser->p += 2;
+				if (!_parseHex4(parser, &low) || low < 0xdc00 || low >= 0xe000)
+					goto error;
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+			}
+			out += _encodeUtf8(cp, out); // at most 4 bytes from at least 6 input bytes
+			break;
+		}
+		default:
+			goto error;
+		}
+	}
+	*out = '\0';
+	++parser->p; // closing quote
+	return str;
+error:
+	free(str);
+	return NULL;
+}
+
+static struct json* _parseContainer(struct json_parser* parser, enum json_type type) {
+	const char close = (type == JsonArray) ? ']' : '}';
+	if (++parser->depth > JSON_MAX_DEPTH)
+		return NULL;
+	++parser->p; // opening bracket
+	struct json* const node = _newNode(type);
+	if (node == NULL)
+		return NULL;
+	struct json** tail = &node->child;
+	if (_consume(parser, close)) {
+		--parser->depth;
+		return node;
+	}
+	do {
+		char* key = NULL;
+		if (type == JsonObject) {
+			_skipSpaces(parser);
+			if (*parser->p != '"' || (key = _parseString(parser)) == NULL || !_consume(parser, ':')) {
+				free(key);
+				goto error;
+			}
+		}
+		struct json* const child = _parseValue(parser);
+		if (child == NULL) {
+			free(key);
+			goto error;
+		}
+		child->key = key;
+		*tail = child;
+		tail = &child->next;
+	} while (_consume(parser, ','));
+	if (!_consume(parser, close))
+		goto error;
+	--parser->depth;
+	return node;
+error:
+	json_free(node);
+	return NULL;
+}
+
+static struct json* _parseValue(struct json_parser* parser) {
+	struct json* node = NULL;
+	_skipSpaces(parser);
+	switch (*parser->p) {
+	case '{':
+		return _parseContainer(parser, JsonObject);
+	case '[':
+		return _parseContainer(parser, JsonArray);
+	case '"':
+		node = _newNode(JsonString);
+		if (node != NULL && (node->string = _parseString(parser)) == NULL) {
+			free(node);
+			node = NULL;
+		}
+		return node;
+	case 't':
+	case 'f':
+		node = _newNode(JsonBool);
+		if (node == NULL)
+			return NULL;
+		node->boolean = (*parser->p == 't');
+		if (!_consumeLiteral(parser, node->boolean ? "true" : "false")) {
+			free(node);
+			return NULL;
+		}
+		return node;
+	case 'n':
+		if (!_consumeLiteral(parser, "null"))
+			return NULL;
+		return _newNode(JsonNull);
+	default: {
+		char* end;
+		const double value = strtod(parser->p, &end);
+		if (end == parser->p)
+			return NULL;
+		node = _newNode(JsonNumber);
+		if (node == NULL)
+			return NULL;
+		node->number = value;
+		parser->p = end;
+		return node;
+	}
+	}
+}
+
+struct json* json_parse(const char* text) {
+	if (text == NULL)
+		return NULL;
+	struct json_parser parser = {
+		.p = text,
+		.depth = 0,
+	};
+	struct json* const root = _parseValue(&parser);
+	if (root == NULL)
+		return NULL;
+	_skipSpaces(&parser);
+	if (*parser.p != '\0') {
+		json_free(root);
+		return NULL;
+	}
+	return root;
+}
+
+void json_free(struct json* root) {
+	while (root != NULL) {
+		struct json* const next = root->next;
+		json_free(root->child);
+		free(root->key);
+		free(root->string);
+		free(root);
+		root = next;
+	}
+}
+
+const struct json* json_get(const struct json* object, const char* key) {
+	if (object == NULL || object->type != JsonObject)
+		return NULL;
+	for (const struct json* m = object->child; m != NULL; m = m->next)
+		if (strcmp(m->key, key) == 0)
+			return m;
+	return NULL;
+}
+
+size_t json_size(const struct json* array) {
+	size_t n = 0;
+	if (array == NULL || (array->type != JsonArray && array->type != JsonObject))
+		return 0;
+	for (const struct json* e = array->child; e != NULL; e = e->next)
+		++n;
+	return n;
+}
+
+double json_number(const struct json* value, double def) {
+	return (value != NULL && value->type == JsonNumber) ? value->number : def;
+}
+
+const char* json_string(const struct json* value, const char* def) {
+	return (value != NULL && value->type == JsonString) ? value->string : def;
+}
+
+bool json_bool(const struct json* value, bool def) {
+	return (value != NULL && value->type == JsonBool) ? value->boolean : def;
+}
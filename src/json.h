@@ -0,0 +1,81 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		json.h
+*	\brief		Minimal JSON reader
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_JSON_H_
+#define CAEN_INCLUDE_JSON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Minimal JSON reader, used to parse read data formats and options.
+ * The document is converted to a tree of nodes; object members and array
+ * elements are stored as a linked list of children.
+ */
+
+enum json_type {
+	JsonNull,
+	JsonBool,
+	JsonNumber,
+	JsonString,
+	JsonArray,
+	JsonObject,
+};
+
+struct json {
+	enum json_type					type;
+	char*							key;		// member name, if parent is an object
+	struct json*					next;		// next sibling
+	struct json*					child;		// first child, if array or object
+	char*							string;
+	double							number;
+	bool							boolean;
+};
+
+// return NULL in case of parse error or allocation failure
+struct json* json_parse(const char* text);
+void json_free(struct json* root);
+
+// return NULL if not found or if object is not an object (can be NULL)
+const struct json* json_get(const struct json* object, const char* key);
+size_t json_size(const struct json* array);
+
+// return def if value is NULL or has a different type
+double json_number(const struct json* value, double def);
+const char* json_string(const struct json* value, const char* def);
+bool json_bool(const struct json* value, bool def);
+
+#endif /* CAEN_INCLUDE_JSON_H_ */
@@ -0,0 +1,636 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		merger.c
+*	\brief		Time-ordered merge of several endpoints
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "merger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "coincidence.h"
+#include "json.h"
+#include "pool.h"
+#include "utils.h"
+
+#define MERGER_DEFAULT_SLOTS			64
+#define MERGER_DEFAULT_MAX_LATENCY		100		// ms
+#define MERGER_READ_TIMEOUT				100		// ms, period used to check for destroy requests
+
+int merger_parseSlots(const char* options, size_t* nSlots) {
+	*nSlots = MERGER_DEFAULT_SLOTS;
+	if (options == NULL)
+		return CAEN_FELib_Success;
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid merger options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	const double slots = json_number(json_get(root, "slots"), (double)*nSlots);
+	json_free(root);
+	if (!(slots >= 1 && slots <= (double)(UINT32_C(1) << 24))) {
+		_setLastLocalError("invalid merger options: slots out of range");
+		return CAEN_FELib_InvalidParam;
+	}
+	*nSlots = (size_t)slots;
+	return CAEN_FELib_Success;
+}
+
+#ifndef _WIN32
+
+// event, or end of run if slot is NULL
+struct merger_entry {
+	CAEN_FELib_EventSlot_t*			slot;
+	uint64_t						timestamp;	// with offset
+	uint64_t						arrival;	// monotonic time of the read, ns
+};
+
+struct merger_board {
+	CAEN_FELib_Merger_t*			merger;
+	size_t							index;
+	uint64_t						handle;
+	CAEN_FELib_EventPool_t*			pool;
+	struct numa_cpus				cpus;
+	int								timestampField;
+	enum format_type				timestampType;
+	int								channelField;	// -1 if not available
+	enum format_type				channelType;
+	int64_t							offset;
+	pthread_t						thread;
+	bool							started;
+	// queue of read entries, accessed with merger mutex locked
+	struct merger_entry*			queue;
+	size_t							capacity;
+	size_t							head;
+	size_t							count;
+};
+
+struct CAEN_FELib_Merger {
+	struct merger_board*			boards;
+	size_t							n;
+	merger_read_t					read;
+	uint64_t						window;		// timestamp units
+	uint64_t						maxLatency;	// ns
+	pthread_mutex_t					mutex;		// protects the following fields and the queues
+	pthread_cond_t					cond;		// signaled on new entries
+	pthread_cond_t					slotCond;	// signaled on released slots
+	size_t*							heap;		// boards with an event on the queue head, min-heap on its timestamp
+	size_t							nHeap;
+	size_t							nReady;		// boards with a non-empty queue
+	uint64_t						maxTimestamp;
+	bool							stopRequested;
+	int								error;
+	char							errorDescription[1024 + 64];	// endpoint index and description from CAEN_FELib_GetLastError()
+	// coincidence filter, NULL if not configured; accessed with mutex locked
+	struct coincidence*				coincidence;
+	bool							endOfRun;	// stop read by merger_readGroup, returned when pending events are over
+};
+
+static uint64_t _headTimestamp(const CAEN_FELib_Merger_t* m, size_t board) {
+	const struct merger_board* const b = &m->boards[board];
+	return b->queue[b->head].timestamp;
+}
+
+static void _swap(size_t* a, size_t* b) {
+	const size_t t = *a;
+	*a = *b;
+	*b = t;
+}
+
+static void _siftUp(CAEN_FELib_Merger_t* m, size_t i) {
+	while (i != 0) {
+		const size_t parent = (i - 1) / 2;
+		if (_headTimestamp(m, m->heap[parent]) <= _headTimestamp(m, m->heap[i]))
+			break;
+		_swap(&m->heap[parent], &m->heap[i]);
+		i = parent;
+	}
+}
+
+static void _siftDown(CAEN_FELib_Merger_t* m, size_t i) {
+	for (;;) {
+		const size_t left = 2 * i + 1;
+		const size_t right = left + 1;
+		size_t min = i;
+		if (left < m->nHeap && _headTimestamp(m, m->heap[left]) < _headTimestamp(m, m->heap[min]))
+			min = left;
+		if (right < m->nHeap && _headTimestamp(m, m->heap[right]) < _headTimestamp(m, m->heap[min]))
+			min = right;
+		if (min == i)
+			break;
+		_swap(&m->heap[min], &m->heap[i]);
+		i = min;
+	}
+}
+
+static void _heapPush(CAEN_FELib_Merger_t* m, size_t board) {
+	m->heap[m->nHeap] = board;
+	_siftUp(m, m->nHeap++);
+}
+
+// remove the head of the queue of a board, and update the heap if the board is on its top
+static void _popHead(CAEN_FELib_Merger_t* m, struct merger_board* b) {
+	const bool onHeap = (b->queue[b->head].slot != NULL);
+	b->head = (b->head + 1) % b->capacity;
+	--b->count;
+	if (b->count == 0)
+		--m->nReady;
+	const bool hasEvent = (b->count != 0 && b->queue[b->head].slot != NULL);
+	if (onHeap) {
+		if (!hasEvent)
+			m->heap[0] = m->heap[--m->nHeap];
+		_siftDown(m, 0);
+	} else if (hasEvent) {
+		_heapPush(m, b->index);
+	}
+}
+
+static void _push(CAEN_FELib_Merger_t* m, struct merger_board* b, CAEN_FELib_EventSlot_t* slot, uint64_t timestamp) {
+	// consecutive end of runs are merged, so that the queue cannot exceed twice the slots
+	if (slot == NULL && b->count != 0 && b->queue[(b->head + b->count - 1) % b->capacity].slot == NULL)
+		return;
+	struct merger_entry* const e = &b->queue[(b->head + b->count) % b->capacity];
+	e->slot = slot;
+	e->timestamp = timestamp;
+	e->arrival = utils_now();
+	if (b->count++ == 0) {
+		++m->nReady;
+		if (slot != NULL)
+			_heapPush(m, b->index);
+	}
+	if (slot != NULL && timestamp > m->maxTimestamp)
+		m->maxTimestamp = timestamp;
+	pthread_cond_broadcast(&m->cond);
+}
+
+static uint64_t _timestamp(const struct merger_board* b, const CAEN_FELib_EventSlot_t* slot) {
+	const uint64_t ts = format_loadUnsigned(pool_getArgs(slot)->ptr[b->timestampField], b->timestampType);
+	if (b->offset < 0 && ts < (uint64_t)-b->offset)
+		return 0;
+	return ts + (uint64_t)b->offset;
+}
+
+static void* _readerMain(void* arg) {
+	struct merger_board* const b = arg;
+	CAEN_FELib_Merger_t* const m = b->merger;
+	char description[1024];
+	for (;;) {
+		CAEN_FELib_EventSlot_t* slot = NULL;
+		pthread_mutex_lock(&m->mutex);
+		while (!m->stopRequested && (slot = pool_acquire(b->pool)) == NULL)
+			pthread_cond_wait(&m->slotCond, &m->mutex);
+		const bool stop = m->stopRequested;
+		pthread_mutex_unlock(&m->mutex);
+		if (stop) {
+			if (slot != NULL)
+				pool_release(b->pool, slot);
+			break;
+		}
+		const int ret = m->read(b->handle, MERGER_READ_TIMEOUT, pool_getArgs(slot));
+		if (ret == CAEN_FELib_Success) {
+			const uint64_t timestamp = _timestamp(b, slot);
+			pthread_mutex_lock(&m->mutex);
+			_push(m, b, slot, timestamp);
+			pthread_mutex_unlock(&m->mutex);
+			continue;
+		}
+		pool_release(b->pool, slot);
+		// CAEN_FELib_Interrupt on the endpoint only wakes the reader
+		if (ret == CAEN_FELib_Timeout || ret == CAEN_FELib_Interrupted)
+			continue;
+		if (ret == CAEN_FELib_Stop) {
+			pthread_mutex_lock(&m->mutex);
+			_push(m, b, NULL, 0);
+			pthread_mutex_unlock(&m->mutex);
+			continue;
+		}
+		CAEN_FELib_GetLastError(description);
+		pthread_mutex_lock(&m->mutex);
+		if (m->error == CAEN_FELib_Success) {
+			m->error = ret;
+			snprintf(m->errorDescription, sizeof(m->errorDescription), "endpoint %zu: %s", b->index, description);
+		}
+		pthread_cond_broadcast(&m->cond);
+		pthread_mutex_unlock(&m->mutex);
+		break;
+	}
+	return NULL;
+}
+
+// wait until a monotonic deadline, UINT64_MAX to wait forever
+static void _waitUntil(CAEN_FELib_Merger_t* m, uint64_t deadline) {
+	if (deadline == UINT64_MAX) {
+		pthread_cond_wait(&m->cond, &m->mutex);
+		return;
+	}
+	const uint64_t now = utils_now();
+	if (deadline <= now)
+		return;
+	const uint64_t t = utils_realtime() + (deadline - now);
+	struct timespec ts;
+	ts.tv_sec = (time_t)(t / UINT64_C(1000000000));
+	ts.tv_nsec = (long)(t % UINT64_C(1000000000));
+	pthread_cond_timedwait(&m->cond, &m->mutex, &ts);
+}
+
+static int _parseOptions(CAEN_FELib_Merger_t* m, const char* options) {
+	double window = 0.;
+	double maxLatency = MERGER_DEFAULT_MAX_LATENCY;
+	if (options == NULL) {
+		m->maxLatency = (uint64_t)(maxLatency * 1e6);
+		return CAEN_FELib_Success;
+	}
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid merger options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	window = json_number(json_get(root, "window"), window);
+	maxLatency = json_number(json_get(root, "max_latency"), maxLatency);
+	size_t capacity = 0;
+	for (size_t i = 0; i < m->n; ++i)
+		capacity += pool_getSize(m->boards[i].pool);
+	const int ret = coincidence_create(&m->coincidence, json_get(root, "coincidence"), m->n, capacity);
+	if (ret != CAEN_FELib_Success) {
+		json_free(root);
+		return ret;
+	}
+	const struct json* const offsets = json_get(root, "offsets");
+	bool valid = (offsets == NULL || (offsets->type == JsonArray && json_size(offsets) == m->n));
+	if (valid && offsets != NULL) {
+		size_t i = 0;
+		for (const struct json* o = offsets->child; o != NULL; o = o->next, ++i) {
+			valid &= (o->type == JsonNumber && o->number > (double)INT64_MIN && o->number < (double)INT64_MAX);
+			m->boards[i].offset = valid ? (int64_t)o->number : 0;
+		}
+	}
+	json_free(root);
+	if (!valid) {
+		_setLastLocalError("invalid merger options: offsets must be an array of a number per endpoint");
+		return CAEN_FELib_InvalidParam;
+	}
+	if (!(window >= 0 && window < (double)UINT64_MAX) || !(maxLatency >= 0 && maxLatency <= 1e9)) {
+		_setLastLocalError("invalid merger options: value out of range");
+		return CAEN_FELib_InvalidParam;
+	}
+	m->window = (uint64_t)window;
+	m->maxLatency = (uint64_t)(maxLatency * 1e6);
+	return CAEN_FELib_Success;
+}
+
+static void _stopReaders(CAEN_FELib_Merger_t* m) {
+	pthread_mutex_lock(&m->mutex);
+	m->stopRequested = true;
+	pthread_cond_broadcast(&m->slotCond);
+	pthread_mutex_unlock(&m->mutex);
+	for (size_t i = 0; i < m->n; ++i) {
+		if (m->boards[i].started)
+			pthread_join(m->boards[i].thread, NULL);
+		m->boards[i].started = false;
+	}
+}
+
+static void _free(CAEN_FELib_Merger_t* m) {
+	for (size_t i = 0; i < m->n; ++i) {
+		pool_destroy(m->boards[i].pool);
+		free(m->boards[i].queue);
+	}
+	free(m->boards);
+	free(m->heap);
+	coincidence_destroy(m->coincidence);
+	pthread_cond_destroy(&m->slotCond);
+	pthread_cond_destroy(&m->cond);
+	pthread_mutex_destroy(&m->mutex);
+	free(m);
+}
+
+static int _initBoard(struct merger_board* b, const struct merger_source* source, size_t nSlots) {
+	const struct format* const fmt = pool_getFormat(source->pool);
+	b->handle = source->handle;
+	b->pool = source->pool;
+	b->cpus = source->cpus;
+	b->timestampField = format_find(fmt, "TIMESTAMP");
+	if (b->timestampField < 0 || fmt->fields[b->timestampField].dim != 0) {
+		_setLastLocalError("read data format of endpoint %zu has no scalar TIMESTAMP", b->index);
+		return CAEN_FELib_InvalidParam;
+	}
+	b->timestampType = fmt->fields[b->timestampField].type;
+	b->channelField = format_find(fmt, "CHANNEL");
+	if (b->channelField >= 0 && fmt->fields[b->channelField].dim != 0)
+		b->channelField = -1;
+	if (b->channelField >= 0)
+		b->channelType = fmt->fields[b->channelField].type;
+	// events are at most the slots, each possibly followed by an end of run
+	b->capacity = 2 * nSlots + 1;
+	b->queue = calloc(b->capacity, sizeof(*b->queue));
+	if (b->queue == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	return CAEN_FELib_Success;
+}
+
+int merger_create(CAEN_FELib_Merger_t** merger, const struct merger_source* sources, size_t n, merger_read_t read, const char* options) {
+	CAEN_FELib_Merger_t* const m = calloc(1, sizeof(*m));
+	if (m == NULL) {
+		for (size_t i = 0; i < n; ++i)
+			pool_destroy(sources[i].pool);
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	pthread_mutex_init(&m->mutex, NULL);
+	pthread_cond_init(&m->cond, NULL);
+	pthread_cond_init(&m->slotCond, NULL);
+	m->read = read;
+	m->error = CAEN_FELib_Success;
+	m->boards = calloc(n, sizeof(*m->boards));
+	m->heap = calloc(n, sizeof(*m->heap));
+	if (m->boards == NULL || m->heap == NULL) {
+		for (size_t i = 0; i < n; ++i)
+			pool_destroy(sources[i].pool);
+		_free(m);
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	// from now on pools are destroyed by _free
+	m->n = n;
+	for (size_t i = 0; i < n; ++i) {
+		m->boards[i].merger = m;
+		m->boards[i].index = i;
+		m->boards[i].pool = sources[i].pool;
+	}
+	int ret = _parseOptions(m, options);
+	for (size_t i = 0; ret == CAEN_FELib_Success && i < n; ++i)
+		ret = _initBoard(&m->boards[i], &sources[i], pool_getSize(sources[i].pool));
+	for (size_t i = 0; ret == CAEN_FELib_Success && i < n; ++i) {
+		struct merger_board* const b = &m->boards[i];
+		pthread_attr_t attr;
+		ret = numa_initThreadAttr(&attr, &b->cpus);
+		if (ret != CAEN_FELib_Success)
+			break;
+		if (pthread_create(&b->thread, &attr, _readerMain, b) == 0) {
+			b->started = true;
+		} else {
+			_setLastLocalError("merger start failed: cannot create threads%s", numa_isEmpty(&b->cpus) ? "" : " on the CPUs of the affinity");
+			ret = CAEN_FELib_InternalError;
+		}
+		pthread_attr_destroy(&attr);
+	}
+	if (ret != CAEN_FELib_Success) {
+		_stopReaders(m);
+		_free(m);
+		return ret;
+	}
+	*merger = m;
+	return CAEN_FELib_Success;
+}
+
+void merger_stop(CAEN_FELib_Merger_t* merger) {
+	_stopReaders(merger);
+}
+
+void merger_destroy(CAEN_FELib_Merger_t* merger) {
+	_stopReaders(merger);
+	_free(merger);
+}
+
+size_t merger_getSize(const CAEN_FELib_Merger_t* merger) {
+	return merger->n;
+}
+
+uint64_t merger_getHandle(const CAEN_FELib_Merger_t* merger, size_t index) {
+	return merger->boards[index].handle;
+}
+
+static uint64_t _deadline(int timeout) {
+	return (timeout < 0) ? UINT64_MAX : utils_now() + (uint64_t)timeout * UINT64_C(1000000);
+}
+
+// pop the next event in timestamp order, to be called with mutex locked
+static int _nextEvent(CAEN_FELib_Merger_t* m, uint64_t deadline, CAEN_FELib_MergedEvent_t* event) {
+	int ret;
+	for (;;) {
+		if (m->error != CAEN_FELib_Success) {
+			_setLastLocalError("%s", m->errorDescription);
+			ret = m->error;
+			break;
+		}
+		const uint64_t now = utils_now();
+		uint64_t waitDeadline = deadline;
+		if (m->nHeap != 0) {
+			struct merger_board* const b = &m->boards[m->heap[0]];
+			const struct merger_entry* const e = &b->queue[b->head];
+			const bool allReady = (m->nReady == m->n);
+			// a null window disables this criterion: otherwise, every event would be out of window
+			const bool outOfWindow = (m->window != 0 && m->maxTimestamp >= m->window && e->timestamp <= m->maxTimestamp - m->window);
+			const uint64_t latencyDeadline = e->arrival + m->maxLatency;
+			if (allReady || outOfWindow || now >= latencyDeadline) {
+				event->board = b->index;
+				event->handle = b->handle;
+				event->timestamp = e->timestamp;
+				event->slot = e->slot;
+				_popHead(m, b);
+				ret = CAEN_FELib_Success;
+				break;
+			}
+			if (latencyDeadline < waitDeadline)
+				waitDeadline = latencyDeadline;
+		} else if (m->nReady == m->n) {
+			// every board is at the end of run
+			for (size_t i = 0; i < m->n; ++i)
+				_popHead(m, &m->boards[i]);
+			m->maxTimestamp = 0;
+			ret = CAEN_FELib_Stop;
+			break;
+		}
+		if (now >= deadline) {
+			_setLastLocalError("timeout");
+			ret = CAEN_FELib_Timeout;
+			break;
+		}
+		_waitUntil(m, waitDeadline);
+	}
+	return ret;
+}
+
+int merger_readData(CAEN_FELib_Merger_t* m, int timeout, CAEN_FELib_MergedEvent_t* event) {
+	if (m->coincidence != NULL) {
+		_setLastLocalError("coincidence filter configured: use CAEN_FELib_MergerReadGroup");
+		return CAEN_FELib_CommandError;
+	}
+	const uint64_t deadline = _deadline(timeout);
+	pthread_mutex_lock(&m->mutex);
+	const int ret = _nextEvent(m, deadline, event);
+	pthread_mutex_unlock(&m->mutex);
+	return ret;
+}
+
+static uint64_t _channel(const struct merger_board* b, const CAEN_FELib_EventSlot_t* slot) {
+	if (b->channelField < 0)
+		return 0;
+	return format_loadUnsigned(pool_getArgs(slot)->ptr[b->channelField], b->channelType);
+}
+
+// to be called with mutex locked
+static void _discard(CAEN_FELib_Merger_t* m, const CAEN_FELib_MergedEvent_t* event) {
+	pool_release(m->boards[event->board].pool, event->slot);
+	pthread_cond_broadcast(&m->slotCond);
+}
+
+// the window of the oldest pending event must be closed if no more events can be read
+static bool _mustFlush(const CAEN_FELib_Merger_t* m) {
+	if (m->endOfRun)
+		return true;
+	for (size_t i = 0; i < m->n; ++i)
+		if (coincidence_sizeOf(m->coincidence, i) == pool_getSize(m->boards[i].pool))
+			return true;
+	return false;
+}
+
+int merger_readGroup(CAEN_FELib_Merger_t* m, int timeout, CAEN_FELib_MergedEvent_t* events, size_t size, size_t* count) {
+	if (m->coincidence == NULL) {
+		_setLastLocalError("coincidence filter not configured");
+		return CAEN_FELib_CommandError;
+	}
+	if (size == 0) {
+		_setLastLocalError("invalid size");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct coincidence* const c = m->coincidence;
+	const uint64_t deadline = _deadline(timeout);
+	int ret;
+	pthread_mutex_lock(&m->mutex);
+	for (;;) {
+		size_t n;
+		const enum coincidence_result result = coincidence_next(c, _mustFlush(m), &n);
+		if (result == CoincidenceMatch) {
+			// the tail of a group larger than size is evaluated again
+			if (n > size)
+				n = size;
+			memcpy(events, coincidence_events(c), n * sizeof(*events));
+			coincidence_consume(c, n);
+			*count = n;
+			ret = CAEN_FELib_Success;
+			break;
+		}
+		if (result == CoincidenceReject) {
+			_discard(m, &coincidence_events(c)[0]);
+			coincidence_consume(c, 1);
+			continue;
+		}
+		if (m->endOfRun && coincidence_size(c) == 0) {
+			m->endOfRun = false;
+			ret = CAEN_FELib_Stop;
+			break;
+		}
+		CAEN_FELib_MergedEvent_t event;
+		ret = _nextEvent(m, deadline, &event);
+		if (ret == CAEN_FELib_Success) {
+			const uint64_t channel = _channel(&m->boards[event.board], event.slot);
+			if (coincidence_accepts(c, event.board, channel))
+				coincidence_push(c, &event, channel);
+			else
+				_discard(m, &event);
+			continue;
+		}
+		if (ret == CAEN_FELib_Stop) {
+			m->endOfRun = true;
+			continue;
+		}
+		break;
+	}
+	pthread_mutex_unlock(&m->mutex);
+	return ret;
+}
+
+int merger_release(CAEN_FELib_Merger_t* m, const CAEN_FELib_MergedEvent_t* event) {
+	if (event->board >= m->n) {
+		_setLastLocalError("invalid board %zu", event->board);
+		return CAEN_FELib_InvalidParam;
+	}
+	const int ret = pool_release(m->boards[event->board].pool, event->slot);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	pthread_mutex_lock(&m->mutex);
+	pthread_cond_broadcast(&m->slotCond);
+	pthread_mutex_unlock(&m->mutex);
+	return CAEN_FELib_Success;
+}
+
+#else
+
+int merger_create(CAEN_FELib_Merger_t** merger, const struct merger_source* sources, size_t n, merger_read_t read, const char* options) {
+	for (size_t i = 0; i < n; ++i)
+		pool_destroy(sources[i].pool);
+	_setLastLocalError("merger not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+void merger_stop(CAEN_FELib_Merger_t* merger) {}
+
+void merger_destroy(CAEN_FELib_Merger_t* merger) {}
+
+size_t merger_getSize(const CAEN_FELib_Merger_t* merger) {
+	return 0;
+}
+
+uint64_t merger_getHandle(const CAEN_FELib_Merger_t* merger, size_t index) {
+	return 0;
+}
+
+int merger_readData(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* event) {
+	_setLastLocalError("merger not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+int merger_readGroup(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* events, size_t size, size_t* count) {
+	_setLastLocalError("merger not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+int merger_release(CAEN_FELib_Merger_t* merger, const CAEN_FELib_MergedEvent_t* event) {
+	_setLastLocalError("merger not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+#endif
@@ -0,0 +1,86 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		merger.h
+*	\brief		Time-ordered merge of several endpoints
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_MERGER_H_
+#define CAEN_INCLUDE_MERGER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "format.h"
+#include "numa.h"
+
+/*
+ * Time-ordered merge of the events of several endpoints. A reader thread per endpoint reads
+ * events on the slots of an event pool and appends them to a queue; the consumer k-way merges
+ * the queues by TIMESTAMP, with a min-heap of the queue heads.
+ *
+ * The event with the smallest timestamp is returned when every endpoint has a pending event or
+ * end of run, when it is older than the most recent timestamp by at least the reorder window,
+ * or when it has been waiting for the maximum latency: a quiet endpoint does not block others.
+ *
+ * If a coincidence filter is configured, merged events are returned in groups by merger_readGroup
+ * and events not belonging to a matching group are released internally.
+ */
+
+// read an event on the buffers of args, return a CAEN_FELib_ErrorCode and set last error on failure
+typedef int (*merger_read_t)(uint64_t handle, int timeout, const struct format_args* args);
+
+struct merger_source {
+	uint64_t						handle;
+	CAEN_FELib_EventPool_t*			pool;
+	struct numa_cpus				cpus;		// affinity of the reader thread
+};
+
+// number of slots of the pool of each endpoint, from the "slots" member of options
+int merger_parseSlots(const char* options, size_t* nSlots);
+
+/*
+ * Pools are owned by the merger, also on failure; their format must have a scalar TIMESTAMP.
+ * Return a CAEN_FELib_ErrorCode, set last error on failure.
+ */
+int merger_create(CAEN_FELib_Merger_t** merger, const struct merger_source* sources, size_t n, merger_read_t read, const char* options);
+// join the reader threads, that do not read any more; merger_destroy must still be invoked
+void merger_stop(CAEN_FELib_Merger_t* merger);
+void merger_destroy(CAEN_FELib_Merger_t* merger);
+size_t merger_getSize(const CAEN_FELib_Merger_t* merger);
+uint64_t merger_getHandle(const CAEN_FELib_Merger_t* merger, size_t index);
+int merger_readData(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* event);
+int merger_readGroup(CAEN_FELib_Merger_t* merger, int timeout, CAEN_FELib_MergedEvent_t* events, size_t size, size_t* count);
+int merger_release(CAEN_FELib_Merger_t* merger, const CAEN_FELib_MergedEvent_t* event);
+
+#endif /* CAEN_INCLUDE_MERGER_H_ */
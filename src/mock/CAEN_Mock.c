@@ -0,0 +1,1100 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		CAEN_Mock.c
+*	\brief		Mock implementation library
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Mock implementation library, loaded by CAEN_FELib_Open() with URL "mock://<name>[?<options>]".
+ *
+ * It implements the whole API v2, and the optional Interrupt, without any hardware, to develop
+ * and profile applications and the dispatcher itself. Options are a list of "<parameter>=<value>" separated by '&',
+ * applied with SetValue on the "/par" folder just after the open, e.g.:
+ *     mock://dig0?NumCh=8&EventRate=10000&CallLatencyUs=20&ErrorRate=0.001
+ *
+ * Tree:
+ * - /par/ModelName, /par/SerialNum, /par/AcqStatus, /par/EventCount, /par/MaxRawDataSize (read only)
+ * - /par/NumCh, /par/RecordLengthS, /par/RawEventSize, /par/EventRate, /par/MaxEvents
+ * - /par/CallLatencyUs, /par/ErrorRate, /par/ErrorCode (simulation control)
+ * - /cmd/ArmAcquisition, /cmd/DisarmAcquisition, /cmd/SwStartAcquisition, /cmd/SwStopAcquisition,
+ *   /cmd/Reset
+ * - /endpoint/RAW: DATA (U8, dim 1), SIZE, N_EVENTS
+ * - /endpoint/SCOPE: TIMESTAMP (8 ns ticks), TIMESTAMP_NS, TRIGGER_ID, EVENT_SIZE,
+ *   WAVEFORM (dim 2), WAVEFORM_SIZE (dim 1)
+ *
+ * Events are generated on demand: event n is available EventRate after the start of the run
+ * (immediately if EventRate is zero), and its content depends only on n, so that runs can be
+ * reproduced. As on real digitizers, ReadData and HasData return CAEN_FELib_Stop once after
+ * the last event of a run. If ErrorRate is not zero, calls fail randomly with ErrorCode.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <pthread.h>
+#include <time.h>
+
+#include <CAEN_FELib.h>
+
+#include "../format.h"
+#include "../utils.h"
+
+#define MOCK_API						CAEN_FELIB_DLLAPI int CAEN_FELIB_API
+#define MOCK_MAX_DEVICES				64
+#define MOCK_MAX_CHANNELS				64
+#define MOCK_NUM_REGISTERS				256
+#define MOCK_RAW_HEADER_SIZE			(3 * sizeof(uint64_t))
+#define MOCK_POLL_PERIOD				UINT64_C(10000000)		// 10 ms, maximum sleep without checking the state
+
+enum node_id {
+	NodeRoot,
+	NodePar,
+	NodeParModelName,
+	NodeParSerialNum,
+	NodeParAcqStatus,
+	NodeParEventCount,
+	NodeParMaxRawDataSize,
+	NodeParNumCh,
+	NodeParRecordLengthS,
+	NodeParRawEventSize,
+	NodeParEventRate,
+	NodeParMaxEvents,
+	NodeParCallLatencyUs,
+	NodeParErrorRate,
+	NodeParErrorCode,
+	NodeCmd,
+	NodeCmdArmAcquisition,
+	NodeCmdDisarmAcquisition,
+	NodeCmdSwStartAcquisition,
+	NodeCmdSwStopAcquisition,
+	NodeCmdReset,
+	NodeEndpoint,
+	NodeEndpointRaw,
+	NodeEndpointScope,
+	NodeCount,
+};
+
+struct node {
+	const char*						path;
+	CAEN_FELib_NodeType_t			type;
+	enum node_id					parent;
+	bool							readOnly;
+};
+
+static const struct node nodes[NodeCount] = {
+	[NodeRoot]					= { "",								CAEN_FELib_DIGITIZER,	NodeRoot,		true },
+	[NodePar]					= { "/par",							CAEN_FELib_FOLDER,		NodeRoot,		true },
+	[NodeParModelName]			= { "/par/ModelName",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParSerialNum]			= { "/par/SerialNum",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParAcqStatus]			= { "/par/AcqStatus",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParEventCount]			= { "/par/EventCount",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParMaxRawDataSize]		= { "/par/MaxRawDataSize",			CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParNumCh]				= { "/par/NumCh",					CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParRecordLengthS]		= { "/par/RecordLengthS",			CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParRawEventSize]		= { "/par/RawEventSize",			CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParEventRate]			= { "/par/EventRate",				CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParMaxEvents]			= { "/par/MaxEvents",				CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParCallLatencyUs]		= { "/par/CallLatencyUs",			CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParErrorRate]			= { "/par/ErrorRate",				CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParErrorCode]			= { "/par/ErrorCode",				CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeCmd]					= { "/cmd",							CAEN_FELib_FOLDER,		NodeRoot,		true },
+	[NodeCmdArmAcquisition]		= { "/cmd/ArmAcquisition",			CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdDisarmAcquisition]	= { "/cmd/DisarmAcquisition",		CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdSwStartAcquisition]	= { "/cmd/SwStartAcquisition",		CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdSwStopAcquisition]	= { "/cmd/SwStopAcquisition",		CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdReset]				= { "/cmd/Reset",					CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeEndpoint]				= { "/endpoint",					CAEN_FELib_FOLDER,		NodeRoot,		true },
+	[NodeEndpointRaw]			= { "/endpoint/RAW",				CAEN_FELib_ENDPOINT,	NodeEndpoint,	true },
+	[NodeEndpointScope]			= { "/endpoint/SCOPE",				CAEN_FELib_ENDPOINT,	NodeEndpoint,	true },
+};
+
+enum mock_field {
+	FieldData,
+	FieldSize,
+	FieldNEvents,
+	FieldTimestamp,
+	FieldTimestampNs,
+	FieldTriggerId,
+	FieldEventSize,
+	FieldWaveform,
+	FieldWaveformSize,
+};
+
+struct field_descr {
+	const char*						name;
+	enum node_id					endpoint;
+	unsigned						dim;
+};
+
+static const struct field_descr fieldDescr[] = {
+	[FieldData]						= { "DATA",				NodeEndpointRaw,	1 },
+	[FieldSize]						= { "SIZE",				NodeEndpointRaw,	0 },
+	[FieldNEvents]					= { "N_EVENTS",			NodeEndpointRaw,	0 },
+	[FieldTimestamp]				= { "TIMESTAMP",		NodeEndpointScope,	0 },
+	[FieldTimestampNs]				= { "TIMESTAMP_NS",		NodeEndpointScope,	0 },
+	[FieldTriggerId]				= { "TRIGGER_ID",		NodeEndpointScope,	0 },
+	[FieldEventSize]				= { "EVENT_SIZE",		NodeEndpointScope,	0 },
+	[FieldWaveform]					= { "WAVEFORM",			NodeEndpointScope,	2 },
+	[FieldWaveformSize]				= { "WAVEFORM_SIZE",	NodeEndpointScope,	1 },
+};
+
+static const char* const defaultFormat[NodeCount] = {
+	[NodeEndpointRaw] = "[{\"name\":\"DATA\",\"type\":\"U8\",\"dim\":1},{\"name\":\"SIZE\",\"type\":\"SIZE_T\"},{\"name\":\"N_EVENTS\",\"type\":\"U32\"}]",
+	[NodeEndpointScope] = "[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"},{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]",
+};
+
+struct mock_endpoint {
+	struct format					format;
+	enum mock_field					fields[FORMAT_MAX_FIELDS];
+	uint64_t						next;				// next event to be read
+	bool							stopSent;
+	bool							interrupted;		// set by Interrupt, consumed by the next wait
+};
+
+struct mock_device {
+	char							name[64];
+	pthread_mutex_t					mutex;
+	// configuration
+	size_t							numCh;
+	size_t							recordLength;
+	size_t							rawEventSize;
+	double							eventRate;
+	uint64_t						maxEvents;
+	uint64_t						callLatency;		// ns
+	double							errorRate;
+	int								errorCode;
+	uint64_t						rng;
+	uint32_t						registers[MOCK_NUM_REGISTERS];
+	// acquisition
+	bool							armed;
+	bool							running;
+	bool							runEnded;
+	uint64_t						startTime;
+	uint64_t						nEvents;			// events of the run, valid if runEnded
+	struct mock_endpoint			endpoints[2];
+};
+
+static struct mock_device* devices[MOCK_MAX_DEVICES];
+static pthread_mutex_t devicesMutex = PTHREAD_MUTEX_INITIALIZER;
+static THREAD_LOCAL char lastError[1024];
+
+// used also by format.c
+void _setLastLocalError(const char* description, ...) {
+	va_list args;
+	va_start(args, description);
+	vsnprintf(lastError, ARRAY_SIZE(lastError), description, args);
+	va_end(args);
+}
+
+static void _sleep(uint64_t ns) {
+	struct timespec ts = { .tv_sec = (time_t)(ns / UINT64_C(1000000000)), .tv_nsec = (long)(ns % UINT64_C(1000000000)) };
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+// latency of few microseconds cannot be simulated with sleeps
+static void _busyWait(uint64_t ns) {
+	if (ns == 0)
+		return;
+	if (ns > UINT64_C(100000)) {
+		_sleep(ns);
+		return;
+	}
+	const uint64_t end = utils_now() + ns;
+	while (utils_now() < end);
+}
+
+// xorshift64*
+static uint64_t _random(uint64_t* state) {
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+// splitmix64, to generate event content from indexes
+static uint64_t _hash(uint64_t x) {
+	x += UINT64_C(0x9E3779B97F4A7C15);
+	x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return x ^ (x >> 31);
+}
+
+static bool _decodeHandle(uint32_t handle, struct mock_device** dev, enum node_id* node) {
+	const uint32_t index = (handle >> 16) - 1;
+	const uint32_t n = handle & UINT32_C(0xffff);
+	if (index >= MOCK_MAX_DEVICES || n >= NodeCount)
+		return false;
+	*dev = ATOMIC_LOAD_ACQUIRE(&devices[index]);
+	*node = (enum node_id)n;
+	return *dev != NULL;
+}
+
+static int _invalidHandle(uint32_t handle) {
+	_setLastLocalError("invalid handle 0x%08"PRIx32, handle);
+	return CAEN_FELib_InvalidHandle;
+}
+
+// simulate call latency and random failures
+static int _enterCall(struct mock_device* dev) {
+	pthread_mutex_lock(&dev->mutex);
+	const uint64_t latency = dev->callLatency;
+	const bool fail = (dev->errorRate > 0.) && ((double)(_random(&dev->rng) >> 11) * 0x1.0p-53 < dev->errorRate);
+	const int errorCode = dev->errorCode;
+	pthread_mutex_unlock(&dev->mutex);
+	_busyWait(latency);
+	if (fail) {
+		_setLastLocalError("injected error");
+		return errorCode;
+	}
+	return CAEN_FELib_Success;
+}
+
+/*
+ * Resolve path relative to node. Node names are case insensitive, "." and ".." are supported.
+ * Return NodeCount if not found.
+ */
+static enum node_id _resolve(enum node_id from, const char* path) {
+	char full[256];
+	char normalized[256];
+	if (path == NULL)
+		path = "";
+	if (snprintf(full, ARRAY_SIZE(full), "%s/%s", nodes[from].path, path) >= (int)ARRAY_SIZE(full))
+		return NodeCount;
+	normalized[0] = '\0';
+	size_t len = 0;
+	char* saveptr;
+	for (char* token = strtok_r(full, "/", &saveptr); token != NULL; token = strtok_r(NULL, "/", &saveptr)) {
+		if (strcmp(token, ".") == 0)
+			continue;
+		if (strcmp(token, "..") == 0) {
+			char* const last = strrchr(normalized, '/');
+			if (last == NULL)
+				return NodeCount;
+			*last = '\0';
+			len = (size_t)(last - normalized);
+			continue;
+		}
+		const int n = snprintf(normalized + len, ARRAY_SIZE(normalized) - len, "/%s", token);
+		if (n < 0 || (size_t)n >= ARRAY_SIZE(normalized) - len)
+			return NodeCount;
+		len += (size_t)n;
+	}
+	for (size_t i = 0; i < NodeCount; ++i)
+		if (strcasecmp(nodes[i].path, normalized) == 0)
+			return (enum node_id)i;
+	return NodeCount;
+}
+
+static const char* _nodeName(enum node_id node) {
+	const char* const p = strrchr(nodes[node].path, '/');
+	return (p != NULL) ? p + 1 : nodes[node].path;
+}
+
+static struct mock_endpoint* _endpoint(struct mock_device* dev, enum node_id node) {
+	switch (node) {
+	case NodeEndpointRaw:		return &dev->endpoints[0];
+	case NodeEndpointScope:		return &dev->endpoints[1];
+	default:					return NULL;
+	}
+}
+
+/*
+ * Acquisition
+ */
+
+static uint64_t _eventTime(const struct mock_device* dev, uint64_t n) {
+	return (dev->eventRate > 0.) ? (uint64_t)((double)n * 1e9 / dev->eventRate) : n * UINT64_C(1000);
+}
+
+// number of events generated so far, to be called with mutex locked
+static uint64_t _availableEvents(struct mock_device* dev, uint64_t now) {
+	if (!dev->running)
+		return dev->runEnded ? dev->nEvents : 0;
+	uint64_t n = UINT64_MAX;
+	if (dev->eventRate > 0.)
+		n = (uint64_t)((double)(now - dev->startTime) * dev->eventRate * 1e-9) + 1;
+	if (dev->maxEvents != 0 && n >= dev->maxEvents) {
+		// run completed
+		n = dev->maxEvents;
+		dev->running = false;
+		dev->runEnded = true;
+		dev->nEvents = n;
+	}
+	return n;
+}
+
+static void _startRun(struct mock_device* dev) {
+	dev->running = true;
+	dev->runEnded = false;
+	dev->startTime = utils_now();
+	for (size_t i = 0; i < ARRAY_SIZE(dev->endpoints); ++i) {
+		dev->endpoints[i].next = 0;
+		dev->endpoints[i].stopSent = false;
+	}
+}
+
+static void _stopRun(struct mock_device* dev) {
+	if (!dev->running)
+		return;
+	dev->nEvents = _availableEvents(dev, utils_now());
+	dev->running = false;
+	dev->runEnded = true;
+}
+
+static uint16_t _sample(uint64_t n, size_t ch, size_t s, size_t len) {
+	const uint64_t h = _hash((n << 8) | ch);
+	const size_t t0 = len / 4;
+	const size_t decay = (len >= 64) ? len / 64 : 1;
+	const unsigned noise = (unsigned)(_hash(h + s) & 0x7);
+	unsigned value = 2048 + noise;
+	if (s >= t0) {
+		const unsigned amplitude = 100 + (unsigned)(h % 1000);
+		const size_t shift = (s - t0) / decay;
+		value += (shift < 16) ? amplitude >> shift : 0;
+	}
+	return (uint16_t)value;
+}
+
+static size_t _eventSize(const struct mock_device* dev, enum node_id node) {
+	if (node == NodeEndpointRaw)
+		return dev->rawEventSize;
+	return MOCK_RAW_HEADER_SIZE + dev->numCh * dev->recordLength * sizeof(uint16_t);
+}
+
+static void _fillEvent(const struct mock_device* dev, enum node_id node, const struct mock_endpoint* ep, uint64_t n, va_list args) {
+	struct format_args fargs;
+	format_getArgs(&ep->format, args, &fargs);
+	const uint64_t time = _eventTime(dev, n);
+	for (size_t i = 0; i < ep->format.nFields; ++i) {
+		const struct format_field* const f = &ep->format.fields[i];
+		void* const p = fargs.ptr[i];
+		if (p == NULL)
+			continue;
+		switch (ep->fields[i]) {
+		case FieldData: {
+			uint8_t* const data = p;
+			const uint64_t header[3] = { n, time, dev->rawEventSize };
+			memcpy(data, header, sizeof(header));
+			memset(data + sizeof(header), (int)(n & 0xff), dev->rawEventSize - sizeof(header));
+			break;
+		}
+		case FieldSize:
+			format_storeUnsigned(p, f->type, dev->rawEventSize);
+			break;
+		case FieldNEvents:
+			format_storeUnsigned(p, f->type, 1);
+			break;
+		case FieldTimestamp:
+			format_storeUnsigned(p, f->type, time / 8);
+			break;
+		case FieldTimestampNs:
+			format_storeUnsigned(p, f->type, time);
+			break;
+		case FieldTriggerId:
+			format_storeUnsigned(p, f->type, n);
+			break;
+		case FieldEventSize:
+			format_storeUnsigned(p, f->type, _eventSize(dev, node));
+			break;
+		case FieldWaveform:
+			for (size_t ch = 0; ch < dev->numCh; ++ch) {
+				char* const wave = ((void**)p)[ch];
+				if (wave == NULL)
+					continue;
+				for (size_t s = 0; s < dev->recordLength; ++s)
+					format_storeUnsigned(wave + s * f->typeSize, f->type, _sample(n, ch, s, dev->recordLength));
+			}
+			break;
+		case FieldWaveformSize:
+			for (size_t ch = 0; ch < dev->numCh; ++ch)
+				format_storeUnsigned((char*)p + ch * f->typeSize, f->type, dev->recordLength);
+			break;
+		}
+	}
+}
+
+/*
+ * Wait for an event on endpoint ep, with timeout in milliseconds (negative means infinite).
+ * Return with mutex locked.
+ */
+static int _waitEvent(struct mock_device* dev, struct mock_endpoint* ep, int timeout) {
+	const uint64_t deadline = (timeout < 0) ? UINT64_MAX : utils_now() + (uint64_t)timeout * UINT64_C(1000000);
+	pthread_mutex_lock(&dev->mutex);
+	for (;;) {
+		if (ep->interrupted) {
+			ep->interrupted = false;
+			_setLastLocalError("interrupted");
+			return CAEN_FELib_Interrupted;
+		}
+		const uint64_t now = utils_now();
+		if (ep->next < _availableEvents(dev, now))
+			return CAEN_FELib_Success;
+		if (dev->runEnded && !ep->stopSent)
+			return CAEN_FELib_Stop;
+		if (now >= deadline) {
+			_setLastLocalError("timeout");
+			return CAEN_FELib_Timeout;
+		}
+		uint64_t wait = deadline - now;
+		if (dev->running) {
+			const uint64_t next = dev->startTime + _eventTime(dev, ep->next);
+			if (next > now && next - now < wait)
+				wait = next - now;
+		}
+		if (wait > MOCK_POLL_PERIOD)
+			wait = MOCK_POLL_PERIOD;
+		pthread_mutex_unlock(&dev->mutex);
+		_sleep(wait);
+		pthread_mutex_lock(&dev->mutex);
+	}
+}
+
+/*
+ * Parameters
+ */
+
+static int _getParameter(struct mock_device* dev, enum node_id node, char value[256]) {
+	const size_t size = 256;
+	switch (node) {
+	case NodeParModelName:			snprintf(value, size, "Mock"); break;
+	case NodeParSerialNum:			snprintf(value, size, "%s", dev->name); break;
+	case NodeParAcqStatus:			snprintf(value, size, "%s", dev->running ? "running" : dev->armed ? "armed" : "idle"); break;
+	case NodeParEventCount:			snprintf(value, size, "%"PRIu64, _availableEvents(dev, utils_now())); break;
+	case NodeParMaxRawDataSize:		snprintf(value, size, "%zu", dev->rawEventSize); break;
+	case NodeParNumCh:				snprintf(value, size, "%zu", dev->numCh); break;
+	case NodeParRecordLengthS:		snprintf(value, size, "%zu", dev->recordLength); break;
+	case NodeParRawEventSize:		snprintf(value, size, "%zu", dev->rawEventSize); break;
+	case NodeParEventRate:			snprintf(value, size, "%g", dev->eventRate); break;
+	case NodeParMaxEvents:			snprintf(value, size, "%"PRIu64, dev->maxEvents); break;
+	case NodeParCallLatencyUs:		snprintf(value, size, "%"PRIu64, dev->callLatency / 1000); break;
+	case NodeParErrorRate:			snprintf(value, size, "%g", dev->errorRate); break;
+	case NodeParErrorCode:			snprintf(value, size, "%d", dev->errorCode); break;
+	default:
+		_setLastLocalError("node %s is not a parameter", nodes[node].path);
+		return CAEN_FELib_InvalidParam;
+	}
+	return CAEN_FELib_Success;
+}
+
+static int _setParameter(struct mock_device* dev, enum node_id node, const char* value) {
+	if (nodes[node].type != CAEN_FELib_PARAMETER || nodes[node].readOnly) {
+		_setLastLocalError("node %s is not a writable parameter", nodes[node].path);
+		return CAEN_FELib_InvalidParam;
+	}
+	char* end;
+	errno = 0;
+	const double v = strtod(value, &end);
+	if (end == value || *end != '\0' || errno != 0 || (v < 0. && node != NodeParErrorCode)) {
+		_setLastLocalError("invalid value '%s' for %s", value, nodes[node].path);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (dev->running && (node == NodeParNumCh || node == NodeParRecordLengthS || node == NodeParRawEventSize || node == NodeParEventRate)) {
+		_setLastLocalError("cannot set %s while running", nodes[node].path);
+		return CAEN_FELib_CommandError;
+	}
+	switch (node) {
+	case NodeParNumCh:
+		if (v < 1. || v > MOCK_MAX_CHANNELS)
+			goto out_of_range;
+		dev->numCh = (size_t)v;
+		break;
+	case NodeParRecordLengthS:
+		if (v < 1.)
+			goto out_of_range;
+		dev->recordLength = (size_t)v;
+		break;
+	case NodeParRawEventSize:
+		if (v < MOCK_RAW_HEADER_SIZE)
+			goto out_of_range;
+		dev->rawEventSize = (size_t)v;
+		break;
+	case NodeParEventRate:
+		dev->eventRate = v;
+		break;
+	case NodeParMaxEvents:
+		dev->maxEvents = (uint64_t)v;
+		break;
+	case NodeParCallLatencyUs:
+		dev->callLatency = (uint64_t)(v * 1e3);
+		break;
+	case NodeParErrorRate:
+		if (v > 1.)
+			goto out_of_range;
+		dev->errorRate = v;
+		break;
+	case NodeParErrorCode:
+		if (v >= 0.)
+			goto out_of_range;
+		dev->errorCode = (int)v;
+		break;
+	default:
+		break;
+	}
+	return CAEN_FELib_Success;
+out_of_range:
+	_setLastLocalError("value '%s' out of range for %s", value, nodes[node].path);
+	return CAEN_FELib_InvalidParam;
+}
+
+static int _setFormat(struct mock_device* dev, enum node_id node, const char* jsonString) {
+	struct mock_endpoint* const ep = _endpoint(dev, node);
+	struct format format;
+	enum mock_field fields[FORMAT_MAX_FIELDS];
+	int ret = format_parse(&format, jsonString, 0);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	for (size_t i = 0; i < format.nFields; ++i) {
+		const struct format_field* const f = &format.fields[i];
+		size_t j;
+		for (j = 0; j < ARRAY_SIZE(fieldDescr); ++j)
+			if (fieldDescr[j].endpoint == node && strcasecmp(fieldDescr[j].name, f->name) == 0)
+				break;
+		if (j == ARRAY_SIZE(fieldDescr)) {
+			_setLastLocalError("unknown field %s for endpoint %s", f->name, _nodeName(node));
+			goto error;
+		}
+		if (fieldDescr[j].dim != f->dim || (j == FieldData && f->typeSize != 1)) {
+			_setLastLocalError("invalid type or dim for field %s", f->name);
+			goto error;
+		}
+		fields[i] = (enum mock_field)j;
+	}
+	format_clear(&ep->format);
+	ep->format = format;
+	memcpy(ep->fields, fields, sizeof(fields));
+	return CAEN_FELib_Success;
+error:
+	format_clear(&format);
+	return CAEN_FELib_InvalidParam;
+}
+
+static void _freeDevice(struct mock_device* dev) {
+	for (size_t i = 0; i < ARRAY_SIZE(dev->endpoints); ++i)
+		format_clear(&dev->endpoints[i].format);
+	pthread_mutex_destroy(&dev->mutex);
+	free(dev);
+}
+
+static int _applyOptions(struct mock_device* dev, char* options) {
+	char* saveptr;
+	for (char* token = strtok_r(options, "&", &saveptr); token != NULL; token = strtok_r(NULL, "&", &saveptr)) {
+		char* const value = strchr(token, '=');
+		if (value == NULL) {
+			_setLastLocalError("invalid option '%s'", token);
+			return CAEN_FELib_InvalidParam;
+		}
+		*value = '\0';
+		const enum node_id node = _resolve(NodePar, token);
+		if (node == NodeCount) {
+			_setLastLocalError("unknown option '%s'", token);
+			return CAEN_FELib_InvalidParam;
+		}
+		const int ret = _setParameter(dev, node, value + 1);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+	}
+	return CAEN_FELib_Success;
+}
+
+/*
+ * API
+ */
+
+MOCK_API CAENMock_GetLibInfo(char* jsonString, size_t size) {
+	const int ret = snprintf(jsonString, size, "{\"name\":\"CAEN Mock\",\"version\":\"%s\"}", CAEN_FELIB_VERSION_STRING);
+	return (ret < 0) ? CAEN_FELib_InternalError : ret;
+}
+
+MOCK_API CAENMock_GetLibVersion(char version[16]) {
+	version[0] = '\0';
+	strncat(version, CAEN_FELIB_VERSION_STRING, 16 - 1);
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_GetLastError(char description[1024]) {
+	strncpy(description, lastError, 1024);
+	description[1024 - 1] = '\0';
+	lastError[0] = '\0';
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_DevicesDiscovery(char* jsonString, size_t size, int timeout) {
+	(void)timeout;
+	const int ret = snprintf(jsonString, size, "[{\"url\":\"mock://mock0\",\"ModelName\":\"Mock\"}]");
+	return (ret < 0) ? CAEN_FELib_InternalError : CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_Open(const char* path, uint32_t* handle) {
+	char arg[256];
+	if (path == NULL || handle == NULL || strlen(path) >= ARRAY_SIZE(arg)) {
+		_setLastLocalError("invalid argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	strcpy(arg, path);
+	char* const options = strchr(arg, '?');
+	if (options != NULL)
+		*options = '\0';
+	struct mock_device* const dev = calloc(1, sizeof(*dev));
+	if (dev == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	// longer names are truncated, dev is zeroed by calloc
+	const size_t nameLen = strlen(arg);
+	memcpy(dev->name, arg, (nameLen < ARRAY_SIZE(dev->name)) ? nameLen : ARRAY_SIZE(dev->name) - 1);
+	pthread_mutex_init(&dev->mutex, NULL);
+	dev->numCh = 4;
+	dev->recordLength = 1024;
+	dev->rawEventSize = 4096;
+	dev->eventRate = 1000.;
+	dev->errorCode = CAEN_FELib_CommunicationError;
+	dev->rng = _hash(utils_now()) | 1;
+	for (size_t i = 0; i < ARRAY_SIZE(dev->endpoints); ++i) {
+		const enum node_id node = (i == 0) ? NodeEndpointRaw : NodeEndpointScope;
+		const int ret = _setFormat(dev, node, defaultFormat[node]);
+		if (ret != CAEN_FELib_Success) {
+			_freeDevice(dev);
+			return ret;
+		}
+	}
+	if (options != NULL) {
+		const int ret = _applyOptions(dev, options + 1);
+		if (ret != CAEN_FELib_Success) {
+			_freeDevice(dev);
+			return ret;
+		}
+	}
+	_busyWait(dev->callLatency);
+	pthread_mutex_lock(&devicesMutex);
+	size_t i;
+	for (i = 0; i < MOCK_MAX_DEVICES; ++i)
+		if (devices[i] == NULL)
+			break;
+	if (i == MOCK_MAX_DEVICES) {
+		pthread_mutex_unlock(&devicesMutex);
+		_freeDevice(dev);
+		_setLastLocalError("too many devices (limited to %d)", MOCK_MAX_DEVICES);
+		return CAEN_FELib_MaxDevicesError;
+	}
+	ATOMIC_STORE_RELEASE(&devices[i], dev);
+	pthread_mutex_unlock(&devicesMutex);
+	*handle = (uint32_t)((i + 1) << 16) | NodeRoot;
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_Close(uint32_t handle) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	_busyWait(dev->callLatency);
+	pthread_mutex_lock(&devicesMutex);
+	devices[(handle >> 16) - 1] = NULL;
+	pthread_mutex_unlock(&devicesMutex);
+	_freeDevice(dev);
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_GetDeviceTree(uint32_t handle, char* jsonString, size_t size) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	// flat representation: an object per node
+	size_t len = 0;
+	char tmp[1];
+	for (size_t i = 0; i < NodeCount; ++i) {
+		char value[256] = "";
+		if (nodes[i].type == CAEN_FELib_PARAMETER) {
+			pthread_mutex_lock(&dev->mutex);
+			_getParameter(dev, (enum node_id)i, value);
+			pthread_mutex_unlock(&dev->mutex);
+		}
+		char* const p = (len < size) ? jsonString + len : tmp;
+		const size_t s = (len < size) ? size - len : 0;
+		const int n = snprintf(p, s, "%s{\"path\":\"%s\",\"type\":%d,\"readonly\":%s,\"value\":\"%s\"}%s",
+			(i == 0) ? "[" : "",
+			(i == 0) ? "/" : nodes[i].path,
+			(int)nodes[i].type,
+			nodes[i].readOnly ? "true" : "false",
+			value,
+			(i == NodeCount - 1) ? "]" : ","
+		);
+		if (n < 0)
+			return CAEN_FELib_InternalError;
+		len += (size_t)n;
+	}
+	return (int)len;
+}
+
+MOCK_API CAENMock_GetChildHandles(uint32_t handle, const char* path, uint32_t* handles, size_t size) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id parent = _resolve(node, path);
+	if (parent == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	size_t n = 0;
+	for (size_t i = 1; i < NodeCount; ++i) {
+		if (nodes[i].parent != parent)
+			continue;
+		if (n < size)
+			handles[n] = (handle & UINT32_C(0xffff0000)) | (uint32_t)i;
+		++n;
+	}
+	return (int)n;
+}
+
+MOCK_API CAENMock_GetHandle(uint32_t handle, const char* path, uint32_t* pathHandle) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id target = _resolve(node, path);
+	if (target == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	*pathHandle = (handle & UINT32_C(0xffff0000)) | (uint32_t)target;
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_GetParentHandle(uint32_t handle, const char* path, uint32_t* parentHandle) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id target = _resolve(node, path);
+	if (target == NodeCount || target == NodeRoot) {
+		_setLastLocalError("node %s not found or has no parent", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	*parentHandle = (handle & UINT32_C(0xffff0000)) | (uint32_t)nodes[target].parent;
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_GetPath(uint32_t handle, char path[256]) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	snprintf(path, 256, "%s", (node == NodeRoot) ? "/" : nodes[node].path);
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_GetNodeProperties(uint32_t handle, const char* path, char name[32], CAEN_FELib_NodeType_t* type) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id target = _resolve(node, path);
+	if (target == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (name != NULL)
+		snprintf(name, 32, "%s", _nodeName(target));
+	if (type != NULL)
+		*type = nodes[target].type;
+	return CAEN_FELib_Success;
+}
+
+// depth-first walk, appending to tree while there is space
+static void _walk(uint32_t device, enum node_id node, enum node_id parent, uint32_t depth, int maxDepth, CAEN_FELib_TreeNode_t* tree, size_t size, size_t* count) {
+	if (*count < size) {
+		CAEN_FELib_TreeNode_t* const out = &tree[*count];
+		out->handle = device | (uint32_t)node;
+		out->parent = device | (uint32_t)parent;
+		snprintf(out->name, ARRAY_SIZE(out->name), "%s", _nodeName(node));
+		out->type = nodes[node].type;
+		out->depth = depth;
+	}
+	++*count;
+	if (maxDepth >= 0 && depth >= (uint32_t)maxDepth)
+		return;
+	for (size_t i = 1; i < NodeCount; ++i)
+		if (nodes[i].parent == node)
+			_walk(device, (enum node_id)i, node, depth + 1, maxDepth, tree, size, count);
+}
+
+MOCK_API CAENMock_WalkTree(uint32_t handle, const char* path, int maxDepth, CAEN_FELib_TreeNode_t* tree, size_t size) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id root = _resolve(node, path);
+	if (root == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	size_t count = 0;
+	_walk(handle & UINT32_C(0xffff0000), root, root, 0, maxDepth, tree, size, &count);
+	return (int)count;
+}
+
+MOCK_API CAENMock_GetValue(uint32_t handle, const char* path, char value[256]) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id target = _resolve(node, path);
+	if (target == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	ret = _getParameter(dev, target, value);
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+MOCK_API CAENMock_SetValue(uint32_t handle, const char* path, const char* value) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id target = _resolve(node, path);
+	if (target == NodeCount || value == NULL) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	ret = _setParameter(dev, target, value);
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+MOCK_API CAENMock_SendCommand(uint32_t handle, const char* path) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const enum node_id target = _resolve(node, path);
+	if (target == NodeCount || nodes[target].type != CAEN_FELib_COMMAND) {
+		_setLastLocalError("command %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	switch (target) {
+	case NodeCmdArmAcquisition:
+		dev->armed = true;
+		break;
+	case NodeCmdDisarmAcquisition:
+		_stopRun(dev);
+		dev->armed = false;
+		break;
+	case NodeCmdSwStartAcquisition:
+		if (!dev->armed || dev->running) {
+			_setLastLocalError("acquisition not armed or already running");
+			ret = CAEN_FELib_CommandError;
+			break;
+		}
+		_startRun(dev);
+		break;
+	case NodeCmdSwStopAcquisition:
+		_stopRun(dev);
+		break;
+	case NodeCmdReset:
+		dev->armed = false;
+		dev->running = false;
+		dev->runEnded = false;
+		memset(dev->registers, 0, sizeof(dev->registers));
+		break;
+	default:
+		break;
+	}
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+MOCK_API CAENMock_GetUserRegister(uint32_t handle, uint32_t address, uint32_t* value) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (address % 4 != 0 || address / 4 >= MOCK_NUM_REGISTERS || value == NULL) {
+		_setLastLocalError("invalid address 0x%"PRIx32, address);
+		return CAEN_FELib_InvalidParam;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	*value = dev->registers[address / 4];
+	pthread_mutex_unlock(&dev->mutex);
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_SetUserRegister(uint32_t handle, uint32_t address, uint32_t value) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (address % 4 != 0 || address / 4 >= MOCK_NUM_REGISTERS) {
+		_setLastLocalError("invalid address 0x%"PRIx32, address);
+		return CAEN_FELib_InvalidParam;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	dev->registers[address / 4] = value;
+	pthread_mutex_unlock(&dev->mutex);
+	return CAEN_FELib_Success;
+}
+
+MOCK_API CAENMock_SetReadDataFormat(uint32_t handle, const char* jsonString) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (_endpoint(dev, node) == NULL) {
+		_setLastLocalError("node %s is not an endpoint", nodes[node].path);
+		return CAEN_FELib_InvalidHandle;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	ret = _setFormat(dev, node, jsonString);
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+MOCK_API CAENMock_ReadDataV(uint32_t handle, int timeout, va_list args) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	struct mock_endpoint* const ep = _endpoint(dev, node);
+	if (ep == NULL) {
+		_setLastLocalError("node %s is not an endpoint", nodes[node].path);
+		return CAEN_FELib_InvalidHandle;
+	}
+	ret = _waitEvent(dev, ep, timeout);
+	switch (ret) {
+	case CAEN_FELib_Success:
+		_fillEvent(dev, node, ep, ep->next++, args);
+		break;
+	case CAEN_FELib_Stop:
+		ep->stopSent = true;
+		_setLastLocalError("stop");
+		break;
+	default:
+		break;
+	}
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+MOCK_API CAENMock_HasData(uint32_t handle, int timeout) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	int ret = _enterCall(dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	struct mock_endpoint* const ep = _endpoint(dev, node);
+	if (ep == NULL) {
+		_setLastLocalError("node %s is not an endpoint", nodes[node].path);
+		return CAEN_FELib_InvalidHandle;
+	}
+	ret = _waitEvent(dev, ep, timeout);
+	if (ret == CAEN_FELib_Stop) {
+		ep->stopSent = true;
+		_setLastLocalError("stop");
+	}
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+// a pending wait notices the interrupt within MOCK_POLL_PERIOD
+MOCK_API CAENMock_Interrupt(uint32_t handle) {
+	struct mock_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	struct mock_endpoint* const ep = _endpoint(dev, node);
+	if (ep == NULL) {
+		_setLastLocalError("node %s is not an endpoint", nodes[node].path);
+		return CAEN_FELib_InvalidHandle;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	ep->interrupted = true;
+	pthread_mutex_unlock(&dev->mutex);
+	return CAEN_FELib_Success;
+}
@@ -0,0 +1,361 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		numa.c
+*	\brief		Placement of buffers and threads on hugepages, NUMA nodes and CPUs
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // MAP_HUGETLB, cpu_set_t, pthread_attr_setaffinity_np
+#endif
+
+#include "numa.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h> // VirtualAlloc, VirtualLock
+#else
+#include <sys/mman.h> // mmap, madvise, mlock
+#include <unistd.h> // sysconf
+#endif
+#ifdef __linux__
+#include <linux/mempolicy.h> // MPOL_BIND
+#include <sched.h> // cpu_set_t
+#include <sys/syscall.h> // SYS_mbind
+#endif
+
+#include "CAEN_FELib.h"
+#include "utils.h"
+
+#define NUMA_MAX_NODES				64
+#define NUMA_DEFAULT_HUGEPAGE_SIZE	(UINT32_C(2) << 20)
+
+static const char* const pagesNames[] = {
+	[NumaPagesDefault]			= "none",
+	[NumaPagesTransparent]		= "transparent",
+	[NumaPagesExplicit]			= "explicit",
+};
+
+void numa_initMemory(struct numa_memory* memory, bool prefault) {
+	memory->pages = NumaPagesDefault;
+	memory->node = -1;
+	memory->prefault = prefault;
+	memory->lock = false;
+}
+
+int numa_parseMemory(struct numa_memory* memory, const struct json* options) {
+	const char* const pages = json_string(json_get(options, "hugepages"), pagesNames[memory->pages]);
+	size_t i = 0;
+	while (i < ARRAY_SIZE(pagesNames) && strcmp(pages, pagesNames[i]) != 0)
+		++i;
+	if (i == ARRAY_SIZE(pagesNames)) {
+		_setLastLocalError("invalid options: hugepages '%s' unknown", pages);
+		return CAEN_FELib_InvalidParam;
+	}
+	// the kernel reads one bit less than maxnode passed to mbind
+	const double node = json_number(json_get(options, "numa_node"), (double)memory->node);
+	if (!(node >= -1 && node < NUMA_MAX_NODES - 1)) {
+		_setLastLocalError("invalid options: numa_node out of range");
+		return CAEN_FELib_InvalidParam;
+	}
+	memory->pages = (enum numa_pages)i;
+	memory->node = (int)node;
+	memory->prefault = json_bool(json_get(options, "prefault"), memory->prefault);
+	memory->lock = json_bool(json_get(options, "mlock"), memory->lock);
+	return CAEN_FELib_Success;
+}
+
+#ifdef _WIN32
+
+int numa_alloc(struct numa_buffer* buffer, size_t size, const struct numa_memory* memory) {
+	memset(buffer, 0, sizeof(*buffer));
+	if (memory->pages != NumaPagesDefault || memory->node >= 0) {
+		_setLastLocalError("hugepages and NUMA node not supported on this platform");
+		return CAEN_FELib_NotImplemented;
+	}
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	const size_t pageSize = info.dwPageSize;
+	buffer->size = (size + pageSize - 1) / pageSize * pageSize;
+	buffer->ptr = VirtualAlloc(NULL, buffer->size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (buffer->ptr == NULL) {
+		_setLastLocalError("allocation of %zu bytes failed", buffer->size);
+		return CAEN_FELib_InternalError;
+	}
+	if (memory->prefault)
+		for (size_t i = 0; i < buffer->size; i += pageSize)
+			((volatile char*)buffer->ptr)[i] = 0;
+	if (memory->lock) {
+		if (!VirtualLock(buffer->ptr, buffer->size)) {
+			_setLastLocalError("VirtualLock failed: see working set size");
+			numa_free(buffer);
+			return CAEN_FELib_InternalError;
+		}
+		buffer->locked = true;
+	}
+	return CAEN_FELib_Success;
+}
+
+void numa_free(struct numa_buffer* buffer) {
+	if (buffer->ptr == NULL)
+		return;
+	if (buffer->locked)
+		VirtualUnlock(buffer->ptr, buffer->size);
+	VirtualFree(buffer->ptr, 0, MEM_RELEASE);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+#else
+
+static size_t _hugePageSize(void) {
+	size_t size = NUMA_DEFAULT_HUGEPAGE_SIZE;
+#ifdef __linux__
+	// size of explicit hugepages, required to unmap them
+	FILE* const f = fopen("/proc/meminfo", "r");
+	if (f == NULL)
+		return size;
+	char line[128];
+	unsigned long kb;
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+			size = (size_t)kb << 10;
+			break;
+		}
+	fclose(f);
+#endif
+	return size;
+}
+
+static size_t _pageSize(enum numa_pages pages) {
+	switch (pages) {
+	case NumaPagesTransparent:
+		return NUMA_DEFAULT_HUGEPAGE_SIZE;
+	case NumaPagesExplicit:
+		return _hugePageSize();
+	default:
+		return (size_t)sysconf(_SC_PAGESIZE);
+	}
+}
+
+static void* _map(size_t size, int flags) {
+	return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+}
+
+// mapping aligned to alignment, that must be a multiple of the page size
+static void* _mapAligned(size_t size, size_t alignment) {
+	char* const p = _map(size + alignment, 0);
+	if (p == MAP_FAILED)
+		return p;
+	const size_t head = (alignment - (uintptr_t)p % alignment) % alignment;
+	if (head != 0)
+		munmap(p, head);
+	munmap(p + head + size, alignment - head);
+	return p + head;
+}
+
+static void* _mapPages(size_t size, enum numa_pages pages) {
+	switch (pages) {
+	case NumaPagesTransparent: {
+		void* const p = _mapAligned(size, NUMA_DEFAULT_HUGEPAGE_SIZE);
+#ifdef MADV_HUGEPAGE
+		// if transparent hugepages are disabled, regular pages are used
+		if (p != MAP_FAILED)
+			madvise(p, size, MADV_HUGEPAGE);
+#endif
+		return p;
+	}
+	case NumaPagesExplicit:
+#ifdef MAP_HUGETLB
+		return _map(size, MAP_HUGETLB);
+#else
+		errno = ENOTSUP;
+		return MAP_FAILED;
+#endif
+	default:
+		return _map(size, 0);
+	}
+}
+
+static int _bind(void* p, size_t size, int node) {
+#ifdef __linux__
+	unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+	const size_t bits = 8 * sizeof(unsigned long);
+	mask[node / bits] |= 1UL << (node % bits);
+	if (syscall(SYS_mbind, p, size, MPOL_BIND, mask, (unsigned long)NUMA_MAX_NODES, 0) != 0) {
+		_setLastLocalError("mbind on NUMA node %d failed: %s", node, strerror(errno));
+		return CAEN_FELib_InternalError;
+	}
+	return CAEN_FELib_Success;
+#else
+	_setLastLocalError("NUMA node not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+#endif
+}
+
+int numa_alloc(struct numa_buffer* buffer, size_t size, const struct numa_memory* memory) {
+	memset(buffer, 0, sizeof(*buffer));
+	const size_t pageSize = _pageSize(memory->pages);
+	if (size > SIZE_MAX - 2 * pageSize) {
+		_setLastLocalError("allocation of %zu bytes failed", size);
+		return CAEN_FELib_InternalError;
+	}
+	const size_t mapSize = (size + pageSize - 1) / pageSize * pageSize;
+	void* const p = _mapPages((mapSize != 0) ? mapSize : pageSize, memory->pages);
+	if (p == MAP_FAILED) {
+		const bool explicit = (memory->pages == NumaPagesExplicit);
+		_setLastLocalError("allocation of %zu bytes failed: %s%s", mapSize, strerror(errno), explicit ? " (see /proc/sys/vm/nr_hugepages)" : "");
+		return CAEN_FELib_InternalError;
+	}
+	buffer->ptr = p;
+	buffer->size = (mapSize != 0) ? mapSize : pageSize;
+	// the policy applies to pages faulted in later: bind before prefault and mlock
+	if (memory->node >= 0) {
+		const int ret = _bind(buffer->ptr, buffer->size, memory->node);
+		if (ret != CAEN_FELib_Success) {
+			numa_free(buffer);
+			return ret;
+		}
+	}
+	if (memory->prefault)
+		for (size_t i = 0; i < buffer->size; i += pageSize)
+			((volatile char*)buffer->ptr)[i] = 0;
+	if (memory->lock) {
+		if (mlock(buffer->ptr, buffer->size) != 0) {
+			_setLastLocalError("mlock of %zu bytes failed: %s (see RLIMIT_MEMLOCK)", buffer->size, strerror(errno));
+			numa_free(buffer);
+			return CAEN_FELib_InternalError;
+		}
+		buffer->locked = true;
+	}
+	return CAEN_FELib_Success;
+}
+
+void numa_free(struct numa_buffer* buffer) {
+	if (buffer->ptr == NULL)
+		return;
+	// munmap also unlocks
+	munmap(buffer->ptr, buffer->size);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+#endif
+
+static bool _parseCpus(struct numa_cpus* cpus, const char* list) {
+	const char* p = list;
+	while (*p != '\0') {
+		char* end;
+		const unsigned long first = strtoul(p, &end, 10);
+		if (end == p)
+			return false;
+		unsigned long last = first;
+		p = end;
+		if (*p == '-') {
+			++p;
+			last = strtoul(p, &end, 10);
+			if (end == p)
+				return false;
+			p = end;
+		}
+		if (first > last || last >= NUMA_MAX_CPUS)
+			return false;
+		for (unsigned long cpu = first; cpu <= last; ++cpu)
+			cpus->mask[cpu / 64] |= UINT64_C(1) << (cpu % 64);
+		if (*p == ',')
+			++p;
+		else if (*p != '\0')
+			return false;
+	}
+	return true;
+}
+
+int numa_parseCpus(struct numa_cpus* cpus, const char* list) {
+	memset(cpus, 0, sizeof(*cpus));
+	if (list != NULL && !_parseCpus(cpus, list)) {
+		memset(cpus, 0, sizeof(*cpus));
+		_setLastLocalError("invalid CPU list '%s'", list);
+		return CAEN_FELib_InvalidParam;
+	}
+	return CAEN_FELib_Success;
+}
+
+int numa_parseCpusOption(struct numa_cpus* cpus, const struct json* options) {
+	const struct json* const value = json_get(options, "cpu_affinity");
+	if (value == NULL)
+		return CAEN_FELib_Success;
+	if (value->type != JsonString) {
+		_setLastLocalError("invalid options: cpu_affinity is not a string");
+		return CAEN_FELib_InvalidParam;
+	}
+	return numa_parseCpus(cpus, value->string);
+}
+
+bool numa_isEmpty(const struct numa_cpus* cpus) {
+	for (size_t i = 0; i < ARRAY_SIZE(cpus->mask); ++i)
+		if (cpus->mask[i] != 0)
+			return false;
+	return true;
+}
+
+#ifndef _WIN32
+
+int numa_initThreadAttr(pthread_attr_t* attr, const struct numa_cpus* cpus) {
+	if (pthread_attr_init(attr) != 0) {
+		_setLastLocalError("pthread_attr_init failed");
+		return CAEN_FELib_InternalError;
+	}
+	if (numa_isEmpty(cpus))
+		return CAEN_FELib_Success;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE; ++cpu)
+		if (cpus->mask[cpu / 64] & (UINT64_C(1) << (cpu % 64)))
+			CPU_SET(cpu, &set);
+	const int ret = pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+	if (ret != 0) {
+		pthread_attr_destroy(attr);
+		_setLastLocalError("pthread_attr_setaffinity_np failed: %s", strerror(ret));
+		return CAEN_FELib_InternalError;
+	}
+	return CAEN_FELib_Success;
+#else
+	pthread_attr_destroy(attr);
+	_setLastLocalError("CPU affinity not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+#endif
+}
+
+#endif
@@ -0,0 +1,104 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		numa.h
+*	\brief		Placement of buffers and threads on hugepages, NUMA nodes and CPUs
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_NUMA_H_
+#define CAEN_INCLUDE_NUMA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "json.h"
+
+/*
+ * Placement of library-owned buffers and threads: hugepages, NUMA node, prefault and lock of
+ * buffers, CPU affinity of threads. Options are parsed from the JSON options of the functions
+ * that allocate buffers or create threads, with the members documented on CAEN_FELib.h.
+ */
+
+#define NUMA_MAX_CPUS			1024
+
+enum numa_pages {
+	NumaPagesDefault,			// regular pages
+	NumaPagesTransparent,		// transparent hugepages, if enabled by the system
+	NumaPagesExplicit,			// pages reserved on the hugetlbfs pool (fail if not enough)
+};
+
+struct numa_memory {
+	enum numa_pages				pages;
+	int							node;		// NUMA node, or -1 to use the default policy
+	bool						prefault;	// touch pages on allocation
+	bool						lock;		// lock pages on RAM
+};
+
+// memory mapping, page aligned
+struct numa_buffer {
+	void*						ptr;
+	size_t						size;		// mapped size, rounded up to the page size
+	bool						locked;
+};
+
+struct numa_cpus {
+	uint64_t					mask[NUMA_MAX_CPUS / 64];
+};
+
+void numa_initMemory(struct numa_memory* memory, bool prefault);
+
+// parse "hugepages", "numa_node", "prefault" and "mlock" members of a JSON object, set last error on failure
+int numa_parseMemory(struct numa_memory* memory, const struct json* options);
+
+// zero initialized buffer, return a CAEN_FELib_ErrorCode, set last error on failure
+int numa_alloc(struct numa_buffer* buffer, size_t size, const struct numa_memory* memory);
+void numa_free(struct numa_buffer* buffer);
+
+// parse a list of CPUs in the Linux cpulist format (e.g. "0-3,8"), set last error on failure
+int numa_parseCpus(struct numa_cpus* cpus, const char* list);
+
+// parse the "cpu_affinity" member of a JSON object, if present, set last error on failure
+int numa_parseCpusOption(struct numa_cpus* cpus, const struct json* options);
+
+bool numa_isEmpty(const struct numa_cpus* cpus);
+
+#ifndef _WIN32
+// initialize a thread attributes object with the affinity (default attributes if empty), set last error on failure
+int numa_initThreadAttr(pthread_attr_t* attr, const struct numa_cpus* cpus);
+#endif
+
+#endif /* CAEN_INCLUDE_NUMA_H_ */
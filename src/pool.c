@@ -0,0 +1,285 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		pool.c
+*	\brief		Pool of preallocated event buffers
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "pool.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc
+#endif
+
+#include "json.h"
+#include "numa.h"
+#include "utils.h"
+
+#define POOL_EMPTY			UINT32_MAX	// index of the end of the free list
+#define POOL_MAX_SLOTS		(UINT32_C(1) << 24)
+
+struct pool_slot {
+	CAEN_FELib_EventSlot_t			slot;		// returned to the user
+	uint32_t						next;		// next free slot, valid while on the free list
+	bool							acquired;
+	struct format_args				args;
+};
+
+struct CAEN_FELib_EventPool {
+	// free list head: tag on the 32 most significant bits, to avoid ABA, and index of the first free slot
+	uint64_t						head;
+	char							padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
+	uint64_t						handle;
+	uint32_t						formatGeneration;
+	struct format					fmt;
+	size_t							nChannels;
+	size_t							recordLength;
+	size_t							maxArraySize;
+	size_t							nSlots;
+	size_t							slotSize;
+	struct numa_buffer				arena;		// slot headers, followed by slot buffers
+	struct pool_slot*				slots;
+};
+
+static void* _alignedAlloc(size_t size) {
+#ifdef _WIN32
+	return _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+	void* p;
+	return (posix_memalign(&p, CACHE_LINE_SIZE, size) == 0) ? p : NULL;
+#endif
+}
+
+static void _alignedFree(void* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static size_t _align(size_t size) {
+	return (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+static size_t _arrayCount(const CAEN_FELib_EventPool_t* pool, const struct format_field* f) {
+	if (f->dim == 1 && f->sizeField == FORMAT_SIZE_NCHANNELS)
+		return pool->nChannels;
+	if (f->typeSize == 1 || pool->recordLength == 0)
+		return pool->maxArraySize / f->typeSize;
+	return pool->recordLength;
+}
+
+/*
+ * Layout of the buffers of a slot, each aligned to a cache line. Return the size of the slot;
+ * if base is not NULL, also set the pointers of args, and the channel pointers of dim 2 fields.
+ */
+static size_t _layout(const CAEN_FELib_EventPool_t* pool, char* base, struct format_args* args) {
+	size_t offset = 0;
+	for (size_t i = 0; i < pool->fmt.nFields; ++i) {
+		const struct format_field* const f = &pool->fmt.fields[i];
+		if (base != NULL)
+			args->ptr[i] = base + offset;
+		switch (f->dim) {
+		case 0:
+			offset += _align(f->typeSize);
+			break;
+		case 1:
+			offset += _align(_arrayCount(pool, f) * f->typeSize);
+			break;
+		case 2: {
+			void** const channels = (void**)(base + offset);
+			offset += _align(pool->nChannels * sizeof(void*));
+			for (size_t ch = 0; ch < pool->nChannels; ++ch) {
+				if (base != NULL)
+					channels[ch] = base + offset;
+				offset += _align(_arrayCount(pool, f) * f->typeSize);
+			}
+			break;
+		}
+		}
+	}
+	return offset;
+}
+
+static void _push(CAEN_FELib_EventPool_t* pool, uint32_t index) {
+	uint64_t head = ATOMIC_LOAD_RELAXED(&pool->head);
+	uint64_t newHead;
+	do {
+		ATOMIC_STORE_RELAXED(&pool->slots[index].next, (uint32_t)head);
+		newHead = (((head >> 32) + 1) << 32) | index;
+	} while (!ATOMIC_CAS_WEAK(&pool->head, &head, newHead));
+}
+
+static uint32_t _pop(CAEN_FELib_EventPool_t* pool) {
+	uint64_t head = ATOMIC_LOAD_ACQUIRE(&pool->head);
+	uint64_t newHead;
+	uint32_t index;
+	do {
+		index = (uint32_t)head;
+		if (index == POOL_EMPTY)
+			return POOL_EMPTY;
+		// next may be stale if the slot is popped concurrently: the tag makes the exchange fail
+		newHead = (((head >> 32) + 1) << 32) | ATOMIC_LOAD_RELAXED(&pool->slots[index].next);
+	} while (!ATOMIC_CAS_WEAK(&pool->head, &head, newHead));
+	return index;
+}
+
+static int _parseOptions(const char* options, size_t* recordLength, size_t* maxArraySize, struct numa_memory* memory) {
+	if (options == NULL)
+		return CAEN_FELib_Success;
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid pool options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	const double r = json_number(json_get(root, "record_length"), (double)*recordLength);
+	const double m = json_number(json_get(root, "max_array_size"), (double)*maxArraySize);
+	const int ret = numa_parseMemory(memory, root);
+	json_free(root);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (!(r >= 0 && r <= (double)(SIZE_MAX / 16)) || !(m >= 1 && m <= (double)(SIZE_MAX / 2))) {
+		_setLastLocalError("invalid pool options: value out of range");
+		return CAEN_FELib_InvalidParam;
+	}
+	*recordLength = (size_t)r;
+	*maxArraySize = (size_t)m;
+	return CAEN_FELib_Success;
+}
+
+int pool_create(CAEN_FELib_EventPool_t** pool, uint64_t handle, uint32_t formatGeneration, const struct format* fmt, size_t nSlots, size_t recordLength, size_t maxArraySize, const char* options) {
+	if (nSlots == 0 || nSlots > POOL_MAX_SLOTS) {
+		_setLastLocalError("invalid number of slots %zu", nSlots);
+		return CAEN_FELib_InvalidParam;
+	}
+	// the arena is prefaulted by default, so that pages are not faulted in during the readout
+	struct numa_memory memory;
+	numa_initMemory(&memory, true);
+	int ret = _parseOptions(options, &recordLength, &maxArraySize, &memory);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	CAEN_FELib_EventPool_t* const p = _alignedAlloc(sizeof(*p));
+	if (p == NULL) {
+		_setLastLocalError("allocation failed");
+		return CAEN_FELib_InternalError;
+	}
+	memset(p, 0, sizeof(*p));
+	p->handle = handle;
+	p->formatGeneration = formatGeneration;
+	p->nChannels = fmt->nChannels;
+	p->recordLength = recordLength;
+	p->maxArraySize = maxArraySize;
+	p->nSlots = nSlots;
+	ret = format_parse(&p->fmt, fmt->json, fmt->nChannels);
+	if (ret != CAEN_FELib_Success) {
+		_alignedFree(p);
+		return ret;
+	}
+	p->slotSize = _layout(p, NULL, NULL);
+	const size_t headersSize = _align(nSlots * sizeof(struct pool_slot));
+	if (p->slotSize > (SIZE_MAX - headersSize) / nSlots) {
+		_setLastLocalError("pool too large");
+		pool_destroy(p);
+		return CAEN_FELib_InvalidParam;
+	}
+	ret = numa_alloc(&p->arena, headersSize + nSlots * p->slotSize, &memory);
+	if (ret != CAEN_FELib_Success) {
+		pool_destroy(p);
+		return ret;
+	}
+	p->slots = p->arena.ptr;
+	char* const buffers = (char*)p->arena.ptr + headersSize;
+	p->head = POOL_EMPTY;
+	for (size_t i = nSlots; i-- != 0;) {
+		struct pool_slot* const s = &p->slots[i];
+		_layout(p, buffers + i * p->slotSize, &s->args);
+		s->slot.fields = s->args.ptr;
+		s->slot.nFields = p->fmt.nFields;
+		s->slot.index = i;
+		_push(p, (uint32_t)i);
+	}
+	*pool = p;
+	return CAEN_FELib_Success;
+}
+
+void pool_destroy(CAEN_FELib_EventPool_t* pool) {
+	if (pool == NULL)
+		return;
+	format_clear(&pool->fmt);
+	numa_free(&pool->arena);
+	_alignedFree(pool);
+}
+
+uint64_t pool_getHandle(const CAEN_FELib_EventPool_t* pool) {
+	return pool->handle;
+}
+
+uint32_t pool_getFormatGeneration(const CAEN_FELib_EventPool_t* pool) {
+	return pool->formatGeneration;
+}
+
+const struct format* pool_getFormat(const CAEN_FELib_EventPool_t* pool) {
+	return &pool->fmt;
+}
+
+size_t pool_getSize(const CAEN_FELib_EventPool_t* pool) {
+	return pool->nSlots;
+}
+
+CAEN_FELib_EventSlot_t* pool_acquire(CAEN_FELib_EventPool_t* pool) {
+	const uint32_t index = _pop(pool);
+	if (index == POOL_EMPTY)
+		return NULL;
+	struct pool_slot* const s = &pool->slots[index];
+	s->acquired = true;
+	return &s->slot;
+}
+
+int pool_release(CAEN_FELib_EventPool_t* pool, CAEN_FELib_EventSlot_t* slot) {
+	if (slot->index >= pool->nSlots || slot != &pool->slots[slot->index].slot || !pool->slots[slot->index].acquired) {
+		_setLastLocalError("slot not acquired from this pool");
+		return CAEN_FELib_InvalidParam;
+	}
+	pool->slots[slot->index].acquired = false;
+	_push(pool, (uint32_t)slot->index);
+	return CAEN_FELib_Success;
+}
+
+const struct format_args* pool_getArgs(const CAEN_FELib_EventSlot_t* slot) {
+	return &((const struct pool_slot*)slot)->args;
+}
@@ -0,0 +1,76 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		pool.h
+*	\brief		Pool of preallocated event buffers
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_POOL_H_
+#define CAEN_INCLUDE_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "format.h"
+
+/*
+ * Pool of event slots, with buffers sized for a read data format and preallocated in a single
+ * arena. Free slots are kept on a lock-free list, so that slots can be acquired by the readout
+ * thread and released by any other thread without locks and without allocations.
+ */
+
+/*
+ * Slots have a buffer for each field of fmt. Arrays have maxArraySize bytes if the element
+ * size is 1 byte (raw data), or recordLength elements otherwise (waveforms); if recordLength is
+ * zero, maxArraySize is used for all arrays. Arrays of dim 1 with a size per channel have
+ * nChannels elements. recordLength and maxArraySize are defaults, overridden by the JSON options
+ * (see CAEN_FELib_CreateEventPool()). Return a CAEN_FELib_ErrorCode, set last error on failure.
+ */
+int pool_create(CAEN_FELib_EventPool_t** pool, uint64_t handle, uint32_t formatGeneration, const struct format* fmt, size_t nSlots, size_t recordLength, size_t maxArraySize, const char* options);
+void pool_destroy(CAEN_FELib_EventPool_t* pool);
+
+uint64_t pool_getHandle(const CAEN_FELib_EventPool_t* pool);
+uint32_t pool_getFormatGeneration(const CAEN_FELib_EventPool_t* pool);
+const struct format* pool_getFormat(const CAEN_FELib_EventPool_t* pool);
+size_t pool_getSize(const CAEN_FELib_EventPool_t* pool);
+
+// return NULL if no slot is free
+CAEN_FELib_EventSlot_t* pool_acquire(CAEN_FELib_EventPool_t* pool);
+
+// return a CAEN_FELib_ErrorCode, set last error if slot does not belong to pool or is not acquired
+int pool_release(CAEN_FELib_EventPool_t* pool, CAEN_FELib_EventSlot_t* slot);
+
+// buffers to be passed to CAEN_FELib_ReadData()
+const struct format_args* pool_getArgs(const CAEN_FELib_EventSlot_t* slot);
+
+#endif /* CAEN_INCLUDE_POOL_H_ */
@@ -0,0 +1,78 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		probes.h
+*	\brief		USDT static probes
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_PROBES_H_
+#define CAEN_INCLUDE_PROBES_H_
+
+/*
+ * USDT static probes, available with SystemTap, bpftrace, perf and any tool
+ * supporting SDT notes. Probes are a single nop when no tracer is attached.
+ *
+ * Provider is "caen_felib". Example:
+ *   bpftrace -e 'usdt:/usr/local/lib/libCAEN_FELib.so:caen_felib:readdata__timeout { @[arg0] = count(); }'
+ *
+ * Probes:
+ * - call__entry(const char* function, uint64_t handle, const char* path)
+ * - call__return(const char* function, uint64_t handle, int ret)
+ * - library__load(const char* filename, void* dlHandle)
+ * - library__unload(void* dlHandle)
+ * - readdata__timeout(uint64_t handle, int timeout)
+ * - readdata__stop(uint64_t handle)
+ * - hasdata__timeout(uint64_t handle, int timeout)
+ * - hasdata__stop(uint64_t handle)
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROBE_CALL_ENTRY(FUNCTION, HANDLE, PATH)	DTRACE_PROBE3(caen_felib, call__entry, FUNCTION, HANDLE, PATH)
+#define PROBE_CALL_RETURN(FUNCTION, HANDLE, RET)	DTRACE_PROBE3(caen_felib, call__return, FUNCTION, HANDLE, RET)
+#define PROBE_LIBRARY_LOAD(FILENAME, DLHANDLE)		DTRACE_PROBE2(caen_felib, library__load, FILENAME, DLHANDLE)
+#define PROBE_LIBRARY_UNLOAD(DLHANDLE)				DTRACE_PROBE1(caen_felib, library__unload, DLHANDLE)
+#define PROBE_READDATA_TIMEOUT(HANDLE, TIMEOUT)		DTRACE_PROBE2(caen_felib, readdata__timeout, HANDLE, TIMEOUT)
+#define PROBE_READDATA_STOP(HANDLE)					DTRACE_PROBE1(caen_felib, readdata__stop, HANDLE)
+#define PROBE_HASDATA_TIMEOUT(HANDLE, TIMEOUT)		DTRACE_PROBE2(caen_felib, hasdata__timeout, HANDLE, TIMEOUT)
+#define PROBE_HASDATA_STOP(HANDLE)					DTRACE_PROBE1(caen_felib, hasdata__stop, HANDLE)
+#else
+#define PROBE_CALL_ENTRY(FUNCTION, HANDLE, PATH)	do { (void)(FUNCTION); (void)(HANDLE); (void)(PATH); } while (0)
+#define PROBE_CALL_RETURN(FUNCTION, HANDLE, RET)	do { (void)(FUNCTION); (void)(HANDLE); (void)(RET); } while (0)
+#define PROBE_LIBRARY_LOAD(FILENAME, DLHANDLE)		do { (void)(FILENAME); (void)(DLHANDLE); } while (0)
+#define PROBE_LIBRARY_UNLOAD(DLHANDLE)				do { (void)(DLHANDLE); } while (0)
+#define PROBE_READDATA_TIMEOUT(HANDLE, TIMEOUT)		do { (void)(HANDLE); (void)(TIMEOUT); } while (0)
+#define PROBE_READDATA_STOP(HANDLE)					do { (void)(HANDLE); } while (0)
+#define PROBE_HASDATA_TIMEOUT(HANDLE, TIMEOUT)		do { (void)(HANDLE); (void)(TIMEOUT); } while (0)
+#define PROBE_HASDATA_STOP(HANDLE)					do { (void)(HANDLE); } while (0)
+#endif
+
+#endif /* CAEN_INCLUDE_PROBES_H_ */
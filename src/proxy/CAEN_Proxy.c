@@ -0,0 +1,881 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		CAEN_Proxy.c
+*	\brief		Proxy implementation library
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Proxy implementation library, loaded by CAEN_FELib_Open() with URL "proxy://<scheme>/<address>",
+ * to access the device "<scheme>://<address>" through the proxy daemon caen-felib-proxyd (e.g.
+ * "proxy://dig2/192.168.0.1" for "dig2://192.168.0.1"). The daemon holds the connections to the
+ * devices: several processes can share the same device, without reconnecting.
+ *
+ * All the processes of a user share the same daemon, listening on the Unix-domain socket
+ * PROXY_DEFAULT_SOCKET (see protocol.h).
+ *
+ * Each process has a single connection to the daemon, used by all threads. Calls are sent as soon
+ * as they are invoked, with an identifier, and the thread waits for the response with the same
+ * identifier, received by a dedicated thread: calls of different threads are pipelined on the same
+ * socket, and the daemon executes them concurrently.
+ *
+ * Handles of the daemon are 64-bit: they are mapped to 32-bit handles of this library, allocated on
+ * first use and valid until the library is unloaded.
+ *
+ * Readout data does not go through the socket. On SetReadDataFormat the daemon starts to read the
+ * endpoint, publishing the events on a shared memory fan-out (see fanout.h), read by ReadData. If
+ * the endpoint is already read for other clients, its format is not changed: the fields requested
+ * must be a subset of the format in use, and are converted to the requested type, if different.
+ * Interrupt wakes the local reader of the fan-out, without involving the daemon.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <CAEN_FELib.h>
+
+#include "../evfile.h"
+#include "../fanout.h"
+#include "../format.h"
+#include "../utils.h"
+#include "protocol.h"
+
+#define PROXY_API						CAEN_FELIB_DLLAPI int CAEN_FELIB_API
+#define PROXY_READER_OPTIONS			"{\"policy\":\"block\"}"
+
+struct proxy_endpoint {
+	pthread_mutex_t					mutex;
+	CAEN_FELib_FanoutReader_t*		reader;
+	struct format					userFormat;
+	int								fieldMap[FORMAT_MAX_FIELDS];	// field of userFormat for each field of the fan-out format, or -1
+	uint64_t						mapGeneration;	// generation of the fan-out format of fieldMap, zero if not valid
+	CAEN_FELib_Event_t				pending;		// read by HasData, or not consumed by ReadData
+	int								pendingRet;		// CAEN_FELib_Success or CAEN_FELib_Stop, if pending
+	bool							hasPending;
+};
+
+struct proxy_node {
+	uint64_t						remote;			// handle of the daemon
+	uint32_t						device;			// local handle of the root
+	unsigned						opens;			// number of opens, on roots
+	struct proxy_endpoint*			endpoint;		// allocated on SetReadDataFormat
+};
+
+// call waiting for its response
+struct proxy_call {
+	uint32_t						id;
+	bool							done;
+	struct proxy_header				response;
+	char*							payload;		// null-terminated, NULL if empty
+	pthread_cond_t					cond;
+	struct proxy_call*				next;
+};
+
+// connection
+static pthread_mutex_t connectionMutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned connectionUsers;				// open devices and pending opens
+static int connectionFd = -1;
+static pthread_t receiver;
+static pthread_mutex_t sendMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// calls, protected by callsMutex
+static pthread_mutex_t callsMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct proxy_call* calls;
+static uint32_t nextId;
+static bool broken;
+
+// handles, protected by nodesMutex: local handles are indexes on nodes plus one
+static pthread_mutex_t nodesMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct proxy_node* nodes;
+static size_t nNodes;
+static size_t nodesCapacity;
+static uint32_t* buckets;						// open addressing hash table of local handles, zero if empty
+static size_t nBuckets;
+
+static THREAD_LOCAL char lastError[1024];
+
+// used also by format.c, evfile.c and fanout.c
+void _setLastLocalError(const char* description, ...) {
+	va_list args;
+	va_start(args, description);
+	vsnprintf(lastError, ARRAY_SIZE(lastError), description, args);
+	va_end(args);
+}
+
+static int _invalidHandle(uint32_t handle) {
+	_setLastLocalError("invalid handle 0x%08"PRIx32, handle);
+	return CAEN_FELib_InvalidHandle;
+}
+
+/*
+ * Handles
+ */
+
+static size_t _bucket(uint64_t remote) {
+	// Fibonacci hashing
+	return (size_t)((remote * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & (nBuckets - 1);
+}
+
+static bool _rehash(size_t size) {
+	uint32_t* const b = calloc(size, sizeof(*b));
+	if (b == NULL)
+		return false;
+	free(buckets);
+	buckets = b;
+	nBuckets = size;
+	for (size_t i = 0; i < nNodes; ++i) {
+		size_t j = _bucket(nodes[i].remote);
+		while (buckets[j] != 0)
+			j = (j + 1) & (nBuckets - 1);
+		buckets[j] = (uint32_t)(i + 1);
+	}
+	return true;
+}
+
+// find or add the local handle of a daemon handle, with nodesMutex locked
+static int _mapLocked(uint64_t remote, uint32_t device, uint32_t* local) {
+	if (nBuckets != 0) {
+		for (size_t j = _bucket(remote); buckets[j] != 0; j = (j + 1) & (nBuckets - 1)) {
+			if (nodes[buckets[j] - 1].remote == remote) {
+				*local = buckets[j];
+				return CAEN_FELib_Success;
+			}
+		}
+	}
+	if (nNodes == UINT32_MAX - 1) {
+		_setLastLocalError("too many handles");
+		return CAEN_FELib_InternalError;
+	}
+	if (nNodes == nodesCapacity) {
+		const size_t capacity = (nodesCapacity == 0) ? 256 : nodesCapacity * 2;
+		struct proxy_node* const n = realloc(nodes, capacity * sizeof(*n));
+		if (n == NULL) {
+			_setLastLocalError("realloc failed");
+			return CAEN_FELib_InternalError;
+		}
+		nodes = n;
+		nodesCapacity = capacity;
+	}
+	const uint32_t handle = (uint32_t)(nNodes + 1);
+	nodes[nNodes++] = (struct proxy_node){ .remote = remote, .device = (device != 0) ? device : handle };
+	// load factor at most 1/2
+	if (nNodes * 2 > nBuckets) {
+		if (!_rehash((nBuckets == 0) ? 512 : nBuckets * 2)) {
+			--nNodes;
+			_setLastLocalError("calloc failed");
+			return CAEN_FELib_InternalError;
+		}
+	} else {
+		size_t j = _bucket(remote);
+		while (buckets[j] != 0)
+			j = (j + 1) & (nBuckets - 1);
+		buckets[j] = handle;
+	}
+	*local = handle;
+	return CAEN_FELib_Success;
+}
+
+// device is the local handle of the root, or zero for a new device
+static int _map(uint64_t remote, uint32_t device, uint32_t* local) {
+	pthread_mutex_lock(&nodesMutex);
+	const int ret = _mapLocked(remote, device, local);
+	pthread_mutex_unlock(&nodesMutex);
+	return ret;
+}
+
+static bool _decodeHandle(uint32_t handle, struct proxy_node* node) {
+	pthread_mutex_lock(&nodesMutex);
+	const bool valid = (handle != 0 && handle <= nNodes);
+	if (valid)
+		*node = nodes[handle - 1];
+	pthread_mutex_unlock(&nodesMutex);
+	return valid;
+}
+
+/*
+ * Connection
+ */
+
+static void _failCalls(void) {
+	pthread_mutex_lock(&callsMutex);
+	broken = true;
+	for (struct proxy_call* c = calls; c != NULL; c = c->next) {
+		if (c->done)
+			continue;
+		c->done = true;
+		c->response.ret = CAEN_FELib_CommunicationError;
+		pthread_cond_signal(&c->cond);
+	}
+	pthread_mutex_unlock(&callsMutex);
+}
+
+static bool _isBroken(void) {
+	pthread_mutex_lock(&callsMutex);
+	const bool ret = broken;
+	pthread_mutex_unlock(&callsMutex);
+	return ret;
+}
+
+static void* _receiverMain(void* arg) {
+	const int fd = *(const int*)arg;
+	free(arg);
+	for (;;) {
+		struct proxy_header response;
+		if (!proxy_recv(fd, &response, sizeof(response)) || response.size > PROXY_MAX_PAYLOAD)
+			break;
+		char* payload = NULL;
+		if (response.size != 0) {
+			payload = malloc((size_t)response.size + 1);
+			if (payload == NULL || !proxy_recv(fd, payload, response.size)) {
+				free(payload);
+				break;
+			}
+			payload[response.size] = '\0';
+		}
+		pthread_mutex_lock(&callsMutex);
+		struct proxy_call* c;
+		for (c = calls; c != NULL; c = c->next)
+			if (c->id == response.id && !c->done)
+				break;
+		if (c != NULL) {
+			c->response = response;
+			c->payload = payload;
+			c->done = true;
+			pthread_cond_signal(&c->cond);
+		} else {
+			free(payload);
+		}
+		pthread_mutex_unlock(&callsMutex);
+	}
+	_failCalls();
+	return NULL;
+}
+
+static int _connect(void) {
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		_setLastLocalError("socket failed: %s", strerror(errno));
+		return CAEN_FELib_CommunicationError;
+	}
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	strncpy(addr.sun_path, PROXY_DEFAULT_SOCKET, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		_setLastLocalError("cannot connect to the proxy daemon on %s: %s", PROXY_DEFAULT_SOCKET, strerror(errno));
+		close(fd);
+		return CAEN_FELib_CommunicationError;
+	}
+	int* const arg = malloc(sizeof(*arg));
+	if (arg == NULL) {
+		_setLastLocalError("malloc failed");
+		close(fd);
+		return CAEN_FELib_InternalError;
+	}
+	*arg = fd;
+	pthread_mutex_lock(&callsMutex);
+	broken = false;
+	pthread_mutex_unlock(&callsMutex);
+	if (pthread_create(&receiver, NULL, _receiverMain, arg) != 0) {
+		_setLastLocalError("pthread_create failed");
+		free(arg);
+		close(fd);
+		return CAEN_FELib_InternalError;
+	}
+	connectionFd = fd;
+	return CAEN_FELib_Success;
+}
+
+// the connection is kept while devices are open: the library is unloaded when the last is closed
+static int _acquireConnection(void) {
+	int ret = CAEN_FELib_Success;
+	pthread_mutex_lock(&connectionMutex);
+	if (connectionFd == -1)
+		ret = _connect();
+	if (ret == CAEN_FELib_Success)
+		++connectionUsers;
+	pthread_mutex_unlock(&connectionMutex);
+	return ret;
+}
+
+static void _releaseConnection(void) {
+	pthread_mutex_lock(&connectionMutex);
+	if (--connectionUsers == 0) {
+		shutdown(connectionFd, SHUT_RDWR);
+		pthread_join(receiver, NULL);
+		close(connectionFd);
+		connectionFd = -1;
+	}
+	pthread_mutex_unlock(&connectionMutex);
+}
+
+/*
+ * Send a request and wait for its response. Two optional strings are sent as payload. On success,
+ * *payload is the payload of the response, to be freed by the caller, if not NULL.
+ */
+static int _call(uint32_t op, uint64_t handle, uint64_t arg0, uint64_t arg1, const char* s1, const char* s2, struct proxy_header* response, char** payload) {
+	const size_t size1 = (s1 != NULL) ? strlen(s1) + 1 : 0;
+	const size_t size2 = (s2 != NULL) ? strlen(s2) + 1 : 0;
+	if (size1 + size2 > PROXY_MAX_PAYLOAD) {
+		_setLastLocalError("request too large");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct proxy_call call = { .done = false };
+	pthread_cond_init(&call.cond, NULL);
+	pthread_mutex_lock(&callsMutex);
+	if (broken || connectionFd == -1) {
+		pthread_mutex_unlock(&callsMutex);
+		pthread_cond_destroy(&call.cond);
+		_setLastLocalError("connection to the proxy daemon lost");
+		return CAEN_FELib_CommunicationError;
+	}
+	call.id = nextId++;
+	call.next = calls;
+	calls = &call;
+	pthread_mutex_unlock(&callsMutex);
+	const struct proxy_header request = {
+		.op = op,
+		.id = call.id,
+		.size = (uint32_t)(size1 + size2),
+		.handle = handle,
+		.arg = { arg0, arg1 },
+	};
+	pthread_mutex_lock(&sendMutex);
+	const bool sent = proxy_send(connectionFd, &request, sizeof(request))
+		&& proxy_send(connectionFd, s1, size1)
+		&& proxy_send(connectionFd, s2, size2);
+	pthread_mutex_unlock(&sendMutex);
+	if (!sent)
+		shutdown(connectionFd, SHUT_RDWR);	// the receiver fails all the calls
+	pthread_mutex_lock(&callsMutex);
+	while (!call.done)
+		pthread_cond_wait(&call.cond, &callsMutex);
+	struct proxy_call** p = &calls;
+	while (*p != &call)
+		p = &(*p)->next;
+	*p = call.next;
+	pthread_mutex_unlock(&callsMutex);
+	pthread_cond_destroy(&call.cond);
+	*response = call.response;
+	if (response->ret < 0) {
+		if (call.payload != NULL)
+			_setLastLocalError("%s", call.payload);
+		else if (response->ret == CAEN_FELib_CommunicationError)
+			_setLastLocalError("connection to the proxy daemon lost");
+		else
+			lastError[0] = '\0';
+		free(call.payload);
+		return response->ret;
+	}
+	if (payload != NULL)
+		*payload = call.payload;
+	else
+		free(call.payload);
+	return CAEN_FELib_Success;
+}
+
+// for calls without payload in the response
+static int _simpleCall(uint32_t op, uint64_t handle, uint64_t arg0, uint64_t arg1, const char* s1, const char* s2) {
+	struct proxy_header response;
+	const int ret = _call(op, handle, arg0, arg1, s1, s2, &response, NULL);
+	return (ret < 0) ? ret : response.ret;
+}
+
+/*
+ * Endpoints
+ */
+
+static void _freeEndpoint(struct proxy_endpoint* ep) {
+	if (ep == NULL)
+		return;
+	if (ep->reader != NULL)
+		fanout_close(ep->reader);
+	format_clear(&ep->userFormat);
+	pthread_mutex_destroy(&ep->mutex);
+	free(ep);
+}
+
+// map fields of the fan-out format to the user format
+static int _updateMap(const struct format* src, struct format* dst, int* map) {
+	for (size_t i = 0; i < dst->nFields; ++i) {
+		const int j = format_find(src, dst->fields[i].name);
+		if (j < 0) {
+			_setLastLocalError("field %s not provided by the endpoint, read by other clients with format %s", dst->fields[i].name, src->json);
+			return CAEN_FELib_InvalidParam;
+		}
+		if (src->fields[j].dim != dst->fields[i].dim) {
+			_setLastLocalError("field %s has dim %u on the endpoint, read by other clients", dst->fields[i].name, src->fields[j].dim);
+			return CAEN_FELib_InvalidParam;
+		}
+	}
+	if (map != NULL)
+		for (size_t i = 0; i < src->nFields; ++i)
+			map[i] = format_find(dst, src->fields[i].name);
+	dst->nChannels = src->nChannels;
+	return CAEN_FELib_Success;
+}
+
+// wait for an event, unless one is already pending, with ep->mutex locked
+static int _nextEvent(struct proxy_endpoint* ep, int timeout) {
+	if (ep->hasPending)
+		return ep->pendingRet;
+	const int ret = fanout_read(ep->reader, timeout, &ep->pending);
+	switch (ret) {
+	case CAEN_FELib_Success:
+	case CAEN_FELib_Stop:
+		ep->hasPending = true;
+		ep->pendingRet = ret;
+		break;
+	case CAEN_FELib_Disabled:
+		_setLastLocalError("readout stopped by the proxy daemon");
+		return CAEN_FELib_CommunicationError;
+	default:
+		break;
+	}
+	return ret;
+}
+
+static int _getEndpoint(uint32_t handle, struct proxy_endpoint** ep) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	if (node.endpoint == NULL) {
+		_setLastLocalError("read data format not set");
+		return CAEN_FELib_CommandError;
+	}
+	*ep = node.endpoint;
+	return CAEN_FELib_Success;
+}
+
+/*
+ * API
+ */
+
+PROXY_API CAENProxy_GetLibInfo(char* jsonString, size_t size) {
+	const int ret = snprintf(jsonString, size, "{\"name\":\"CAEN Proxy\",\"version\":\"%s\",\"socket\":\"%s\"}", CAEN_FELIB_VERSION_STRING, PROXY_DEFAULT_SOCKET);
+	return (ret < 0) ? CAEN_FELib_InternalError : ret;
+}
+
+PROXY_API CAENProxy_GetLibVersion(char version[16]) {
+	version[0] = '\0';
+	strncat(version, CAEN_FELIB_VERSION_STRING, 16 - 1);
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_GetLastError(char description[1024]) {
+	strncpy(description, lastError, 1024);
+	description[1024 - 1] = '\0';
+	lastError[0] = '\0';
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_DevicesDiscovery(char* jsonString, size_t size, int timeout) {
+	int ret = _acquireConnection();
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	struct proxy_header response;
+	char* payload = NULL;
+	ret = _call(ProxyOpDevicesDiscovery, 0, size, (uint64_t)(int64_t)timeout, NULL, NULL, &response, &payload);
+	if (ret == CAEN_FELib_Success) {
+		ret = response.ret;
+		if (size != 0)
+			snprintf(jsonString, size, "%s", (payload != NULL) ? payload : "");
+	}
+	free(payload);
+	_releaseConnection();
+	return ret;
+}
+
+PROXY_API CAENProxy_Open(const char* path, uint32_t* handle) {
+	if (path == NULL || handle == NULL) {
+		_setLastLocalError("invalid argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	// "<scheme>/<address>" to "<scheme>://<address>"
+	char url[512];
+	const char* const address = strchr(path, '/');
+	if (address == NULL || address == path) {
+		_setLastLocalError("invalid proxy path '%s': expected <scheme>/<address>", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (snprintf(url, ARRAY_SIZE(url), "%.*s://%s", (int)(address - path), path, address + 1) >= (int)ARRAY_SIZE(url)) {
+		_setLastLocalError("URL too long");
+		return CAEN_FELib_InvalidParam;
+	}
+	int ret = _acquireConnection();
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	struct proxy_header response;
+	ret = _call(ProxyOpOpen, 0, 0, 0, url, NULL, &response, NULL);
+	if (ret != CAEN_FELib_Success) {
+		_releaseConnection();
+		return ret;
+	}
+	uint32_t local;
+	ret = _map(response.arg[0], 0, &local);
+	if (ret != CAEN_FELib_Success) {
+		_simpleCall(ProxyOpClose, response.arg[0], 0, 0, NULL, NULL);
+		_releaseConnection();
+		return ret;
+	}
+	pthread_mutex_lock(&nodesMutex);
+	++nodes[local - 1].opens;
+	pthread_mutex_unlock(&nodesMutex);
+	*handle = local;
+	return response.ret;
+}
+
+PROXY_API CAENProxy_Close(uint32_t handle) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	const int ret = _simpleCall(ProxyOpClose, node.remote, 0, 0, NULL, NULL);
+	// the daemon closes the handles of lost connections
+	if (ret != CAEN_FELib_Success && !(ret == CAEN_FELib_CommunicationError && _isBroken()))
+		return ret;
+	// readers of the device are closed with the last open
+	pthread_mutex_lock(&nodesMutex);
+	if (--nodes[node.device - 1].opens == 0) {
+		for (size_t i = 0; i < nNodes; ++i) {
+			if (nodes[i].device == node.device && nodes[i].endpoint != NULL) {
+				_freeEndpoint(nodes[i].endpoint);
+				nodes[i].endpoint = NULL;
+			}
+		}
+	}
+	pthread_mutex_unlock(&nodesMutex);
+	_releaseConnection();
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_GetDeviceTree(uint32_t handle, char* jsonString, size_t size) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	struct proxy_header response;
+	char* payload = NULL;
+	const int ret = _call(ProxyOpGetDeviceTree, node.remote, size, 0, NULL, NULL, &response, &payload);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (size != 0)
+		snprintf(jsonString, size, "%s", (payload != NULL) ? payload : "");
+	free(payload);
+	return response.ret;
+}
+
+PROXY_API CAENProxy_GetChildHandles(uint32_t handle, const char* path, uint32_t* handles, size_t size) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	struct proxy_header response;
+	char* payload = NULL;
+	int ret = _call(ProxyOpGetChildHandles, node.remote, size, 0, (path != NULL) ? path : "", NULL, &response, &payload);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const size_t n = response.size / sizeof(uint64_t);
+	pthread_mutex_lock(&nodesMutex);
+	for (size_t i = 0; i < n && i < size && ret == CAEN_FELib_Success; ++i) {
+		uint64_t remote;
+		memcpy(&remote, payload + i * sizeof(remote), sizeof(remote));
+		ret = _mapLocked(remote, node.device, &handles[i]);
+	}
+	pthread_mutex_unlock(&nodesMutex);
+	free(payload);
+	return (ret != CAEN_FELib_Success) ? ret : response.ret;
+}
+
+static int _getRelative(uint32_t op, uint32_t handle, const char* path, uint32_t* out) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	if (out == NULL) {
+		_setLastLocalError("invalid argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct proxy_header response;
+	const int ret = _call(op, node.remote, 0, 0, (path != NULL) ? path : "", NULL, &response, NULL);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	return _map(response.arg[0], node.device, out);
+}
+
+PROXY_API CAENProxy_GetHandle(uint32_t handle, const char* path, uint32_t* pathHandle) {
+	return _getRelative(ProxyOpGetHandle, handle, path, pathHandle);
+}
+
+PROXY_API CAENProxy_GetParentHandle(uint32_t handle, const char* path, uint32_t* parentHandle) {
+	return _getRelative(ProxyOpGetParentHandle, handle, path, parentHandle);
+}
+
+PROXY_API CAENProxy_GetPath(uint32_t handle, char path[256]) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	struct proxy_header response;
+	char* payload = NULL;
+	const int ret = _call(ProxyOpGetPath, node.remote, 0, 0, NULL, NULL, &response, &payload);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	snprintf(path, 256, "%s", (payload != NULL) ? payload : "");
+	free(payload);
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_GetNodeProperties(uint32_t handle, const char* path, char name[32], CAEN_FELib_NodeType_t* type) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	struct proxy_header response;
+	char* payload = NULL;
+	const int ret = _call(ProxyOpGetNodeProperties, node.remote, 0, 0, (path != NULL) ? path : "", NULL, &response, &payload);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	if (name != NULL)
+		snprintf(name, 32, "%s", (payload != NULL) ? payload : "");
+	if (type != NULL)
+		*type = (CAEN_FELib_NodeType_t)(int64_t)response.arg[0];
+	free(payload);
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_GetValue(uint32_t handle, const char* path, char value[256]) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	struct proxy_header response;
+	char* payload = NULL;
+	const int ret = _call(ProxyOpGetValue, node.remote, 0, 0, (path != NULL) ? path : "", NULL, &response, &payload);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	snprintf(value, 256, "%s", (payload != NULL) ? payload : "");
+	free(payload);
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_SetValue(uint32_t handle, const char* path, const char* value) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	if (value == NULL) {
+		_setLastLocalError("invalid argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	return _simpleCall(ProxyOpSetValue, node.remote, 0, 0, (path != NULL) ? path : "", value);
+}
+
+PROXY_API CAENProxy_SendCommand(uint32_t handle, const char* path) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	return _simpleCall(ProxyOpSendCommand, node.remote, 0, 0, (path != NULL) ? path : "", NULL);
+}
+
+PROXY_API CAENProxy_GetUserRegister(uint32_t handle, uint32_t address, uint32_t* value) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	struct proxy_header response;
+	const int ret = _call(ProxyOpGetUserRegister, node.remote, address, 0, NULL, NULL, &response, NULL);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	*value = (uint32_t)response.arg[0];
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_SetUserRegister(uint32_t handle, uint32_t address, uint32_t value) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	return _simpleCall(ProxyOpSetUserRegister, node.remote, address, value, NULL, NULL);
+}
+
+PROXY_API CAENProxy_SetReadDataFormat(uint32_t handle, const char* jsonString) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	if (jsonString == NULL) {
+		_setLastLocalError("invalid argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct format userFormat;
+	int ret = format_parse(&userFormat, jsonString, 0);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	struct proxy_header response;
+	char* payload = NULL;
+	ret = _call(ProxyOpSetReadDataFormat, node.remote, 0, 0, jsonString, NULL, &response, &payload);
+	const size_t nameSize = (payload != NULL) ? strlen(payload) + 1 : 0;
+	if (ret == CAEN_FELib_Success && nameSize >= response.size) {
+		_setLastLocalError("invalid response of the proxy daemon");
+		ret = CAEN_FELib_CommunicationError;
+	}
+	// the endpoint may be read with a format different from the requested one, see file description
+	struct format endpointFormat = { .nFields = 0 };
+	if (ret == CAEN_FELib_Success)
+		ret = format_parse(&endpointFormat, payload + nameSize, 0);
+	if (ret == CAEN_FELib_Success)
+		ret = _updateMap(&endpointFormat, &userFormat, NULL);
+	format_clear(&endpointFormat);
+	if (ret != CAEN_FELib_Success) {
+		free(payload);
+		format_clear(&userFormat);
+		return ret;
+	}
+	pthread_mutex_lock(&nodesMutex);
+	struct proxy_endpoint* ep = nodes[handle - 1].endpoint;
+	pthread_mutex_unlock(&nodesMutex);
+	if (ep == NULL) {
+		ep = calloc(1, sizeof(*ep));
+		if (ep == NULL) {
+			free(payload);
+			format_clear(&userFormat);
+			_setLastLocalError("calloc failed");
+			return CAEN_FELib_InternalError;
+		}
+		pthread_mutex_init(&ep->mutex, NULL);
+		ret = fanout_open(payload, PROXY_READER_OPTIONS, &ep->reader);
+		if (ret != CAEN_FELib_Success) {
+			free(payload);
+			format_clear(&userFormat);
+			_freeEndpoint(ep);
+			return ret;
+		}
+		pthread_mutex_lock(&nodesMutex);
+		nodes[handle - 1].endpoint = ep;
+		pthread_mutex_unlock(&nodesMutex);
+	}
+	free(payload);
+	pthread_mutex_lock(&ep->mutex);
+	format_clear(&ep->userFormat);
+	ep->userFormat = userFormat;
+	ep->mapGeneration = 0;
+	pthread_mutex_unlock(&ep->mutex);
+	return CAEN_FELib_Success;
+}
+
+PROXY_API CAENProxy_ReadDataV(uint32_t handle, int timeout, va_list args) {
+	struct proxy_endpoint* ep;
+	int ret = _getEndpoint(handle, &ep);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	pthread_mutex_lock(&ep->mutex);
+	ret = _nextEvent(ep, timeout);
+	switch (ret) {
+	case CAEN_FELib_Success: {
+		ep->hasPending = false;
+		const struct format* const fmt = fanout_getFormat(ep->reader);
+		if (fmt == NULL) {
+			_setLastLocalError("invalid format of the event");
+			ret = CAEN_FELib_GenericError;
+			break;
+		}
+		if (ep->mapGeneration != ep->pending.reserved[0]) {
+			ret = _updateMap(fmt, &ep->userFormat, ep->fieldMap);
+			if (ret != CAEN_FELib_Success)
+				break;
+			ep->mapGeneration = ep->pending.reserved[0];
+		}
+		struct format_args fargs;
+		format_getArgs(&ep->userFormat, args, &fargs);
+		if (!evfile_unpack(fmt, ep->pending.payload, ep->pending.size, ep->fieldMap, &ep->userFormat, &fargs)) {
+			_setLastLocalError("corrupted event %"PRIu64, ep->pending.index);
+			ret = CAEN_FELib_GenericError;
+		}
+		break;
+	}
+	case CAEN_FELib_Stop:
+		ep->hasPending = false;
+		_setLastLocalError("stop");
+		break;
+	default:
+		break;
+	}
+	pthread_mutex_unlock(&ep->mutex);
+	return ret;
+}
+
+PROXY_API CAENProxy_HasData(uint32_t handle, int timeout) {
+	struct proxy_endpoint* ep;
+	int ret = _getEndpoint(handle, &ep);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	pthread_mutex_lock(&ep->mutex);
+	ret = _nextEvent(ep, timeout);
+	if (ret == CAEN_FELib_Stop) {
+		ep->hasPending = false;
+		_setLastLocalError("stop");
+	}
+	pthread_mutex_unlock(&ep->mutex);
+	return ret;
+}
+
+// wakes the reader of the fan-out, without locking the endpoint held by the pending call
+PROXY_API CAENProxy_Interrupt(uint32_t handle) {
+	struct proxy_endpoint* ep;
+	const int ret = _getEndpoint(handle, &ep);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	return fanout_interrupt(ep->reader);
+}
+
+PROXY_API CAENProxy_WalkTree(uint32_t handle, const char* path, int maxDepth, CAEN_FELib_TreeNode_t* tree, size_t size) {
+	struct proxy_node node;
+	if (!_decodeHandle(handle, &node))
+		return _invalidHandle(handle);
+	struct proxy_header response;
+	char* payload = NULL;
+	int ret = _call(ProxyOpWalkTree, node.remote, (uint64_t)(int64_t)maxDepth, size, (path != NULL) ? path : "", NULL, &response, &payload);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	const size_t n = response.size / sizeof(CAEN_FELib_TreeNode_t);
+	pthread_mutex_lock(&nodesMutex);
+	for (size_t i = 0; i < n && i < size && ret == CAEN_FELib_Success; ++i) {
+		memcpy(&tree[i], payload + i * sizeof(*tree), sizeof(*tree));
+		uint32_t local;
+		ret = _mapLocked(tree[i].handle, node.device, &local);
+		tree[i].handle = local;
+		if (ret == CAEN_FELib_Success && tree[i].parent != 0) {
+			ret = _mapLocked(tree[i].parent, node.device, &local);
+			tree[i].parent = local;
+		}
+	}
+	pthread_mutex_unlock(&nodesMutex);
+	free(payload);
+	return (ret != CAEN_FELib_Success) ? ret : response.ret;
+}
@@ -0,0 +1,124 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		protocol.h
+*	\brief		Protocol of the proxy implementation library
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_PROXY_PROTOCOL_H_
+#define CAEN_INCLUDE_PROXY_PROTOCOL_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Protocol between the proxy implementation library (libCAEN_Proxy) and the proxy daemon
+ * (caen-felib-proxyd), on a Unix-domain stream socket.
+ *
+ * Each message is a struct proxy_header followed by size bytes of payload. Requests carry an
+ * identifier chosen by the client, echoed by the response: several requests can be in flight on
+ * the same connection, and responses can be sent in any order. Strings on payloads are
+ * null-terminated; when a request has two strings, they are consecutive.
+ *
+ * Responses with a negative ret carry the last error description of the daemon as payload.
+ * Readout data does not go through the socket: the response to SetReadDataFormat carries the
+ * name of the shared memory fan-out of the endpoint (see fanout.h), followed by its read data
+ * format.
+ */
+
+#define PROXY_DEFAULT_SOCKET		"/tmp/caen-felib-proxyd.sock"
+#define PROXY_MAX_PAYLOAD			(UINT32_C(64) << 20)
+
+enum proxy_op {
+	ProxyOpDevicesDiscovery,	// arg[0]: size, arg[1]: timeout; ret: error code, payload: JSON
+	ProxyOpOpen,				// payload: URL; arg[0] of response: handle
+	ProxyOpClose,
+	ProxyOpGetDeviceTree,		// arg[0]: size; ret: length, payload: JSON
+	ProxyOpGetChildHandles,		// payload: path, arg[0]: size; ret: number of children, payload: handles
+	ProxyOpGetHandle,			// payload: path; arg[0] of response: handle
+	ProxyOpGetParentHandle,		// payload: path; arg[0] of response: handle
+	ProxyOpGetPath,				// payload of response: path
+	ProxyOpGetNodeProperties,	// payload: path; arg[0] of response: type, payload: name
+	ProxyOpGetValue,			// payload: path; payload of response: value
+	ProxyOpSetValue,			// payload: path, value
+	ProxyOpSendCommand,			// payload: path
+	ProxyOpGetUserRegister,		// arg[0]: address; arg[0] of response: value
+	ProxyOpSetUserRegister,		// arg[0]: address, arg[1]: value
+	ProxyOpSetReadDataFormat,	// payload: JSON; payload of response: fan-out name, format
+	ProxyOpWalkTree,			// payload: path, arg[0]: max depth, arg[1]: size; ret: number of nodes, payload: nodes
+	ProxyOpCount,
+};
+
+struct proxy_header {
+	uint32_t						op;					// enum proxy_op
+	uint32_t						id;					// identifier of the request
+	int32_t							ret;				// CAEN_FELib_ErrorCode or result, responses only
+	uint32_t						size;				// payload size
+	uint64_t						handle;				// handle of the daemon
+	uint64_t						arg[2];
+};
+
+// send or receive exactly size bytes, false on error or end of stream
+static inline bool proxy_send(int fd, const void* buffer, size_t size) {
+	const char* p = buffer;
+	while (size != 0) {
+		const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+static inline bool proxy_recv(int fd, void* buffer, size_t size) {
+	char* p = buffer;
+	while (size != 0) {
+		const ssize_t n = recv(fd, p, size, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+#endif /* CAEN_INCLUDE_PROXY_PROTOCOL_H_ */
@@ -0,0 +1,848 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		proxyd.c
+*	\brief		Proxy daemon
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Proxy daemon, serving the proxy implementation library (see CAEN_Proxy.c) on a Unix-domain socket.
+ *
+ * Usage: caen-felib-proxyd [-s <socket>] [-w <workers>] [-v]
+ *
+ * Devices are opened on behalf of the clients and shared by URL: a device opened by several clients
+ * is opened once, and closed when the last client closes it or disconnects. Each connection has a
+ * thread that receives the requests, executed concurrently by a pool of workers; responses are sent
+ * as soon as they are ready, in any order.
+ *
+ * Concurrent GetValue on the same handle and path are coalesced: a single call is made to the
+ * device, and its result is sent to all the requesters.
+ *
+ * Endpoints are read by a thread of the daemon, from the first SetReadDataFormat, and the events
+ * are published on a shared memory fan-out, read by the clients. The format can be changed only
+ * by the only client reading the endpoint, if any: the others get the format in use.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <CAEN_FELib.h>
+
+#include "../utils.h"
+#include "protocol.h"
+
+#define PROXYD_DEFAULT_WORKERS			8
+#define PROXYD_MAX_WORKERS				256
+#define PROXYD_READ_TIMEOUT				100		// ms, maximum delay to stop a readout
+#define PROXYD_ERROR_BACKOFF			UINT64_C(100000000)	// 100 ms, sleep after readout errors
+#define PROXYD_POOL_SLOTS				4
+
+struct device {
+	char							url[512];
+	uint64_t						handle;
+	unsigned						refs;				// opens of all the clients
+	struct device*					next;
+};
+
+struct endpoint {
+	uint64_t						handle;
+	uint64_t						root;				// handle of the device
+	char							name[64];			// of the fan-out
+	char*							json;				// format in use
+	unsigned						users;				// clients reading
+	CAEN_FELib_EventPool_t*			pool;
+	pthread_t						thread;
+	bool							reading;			// thread running
+	uint32_t						stop;
+	struct endpoint*				next;
+};
+
+// devices opened, or endpoints read, by a client
+struct link {
+	void*							target;				// struct device or struct endpoint
+	unsigned						count;
+	struct link*					next;
+};
+
+struct client {
+	int								fd;
+	pthread_mutex_t					sendMutex;
+	uint32_t						refs;				// receiving thread and jobs in progress
+	struct link*					devices;			// protected by stateMutex
+	struct link*					endpoints;			// protected by stateMutex
+};
+
+struct job {
+	struct client*					client;
+	struct proxy_header				request;
+	char*							payload;			// null-terminated
+	struct job*						next;
+};
+
+// GetValue in progress, see _getValue
+struct flight {
+	uint64_t						handle;
+	char							path[256];
+	bool							done;
+	int								ret;
+	char							value[256];
+	char							error[1024];
+	unsigned						waiters;
+	struct flight*					next;
+};
+
+// devices and endpoints, shared by all the clients
+static pthread_mutex_t stateMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct device* devices;
+static struct endpoint* endpoints;
+static unsigned nextFanout;
+
+// jobs
+static pthread_mutex_t jobsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobsCond = PTHREAD_COND_INITIALIZER;
+static struct job* jobsHead;
+static struct job* jobsTail;
+
+// GetValue in progress
+static pthread_mutex_t flightsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flightsCond = PTHREAD_COND_INITIALIZER;
+static struct flight* flights;
+
+// statistics
+static uint64_t nRequests;
+static uint64_t nGetValues;
+static uint64_t nCoalesced;
+
+static volatile sig_atomic_t quit;
+static bool verbose;
+
+static void _log(const char* format, ...) {
+	if (!verbose)
+		return;
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+static void _sleep(uint64_t ns) {
+	struct timespec ts = { .tv_sec = (time_t)(ns / UINT64_C(1000000000)), .tv_nsec = (long)(ns % UINT64_C(1000000000)) };
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+/*
+ * Links
+ */
+
+static struct link* _findLink(struct link* list, const void* target) {
+	for (struct link* l = list; l != NULL; l = l->next)
+		if (l->target == target)
+			return l;
+	return NULL;
+}
+
+static bool _addLink(struct link** list, void* target) {
+	struct link* l = _findLink(*list, target);
+	if (l == NULL) {
+		l = calloc(1, sizeof(*l));
+		if (l == NULL)
+			return false;
+		l->target = target;
+		l->next = *list;
+		*list = l;
+	}
+	++l->count;
+	return true;
+}
+
+static void _removeLink(struct link** list, const struct link* link) {
+	struct link** p = list;
+	while (*p != link)
+		p = &(*p)->next;
+	*p = link->next;
+	free((void*)link);
+}
+
+/*
+ * Endpoints, with stateMutex locked
+ */
+
+static void* _readoutMain(void* arg) {
+	struct endpoint* const ep = arg;
+	while (!ATOMIC_LOAD_ACQUIRE(&ep->stop)) {
+		CAEN_FELib_EventSlot_t* slot;
+		const int ret = CAEN_FELib_ReadDataSlot(ep->pool, PROXYD_READ_TIMEOUT, &slot);
+		switch (ret) {
+		case CAEN_FELib_Success:
+			// already published on the fan-out
+			CAEN_FELib_ReleaseSlot(ep->pool, slot);
+			break;
+		case CAEN_FELib_Timeout:
+		case CAEN_FELib_Stop:
+		case CAEN_FELib_Interrupted:
+			break;
+		default: {
+			char error[1024];
+			CAEN_FELib_GetLastError(error);
+			_log("readout of 0x%016"PRIx64" failed (%d): %s", ep->handle, ret, error);
+			_sleep(PROXYD_ERROR_BACKOFF);
+			break;
+		}
+		}
+	}
+	return NULL;
+}
+
+static void _stopReadout(struct endpoint* ep) {
+	if (!ep->reading)
+		return;
+	ATOMIC_STORE_RELEASE(&ep->stop, 1);
+	pthread_join(ep->thread, NULL);
+	CAEN_FELib_DestroyEventPool(ep->pool);
+	ep->pool = NULL;
+	ep->reading = false;
+}
+
+static int _startReadout(struct endpoint* ep, const char* json) {
+	int ret = CAEN_FELib_SetReadDataFormat(ep->handle, json);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	char* const copy = strdup(json);
+	if (copy == NULL)
+		return CAEN_FELib_InternalError;
+	free(ep->json);
+	ep->json = copy;
+	if (ep->name[0] == '\0') {
+		char name[ARRAY_SIZE(ep->name)];
+		snprintf(name, ARRAY_SIZE(name), "/caen-felib-proxyd-%ld-%u", (long)getpid(), nextFanout++);
+		ret = CAEN_FELib_StartFanout(ep->handle, name, NULL);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+		strcpy(ep->name, name);
+	}
+	ret = CAEN_FELib_CreateEventPool(ep->handle, PROXYD_POOL_SLOTS, NULL, &ep->pool);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	ep->stop = 0;
+	if (pthread_create(&ep->thread, NULL, _readoutMain, ep) != 0) {
+		CAEN_FELib_DestroyEventPool(ep->pool);
+		ep->pool = NULL;
+		return CAEN_FELib_InternalError;
+	}
+	ep->reading = true;
+	return CAEN_FELib_Success;
+}
+
+static void _freeEndpoint(struct endpoint* ep) {
+	_stopReadout(ep);
+	if (ep->name[0] != '\0')
+		CAEN_FELib_StopFanout(ep->handle);
+	struct endpoint** p = &endpoints;
+	while (*p != ep)
+		p = &(*p)->next;
+	*p = ep->next;
+	free(ep->json);
+	free(ep);
+}
+
+static uint64_t _root(uint64_t handle) {
+	uint64_t parent;
+	while (CAEN_FELib_GetParentHandle(handle, NULL, &parent) == CAEN_FELib_Success)
+		handle = parent;
+	return handle;
+}
+
+static void _detachEndpoint(struct client* client, struct link* link) {
+	struct endpoint* const ep = link->target;
+	_removeLink(&client->endpoints, link);
+	if (--ep->users == 0)
+		_freeEndpoint(ep);
+}
+
+/*
+ * Devices, with stateMutex locked
+ */
+
+static void _releaseDevice(struct client* client, struct link* link) {
+	struct device* const dev = link->target;
+	if (--link->count == 0) {
+		// the client does not read the endpoints of the device anymore
+		for (struct link* l = client->endpoints; l != NULL;) {
+			struct link* const next = l->next;
+			if (((const struct endpoint*)l->target)->root == dev->handle)
+				_detachEndpoint(client, l);
+			l = next;
+		}
+		_removeLink(&client->devices, link);
+	}
+	if (--dev->refs != 0)
+		return;
+	for (struct endpoint* ep = endpoints; ep != NULL;) {
+		struct endpoint* const next = ep->next;
+		if (ep->root == dev->handle)
+			_freeEndpoint(ep);
+		ep = next;
+	}
+	const int ret = CAEN_FELib_Close(dev->handle);
+	_log("closed %s (%d)", dev->url, ret);
+	struct device** p = &devices;
+	while (*p != dev)
+		p = &(*p)->next;
+	*p = dev->next;
+	free(dev);
+}
+
+/*
+ * Requests, executed by workers
+ */
+
+struct response {
+	struct proxy_header				header;
+	const void*						payload;
+	char							error[1024];
+};
+
+static void _setString(struct response* r, const char* s) {
+	r->payload = s;
+	r->header.size = (uint32_t)strlen(s) + 1;
+}
+
+static void _setError(struct response* r, int ret) {
+	r->header.ret = ret;
+	if (ret < 0) {
+		CAEN_FELib_GetLastError(r->error);
+		_setString(r, r->error);
+	}
+}
+
+static void _setLocalError(struct response* r, int ret, const char* error) {
+	r->header.ret = ret;
+	snprintf(r->error, ARRAY_SIZE(r->error), "%s", error);
+	_setString(r, r->error);
+}
+
+// buffer of the response, of at most PROXY_MAX_PAYLOAD bytes
+static void* _allocate(struct response* r, uint64_t n, size_t elementSize, size_t* size) {
+	*size = (n < PROXY_MAX_PAYLOAD / elementSize) ? (size_t)n : PROXY_MAX_PAYLOAD / elementSize;
+	void* const p = malloc(*size * elementSize + 1);
+	if (p == NULL)
+		_setLocalError(r, CAEN_FELib_InternalError, "malloc failed");
+	return p;
+}
+
+static void _open(struct client* client, const char* url, struct response* r) {
+	pthread_mutex_lock(&stateMutex);
+	struct device* dev;
+	for (dev = devices; dev != NULL; dev = dev->next)
+		if (strcmp(dev->url, url) == 0)
+			break;
+	if (dev == NULL) {
+		uint64_t handle;
+		const int ret = CAEN_FELib_Open(url, &handle);
+		_log("opened %s (%d)", url, ret);
+		if (ret != CAEN_FELib_Success) {
+			_setError(r, ret);
+			pthread_mutex_unlock(&stateMutex);
+			return;
+		}
+		dev = calloc(1, sizeof(*dev));
+		if (dev == NULL) {
+			CAEN_FELib_Close(handle);
+			_setLocalError(r, CAEN_FELib_InternalError, "calloc failed");
+			pthread_mutex_unlock(&stateMutex);
+			return;
+		}
+		snprintf(dev->url, ARRAY_SIZE(dev->url), "%s", url);
+		dev->handle = handle;
+		dev->next = devices;
+		devices = dev;
+	}
+	if (!_addLink(&client->devices, dev)) {
+		_setLocalError(r, CAEN_FELib_InternalError, "calloc failed");
+	} else {
+		++dev->refs;
+		r->header.arg[0] = dev->handle;
+	}
+	pthread_mutex_unlock(&stateMutex);
+}
+
+static void _close(struct client* client, uint64_t handle, struct response* r) {
+	pthread_mutex_lock(&stateMutex);
+	struct link* l;
+	for (l = client->devices; l != NULL; l = l->next)
+		if (((const struct device*)l->target)->handle == handle)
+			break;
+	if (l == NULL)
+		_setLocalError(r, CAEN_FELib_InvalidHandle, "device not opened by the client");
+	else
+		_releaseDevice(client, l);
+	pthread_mutex_unlock(&stateMutex);
+}
+
+// the response is the fan-out name followed by the format in use
+static void _setReadDataFormat(struct client* client, uint64_t handle, const char* json, struct response* r, char** payload) {
+	pthread_mutex_lock(&stateMutex);
+	struct endpoint* ep;
+	for (ep = endpoints; ep != NULL; ep = ep->next)
+		if (ep->handle == handle)
+			break;
+	if (ep == NULL) {
+		ep = calloc(1, sizeof(*ep));
+		if (ep == NULL) {
+			_setLocalError(r, CAEN_FELib_InternalError, "calloc failed");
+			pthread_mutex_unlock(&stateMutex);
+			return;
+		}
+		ep->handle = handle;
+		ep->root = _root(handle);
+		ep->next = endpoints;
+		endpoints = ep;
+	}
+	struct link* const link = _findLink(client->endpoints, ep);
+	const bool exclusive = (ep->users == 0 || (ep->users == 1 && link != NULL));
+	int ret = CAEN_FELib_Success;
+	if (exclusive && (!ep->reading || strcmp(ep->json, json) != 0)) {
+		_stopReadout(ep);
+		ret = _startReadout(ep, json);
+		if (ret != CAEN_FELib_Success) {
+			_setError(r, ret);
+			// restore the previous format, if any
+			if (ep->json != NULL && strcmp(ep->json, json) != 0)
+				_startReadout(ep, ep->json);
+		}
+	}
+	if (ret == CAEN_FELib_Success && link == NULL) {
+		if (_addLink(&client->endpoints, ep)) {
+			++ep->users;
+		} else {
+			ret = CAEN_FELib_InternalError;
+			_setLocalError(r, ret, "calloc failed");
+		}
+	}
+	if (ret == CAEN_FELib_Success && ep->reading) {
+		const size_t nameSize = strlen(ep->name) + 1;
+		const size_t jsonSize = strlen(ep->json) + 1;
+		*payload = malloc(nameSize + jsonSize);
+		if (*payload == NULL) {
+			_setLocalError(r, CAEN_FELib_InternalError, "malloc failed");
+		} else {
+			memcpy(*payload, ep->name, nameSize);
+			memcpy(*payload + nameSize, ep->json, jsonSize);
+			r->payload = *payload;
+			r->header.size = (uint32_t)(nameSize + jsonSize);
+		}
+	} else if (ret == CAEN_FELib_Success) {
+		_setLocalError(r, CAEN_FELib_InternalError, "readout not started");
+	}
+	if (ep->users == 0)
+		_freeEndpoint(ep);
+	pthread_mutex_unlock(&stateMutex);
+}
+
+/*
+ * Concurrent GetValue on the same node share a single call: the first is executed, the others
+ * wait for its result.
+ */
+static void _getValue(uint64_t handle, const char* path, struct response* r, char value[256]) {
+	ATOMIC_FETCH_ADD(&nGetValues, 1);
+	if (strlen(path) >= ARRAY_SIZE(((struct flight*)NULL)->path)) {
+		_setError(r, CAEN_FELib_GetValue(handle, path, value));
+		return;
+	}
+	pthread_mutex_lock(&flightsMutex);
+	struct flight* f;
+	for (f = flights; f != NULL; f = f->next)
+		if (f->handle == handle && strcmp(f->path, path) == 0)
+			break;
+	if (f != NULL) {
+		ATOMIC_FETCH_ADD(&nCoalesced, 1);
+		++f->waiters;
+		while (!f->done)
+			pthread_cond_wait(&flightsCond, &flightsMutex);
+		r->header.ret = f->ret;
+		strcpy(value, f->value);
+		if (f->ret < 0)
+			_setLocalError(r, f->ret, f->error);
+		// the last waiter frees the flight, already removed from the list
+		if (--f->waiters == 0)
+			free(f);
+		pthread_mutex_unlock(&flightsMutex);
+		return;
+	}
+	f = calloc(1, sizeof(*f));
+	if (f == NULL) {
+		pthread_mutex_unlock(&flightsMutex);
+		_setError(r, CAEN_FELib_GetValue(handle, path, value));
+		return;
+	}
+	f->handle = handle;
+	strcpy(f->path, path);
+	f->next = flights;
+	flights = f;
+	pthread_mutex_unlock(&flightsMutex);
+	f->ret = CAEN_FELib_GetValue(handle, path, f->value);
+	if (f->ret < 0)
+		CAEN_FELib_GetLastError(f->error);
+	pthread_mutex_lock(&flightsMutex);
+	struct flight** p = &flights;
+	while (*p != f)
+		p = &(*p)->next;
+	*p = f->next;
+	f->done = true;
+	pthread_cond_broadcast(&flightsCond);
+	r->header.ret = f->ret;
+	strcpy(value, f->value);
+	if (f->ret < 0)
+		_setLocalError(r, f->ret, f->error);
+	if (f->waiters == 0)
+		free(f);
+	pthread_mutex_unlock(&flightsMutex);
+}
+
+static void _execute(struct job* job) {
+	struct client* const client = job->client;
+	const struct proxy_header* const q = &job->request;
+	const char* const s1 = job->payload;
+	const size_t s1Size = strlen(s1) + 1;
+	const char* const s2 = (s1Size < q->size) ? s1 + s1Size : "";
+	struct response r = { .header = { .op = q->op, .id = q->id } };
+	char text[256];
+	char name[32];
+	void* buffer = NULL;
+	size_t n;
+	ATOMIC_FETCH_ADD(&nRequests, 1);
+	switch (q->op) {
+	case ProxyOpDevicesDiscovery:
+		if ((buffer = _allocate(&r, q->arg[0], 1, &n)) == NULL)
+			break;
+		_setError(&r, CAEN_FELib_DevicesDiscovery(buffer, n, (int)(int64_t)q->arg[1]));
+		if (r.header.ret >= 0 && n != 0)
+			_setString(&r, buffer);
+		break;
+	case ProxyOpOpen:
+		_open(client, s1, &r);
+		break;
+	case ProxyOpClose:
+		_close(client, q->handle, &r);
+		break;
+	case ProxyOpGetDeviceTree:
+		if ((buffer = _allocate(&r, q->arg[0], 1, &n)) == NULL)
+			break;
+		_setError(&r, CAEN_FELib_GetDeviceTree(q->handle, (n != 0) ? buffer : NULL, n));
+		if (r.header.ret >= 0 && n != 0)
+			_setString(&r, buffer);
+		break;
+	case ProxyOpGetChildHandles:
+		if ((buffer = _allocate(&r, q->arg[0], sizeof(uint64_t), &n)) == NULL)
+			break;
+		_setError(&r, CAEN_FELib_GetChildHandles(q->handle, s1, (n != 0) ? buffer : NULL, n));
+		if (r.header.ret >= 0) {
+			r.payload = buffer;
+			r.header.size = (uint32_t)(((size_t)r.header.ret < n ? (size_t)r.header.ret : n) * sizeof(uint64_t));
+		}
+		break;
+	case ProxyOpGetHandle:
+		_setError(&r, CAEN_FELib_GetHandle(q->handle, s1, &r.header.arg[0]));
+		break;
+	case ProxyOpGetParentHandle:
+		_setError(&r, CAEN_FELib_GetParentHandle(q->handle, s1, &r.header.arg[0]));
+		break;
+	case ProxyOpGetPath:
+		_setError(&r, CAEN_FELib_GetPath(q->handle, text));
+		if (r.header.ret >= 0)
+			_setString(&r, text);
+		break;
+	case ProxyOpGetNodeProperties: {
+		CAEN_FELib_NodeType_t type;
+		_setError(&r, CAEN_FELib_GetNodeProperties(q->handle, s1, name, &type));
+		if (r.header.ret >= 0) {
+			r.header.arg[0] = (uint64_t)(int64_t)type;
+			_setString(&r, name);
+		}
+		break;
+	}
+	case ProxyOpGetValue:
+		_getValue(q->handle, s1, &r, text);
+		if (r.header.ret >= 0)
+			_setString(&r, text);
+		break;
+	case ProxyOpSetValue:
+		_setError(&r, CAEN_FELib_SetValue(q->handle, s1, s2));
+		break;
+	case ProxyOpSendCommand:
+		_setError(&r, CAEN_FELib_SendCommand(q->handle, s1));
+		break;
+	case ProxyOpGetUserRegister: {
+		uint32_t value;
+		_setError(&r, CAEN_FELib_GetUserRegister(q->handle, (uint32_t)q->arg[0], &value));
+		r.header.arg[0] = value;
+		break;
+	}
+	case ProxyOpSetUserRegister:
+		_setError(&r, CAEN_FELib_SetUserRegister(q->handle, (uint32_t)q->arg[0], (uint32_t)q->arg[1]));
+		break;
+	case ProxyOpSetReadDataFormat:
+		_setReadDataFormat(client, q->handle, s1, &r, (char**)&buffer);
+		break;
+	case ProxyOpWalkTree:
+		if ((buffer = _allocate(&r, q->arg[1], sizeof(CAEN_FELib_TreeNode_t), &n)) == NULL)
+			break;
+		_setError(&r, CAEN_FELib_WalkTree(q->handle, s1, (int)(int64_t)q->arg[0], (n != 0) ? buffer : NULL, n));
+		if (r.header.ret >= 0) {
+			r.payload = buffer;
+			r.header.size = (uint32_t)(((size_t)r.header.ret < n ? (size_t)r.header.ret : n) * sizeof(CAEN_FELib_TreeNode_t));
+		}
+		break;
+	default:
+		_setLocalError(&r, CAEN_FELib_NotImplemented, "unknown request");
+		break;
+	}
+	pthread_mutex_lock(&client->sendMutex);
+	// errors are detected by the receiving thread
+	if (proxy_send(client->fd, &r.header, sizeof(r.header)))
+		proxy_send(client->fd, r.payload, r.header.size);
+	pthread_mutex_unlock(&client->sendMutex);
+	free(buffer);
+}
+
+/*
+ * Clients
+ */
+
+static void _releaseClient(struct client* client) {
+	if (ATOMIC_FETCH_ADD(&client->refs, (uint32_t)-1) != 1)
+		return;
+	pthread_mutex_lock(&stateMutex);
+	while (client->endpoints != NULL)
+		_detachEndpoint(client, client->endpoints);
+	// once per open
+	while (client->devices != NULL)
+		_releaseDevice(client, client->devices);
+	pthread_mutex_unlock(&stateMutex);
+	close(client->fd);
+	pthread_mutex_destroy(&client->sendMutex);
+	free(client);
+	_log("client disconnected");
+}
+
+static void* _workerMain(void* arg) {
+	(void)arg;
+	for (;;) {
+		pthread_mutex_lock(&jobsMutex);
+		while (jobsHead == NULL)
+			pthread_cond_wait(&jobsCond, &jobsMutex);
+		struct job* const job = jobsHead;
+		jobsHead = job->next;
+		if (jobsHead == NULL)
+			jobsTail = NULL;
+		pthread_mutex_unlock(&jobsMutex);
+		_execute(job);
+		_releaseClient(job->client);
+		free(job->payload);
+		free(job);
+	}
+	return NULL;
+}
+
+static void* _clientMain(void* arg) {
+	struct client* const client = arg;
+	for (;;) {
+		struct job* const job = calloc(1, sizeof(*job));
+		if (job == NULL)
+			break;
+		if (!proxy_recv(client->fd, &job->request, sizeof(job->request)) || job->request.size > PROXY_MAX_PAYLOAD) {
+			free(job);
+			break;
+		}
+		job->payload = malloc((size_t)job->request.size + 1);
+		if (job->payload == NULL || !proxy_recv(client->fd, job->payload, job->request.size)) {
+			free(job->payload);
+			free(job);
+			break;
+		}
+		job->payload[job->request.size] = '\0';
+		job->client = client;
+		ATOMIC_FETCH_ADD(&client->refs, 1);
+		pthread_mutex_lock(&jobsMutex);
+		if (jobsTail != NULL)
+			jobsTail->next = job;
+		else
+			jobsHead = job;
+		jobsTail = job;
+		pthread_cond_signal(&jobsCond);
+		pthread_mutex_unlock(&jobsMutex);
+	}
+	shutdown(client->fd, SHUT_RDWR);
+	_releaseClient(client);
+	return NULL;
+}
+
+static bool _startThread(void* (*main)(void*), void* arg) {
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, main, arg) != 0)
+		return false;
+	pthread_detach(thread);
+	return true;
+}
+
+static void _accept(int listenFd) {
+	const int fd = accept(listenFd, NULL, NULL);
+	if (fd == -1)
+		return;
+	struct client* const client = calloc(1, sizeof(*client));
+	if (client == NULL) {
+		close(fd);
+		return;
+	}
+	client->fd = fd;
+	client->refs = 1;
+	pthread_mutex_init(&client->sendMutex, NULL);
+	if (!_startThread(_clientMain, client)) {
+		pthread_mutex_destroy(&client->sendMutex);
+		free(client);
+		close(fd);
+		return;
+	}
+	_log("client connected");
+}
+
+/*
+ * Main
+ */
+
+static int _listen(const char* path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+	// a stale socket is replaced, unless a daemon is listening on it
+	if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) == 0) {
+		fprintf(stderr, "a daemon is already listening on %s\n", path);
+		close(fd);
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void _onSignal(int sig) {
+	(void)sig;
+	quit = 1;
+}
+
+static void _usage(const char* name) {
+	fprintf(stderr, "usage: %s [-s <socket>] [-w <workers>] [-v]\n", name);
+	fprintf(stderr, "  -s <socket>   Unix-domain socket (default %s)\n", PROXY_DEFAULT_SOCKET);
+	fprintf(stderr, "  -w <workers>  number of worker threads (default %d)\n", PROXYD_DEFAULT_WORKERS);
+	fprintf(stderr, "  -v            log connections and errors on stderr\n");
+}
+
+int main(int argc, char* argv[]) {
+	const char* path = PROXY_DEFAULT_SOCKET;
+	long nWorkers = PROXYD_DEFAULT_WORKERS;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:w:vh")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+		case 'w':
+			nWorkers = strtol(optarg, NULL, 10);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			_usage(argv[0]);
+			return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (nWorkers < 1 || nWorkers > PROXYD_MAX_WORKERS) {
+		fprintf(stderr, "invalid number of workers: %ld\n", nWorkers);
+		return EXIT_FAILURE;
+	}
+	struct sigaction sa = { .sa_handler = _onSignal };
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	const int listenFd = _listen(path);
+	if (listenFd == -1)
+		return EXIT_FAILURE;
+	for (long i = 0; i < nWorkers; ++i) {
+		if (!_startThread(_workerMain, NULL)) {
+			fprintf(stderr, "pthread_create failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	_log("listening on %s with %ld workers", path, nWorkers);
+	while (!quit) {
+		struct pollfd pfd = { .fd = listenFd, .events = POLLIN };
+		if (poll(&pfd, 1, 500) == 1)
+			_accept(listenFd);
+	}
+	unlink(path);
+	close(listenFd);
+	// readouts must be stopped to remove the fan-outs; devices are closed for the other requests
+	pthread_mutex_lock(&stateMutex);
+	while (endpoints != NULL)
+		_freeEndpoint(endpoints);
+	for (struct device* dev = devices; dev != NULL; dev = dev->next)
+		CAEN_FELib_Close(dev->handle);
+	_log("requests %"PRIu64", GetValue %"PRIu64" (coalesced %"PRIu64")", nRequests, nGetValues, nCoalesced);
+	return EXIT_SUCCESS;
+}
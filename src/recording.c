@@ -0,0 +1,866 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		recording.c
+*	\brief		Recording of endpoints on background threads
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // O_DIRECT
+#endif
+
+#include "recording.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h> // open, O_* constants
+#include <unistd.h> // pwrite, fdatasync, ftruncate
+#endif
+
+#include "codec.h"
+#include "evfile.h"
+#include "json.h"
+#include "utils.h"
+
+#define RECORDING_ALIGNMENT				4096					// direct I/O alignment, multiple of the logical block size of common devices
+#define RECORDING_DEFAULT_BUFFER_SIZE	(UINT32_C(8) << 20)
+#define RECORDING_DEFAULT_BUFFERS		2						// double buffering
+#define RECORDING_DEFAULT_FSYNC_PERIOD	1000					// ms
+#define RECORDING_DEFAULT_DIRECT_IO		true
+#define RECORDING_DEFAULT_THREADS		2						// compression threads
+#define RECORDING_JOBS_PER_THREAD		2						// chunks being compressed or waiting, per thread
+#define RECORDING_READ_TIMEOUT			100						// ms, period used to check for stop requests
+#define RECORDING_RATE_PERIOD			UINT64_C(1000000000)	// ns, throughput window
+
+#ifndef _WIN32
+
+// chunk to be compressed
+struct recording_job {
+	char*							raw;				// event and stop records
+	size_t							rawSize;
+	size_t							rawCapacity;
+	char*							out;				// EvfileRecordCompressed record, padded
+	size_t							outSize;
+	size_t							outCapacity;
+	uint64_t						time;				// time of the last record
+	bool							done;
+	bool							failed;
+};
+
+struct recording_worker {
+	struct recording*				recording;
+	struct codec*					codec;
+	pthread_t						thread;
+};
+
+struct recording {
+	uint64_t						handle;
+	recording_read_t				read;
+	struct format					fmt;
+	struct format_args				args;				// field buffers
+	char*							scratch;			// serialization of events that do not fit the current buffer
+	size_t							scratchSize;
+	uint64_t						startTime;
+	uint64_t						offset;				// file offset of the next record, accessed only by the reader
+	struct evfile_index				index;
+	// file
+	int								fd;
+	bool							directIO;
+	uint64_t						fsyncPeriod;		// ns, 0 to sync only at the end
+	// ring of buffers, used in order: buffer i % nBuffers is filled by the reader while i >= written
+	struct numa_buffer				ring;				// single mapping of all the buffers
+	struct numa_memory				memory;
+	struct numa_cpus				cpus;				// affinity of all the threads
+	char**							buffers;
+	size_t*							sizes;
+	size_t							nBuffers;
+	size_t							bufferSize;
+	size_t							used;				// bytes on the buffer being filled, accessed only by the reader
+	uint64_t						filled;				// number of buffers passed to the writer
+	uint64_t						written;			// number of buffers written
+	bool							stopRequested;		// read by the reader without lock
+	bool							readerDone;
+	pthread_t						reader;
+	pthread_t						writer;
+	// compression, if codec is not CodecNone: jobs are filled, compressed and written in order
+	enum codec_type					codec;
+	int								level;
+	struct recording_worker*		workers;
+	size_t							nWorkers;			// started
+	size_t							nThreads;
+	struct recording_job*			jobs;
+	size_t							nJobs;
+	size_t							jobEvents;			// events on the job being filled, accessed only by the reader
+	uint64_t						jobsSubmitted;		// job jobsSubmitted % nJobs is filled by the reader
+	uint64_t						jobsStarted;
+	uint64_t						jobsWritten;		// accessed only by the reader
+	bool							workersStop;
+	pthread_cond_t					jobCond;
+	pthread_mutex_t					mutex;				// protects the following fields and the counters above
+	pthread_cond_t					cond;
+	CAEN_FELib_RecordingStatus_t	status;
+	uint64_t						rateTime;
+	uint64_t						rateBytes;
+	uint64_t						rateCompressed;
+	char							errorDescription[1024 + 64];	// prefix and description from CAEN_FELib_GetLastError()
+};
+
+// set the first error and stop, with mutex locked
+static void _fail(struct recording* r, int error, const char* description) {
+	if (r->status.error == CAEN_FELib_Success) {
+		r->status.error = error;
+		snprintf(r->errorDescription, ARRAY_SIZE(r->errorDescription), "recording aborted: %s", description);
+	}
+	ATOMIC_STORE_RELEASE(&r->stopRequested, true);
+	pthread_cond_broadcast(&r->cond);
+}
+
+/*
+ * Compression workers
+ */
+
+// let workers exit when there are no more jobs
+static void _releaseWorkers(struct recording* r) {
+	pthread_mutex_lock(&r->mutex);
+	r->workersStop = true;
+	pthread_cond_broadcast(&r->jobCond);
+	pthread_mutex_unlock(&r->mutex);
+}
+
+static void _joinWorkers(struct recording* r) {
+	_releaseWorkers(r);
+	for (; r->nWorkers != 0; --r->nWorkers)
+		pthread_join(r->workers[r->nWorkers - 1].thread, NULL);
+}
+
+static bool _compress(struct recording* r, struct codec* codec, struct recording_job* job) {
+	const size_t header = sizeof(struct evfile_record) + sizeof(struct evfile_compressed);
+	const size_t bound = codec_bound(codec, job->rawSize);
+	if (bound == 0 || bound > UINT32_MAX - sizeof(struct evfile_compressed))
+		return false;
+	const size_t capacity = header + bound + EVFILE_ALIGNMENT;
+	if (capacity > job->outCapacity) {
+		char* const out = realloc(job->out, capacity);
+		if (out == NULL)
+			return false;
+		job->out = out;
+		job->outCapacity = capacity;
+	}
+	const size_t n = codec_compress(codec, job->raw, job->rawSize, job->out + header, bound);
+	if (n == 0)
+		return false;
+	const struct evfile_record record = {
+		.type = EvfileRecordCompressed,
+		.size = (uint32_t)(sizeof(struct evfile_compressed) + n),
+		.time = job->time,
+	};
+	const struct evfile_compressed compressed = {
+		.codec = (uint32_t)r->codec,
+		.rawSize = job->rawSize,
+	};
+	memcpy(job->out, &record, sizeof(record));
+	memcpy(job->out + sizeof(record), &compressed, sizeof(compressed));
+	memset(job->out + header + n, 0, evfile_padding(record.size));
+	job->outSize = sizeof(record) + record.size + evfile_padding(record.size);
+	return true;
+}
+
+static void* _workerMain(void* arg) {
+	struct recording_worker* const w = arg;
+	struct recording* const r = w->recording;
+	pthread_mutex_lock(&r->mutex);
+	for (;;) {
+		while (r->jobsStarted == r->jobsSubmitted && !r->workersStop)
+			pthread_cond_wait(&r->jobCond, &r->mutex);
+		if (r->jobsStarted == r->jobsSubmitted)
+			break;
+		struct recording_job* const job = &r->jobs[r->jobsStarted++ % r->nJobs];
+		pthread_mutex_unlock(&r->mutex);
+		const bool ok = _compress(r, w->codec, job);
+		pthread_mutex_lock(&r->mutex);
+		job->failed = !ok;
+		job->done = true;
+		r->status.bytesCompressed += job->rawSize;
+		if (ok)
+			r->status.bytesCompressedOut += job->outSize;
+		pthread_cond_broadcast(&r->cond);
+	}
+	pthread_mutex_unlock(&r->mutex);
+	return NULL;
+}
+
+/*
+ * Reader
+ */
+
+// pass the current buffer to the writer and wait for the next one to be free
+static int _submit(struct recording* r) {
+	pthread_mutex_lock(&r->mutex);
+	r->sizes[r->filled % r->nBuffers] = r->used;
+	++r->filled;
+	r->status.backlog += r->used;
+	pthread_cond_broadcast(&r->cond);
+	if (r->filled - r->written == r->nBuffers && r->status.error == CAEN_FELib_Success) {
+		++r->status.stalls;
+		do {
+			pthread_cond_wait(&r->cond, &r->mutex);
+		} while (r->filled - r->written == r->nBuffers && r->status.error == CAEN_FELib_Success);
+	}
+	const int ret = r->status.error;
+	pthread_mutex_unlock(&r->mutex);
+	r->used = 0;
+	return ret;
+}
+
+static char* _current(struct recording* r) {
+	return r->buffers[r->filled % r->nBuffers] + r->used;
+}
+
+static int _append(struct recording* r, const char* data, size_t size) {
+	while (size != 0) {
+		const size_t n = (size < r->bufferSize - r->used) ? size : r->bufferSize - r->used;
+		memcpy(_current(r), data, n);
+		r->used += n;
+		data += n;
+		size -= n;
+		if (r->used == r->bufferSize) {
+			const int ret = _submit(r);
+			if (ret != CAEN_FELib_Success)
+				return ret;
+		}
+	}
+	return CAEN_FELib_Success;
+}
+
+// serialize a record to dst, aligned to EVFILE_ALIGNMENT
+static void _serialize(struct recording* r, char* dst, const struct evfile_record* record, const void* payload) {
+	memcpy(dst, record, sizeof(*record));
+	dst += sizeof(*record);
+	if (payload != NULL)
+		memcpy(dst, payload, record->size);
+	else if (record->type == EvfileRecordEvent)
+		evfile_pack(&r->fmt, &r->args, dst);
+	memset(dst + record->size, 0, evfile_padding(record->size));
+}
+
+static int _failWith(struct recording* r, int error, const char* description) {
+	pthread_mutex_lock(&r->mutex);
+	_fail(r, error, description);
+	pthread_mutex_unlock(&r->mutex);
+	return error;
+}
+
+static int _failAlloc(struct recording* r) {
+	return _failWith(r, CAEN_FELib_InternalError, "allocation failed");
+}
+
+// write a compressed job and add it to the index
+static int _writeJob(struct recording* r, struct recording_job* job) {
+	++r->jobsWritten;
+	if (job->failed)
+		return _failWith(r, CAEN_FELib_InternalError, "compression failed");
+	const struct evfile_record* const record = (const struct evfile_record*)job->out;
+	if (!evfile_indexOnCompressed(&r->index, r->offset, record, job->raw, job->rawSize, &r->fmt))
+		return _failAlloc(r);
+	r->offset += job->outSize;
+	job->rawSize = 0;
+	job->done = false;
+	return _append(r, job->out, job->outSize);
+}
+
+/*
+ * Write compressed jobs in order. The oldest job is waited for if all is true, or if there is
+ * no free job to fill.
+ */
+static int _writeJobs(struct recording* r, bool all) {
+	while (r->jobsWritten != r->jobsSubmitted) {
+		struct recording_job* const job = &r->jobs[r->jobsWritten % r->nJobs];
+		pthread_mutex_lock(&r->mutex);
+		if (!job->done && (all || r->jobsSubmitted - r->jobsWritten == r->nJobs)) {
+			if (!all)
+				++r->status.stalls;
+			do {
+				pthread_cond_wait(&r->cond, &r->mutex);
+			} while (!job->done);
+		}
+		const bool done = job->done;
+		pthread_mutex_unlock(&r->mutex);
+		if (!done)
+			break;
+		const int ret = _writeJob(r, job);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+	}
+	return CAEN_FELib_Success;
+}
+
+// pass the job being filled to the workers
+static int _submitJob(struct recording* r) {
+	pthread_mutex_lock(&r->mutex);
+	++r->jobsSubmitted;
+	pthread_cond_signal(&r->jobCond);
+	pthread_mutex_unlock(&r->mutex);
+	r->jobEvents = 0;
+	return _writeJobs(r, false);
+}
+
+// append a record to the job being filled, that is submitted when it reaches the size of a chunk
+static int _stageRecord(struct recording* r, const struct evfile_record* record, const void* payload) {
+	struct recording_job* const job = &r->jobs[r->jobsSubmitted % r->nJobs];
+	const size_t total = sizeof(*record) + record->size + evfile_padding(record->size);
+	if (total > job->rawCapacity - job->rawSize) {
+		const size_t capacity = (job->rawSize + total > 2 * job->rawCapacity) ? job->rawSize + total : 2 * job->rawCapacity;
+		char* const raw = realloc(job->raw, capacity);
+		if (raw == NULL)
+			return _failAlloc(r);
+		job->raw = raw;
+		job->rawCapacity = capacity;
+	}
+	_serialize(r, job->raw + job->rawSize, record, payload);
+	job->rawSize += total;
+	job->time = record->time;
+	if (record->type == EvfileRecordEvent)
+		++r->jobEvents;
+	if (r->jobEvents == EVFILE_CHUNK_EVENTS || job->rawSize >= EVFILE_CHUNK_SIZE)
+		return _submitJob(r);
+	return CAEN_FELib_Success;
+}
+
+/*
+ * Append a record. Payload of events is serialized from the field buffers if payload is NULL.
+ * Records are serialized in place, if they fit the current buffer.
+ */
+static int _appendRecord(struct recording* r, enum evfile_record_type type, const void* payload, size_t size) {
+	if (size > UINT32_MAX)
+		return _failWith(r, CAEN_FELib_GenericError, "event too large");
+	const struct evfile_record record = {
+		.type = (uint32_t)type,
+		.size = (uint32_t)size,
+		.time = utils_now() - r->startTime,
+	};
+	if (r->codec != CodecNone && (type == EvfileRecordEvent || type == EvfileRecordStop))
+		return _stageRecord(r, &record, payload);
+	const size_t total = sizeof(struct evfile_record) + size + evfile_padding(size);
+	const bool inPlace = (total <= r->bufferSize - r->used);
+	if (!inPlace && total > r->scratchSize) {
+		char* const scratch = realloc(r->scratch, total);
+		if (scratch == NULL)
+			return _failAlloc(r);
+		r->scratch = scratch;
+		r->scratchSize = total;
+	}
+	char* const dst = inPlace ? _current(r) : r->scratch;
+	_serialize(r, dst, &record, payload);
+	if (type != EvfileRecordIndex && !evfile_indexOnRecord(&r->index, r->offset, &record, &r->fmt, dst + sizeof(record)))
+		return _failAlloc(r);
+	r->offset += total;
+	if (!inPlace)
+		return _append(r, r->scratch, total);
+	r->used += total;
+	return (r->used == r->bufferSize) ? _submit(r) : CAEN_FELib_Success;
+}
+
+static int _appendFormat(struct recording* r) {
+	const size_t jsonSize = strlen(r->fmt.json) + 1;
+	const struct evfile_format f = {
+		.nChannels = (uint32_t)r->fmt.nChannels,
+	};
+	char* const payload = malloc(sizeof(f) + jsonSize);
+	if (payload == NULL)
+		return CAEN_FELib_InternalError;
+	memcpy(payload, &f, sizeof(f));
+	memcpy(payload + sizeof(f), r->fmt.json, jsonSize);
+	evfile_indexOnFormat(&r->index, r->offset, &r->fmt);
+	const int ret = _appendRecord(r, EvfileRecordFormat, payload, sizeof(f) + jsonSize);
+	free(payload);
+	return ret;
+}
+
+static void _count(struct recording* r, uint64_t* counter, size_t bytes) {
+	pthread_mutex_lock(&r->mutex);
+	++*counter;
+	r->status.bytesRecorded += bytes;
+	pthread_mutex_unlock(&r->mutex);
+}
+
+static void* _readerMain(void* arg) {
+	struct recording* const r = arg;
+	char description[1024];
+	for (;;) {
+		if (ATOMIC_LOAD_ACQUIRE(&r->stopRequested))
+			break;
+		const int ret = r->read(r->handle, RECORDING_READ_TIMEOUT, &r->args);
+		size_t size;
+		switch (ret) {
+		case CAEN_FELib_Success:
+			size = evfile_packedSize(&r->fmt, &r->args);
+			if (_appendRecord(r, EvfileRecordEvent, NULL, size) == CAEN_FELib_Success)
+				_count(r, &r->status.events, sizeof(struct evfile_record) + size);
+			break;
+		case CAEN_FELib_Stop:
+			if (_appendRecord(r, EvfileRecordStop, NULL, 0) == CAEN_FELib_Success)
+				_count(r, &r->status.stops, sizeof(struct evfile_record));
+			break;
+		case CAEN_FELib_Timeout:
+		case CAEN_FELib_Interrupted: // CAEN_FELib_Interrupt on the endpoint only wakes the reader
+			break;
+		default:
+			CAEN_FELib_GetLastError(description);
+			_failWith(r, ret, description);
+			break;
+		}
+	}
+	// last chunk, if compressed, then stop workers
+	if (r->codec != CodecNone) {
+		if (r->jobs[r->jobsSubmitted % r->nJobs].rawSize == 0 || _submitJob(r) == CAEN_FELib_Success)
+			_writeJobs(r, true);
+		_releaseWorkers(r);
+	}
+	// index and trailer, see evfile.h
+	const struct evfile_trailer trailer = {
+		.indexOffset = r->offset,
+		.nChunks = r->index.nChunks,
+		.magic = EVFILE_TRAILER_MAGIC,
+	};
+	if (_appendRecord(r, EvfileRecordIndex, r->index.chunks, r->index.nChunks * sizeof(struct evfile_chunk)) == CAEN_FELib_Success)
+		_append(r, (const char*)&trailer, sizeof(trailer));
+	// last buffer, possibly partial
+	pthread_mutex_lock(&r->mutex);
+	if (r->used != 0) {
+		r->sizes[r->filled % r->nBuffers] = r->used;
+		++r->filled;
+		r->status.backlog += r->used;
+	}
+	r->readerDone = true;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+	return NULL;
+}
+
+/*
+ * Writer
+ */
+
+static bool _writeAll(int fd, const char* data, size_t size, off_t offset) {
+	while (size != 0) {
+		const ssize_t n = pwrite(fd, data, size, offset);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += n;
+		size -= (size_t)n;
+		offset += n;
+	}
+	return true;
+}
+
+static int _sync(int fd) {
+#ifdef __APPLE__
+	return fsync(fd);
+#else
+	return fdatasync(fd);
+#endif
+}
+
+static void* _writerMain(void* arg) {
+	struct recording* const r = arg;
+	off_t offset = 0;
+	uint64_t lastSync = utils_now();
+	bool dirty = false;
+	bool failed = false;
+	pthread_mutex_lock(&r->mutex);
+	for (;;) {
+		if (r->written == r->filled) {
+			if (r->readerDone)
+				break;
+			// wake up periodically to sync and to update the throughput
+			struct timespec ts;
+			const uint64_t deadline = utils_realtime() + RECORDING_RATE_PERIOD;
+			ts.tv_sec = (time_t)(deadline / UINT64_C(1000000000));
+			ts.tv_nsec = (long)(deadline % UINT64_C(1000000000));
+			pthread_cond_timedwait(&r->cond, &r->mutex, &ts);
+		}
+		const bool hasBuffer = (r->written != r->filled);
+		const char* const buffer = r->buffers[r->written % r->nBuffers];
+		const size_t size = r->sizes[r->written % r->nBuffers];
+		pthread_mutex_unlock(&r->mutex);
+		bool ok = true;
+		if (hasBuffer && !failed) {
+			// only the last buffer can be partial: with direct I/O it is padded, and the file truncated at the end
+			const size_t padded = r->directIO ? (size + RECORDING_ALIGNMENT - 1) / RECORDING_ALIGNMENT * RECORDING_ALIGNMENT : size;
+			memset((char*)buffer + size, 0, padded - size);
+			ok = _writeAll(r->fd, buffer, padded, offset);
+			offset += (off_t)size;
+			dirty = true;
+		}
+		const uint64_t now = utils_now();
+		bool synced = false;
+		if (ok && !failed && dirty && r->fsyncPeriod != 0 && now - lastSync >= r->fsyncPeriod) {
+			ok = (_sync(r->fd) == 0);
+			lastSync = now;
+			dirty = false;
+			synced = true;
+		}
+		pthread_mutex_lock(&r->mutex);
+		if (!ok) {
+			_fail(r, CAEN_FELib_GenericError, strerror(errno));
+			failed = true;
+		}
+		if (hasBuffer) {
+			// after a failure buffers are discarded, to release the reader
+			++r->written;
+			if (!failed)
+				r->status.bytesWritten += size;
+			r->status.backlog -= size;
+			pthread_cond_broadcast(&r->cond);
+		}
+		if (synced)
+			++r->status.fsyncs;
+		if (now - r->rateTime >= RECORDING_RATE_PERIOD) {
+			r->status.throughput = (double)(r->status.bytesWritten - r->rateBytes) * 1e9 / (double)(now - r->rateTime);
+			r->status.compressionThroughput = (double)(r->status.bytesCompressed - r->rateCompressed) * 1e9 / (double)(now - r->rateTime);
+			r->rateTime = now;
+			r->rateBytes = r->status.bytesWritten;
+			r->rateCompressed = r->status.bytesCompressed;
+		}
+	}
+	pthread_mutex_unlock(&r->mutex);
+	return NULL;
+}
+
+/*
+ * Setup
+ */
+
+static void _freeFieldBuffers(struct recording* r) {
+	for (size_t i = 0; i < r->fmt.nFields; ++i) {
+		if (r->fmt.fields[i].dim == 2 && r->args.ptr[i] != NULL)
+			for (size_t ch = 0; ch < r->fmt.nChannels; ++ch)
+				free(((void**)r->args.ptr[i])[ch]);
+		free(r->args.ptr[i]);
+	}
+}
+
+static bool _allocateFieldBuffers(struct recording* r, size_t maxArraySize) {
+	for (size_t i = 0; i < r->fmt.nFields; ++i) {
+		const struct format_field* const f = &r->fmt.fields[i];
+		const size_t arraySize = (maxArraySize / f->typeSize + 1) * f->typeSize;
+		switch (f->dim) {
+		case 0:
+			r->args.ptr[i] = calloc(1, f->typeSize);
+			break;
+		case 1:
+			r->args.ptr[i] = calloc(1, (f->sizeField == FORMAT_SIZE_NCHANNELS) ? r->fmt.nChannels * f->typeSize : arraySize);
+			break;
+		case 2:
+			r->args.ptr[i] = calloc(r->fmt.nChannels, sizeof(void*));
+			if (r->args.ptr[i] == NULL)
+				return false;
+			for (size_t ch = 0; ch < r->fmt.nChannels; ++ch)
+				if ((((void**)r->args.ptr[i])[ch] = calloc(1, arraySize)) == NULL)
+					return false;
+			break;
+		}
+		if (r->args.ptr[i] == NULL)
+			return false;
+	}
+	return true;
+}
+
+static int _parseOptions(struct recording* r, const char* options, size_t* maxArraySize, const struct numa_cpus* cpus) {
+	size_t bufferSize = RECORDING_DEFAULT_BUFFER_SIZE;
+	size_t nBuffers = RECORDING_DEFAULT_BUFFERS;
+	double fsyncPeriod = RECORDING_DEFAULT_FSYNC_PERIOD;
+	double level = 0.;
+	double nThreads = RECORDING_DEFAULT_THREADS;
+	r->directIO = RECORDING_DEFAULT_DIRECT_IO;
+	r->codec = CodecNone;
+	numa_initMemory(&r->memory, false);
+	r->cpus = *cpus;
+	if (options != NULL) {
+		struct json* const root = json_parse(options);
+		if (root == NULL || root->type != JsonObject) {
+			json_free(root);
+			_setLastLocalError("invalid recording options: not a JSON object");
+			return CAEN_FELib_InvalidParam;
+		}
+		const double b = json_number(json_get(root, "buffer_size"), (double)bufferSize);
+		const double n = json_number(json_get(root, "buffers"), (double)nBuffers);
+		const double m = json_number(json_get(root, "max_array_size"), (double)*maxArraySize);
+		fsyncPeriod = json_number(json_get(root, "fsync_period"), fsyncPeriod);
+		r->directIO = json_bool(json_get(root, "direct_io"), r->directIO);
+		const char* const compression = json_string(json_get(root, "compression"), codec_name(CodecNone));
+		const int codec = codec_fromName(compression);
+		if (codec < 0 || !codec_isAvailable((enum codec_type)codec)) {
+			_setLastLocalError("invalid recording options: compression '%s' %s", compression, (codec < 0) ? "unknown" : "not supported by this build");
+			json_free(root);
+			return CAEN_FELib_InvalidParam;
+		}
+		r->codec = (enum codec_type)codec;
+		level = json_number(json_get(root, "compression_level"), (double)codec_defaultLevel(r->codec));
+		nThreads = json_number(json_get(root, "compression_threads"), nThreads);
+		int ret = numa_parseMemory(&r->memory, root);
+		if (ret == CAEN_FELib_Success)
+			ret = numa_parseCpusOption(&r->cpus, root);
+		json_free(root);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+		if (!(b >= RECORDING_ALIGNMENT && b <= (double)(SIZE_MAX / 2)) || !(n >= 2 && n <= 1024) || !(m >= 1 && m <= (double)(SIZE_MAX / 2)) || !(fsyncPeriod >= 0) || !(level >= -100 && level <= 100) || !(nThreads >= 1 && nThreads <= 256)) {
+			_setLastLocalError("invalid recording options: value out of range");
+			return CAEN_FELib_InvalidParam;
+		}
+		bufferSize = (size_t)b;
+		nBuffers = (size_t)n;
+		*maxArraySize = (size_t)m;
+	}
+	r->bufferSize = (bufferSize + RECORDING_ALIGNMENT - 1) / RECORDING_ALIGNMENT * RECORDING_ALIGNMENT;
+	r->nBuffers = nBuffers;
+	r->fsyncPeriod = (uint64_t)(fsyncPeriod * 1e6);
+	r->level = (int)level;
+	r->nThreads = (size_t)nThreads;
+	return CAEN_FELib_Success;
+}
+
+static int _openFile(struct recording* r, const char* filename) {
+	const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+	if (r->directIO) {
+		r->fd = open(filename, flags | O_DIRECT, 0644);
+		// not supported by some file systems (e.g. tmpfs)
+		if (r->fd != -1 || errno != EINVAL)
+			return (r->fd != -1) ? CAEN_FELib_Success : CAEN_FELib_InvalidParam;
+		r->directIO = false;
+	}
+#endif
+	r->fd = open(filename, flags, 0644);
+	if (r->fd == -1)
+		return CAEN_FELib_InvalidParam;
+#ifdef F_NOCACHE
+	if (r->directIO && fcntl(r->fd, F_NOCACHE, 1) == -1)
+		r->directIO = false;
+#elif !defined(O_DIRECT)
+	r->directIO = false;
+#endif
+	return CAEN_FELib_Success;
+}
+
+static void _free(struct recording* r) {
+	numa_free(&r->ring);
+	free(r->buffers);
+	free(r->sizes);
+	free(r->scratch);
+	if (r->jobs != NULL)
+		for (size_t i = 0; i < r->nJobs; ++i) {
+			free(r->jobs[i].raw);
+			free(r->jobs[i].out);
+		}
+	free(r->jobs);
+	if (r->workers != NULL)
+		for (size_t i = 0; i < r->nThreads; ++i)
+			codec_destroy(r->workers[i].codec);
+	free(r->workers);
+	evfile_indexClear(&r->index);
+	_freeFieldBuffers(r);
+	format_clear(&r->fmt);
+	pthread_cond_destroy(&r->jobCond);
+	pthread_cond_destroy(&r->cond);
+	pthread_mutex_destroy(&r->mutex);
+	free(r);
+}
+
+int recording_start(struct recording** recording, uint64_t handle, recording_read_t read, const char* filename, const char* source, const char* endpoint, const struct format* fmt, size_t maxArraySize, const struct numa_cpus* cpus, const char* options) {
+	if (*recording != NULL) {
+		_setLastLocalError("recording already in progress");
+		return CAEN_FELib_CommandError;
+	}
+	if (!format_isSizeable(fmt)) {
+		_setLastLocalError("size of arrays of the read data format cannot be determined");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct recording* const r = calloc(1, sizeof(*r));
+	if (r == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	pthread_cond_init(&r->jobCond, NULL);
+	evfile_indexInit(&r->index);
+	r->handle = handle;
+	r->read = read;
+	r->fd = -1;
+	int ret = _parseOptions(r, options, &maxArraySize, cpus);
+	if (ret != CAEN_FELib_Success) {
+		_free(r);
+		return ret;
+	}
+	ret = format_parse(&r->fmt, fmt->json, fmt->nChannels);
+	if (ret != CAEN_FELib_Success) {
+		_free(r);
+		return ret;
+	}
+	if (r->bufferSize > SIZE_MAX / r->nBuffers) {
+		_setLastLocalError("buffer allocation failed");
+		_free(r);
+		return CAEN_FELib_InternalError;
+	}
+	// buffers are page aligned, hence aligned for direct I/O
+	ret = numa_alloc(&r->ring, r->nBuffers * r->bufferSize, &r->memory);
+	if (ret != CAEN_FELib_Success) {
+		_free(r);
+		return ret;
+	}
+	r->buffers = calloc(r->nBuffers, sizeof(*r->buffers));
+	r->sizes = calloc(r->nBuffers, sizeof(*r->sizes));
+	bool allocated = (r->buffers != NULL && r->sizes != NULL);
+	for (size_t i = 0; allocated && i < r->nBuffers; ++i)
+		r->buffers[i] = (char*)r->ring.ptr + i * r->bufferSize;
+	if (allocated && r->codec != CodecNone) {
+		r->nJobs = r->nThreads * RECORDING_JOBS_PER_THREAD;
+		r->jobs = calloc(r->nJobs, sizeof(*r->jobs));
+		r->workers = calloc(r->nThreads, sizeof(*r->workers));
+		allocated = (r->jobs != NULL && r->workers != NULL);
+		for (size_t i = 0; allocated && i < r->nThreads; ++i) {
+			r->workers[i].recording = r;
+			allocated = ((r->workers[i].codec = codec_create(r->codec, r->level)) != NULL);
+		}
+	}
+	if (!allocated || !_allocateFieldBuffers(r, maxArraySize)) {
+		_setLastLocalError("buffer allocation failed");
+		_free(r);
+		return CAEN_FELib_InternalError;
+	}
+	if (_openFile(r, filename) != CAEN_FELib_Success) {
+		_setLastLocalError("cannot open '%s': %s", filename, strerror(errno));
+		_free(r);
+		return CAEN_FELib_InvalidParam;
+	}
+	r->startTime = utils_now();
+	r->rateTime = r->startTime;
+	r->status.capacity = (uint64_t)r->nBuffers * r->bufferSize;
+	// header and format are the first records of the first buffer
+	struct evfile_header header;
+	evfile_initHeader(&header, source, endpoint);
+	memcpy(_current(r), &header, sizeof(header));
+	r->used = sizeof(header);
+	r->offset = sizeof(header);
+	ret = _appendFormat(r);
+	// all the threads share the same affinity
+	pthread_attr_t attr;
+	const bool hasAttr = (ret == CAEN_FELib_Success && (ret = numa_initThreadAttr(&attr, &r->cpus)) == CAEN_FELib_Success);
+	while (ret == CAEN_FELib_Success && r->codec != CodecNone && r->nWorkers != r->nThreads) {
+		if (pthread_create(&r->workers[r->nWorkers].thread, &attr, _workerMain, &r->workers[r->nWorkers]) != 0)
+			ret = CAEN_FELib_InternalError;
+		else
+			++r->nWorkers;
+	}
+	if (ret == CAEN_FELib_Success && pthread_create(&r->writer, &attr, _writerMain, r) != 0)
+		ret = CAEN_FELib_InternalError;
+	if (ret == CAEN_FELib_Success && pthread_create(&r->reader, &attr, _readerMain, r) != 0) {
+		pthread_mutex_lock(&r->mutex);
+		r->readerDone = true;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->mutex);
+		pthread_join(r->writer, NULL);
+		ret = CAEN_FELib_InternalError;
+	}
+	if (hasAttr)
+		pthread_attr_destroy(&attr);
+	if (ret != CAEN_FELib_Success) {
+		_joinWorkers(r);
+		// otherwise last error is already set
+		if (hasAttr)
+			_setLastLocalError("recording start failed: cannot create threads%s", numa_isEmpty(&r->cpus) ? "" : " on the CPUs of the affinity");
+		close(r->fd);
+		remove(filename);
+		_free(r);
+		return ret;
+	}
+	*recording = r;
+	return CAEN_FELib_Success;
+}
+
+int recording_stop(struct recording** recording) {
+	struct recording* const r = *recording;
+	if (r == NULL)
+		return CAEN_FELib_Success;
+	*recording = NULL;
+	pthread_mutex_lock(&r->mutex);
+	ATOMIC_STORE_RELEASE(&r->stopRequested, true);
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+	pthread_join(r->reader, NULL);
+	_joinWorkers(r);
+	pthread_join(r->writer, NULL);
+	int ret = r->status.error;
+	// remove padding of the last buffer, then sync
+	if ((ftruncate(r->fd, (off_t)r->status.bytesWritten) == -1 || _sync(r->fd) == -1) && ret == CAEN_FELib_Success) {
+		snprintf(r->errorDescription, ARRAY_SIZE(r->errorDescription), "recording close failed: %s", strerror(errno));
+		ret = CAEN_FELib_GenericError;
+	}
+	if (close(r->fd) == -1 && ret == CAEN_FELib_Success) {
+		snprintf(r->errorDescription, ARRAY_SIZE(r->errorDescription), "recording close failed: %s", strerror(errno));
+		ret = CAEN_FELib_GenericError;
+	}
+	if (ret != CAEN_FELib_Success)
+		_setLastLocalError("%s", r->errorDescription);
+	_free(r);
+	return ret;
+}
+
+void recording_getStatus(struct recording* recording, CAEN_FELib_RecordingStatus_t* status) {
+	pthread_mutex_lock(&recording->mutex);
+	*status = recording->status;
+	pthread_mutex_unlock(&recording->mutex);
+}
+
+#else
+
+int recording_start(struct recording** recording, uint64_t handle, recording_read_t read, const char* filename, const char* source, const char* endpoint, const struct format* fmt, size_t maxArraySize, const struct numa_cpus* cpus, const char* options) {
+	_setLastLocalError("recording not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+int recording_stop(struct recording** recording) {
+	return CAEN_FELib_Success;
+}
+
+void recording_getStatus(struct recording* recording, CAEN_FELib_RecordingStatus_t* status) {}
+
+#endif
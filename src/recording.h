@@ -0,0 +1,75 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		recording.h
+*	\brief		Recording of endpoints on background threads
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_RECORDING_H_
+#define CAEN_INCLUDE_RECORDING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "format.h"
+#include "numa.h"
+
+/*
+ * Recording of an endpoint to file, on background threads. The file has the same layout
+ * of captures (see evfile.h), so recordings can be played back by the replay library.
+ *
+ * A reader thread reads events through the dispatcher and serializes them on a ring of
+ * large aligned buffers; a writer thread writes full buffers to file, bypassing the page
+ * cache where supported, and syncs data to disk periodically. If compression is enabled,
+ * the reader fills chunks of records that are compressed by a pool of worker threads, and
+ * appends them to the ring in order.
+ */
+
+// size of buffers of array fields if neither options nor the device provide it
+#define RECORDING_DEFAULT_MAX_ARRAY_SIZE	(UINT32_C(1) << 20)
+
+struct recording;
+
+// read an event on the buffers of args, return a CAEN_FELib_ErrorCode and set last error on failure
+typedef int (*recording_read_t)(uint64_t handle, int timeout, const struct format_args* args);
+
+/*
+ * maxArraySize is the default size in bytes of buffers of array fields, and cpus the default
+ * affinity of the threads, used if not set in options.
+ * Return a CAEN_FELib_ErrorCode, set last error on failure.
+ */
+int recording_start(struct recording** recording, uint64_t handle, recording_read_t read, const char* filename, const char* source, const char* endpoint, const struct format* fmt, size_t maxArraySize, const struct numa_cpus* cpus, const char* options);
+int recording_stop(struct recording** recording);
+void recording_getStatus(struct recording* recording, CAEN_FELib_RecordingStatus_t* status);
+
+#endif /* CAEN_INCLUDE_RECORDING_H_ */
@@ -0,0 +1,324 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		reduction.c
+*	\brief		Data reduction of waveforms
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "reduction.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "waveform.h"
+
+#define REDUCTION_DEFAULT_FIELD				"WAVEFORM"
+#define REDUCTION_DEFAULT_BASELINE_SAMPLES	16
+
+enum reduction_polarity {
+	ReductionPolarityBoth,
+	ReductionPolarityPositive,
+	ReductionPolarityNegative,
+};
+
+// fields sharing a size field
+struct reduction_group {
+	int								sizeField;
+	size_t							nFields;
+	int								fields[FORMAT_MAX_FIELDS];
+};
+
+struct reduction {
+	char							names[FORMAT_MAX_FIELDS][FORMAT_NAME_SIZE];
+	size_t							nNames;
+	// region of interest
+	bool							roi;
+	size_t							roiStart;
+	size_t							roiLength;
+	// zero suppression
+	bool							zeroSuppression;
+	uint16_t						threshold;
+	enum reduction_polarity			polarity;
+	bool							fixedBaseline;
+	uint16_t						baseline;
+	size_t							baselineSamples;
+	size_t							decimation;
+	// fields on the current format, none if not valid
+	struct reduction_group			groups[FORMAT_MAX_FIELDS];
+	size_t							nGroups;
+	// statistics, written only by the reading thread
+	uint64_t						events;
+	uint64_t						samplesIn;
+	uint64_t						samplesOut;
+	uint64_t						suppressed;
+};
+
+uint_fast32_t reductionCount;
+
+// group the fields on the format, return false and set description on failure
+static bool _resolve(struct reduction* r, const struct format* fmt, char* description, size_t size) {
+	r->nGroups = 0;
+	for (size_t i = 0; i < r->nNames; ++i) {
+		const int index = format_find(fmt, r->names[i]);
+		if (index < 0) {
+			snprintf(description, size, "field %s not found on the read data format", r->names[i]);
+			return false;
+		}
+		const struct format_field* const f = &fmt->fields[index];
+		if (f->type != FormatTypeU16 || (f->dim != 1 && f->dim != 2) || f->sizeField < 0) {
+			snprintf(description, size, "field %s is not a U16 array with a size field", r->names[i]);
+			return false;
+		}
+		size_t g = 0;
+		while (g < r->nGroups && r->groups[g].sizeField != f->sizeField)
+			++g;
+		if (g == r->nGroups) {
+			r->groups[g].sizeField = f->sizeField;
+			r->groups[g].nFields = 0;
+			++r->nGroups;
+		}
+		r->groups[g].fields[r->groups[g].nFields++] = index;
+	}
+	// reduced sizes would be wrong for arrays not reduced
+	for (size_t i = 0; i < fmt->nFields; ++i) {
+		const struct format_field* const f = &fmt->fields[i];
+		if (f->dim == 0 || f->sizeField < 0)
+			continue;
+		for (size_t g = 0; g < r->nGroups; ++g) {
+			if (r->groups[g].sizeField != f->sizeField)
+				continue;
+			bool found = false;
+			for (size_t j = 0; j < r->groups[g].nFields; ++j)
+				found |= (r->groups[g].fields[j] == (int)i);
+			if (!found) {
+				r->nGroups = 0;
+				snprintf(description, size, "field %s shares the size field of a reduced field: it must be reduced too", f->name);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool _parseFields(struct reduction* r, const struct json* fields) {
+	if (fields == NULL) {
+		strcpy(r->names[r->nNames++], REDUCTION_DEFAULT_FIELD);
+		return true;
+	}
+	if (fields->type != JsonArray || json_size(fields) == 0 || json_size(fields) > FORMAT_MAX_FIELDS)
+		return false;
+	for (const struct json* f = fields->child; f != NULL; f = f->next) {
+		const char* const name = json_string(f, NULL);
+		if (name == NULL || strlen(name) >= FORMAT_NAME_SIZE)
+			return false;
+		strcpy(r->names[r->nNames++], name);
+	}
+	return true;
+}
+
+static bool _parseZeroSuppression(struct reduction* r, const struct json* zs) {
+	if (zs == NULL)
+		return true;
+	const double threshold = json_number(json_get(zs, "threshold"), -1.);
+	const char* const polarity = json_string(json_get(zs, "polarity"), "both");
+	const struct json* const baseline = json_get(zs, "baseline");
+	const double baselineSamples = json_number(json_get(zs, "baseline_samples"), REDUCTION_DEFAULT_BASELINE_SAMPLES);
+	if (zs->type != JsonObject || !(threshold >= 0 && threshold <= UINT16_MAX) || !(baselineSamples >= 1 && baselineSamples <= UINT32_MAX))
+		return false;
+	if (strcmp(polarity, "both") == 0)
+		r->polarity = ReductionPolarityBoth;
+	else if (strcmp(polarity, "positive") == 0)
+		r->polarity = ReductionPolarityPositive;
+	else if (strcmp(polarity, "negative") == 0)
+		r->polarity = ReductionPolarityNegative;
+	else
+		return false;
+	if (baseline != NULL) {
+		if (baseline->type != JsonNumber || !(baseline->number >= 0 && baseline->number <= UINT16_MAX))
+			return false;
+		r->fixedBaseline = true;
+		r->baseline = (uint16_t)baseline->number;
+	}
+	r->zeroSuppression = true;
+	r->threshold = (uint16_t)threshold;
+	r->baselineSamples = (size_t)baselineSamples;
+	return true;
+}
+
+static bool _parseRoi(struct reduction* r, const struct json* roi) {
+	if (roi == NULL)
+		return true;
+	const double start = json_number(json_get(roi, "start"), 0.);
+	const double length = json_number(json_get(roi, "length"), (double)UINT32_MAX);
+	if (roi->type != JsonObject || !(start >= 0 && start <= UINT32_MAX) || !(length >= 0 && length <= UINT32_MAX))
+		return false;
+	r->roi = true;
+	r->roiStart = (size_t)start;
+	r->roiLength = (size_t)length;
+	return true;
+}
+
+int reduction_create(struct reduction** reduction, const struct format* fmt, const char* options) {
+	struct json* const root = json_parse(options);
+	if (root == NULL || root->type != JsonObject) {
+		json_free(root);
+		_setLastLocalError("invalid data reduction options: not a JSON object");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct reduction* const r = calloc(1, sizeof(*r));
+	if (r == NULL) {
+		json_free(root);
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	const double decimation = json_number(json_get(root, "decimation"), 1.);
+	bool valid = (decimation >= 1 && decimation <= UINT16_MAX);
+	r->decimation = valid ? (size_t)decimation : 1;
+	valid = valid && _parseFields(r, json_get(root, "fields"));
+	valid = valid && _parseRoi(r, json_get(root, "roi"));
+	valid = valid && _parseZeroSuppression(r, json_get(root, "zero_suppression"));
+	json_free(root);
+	if (!valid) {
+		free(r);
+		_setLastLocalError("invalid data reduction options: invalid fields, roi, zero_suppression or decimation");
+		return CAEN_FELib_InvalidParam;
+	}
+	char description[256];
+	if (!_resolve(r, fmt, description, sizeof(description))) {
+		free(r);
+		_setLastLocalError("invalid data reduction options: %s", description);
+		return CAEN_FELib_InvalidParam;
+	}
+	reduction_destroy(reduction);
+	*reduction = r;
+	ATOMIC_FETCH_ADD(&reductionCount, 1);
+	return CAEN_FELib_Success;
+}
+
+void reduction_destroy(struct reduction** reduction) {
+	struct reduction* const r = *reduction;
+	if (r == NULL)
+		return;
+	*reduction = NULL;
+	ATOMIC_FETCH_ADD(&reductionCount, (uint_fast32_t)-1);
+	free(r);
+}
+
+void reduction_getStats(const struct reduction* reduction, CAEN_FELib_ReductionStats_t* stats) {
+	stats->events = ATOMIC_LOAD_RELAXED(&reduction->events);
+	stats->samplesIn = ATOMIC_LOAD_RELAXED(&reduction->samplesIn);
+	stats->samplesOut = ATOMIC_LOAD_RELAXED(&reduction->samplesOut);
+	stats->suppressed = ATOMIC_LOAD_RELAXED(&reduction->suppressed);
+}
+
+void reduction_onFormat(struct reduction* reduction, const struct format* fmt) {
+	char description[256];
+	_resolve(reduction, fmt, description, sizeof(description));
+}
+
+static uint16_t* _samples(const struct format* fmt, const struct format_args* args, int field, size_t ch) {
+	if (fmt->fields[field].dim == 2)
+		return ((uint16_t**)args->ptr[field])[ch];
+	return args->ptr[field];
+}
+
+// true if a sample of the waveform is over threshold
+static bool _overThreshold(const struct reduction* r, const uint16_t* samples, size_t n, size_t start, size_t size) {
+	uint32_t baseline = r->baseline;
+	if (!r->fixedBaseline) {
+		const size_t nBaseline = (r->baselineSamples < n) ? r->baselineSamples : n;
+		baseline = (uint32_t)((waveform_sum(samples, nBaseline) + nBaseline / 2) / nBaseline);
+	}
+	uint16_t low = 0;
+	uint16_t high = UINT16_MAX;
+	if (r->polarity != ReductionPolarityPositive)
+		low = (baseline > r->threshold) ? (uint16_t)(baseline - r->threshold) : 0;
+	if (r->polarity != ReductionPolarityNegative)
+		high = (baseline + r->threshold < UINT16_MAX) ? (uint16_t)(baseline + r->threshold) : UINT16_MAX;
+	return waveform_findOutside(&samples[start], size, low, high) != size;
+}
+
+// in place, each sample is the rounded mean of decimation samples
+static size_t _decimate(uint16_t* samples, size_t n, size_t decimation) {
+	const size_t size = n / decimation;
+	for (size_t i = 0; i < size; ++i)
+		samples[i] = (uint16_t)((waveform_sum(&samples[i * decimation], decimation) + decimation / 2) / decimation);
+	return size;
+}
+
+static void _reduceChannel(struct reduction* r, const struct format* fmt, const struct format_args* args, const struct reduction_group* g, size_t ch) {
+	const size_t n = format_count(fmt, args, (size_t)g->fields[0], ch);
+	if (n == 0)
+		return;
+	size_t start = 0;
+	size_t size = n;
+	if (r->roi) {
+		start = (r->roiStart < n) ? r->roiStart : n;
+		size = (r->roiLength < n - start) ? r->roiLength : n - start;
+	}
+	if (r->zeroSuppression) {
+		bool keep = false;
+		for (size_t i = 0; !keep && i < g->nFields; ++i)
+			keep = _overThreshold(r, _samples(fmt, args, g->fields[i], ch), n, start, size);
+		if (!keep) {
+			size = 0;
+			ATOMIC_STORE_RELAXED(&r->suppressed, r->suppressed + 1);
+		}
+	}
+	size_t reduced = size;
+	for (size_t i = 0; size != 0 && i < g->nFields; ++i) {
+		uint16_t* const samples = _samples(fmt, args, g->fields[i], ch);
+		if (start != 0)
+			memmove(samples, &samples[start], size * sizeof(*samples));
+		if (r->decimation > 1)
+			reduced = _decimate(samples, size, r->decimation);
+	}
+	const struct format_field* const s = &fmt->fields[g->sizeField];
+	uint8_t* const sizePtr = args->ptr[g->sizeField];
+	format_storeUnsigned(sizePtr + ((s->dim == 1) ? ch * s->typeSize : 0), s->type, reduced);
+	ATOMIC_STORE_RELAXED(&r->samplesIn, r->samplesIn + n * g->nFields);
+	ATOMIC_STORE_RELAXED(&r->samplesOut, r->samplesOut + reduced * g->nFields);
+}
+
+void reduction_onEvent(struct reduction* reduction, const struct format* fmt, const struct format_args* args) {
+	if (reduction->nGroups == 0)
+		return;
+	for (size_t g = 0; g < reduction->nGroups; ++g) {
+		const struct reduction_group* const group = &reduction->groups[g];
+		const size_t nChannels = (fmt->fields[group->fields[0]].dim == 2) ? fmt->nChannels : 1;
+		for (size_t ch = 0; ch < nChannels; ++ch)
+			_reduceChannel(reduction, fmt, args, group, ch);
+	}
+	ATOMIC_STORE_RELAXED(&reduction->events, reduction->events + 1);
+}
@@ -0,0 +1,75 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		reduction.h
+*	\brief		Data reduction of waveforms
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_REDUCTION_H_
+#define CAEN_INCLUDE_REDUCTION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "format.h"
+#include "utils.h"
+
+/*
+ * Data reduction of the U16 array fields of an endpoint, applied in place on the buffers filled by
+ * the implementation library, before any other consumer: region of interest cropping, zero
+ * suppression of the waveforms of channels without samples over threshold, and N:1 decimation.
+ * The size fields are updated to the reduced sizes.
+ *
+ * Fields sharing a size field are reduced together: a channel is suppressed if none of them has a
+ * sample over threshold.
+ */
+
+// number of endpoints with data reduction
+extern uint_fast32_t reductionCount;
+
+static inline bool reduction_isActive(void) {
+	return UNLIKELY(ATOMIC_LOAD_RELAXED(&reductionCount) != 0);
+}
+
+struct reduction;
+
+// return a CAEN_FELib_ErrorCode, set last error on failure
+int reduction_create(struct reduction** reduction, const struct format* fmt, const char* options);
+void reduction_destroy(struct reduction** reduction);
+void reduction_getStats(const struct reduction* reduction, CAEN_FELib_ReductionStats_t* stats);
+
+// functions invoked on the reading thread; if the fields are not valid on a new format, events are not reduced
+void reduction_onFormat(struct reduction* reduction, const struct format* fmt);
+void reduction_onEvent(struct reduction* reduction, const struct format* fmt, const struct format_args* args);
+
+#endif /* CAEN_INCLUDE_REDUCTION_H_ */
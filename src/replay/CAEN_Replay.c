@@ -0,0 +1,975 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		CAEN_Replay.c
+*	\brief		Replay implementation library
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Replay implementation library, loaded by CAEN_FELib_Open() with URL "replay://<filename>[?<options>]",
+ * to play back files written by CAEN_FELib_StartCapture(). Absolute paths require three slashes
+ * (e.g. "replay:///data/run0.evf"). Options are a list of "<parameter>=<value>" separated by '&'.
+ *
+ * Tree:
+ * - /par/ModelName, /par/FileName, /par/Source, /par/NumEvents, /par/NumCh, /par/MaxRawDataSize,
+ *   /par/AcqStatus (read only)
+ * - /par/PlaybackTiming: "fast" (default) to serve events as fast as possible, "original" to
+ *   reproduce the timing of the capture
+ * - /par/PlaybackSpeed: time scale factor used with "original" timing (default 1)
+ * - /cmd/ArmAcquisition, /cmd/DisarmAcquisition, /cmd/SwStartAcquisition, /cmd/SwStopAcquisition,
+ *   /cmd/Reset (rewind)
+ * - /endpoint/<name>: the captured endpoint, with the last captured format as default read data format
+ *
+ * To run unmodified applications, values set on unknown nodes and unknown commands are accepted and
+ * ignored. The file is memory mapped: events are copied from the page cache to the user buffers.
+ * Fields requested with SetReadDataFormat must have been captured: they are converted to the
+ * requested type, if different.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <CAEN_FELib.h>
+
+#include "../evfile.h"
+#include "../format.h"
+#include "../utils.h"
+
+#define REPLAY_API						CAEN_FELIB_DLLAPI int CAEN_FELIB_API
+#define REPLAY_MAX_DEVICES				64
+#define REPLAY_POLL_PERIOD				UINT64_C(10000000)		// 10 ms, maximum sleep without checking the state
+
+enum node_id {
+	NodeRoot,
+	NodePar,
+	NodeParModelName,
+	NodeParFileName,
+	NodeParSource,
+	NodeParNumEvents,
+	NodeParNumCh,
+	NodeParMaxRawDataSize,
+	NodeParAcqStatus,
+	NodeParPlaybackTiming,
+	NodeParPlaybackSpeed,
+	NodeCmd,
+	NodeCmdArmAcquisition,
+	NodeCmdDisarmAcquisition,
+	NodeCmdSwStartAcquisition,
+	NodeCmdSwStopAcquisition,
+	NodeCmdReset,
+	NodeEndpoint,
+	NodeEndpointData,
+	NodeCount,
+};
+
+struct node {
+	const char*						path;				// NULL for the endpoint, that depends on the file
+	CAEN_FELib_NodeType_t			type;
+	enum node_id					parent;
+	bool							readOnly;
+};
+
+static const struct node nodes[NodeCount] = {
+	[NodeRoot]					= { "",								CAEN_FELib_DIGITIZER,	NodeRoot,		true },
+	[NodePar]					= { "/par",							CAEN_FELib_FOLDER,		NodeRoot,		true },
+	[NodeParModelName]			= { "/par/ModelName",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParFileName]			= { "/par/FileName",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParSource]				= { "/par/Source",					CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParNumEvents]			= { "/par/NumEvents",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParNumCh]				= { "/par/NumCh",					CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParMaxRawDataSize]		= { "/par/MaxRawDataSize",			CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParAcqStatus]			= { "/par/AcqStatus",				CAEN_FELib_PARAMETER,	NodePar,		true },
+	[NodeParPlaybackTiming]		= { "/par/PlaybackTiming",			CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeParPlaybackSpeed]		= { "/par/PlaybackSpeed",			CAEN_FELib_PARAMETER,	NodePar,		false },
+	[NodeCmd]					= { "/cmd",							CAEN_FELib_FOLDER,		NodeRoot,		true },
+	[NodeCmdArmAcquisition]		= { "/cmd/ArmAcquisition",			CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdDisarmAcquisition]	= { "/cmd/DisarmAcquisition",		CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdSwStartAcquisition]	= { "/cmd/SwStartAcquisition",		CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdSwStopAcquisition]	= { "/cmd/SwStopAcquisition",		CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeCmdReset]				= { "/cmd/Reset",					CAEN_FELib_COMMAND,		NodeCmd,		true },
+	[NodeEndpoint]				= { "/endpoint",					CAEN_FELib_FOLDER,		NodeRoot,		true },
+	[NodeEndpointData]			= { NULL,							CAEN_FELib_ENDPOINT,	NodeEndpoint,	true },
+};
+
+struct replay_device {
+	char							fileName[256];
+	pthread_mutex_t					mutex;
+	// file
+	const char*						map;
+	size_t							mapSize;
+	const struct evfile_header*		header;
+	const struct evfile_record**	records;			// on the map, or on chunks
+	size_t							nRecords;
+	size_t							recordsCapacity;
+	char**							chunks;				// decompressed records of compressed chunks
+	size_t							nChunks;
+	uint64_t						nEvents;
+	size_t							maxEventSize;
+	size_t							nChannels;			// of the first format
+	char							endpointPath[64];
+	// playback
+	bool							originalTiming;
+	double							speed;
+	bool							armed;
+	bool							running;
+	bool							stopPending;		// return CAEN_FELib_Stop on next read
+	size_t							next;				// next record
+	uint64_t						startTime;			// time of resume
+	uint64_t						startRecordTime;	// time of the first record served after resume
+	bool							startRecordTimeValid;
+	// formats
+	struct format					fileFormat;			// last format record
+	struct format					userFormat;
+	int								fieldMap[FORMAT_MAX_FIELDS];	// field of userFormat for each field of fileFormat, or -1
+	bool							userFormatSet;
+};
+
+static struct replay_device* devices[REPLAY_MAX_DEVICES];
+static pthread_mutex_t devicesMutex = PTHREAD_MUTEX_INITIALIZER;
+static THREAD_LOCAL char lastError[1024];
+
+// used also by format.c
+void _setLastLocalError(const char* description, ...) {
+	va_list args;
+	va_start(args, description);
+	vsnprintf(lastError, ARRAY_SIZE(lastError), description, args);
+	va_end(args);
+}
+
+static void _sleep(uint64_t ns) {
+	struct timespec ts = { .tv_sec = (time_t)(ns / UINT64_C(1000000000)), .tv_nsec = (long)(ns % UINT64_C(1000000000)) };
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+static bool _decodeHandle(uint32_t handle, struct replay_device** dev, enum node_id* node) {
+	const uint32_t index = (handle >> 16) - 1;
+	const uint32_t n = handle & UINT32_C(0xffff);
+	if (index >= REPLAY_MAX_DEVICES || n >= NodeCount)
+		return false;
+	*dev = ATOMIC_LOAD_ACQUIRE(&devices[index]);
+	*node = (enum node_id)n;
+	return *dev != NULL;
+}
+
+static int _invalidHandle(uint32_t handle) {
+	_setLastLocalError("invalid handle 0x%08"PRIx32, handle);
+	return CAEN_FELib_InvalidHandle;
+}
+
+static const char* _nodePath(const struct replay_device* dev, enum node_id node) {
+	return (node == NodeEndpointData) ? dev->endpointPath : nodes[node].path;
+}
+
+static const char* _nodeName(const struct replay_device* dev, enum node_id node) {
+	const char* const path = _nodePath(dev, node);
+	const char* const p = strrchr(path, '/');
+	return (p != NULL) ? p + 1 : path;
+}
+
+/*
+ * Resolve path relative to node. Node names are case insensitive, "." and ".." are supported.
+ * Return NodeCount if not found.
+ */
+static enum node_id _resolve(const struct replay_device* dev, enum node_id from, const char* path) {
+	char full[256];
+	char normalized[256];
+	if (path == NULL)
+		path = "";
+	if (snprintf(full, ARRAY_SIZE(full), "%s/%s", _nodePath(dev, from), path) >= (int)ARRAY_SIZE(full))
+		return NodeCount;
+	normalized[0] = '\0';
+	size_t len = 0;
+	char* saveptr;
+	for (char* token = strtok_r(full, "/", &saveptr); token != NULL; token = strtok_r(NULL, "/", &saveptr)) {
+		if (strcmp(token, ".") == 0)
+			continue;
+		if (strcmp(token, "..") == 0) {
+			char* const last = strrchr(normalized, '/');
+			if (last == NULL)
+				return NodeCount;
+			*last = '\0';
+			len = (size_t)(last - normalized);
+			continue;
+		}
+		const int n = snprintf(normalized + len, ARRAY_SIZE(normalized) - len, "/%s", token);
+		if (n < 0 || (size_t)n >= ARRAY_SIZE(normalized) - len)
+			return NodeCount;
+		len += (size_t)n;
+	}
+	for (size_t i = 0; i < NodeCount; ++i)
+		if (strcasecmp(_nodePath(dev, (enum node_id)i), normalized) == 0)
+			return (enum node_id)i;
+	return NodeCount;
+}
+
+static const struct evfile_record* _record(const struct replay_device* dev, size_t i) {
+	return dev->records[i];
+}
+
+static const void* _payload(const struct evfile_record* record) {
+	return record + 1;
+}
+
+/*
+ * Formats
+ */
+
+static int _parseFileFormat(const struct evfile_record* record, struct format* fmt) {
+	const struct evfile_format* const f = _payload(record);
+	const char* const json = (const char*)(f + 1);
+	const size_t jsonSize = record->size - sizeof(*f);
+	if (record->size < sizeof(*f) || memchr(json, '\0', jsonSize) == NULL) {
+		_setLastLocalError("corrupted format record");
+		return CAEN_FELib_GenericError;
+	}
+	const int ret = format_parse(fmt, json, f->nChannels);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	return CAEN_FELib_Success;
+}
+
+// map fields of file format to user format
+static int _updateMap(struct replay_device* dev) {
+	for (size_t i = 0; i < dev->fileFormat.nFields; ++i) {
+		const struct format_field* const f = &dev->fileFormat.fields[i];
+		const int j = format_find(&dev->userFormat, f->name);
+		if (j >= 0 && dev->userFormat.fields[j].dim != f->dim) {
+			_setLastLocalError("field %s has dim %u on file", f->name, f->dim);
+			return CAEN_FELib_InvalidParam;
+		}
+		dev->fieldMap[i] = j;
+	}
+	dev->userFormat.nChannels = dev->fileFormat.nChannels;
+	return CAEN_FELib_Success;
+}
+
+static int _setUserFormat(struct replay_device* dev, const char* json) {
+	struct format fmt;
+	int ret = format_parse(&fmt, json, dev->fileFormat.nChannels);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	for (size_t i = 0; i < fmt.nFields; ++i) {
+		if (format_find(&dev->fileFormat, fmt.fields[i].name) < 0) {
+			_setLastLocalError("field %s not captured", fmt.fields[i].name);
+			format_clear(&fmt);
+			return CAEN_FELib_InvalidParam;
+		}
+	}
+	struct format old = dev->userFormat;
+	dev->userFormat = fmt;
+	ret = _updateMap(dev);
+	if (ret != CAEN_FELib_Success) {
+		dev->userFormat = old;
+		format_clear(&fmt);
+		_updateMap(dev);
+		return ret;
+	}
+	format_clear(&old);
+	dev->userFormatSet = true;
+	return CAEN_FELib_Success;
+}
+
+// on format records: the user format is kept, if set, otherwise it follows the file
+static int _onFileFormat(struct replay_device* dev, const struct evfile_record* record) {
+	struct format fmt;
+	const int ret = _parseFileFormat(record, &fmt);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	format_clear(&dev->fileFormat);
+	dev->fileFormat = fmt;
+	if (!dev->userFormatSet) {
+		format_clear(&dev->userFormat);
+		format_parse(&dev->userFormat, fmt.json, fmt.nChannels);
+	}
+	return _updateMap(dev);
+}
+
+/*
+ * File
+ */
+
+static void _closeFile(struct replay_device* dev) {
+	if (dev->map != NULL)
+		munmap((void*)dev->map, dev->mapSize);
+	free(dev->records);
+	for (size_t i = 0; i < dev->nChunks; ++i)
+		free(dev->chunks[i]);
+	free(dev->chunks);
+	format_clear(&dev->fileFormat);
+	format_clear(&dev->userFormat);
+}
+
+static int _addRecord(struct replay_device* dev, const struct evfile_record* record) {
+	if (dev->nRecords == dev->recordsCapacity) {
+		const size_t capacity = (dev->recordsCapacity == 0) ? 1024 : dev->recordsCapacity * 2;
+		const struct evfile_record** const records = realloc(dev->records, capacity * sizeof(*records));
+		if (records == NULL) {
+			_setLastLocalError("realloc failed");
+			return CAEN_FELib_InternalError;
+		}
+		dev->records = records;
+		dev->recordsCapacity = capacity;
+	}
+	dev->records[dev->nRecords++] = record;
+	switch (record->type) {
+	case EvfileRecordEvent:
+		++dev->nEvents;
+		if (record->size > dev->maxEventSize)
+			dev->maxEventSize = record->size;
+		break;
+	case EvfileRecordFormat:
+		if (dev->fileFormat.nFields == 0) {
+			const int ret = _onFileFormat(dev, record);
+			if (ret != CAEN_FELib_Success)
+				return ret;
+			dev->nChannels = dev->fileFormat.nChannels;
+		}
+		break;
+	default:
+		break;
+	}
+	return CAEN_FELib_Success;
+}
+
+// compressed chunks are decompressed on open
+static int _addCompressed(struct replay_device* dev, const struct evfile_record* record) {
+	char** const chunks = realloc(dev->chunks, (dev->nChunks + 1) * sizeof(*chunks));
+	if (chunks == NULL) {
+		_setLastLocalError("realloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	dev->chunks = chunks;
+	size_t rawSize;
+	char* const data = evfile_decompress(record, &rawSize);
+	if (data == NULL) {
+		_setLastLocalError("cannot decompress chunk of '%s'", dev->fileName);
+		return CAEN_FELib_DeviceNotFound;
+	}
+	dev->chunks[dev->nChunks++] = data;
+	for (size_t pos = 0; rawSize - pos >= sizeof(struct evfile_record);) {
+		const struct evfile_record* const r = (const struct evfile_record*)(data + pos);
+		const size_t size = sizeof(*r) + r->size + evfile_padding(r->size);
+		if (size > rawSize - pos)
+			break;
+		const int ret = _addRecord(dev, r);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+		pos += size;
+	}
+	return CAEN_FELib_Success;
+}
+
+static int _openFile(struct replay_device* dev) {
+	const int fd = open(dev->fileName, O_RDONLY);
+	if (fd == -1) {
+		_setLastLocalError("cannot open '%s': %s", dev->fileName, strerror(errno));
+		return CAEN_FELib_DeviceNotFound;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct evfile_header)) {
+		_setLastLocalError("invalid file '%s'", dev->fileName);
+		close(fd);
+		return CAEN_FELib_DeviceNotFound;
+	}
+	dev->mapSize = (size_t)st.st_size;
+	void* const map = mmap(NULL, dev->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		_setLastLocalError("mmap failed: %s", strerror(errno));
+		return CAEN_FELib_GenericError;
+	}
+	madvise(map, dev->mapSize, MADV_SEQUENTIAL | MADV_WILLNEED);
+	dev->map = map;
+	dev->header = map;
+	if (memcmp(dev->header->magic, EVFILE_MAGIC, sizeof(EVFILE_MAGIC)) != 0 || dev->header->version != EVFILE_VERSION || dev->header->headerSize > dev->mapSize || dev->header->headerSize % EVFILE_ALIGNMENT != 0) {
+		_setLastLocalError("'%s' is not a supported event file", dev->fileName);
+		return CAEN_FELib_DeviceNotFound;
+	}
+	// index records, ignoring any truncated record at the end, and the index written on close
+	const struct evfile_chunk* chunks;
+	size_t nChunks;
+	const size_t end = evfile_findIndex(dev->map, dev->mapSize, &chunks, &nChunks);
+	size_t offset = dev->header->headerSize;
+	while (end - offset >= sizeof(struct evfile_record)) {
+		const struct evfile_record* const record = (const struct evfile_record*)(dev->map + offset);
+		const size_t size = sizeof(*record) + record->size + evfile_padding(record->size);
+		if (size > end - offset)
+			break;
+		const int ret = (record->type == EvfileRecordCompressed) ? _addCompressed(dev, record) : _addRecord(dev, record);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+		offset += size;
+	}
+	if (dev->fileFormat.nFields == 0) {
+		_setLastLocalError("no format found on '%s'", dev->fileName);
+		return CAEN_FELib_DeviceNotFound;
+	}
+	const char* const endpoint = strrchr(dev->header->endpoint, '/');
+	snprintf(dev->endpointPath, ARRAY_SIZE(dev->endpointPath), "/endpoint/%s", (endpoint != NULL && endpoint[1] != '\0') ? endpoint + 1 : "data");
+	return CAEN_FELib_Success;
+}
+
+/*
+ * Playback
+ */
+
+static void _rewind(struct replay_device* dev) {
+	dev->next = 0;
+	dev->running = false;
+	dev->stopPending = false;
+	if (dev->nRecords != 0 && _record(dev, 0)->type == EvfileRecordFormat)
+		_onFileFormat(dev, _record(dev, 0));
+}
+
+static void _resume(struct replay_device* dev) {
+	if (dev->next == dev->nRecords)
+		_rewind(dev);
+	dev->running = true;
+	dev->stopPending = false;
+	dev->startTime = utils_now();
+	dev->startRecordTimeValid = false;
+}
+
+static void _stop(struct replay_device* dev) {
+	if (!dev->running)
+		return;
+	dev->running = false;
+	dev->stopPending = true;
+}
+
+/*
+ * Wait for the next event, with timeout in milliseconds (negative means infinite).
+ * Format records are processed. Return with mutex locked and, on success, dev->next
+ * pointing to an event.
+ */
+static int _waitEvent(struct replay_device* dev, int timeout) {
+	const uint64_t deadline = (timeout < 0) ? UINT64_MAX : utils_now() + (uint64_t)timeout * UINT64_C(1000000);
+	pthread_mutex_lock(&dev->mutex);
+	for (;;) {
+		if (dev->stopPending)
+			return CAEN_FELib_Stop;
+		const uint64_t now = utils_now();
+		uint64_t wait = UINT64_MAX;
+		if (dev->running) {
+			if (dev->next == dev->nRecords) {
+				// end of file
+				dev->running = false;
+				return CAEN_FELib_Stop;
+			}
+			const struct evfile_record* const record = _record(dev, dev->next);
+			switch (record->type) {
+			case EvfileRecordFormat: {
+				const int ret = _onFileFormat(dev, record);
+				if (ret != CAEN_FELib_Success)
+					return ret;
+				++dev->next;
+				continue;
+			}
+			case EvfileRecordStop:
+				++dev->next;
+				dev->running = false;
+				return CAEN_FELib_Stop;
+			case EvfileRecordEvent:
+				if (!dev->originalTiming)
+					return CAEN_FELib_Success;
+				if (!dev->startRecordTimeValid) {
+					dev->startRecordTime = record->time;
+					dev->startRecordTimeValid = true;
+				}
+				const uint64_t due = dev->startTime + (uint64_t)((double)(record->time - dev->startRecordTime) / dev->speed);
+				if (now >= due)
+					return CAEN_FELib_Success;
+				wait = due - now;
+				break;
+			default:
+				++dev->next;
+				continue;
+			}
+		}
+		if (now >= deadline) {
+			_setLastLocalError("timeout");
+			return CAEN_FELib_Timeout;
+		}
+		if (deadline - now < wait)
+			wait = deadline - now;
+		if (wait > REPLAY_POLL_PERIOD)
+			wait = REPLAY_POLL_PERIOD;
+		pthread_mutex_unlock(&dev->mutex);
+		_sleep(wait);
+		pthread_mutex_lock(&dev->mutex);
+	}
+}
+
+/*
+ * Parameters
+ */
+
+static int _getParameter(struct replay_device* dev, enum node_id node, char value[256]) {
+	const size_t size = 256;
+	switch (node) {
+	case NodeParModelName:			snprintf(value, size, "Replay"); break;
+	case NodeParFileName:			snprintf(value, size, "%s", dev->fileName); break;
+	case NodeParSource:				snprintf(value, size, "%s", dev->header->source); break;
+	case NodeParNumEvents:			snprintf(value, size, "%"PRIu64, dev->nEvents); break;
+	case NodeParNumCh:				snprintf(value, size, "%zu", dev->nChannels); break;
+	case NodeParMaxRawDataSize:		snprintf(value, size, "%zu", dev->maxEventSize); break;
+	case NodeParAcqStatus:			snprintf(value, size, "%s", dev->running ? "running" : dev->armed ? "armed" : "idle"); break;
+	case NodeParPlaybackTiming:		snprintf(value, size, "%s", dev->originalTiming ? "original" : "fast"); break;
+	case NodeParPlaybackSpeed:		snprintf(value, size, "%g", dev->speed); break;
+	default:
+		_setLastLocalError("node %s is not a parameter", _nodePath(dev, node));
+		return CAEN_FELib_InvalidParam;
+	}
+	return CAEN_FELib_Success;
+}
+
+static int _setParameter(struct replay_device* dev, enum node_id node, const char* value) {
+	switch (node) {
+	case NodeParPlaybackTiming:
+		if (strcasecmp(value, "original") == 0) {
+			dev->originalTiming = true;
+		} else if (strcasecmp(value, "fast") == 0) {
+			dev->originalTiming = false;
+		} else {
+			_setLastLocalError("invalid value '%s' for %s", value, nodes[node].path);
+			return CAEN_FELib_InvalidParam;
+		}
+		dev->startTime = utils_now();
+		dev->startRecordTimeValid = false;
+		return CAEN_FELib_Success;
+	case NodeParPlaybackSpeed: {
+		char* end;
+		const double v = strtod(value, &end);
+		if (end == value || *end != '\0' || !(v > 0.)) {
+			_setLastLocalError("invalid value '%s' for %s", value, nodes[node].path);
+			return CAEN_FELib_InvalidParam;
+		}
+		dev->speed = v;
+		dev->startTime = utils_now();
+		dev->startRecordTimeValid = false;
+		return CAEN_FELib_Success;
+	}
+	default:
+		_setLastLocalError("node %s is not a writable parameter", _nodePath(dev, node));
+		return CAEN_FELib_InvalidParam;
+	}
+}
+
+static void _freeDevice(struct replay_device* dev) {
+	_closeFile(dev);
+	pthread_mutex_destroy(&dev->mutex);
+	free(dev);
+}
+
+static int _applyOptions(struct replay_device* dev, char* options) {
+	char* saveptr;
+	for (char* token = strtok_r(options, "&", &saveptr); token != NULL; token = strtok_r(NULL, "&", &saveptr)) {
+		char* const value = strchr(token, '=');
+		if (value == NULL) {
+			_setLastLocalError("invalid option '%s'", token);
+			return CAEN_FELib_InvalidParam;
+		}
+		*value = '\0';
+		const enum node_id node = _resolve(dev, NodePar, token);
+		if (node == NodeCount) {
+			_setLastLocalError("unknown option '%s'", token);
+			return CAEN_FELib_InvalidParam;
+		}
+		const int ret = _setParameter(dev, node, value + 1);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+	}
+	return CAEN_FELib_Success;
+}
+
+/*
+ * API
+ */
+
+REPLAY_API CAENReplay_GetLibInfo(char* jsonString, size_t size) {
+	const int ret = snprintf(jsonString, size, "{\"name\":\"CAEN Replay\",\"version\":\"%s\"}", CAEN_FELIB_VERSION_STRING);
+	return (ret < 0) ? CAEN_FELib_InternalError : ret;
+}
+
+REPLAY_API CAENReplay_GetLibVersion(char version[16]) {
+	version[0] = '\0';
+	strncat(version, CAEN_FELIB_VERSION_STRING, 16 - 1);
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_GetLastError(char description[1024]) {
+	strncpy(description, lastError, 1024);
+	description[1024 - 1] = '\0';
+	lastError[0] = '\0';
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_DevicesDiscovery(char* jsonString, size_t size, int timeout) {
+	// files cannot be discovered
+	(void)timeout;
+	const int ret = snprintf(jsonString, size, "[]");
+	return (ret < 0) ? CAEN_FELib_InternalError : CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_Open(const char* path, uint32_t* handle) {
+	if (path == NULL || handle == NULL) {
+		_setLastLocalError("invalid argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	struct replay_device* const dev = calloc(1, sizeof(*dev));
+	if (dev == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	pthread_mutex_init(&dev->mutex, NULL);
+	dev->speed = 1.;
+	char arg[512];
+	snprintf(arg, ARRAY_SIZE(arg), "%s", path);
+	char* const options = strchr(arg, '?');
+	if (options != NULL)
+		*options = '\0';
+	if (strlen(arg) >= ARRAY_SIZE(dev->fileName)) {
+		_setLastLocalError("file name too long");
+		_freeDevice(dev);
+		return CAEN_FELib_InvalidParam;
+	}
+	strcpy(dev->fileName, arg);
+	int ret = _openFile(dev);
+	if (ret == CAEN_FELib_Success && options != NULL)
+		ret = _applyOptions(dev, options + 1);
+	if (ret != CAEN_FELib_Success) {
+		_freeDevice(dev);
+		return ret;
+	}
+	_rewind(dev);
+	pthread_mutex_lock(&devicesMutex);
+	size_t i;
+	for (i = 0; i < REPLAY_MAX_DEVICES; ++i)
+		if (devices[i] == NULL)
+			break;
+	if (i == REPLAY_MAX_DEVICES) {
+		pthread_mutex_unlock(&devicesMutex);
+		_freeDevice(dev);
+		_setLastLocalError("too many devices (limited to %d)", REPLAY_MAX_DEVICES);
+		return CAEN_FELib_MaxDevicesError;
+	}
+	ATOMIC_STORE_RELEASE(&devices[i], dev);
+	pthread_mutex_unlock(&devicesMutex);
+	*handle = (uint32_t)((i + 1) << 16) | NodeRoot;
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_Close(uint32_t handle) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	pthread_mutex_lock(&devicesMutex);
+	devices[(handle >> 16) - 1] = NULL;
+	pthread_mutex_unlock(&devicesMutex);
+	_freeDevice(dev);
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_GetDeviceTree(uint32_t handle, char* jsonString, size_t size) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	// flat representation: an object per node
+	size_t len = 0;
+	char tmp[1];
+	for (size_t i = 0; i < NodeCount; ++i) {
+		char value[256] = "";
+		if (nodes[i].type == CAEN_FELib_PARAMETER) {
+			pthread_mutex_lock(&dev->mutex);
+			_getParameter(dev, (enum node_id)i, value);
+			pthread_mutex_unlock(&dev->mutex);
+		}
+		char* const p = (len < size) ? jsonString + len : tmp;
+		const size_t s = (len < size) ? size - len : 0;
+		const int n = snprintf(p, s, "%s{\"path\":\"%s\",\"type\":%d,\"readonly\":%s,\"value\":\"%s\"}%s",
+			(i == 0) ? "[" : "",
+			(i == 0) ? "/" : _nodePath(dev, (enum node_id)i),
+			(int)nodes[i].type,
+			nodes[i].readOnly ? "true" : "false",
+			value,
+			(i == NodeCount - 1) ? "]" : ","
+		);
+		if (n < 0)
+			return CAEN_FELib_InternalError;
+		len += (size_t)n;
+	}
+	return (int)len;
+}
+
+REPLAY_API CAENReplay_GetChildHandles(uint32_t handle, const char* path, uint32_t* handles, size_t size) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	const enum node_id parent = _resolve(dev, node, path);
+	if (parent == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	size_t n = 0;
+	for (size_t i = 1; i < NodeCount; ++i) {
+		if (nodes[i].parent != parent)
+			continue;
+		if (n < size)
+			handles[n] = (handle & UINT32_C(0xffff0000)) | (uint32_t)i;
+		++n;
+	}
+	return (int)n;
+}
+
+REPLAY_API CAENReplay_GetHandle(uint32_t handle, const char* path, uint32_t* pathHandle) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	const enum node_id target = _resolve(dev, node, path);
+	if (target == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	*pathHandle = (handle & UINT32_C(0xffff0000)) | (uint32_t)target;
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_GetParentHandle(uint32_t handle, const char* path, uint32_t* parentHandle) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	const enum node_id target = _resolve(dev, node, path);
+	if (target == NodeCount || target == NodeRoot) {
+		_setLastLocalError("node %s not found or has no parent", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	*parentHandle = (handle & UINT32_C(0xffff0000)) | (uint32_t)nodes[target].parent;
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_GetPath(uint32_t handle, char path[256]) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	snprintf(path, 256, "%s", (node == NodeRoot) ? "/" : _nodePath(dev, node));
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_GetNodeProperties(uint32_t handle, const char* path, char name[32], CAEN_FELib_NodeType_t* type) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	const enum node_id target = _resolve(dev, node, path);
+	if (target == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	// names longer than the API buffer are truncated, as by the captured device
+	if (name != NULL && snprintf(name, 32, "%s", _nodeName(dev, target)) < 0)
+		return CAEN_FELib_InternalError;
+	if (type != NULL)
+		*type = nodes[target].type;
+	return CAEN_FELib_Success;
+}
+
+REPLAY_API CAENReplay_GetValue(uint32_t handle, const char* path, char value[256]) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	const enum node_id target = _resolve(dev, node, path);
+	if (target == NodeCount) {
+		_setLastLocalError("node %s not found", path);
+		return CAEN_FELib_InvalidParam;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	const int ret = _getParameter(dev, target, value);
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+REPLAY_API CAENReplay_SetValue(uint32_t handle, const char* path, const char* value) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	if (value == NULL) {
+		_setLastLocalError("invalid argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	const enum node_id target = _resolve(dev, node, path);
+	if (target == NodeCount)
+		return CAEN_FELib_Success; // ignored, see file description
+	pthread_mutex_lock(&dev->mutex);
+	const int ret = _setParameter(dev, target, value);
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+REPLAY_API CAENReplay_SendCommand(uint32_t handle, const char* path) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	const enum node_id target = _resolve(dev, node, path);
+	int ret = CAEN_FELib_Success;
+	pthread_mutex_lock(&dev->mutex);
+	switch (target) {
+	case NodeCmdArmAcquisition:
+		dev->armed = true;
+		break;
+	case NodeCmdDisarmAcquisition:
+		_stop(dev);
+		dev->armed = false;
+		break;
+	case NodeCmdSwStartAcquisition:
+		if (!dev->armed || dev->running) {
+			_setLastLocalError("acquisition not armed or already running");
+			ret = CAEN_FELib_CommandError;
+			break;
+		}
+		_resume(dev);
+		break;
+	case NodeCmdSwStopAcquisition:
+		_stop(dev);
+		break;
+	case NodeCmdReset:
+		dev->armed = false;
+		_rewind(dev);
+		break;
+	default:
+		break; // ignored, see file description
+	}
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+REPLAY_API CAENReplay_GetUserRegister(uint32_t handle, uint32_t address, uint32_t* value) {
+	(void)handle;
+	(void)address;
+	(void)value;
+	_setLastLocalError("registers are not captured");
+	return CAEN_FELib_NotImplemented;
+}
+
+REPLAY_API CAENReplay_SetUserRegister(uint32_t handle, uint32_t address, uint32_t value) {
+	(void)handle;
+	(void)address;
+	(void)value;
+	_setLastLocalError("registers are not captured");
+	return CAEN_FELib_NotImplemented;
+}
+
+REPLAY_API CAENReplay_SetReadDataFormat(uint32_t handle, const char* jsonString) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	if (node != NodeEndpointData) {
+		_setLastLocalError("node %s is not an endpoint", _nodePath(dev, node));
+		return CAEN_FELib_InvalidHandle;
+	}
+	pthread_mutex_lock(&dev->mutex);
+	const int ret = _setUserFormat(dev, jsonString);
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+REPLAY_API CAENReplay_ReadDataV(uint32_t handle, int timeout, va_list args) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	if (node != NodeEndpointData) {
+		_setLastLocalError("node %s is not an endpoint", _nodePath(dev, node));
+		return CAEN_FELib_InvalidHandle;
+	}
+	int ret = _waitEvent(dev, timeout);
+	switch (ret) {
+	case CAEN_FELib_Success: {
+		const struct evfile_record* const record = _record(dev, dev->next);
+		struct format_args fargs;
+		format_getArgs(&dev->userFormat, args, &fargs);
+		if (!evfile_unpack(&dev->fileFormat, _payload(record), record->size, dev->fieldMap, &dev->userFormat, &fargs)) {
+			_setLastLocalError("corrupted event %zu", dev->next);
+			ret = CAEN_FELib_GenericError;
+		}
+		++dev->next;
+		break;
+	}
+	case CAEN_FELib_Stop:
+		dev->stopPending = false;
+		_setLastLocalError("stop");
+		break;
+	default:
+		break;
+	}
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
+
+REPLAY_API CAENReplay_HasData(uint32_t handle, int timeout) {
+	struct replay_device* dev;
+	enum node_id node;
+	if (!_decodeHandle(handle, &dev, &node))
+		return _invalidHandle(handle);
+	if (node != NodeEndpointData) {
+		_setLastLocalError("node %s is not an endpoint", _nodePath(dev, node));
+		return CAEN_FELib_InvalidHandle;
+	}
+	const int ret = _waitEvent(dev, timeout);
+	if (ret == CAEN_FELib_Stop) {
+		dev->stopPending = false;
+		_setLastLocalError("stop");
+	}
+	pthread_mutex_unlock(&dev->mutex);
+	return ret;
+}
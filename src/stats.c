@@ -0,0 +1,228 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		stats.c
+*	\brief		Live statistics on shared memory
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "stats.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h> // O_* constants
+#include <sys/mman.h> // shm_open, mmap
+#include <unistd.h> // ftruncate, getpid
+#endif
+
+#define STATS_CAPACITY				1024
+#define STATS_NAME_SIZE				64
+
+STATIC_ASSERT(sizeof(CAEN_FELib_StatsHeader_t) % CACHE_LINE_SIZE == 0, invalid_stats_header_size);
+STATIC_ASSERT(sizeof(CAEN_FELib_StatsEntry_t) % CACHE_LINE_SIZE == 0, invalid_stats_entry_size);	// no false sharing between endpoints
+
+bool statsActive;
+uint_fast32_t statsGeneration;
+
+static CAEN_FELib_StatsHeader_t* statsHeader;
+static CAEN_FELib_StatsEntry_t* statsEntries;
+static size_t statsSize;
+static char statsName[STATS_NAME_SIZE];
+static mutex_t statsMutex = MUTEX_INITIALIZER;
+
+#ifndef _WIN32
+
+static void _unmap(void) {
+	munmap(statsHeader, statsSize);
+	shm_unlink(statsName);
+	statsHeader = NULL;
+	statsEntries = NULL;
+	statsActive = false;
+	++statsGeneration;
+}
+
+int stats_enable(const char* name) {
+	char defaultName[STATS_NAME_SIZE];
+	if (name == NULL) {
+		snprintf(defaultName, ARRAY_SIZE(defaultName), "/caen_felib.%ld", (long)getpid());
+		name = defaultName;
+	}
+	if (name[0] != '/' || strlen(name) >= ARRAY_SIZE(statsName)) {
+		_setLastLocalError("invalid shared memory name '%s'", name);
+		return CAEN_FELib_InvalidParam;
+	}
+	if (statsHeader != NULL)
+		_unmap();
+	const size_t size = sizeof(CAEN_FELib_StatsHeader_t) + STATS_CAPACITY * sizeof(CAEN_FELib_StatsEntry_t);
+	const int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd == -1) {
+		_setLastLocalError("shm_open failed: %s", strerror(errno));
+		return CAEN_FELib_GenericError;
+	}
+	if (ftruncate(fd, (off_t)size) == -1) {
+		_setLastLocalError("ftruncate failed: %s", strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return CAEN_FELib_GenericError;
+	}
+	void* const p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		_setLastLocalError("mmap failed: %s", strerror(errno));
+		shm_unlink(name);
+		return CAEN_FELib_GenericError;
+	}
+	// ftruncate fills the segment with zeros
+	statsHeader = p;
+	statsEntries = (CAEN_FELib_StatsEntry_t*)(statsHeader + 1);
+	statsSize = size;
+	// length checked above
+	memcpy(statsName, name, strlen(name) + 1);
+	statsHeader->version = CAEN_FELIB_STATS_VERSION;
+	statsHeader->headerSize = sizeof(CAEN_FELib_StatsHeader_t);
+	statsHeader->entrySize = sizeof(CAEN_FELib_StatsEntry_t);
+	statsHeader->capacity = STATS_CAPACITY;
+	statsHeader->pid = (int64_t)getpid();
+	statsHeader->creationTime = utils_realtime();
+	// magic is written last, monitors can wait for it
+	ATOMIC_STORE_RELEASE(&statsHeader->magic, CAEN_FELIB_STATS_MAGIC);
+	++statsGeneration;
+	statsActive = true;
+	return CAEN_FELib_Success;
+}
+
+int stats_disable(void) {
+	if (statsHeader != NULL)
+		_unmap();
+	return CAEN_FELib_Success;
+}
+
+CAEN_FELib_StatsEntry_t* stats_newEntry(uint64_t handle, const char* name) {
+	CAEN_FELib_StatsEntry_t* entry = NULL;
+	mutex_lock(&statsMutex);
+	const uint32_t used = statsHeader->used;
+	if (used < statsHeader->capacity) {
+		entry = &statsEntries[used];
+		entry->handle = handle;
+		entry->flags = 1;
+		entry->name[0] = '\0';
+		strncat(entry->name, name, ARRAY_SIZE(entry->name) - 1);
+		ATOMIC_STORE_RELEASE(&statsHeader->used, used + 1);
+	}
+	mutex_unlock(&statsMutex);
+	return entry;
+}
+
+/*
+ * Sequence lock, single writer: counters are written with plain stores by the
+ * reading thread, that owns the entry. No atomic read-modify-write is required.
+ */
+static void _writeBegin(CAEN_FELib_StatsEntry_t* entry) {
+	ATOMIC_STORE_RELAXED(&entry->seq, entry->seq + 1);
+	ATOMIC_FENCE_RELEASE();
+}
+
+static void _writeEnd(CAEN_FELib_StatsEntry_t* entry) {
+	ATOMIC_STORE_RELEASE(&entry->seq, entry->seq + 1);
+}
+
+static void _countError(CAEN_FELib_StatsEntry_t* entry, int ret) {
+	switch (ret) {
+	case CAEN_FELib_Timeout:
+	case CAEN_FELib_Interrupted: // no event, but not an error
+		++entry->timeouts;
+		break;
+	case CAEN_FELib_Stop:
+		++entry->stops;
+		break;
+	default:
+		++entry->errors;
+		break;
+	}
+}
+
+void stats_onReadData(CAEN_FELib_StatsEntry_t* entry, int ret, size_t bytes) {
+	if (entry == NULL)
+		return;
+	const uint64_t now = (ret == CAEN_FELib_Success) ? utils_realtime() : 0;
+	_writeBegin(entry);
+	if (ret == CAEN_FELib_Success) {
+		++entry->readData;
+		entry->bytes += bytes;
+		entry->lastEventTime = now;
+	} else {
+		_countError(entry, ret);
+	}
+	_writeEnd(entry);
+}
+
+void stats_onHasData(CAEN_FELib_StatsEntry_t* entry, int ret) {
+	if (entry == NULL)
+		return;
+	_writeBegin(entry);
+	if (ret == CAEN_FELib_Success)
+		++entry->hasData;
+	else
+		_countError(entry, ret);
+	_writeEnd(entry);
+}
+
+void stats_onClose(CAEN_FELib_StatsEntry_t* entry) {
+	if (entry == NULL)
+		return;
+	_writeBegin(entry);
+	entry->flags &= ~UINT32_C(1);
+	_writeEnd(entry);
+}
+
+#else
+
+int stats_enable(const char* name) {
+	_setLastLocalError("statistics not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+int stats_disable(void) {
+	return CAEN_FELib_Success;
+}
+
+CAEN_FELib_StatsEntry_t* stats_newEntry(uint64_t handle, const char* name) {
+	return NULL;
+}
+
+void stats_onReadData(CAEN_FELib_StatsEntry_t* entry, int ret, size_t bytes) {}
+void stats_onHasData(CAEN_FELib_StatsEntry_t* entry, int ret) {}
+void stats_onClose(CAEN_FELib_StatsEntry_t* entry) {}
+
+#endif
@@ -0,0 +1,67 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		stats.h
+*	\brief		Live statistics on shared memory
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_STATS_H_
+#define CAEN_INCLUDE_STATS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "utils.h"
+
+// true if the shared memory segment is mapped
+extern bool statsActive;
+
+// incremented every time the segment is replaced, to invalidate cached entries
+extern uint_fast32_t statsGeneration;
+
+static inline bool stats_isActive(void) {
+	return UNLIKELY(statsActive);
+}
+
+int stats_enable(const char* name);
+int stats_disable(void);
+
+// return NULL if the segment is full
+CAEN_FELib_StatsEntry_t* stats_newEntry(uint64_t handle, const char* name);
+
+void stats_onReadData(CAEN_FELib_StatsEntry_t* entry, int ret, size_t bytes);
+void stats_onHasData(CAEN_FELib_StatsEntry_t* entry, int ret);
+void stats_onClose(CAEN_FELib_StatsEntry_t* entry);
+
+#endif /* CAEN_INCLUDE_STATS_H_ */
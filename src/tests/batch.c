@@ -0,0 +1,206 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		batch.c
+*	\brief		Check of the Arrow arrays of columnar reads
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of the Arrow arrays exported by CAEN_FELib_ReadBatch(): schema of each field, buffers
+ * of each node, and values, compared with the events read with CAEN_FELib_ReadData() from a
+ * second mock device, whose events are the same.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"},{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]"
+#define MOCK_OPTIONS					"MaxEvents=100&NumCh=2&RecordLengthS=16"
+#define N_EVENTS						100
+#define N_CHANNELS						2
+#define RECORD_LENGTH					16
+#define CAPACITY						32
+
+struct event {
+	uint64_t						timestamp;
+	uint32_t						triggerId;
+	uint16_t						waveform[N_CHANNELS][RECORD_LENGTH];
+	size_t							waveformSize[N_CHANNELS];
+};
+
+static int _checkSchema(const struct ArrowSchema* schema, const char* name, const char* format, int64_t nChildren) {
+	TESTS_CHECK(schema->release != NULL);
+	TESTS_CHECK(strcmp(schema->name, name) == 0);
+	TESTS_CHECK(strcmp(schema->format, format) == 0);
+	TESTS_CHECK(schema->n_children == nChildren);
+	return 0;
+}
+
+static int _checkSchemas(const struct ArrowSchema* s, int fixed) {
+	const char* const sizeFormat = (sizeof(size_t) == 8) ? "L" : "I";
+	if (_checkSchema(s, "", "+s", 4) != 0)
+		return 1;
+	if (_checkSchema(s->children[0], "TIMESTAMP", "L", 0) != 0)
+		return 1;
+	if (_checkSchema(s->children[1], "TRIGGER_ID", "I", 0) != 0)
+		return 1;
+	// a list per channel
+	if (_checkSchema(s->children[2], "WAVEFORM", "+w:2", 1) != 0)
+		return 1;
+	if (_checkSchema(s->children[2]->children[0], "item", fixed ? "+w:16" : "+l", 1) != 0)
+		return 1;
+	if (_checkSchema(s->children[2]->children[0]->children[0], "item", "S", 0) != 0)
+		return 1;
+	// an element per channel
+	if (_checkSchema(s->children[3], "WAVEFORM_SIZE", "+w:2", 1) != 0)
+		return 1;
+	if (_checkSchema(s->children[3]->children[0], "item", sizeFormat, 0) != 0)
+		return 1;
+	return 0;
+}
+
+static int _checkNode(const struct ArrowArray* array, int64_t length, int64_t nBuffers, int64_t nChildren) {
+	TESTS_CHECK(array->release != NULL);
+	TESTS_CHECK(array->length == length);
+	TESTS_CHECK(array->null_count == 0);
+	TESTS_CHECK(array->offset == 0);
+	TESTS_CHECK(array->n_buffers == nBuffers);
+	TESTS_CHECK(array->n_children == nChildren);
+	// events have no null values
+	TESTS_CHECK(array->buffers[0] == NULL);
+	return 0;
+}
+
+// check the array of rows events against the reference events starting from first
+static int _checkArray(const struct ArrowArray* a, const struct event* events, size_t first, int64_t rows, int fixed) {
+	const int64_t nWaves = rows * N_CHANNELS;
+	if (_checkNode(a, rows, 1, 4) != 0)
+		return 1;
+	const struct ArrowArray* const timestamp = a->children[0];
+	const struct ArrowArray* const triggerId = a->children[1];
+	const struct ArrowArray* const waveform = a->children[2];
+	const struct ArrowArray* const waveformSize = a->children[3];
+	if (_checkNode(timestamp, rows, 2, 0) != 0 || _checkNode(triggerId, rows, 2, 0) != 0)
+		return 1;
+	if (_checkNode(waveform, rows, 1, 1) != 0)
+		return 1;
+	if (_checkNode(waveform->children[0], nWaves, fixed ? 1 : 2, 1) != 0)
+		return 1;
+	if (_checkNode(waveform->children[0]->children[0], nWaves * RECORD_LENGTH, 2, 0) != 0)
+		return 1;
+	if (_checkNode(waveformSize, rows, 1, 1) != 0 || _checkNode(waveformSize->children[0], nWaves, 2, 0) != 0)
+		return 1;
+	const uint64_t* const timestamps = timestamp->buffers[1];
+	const uint32_t* const triggerIds = triggerId->buffers[1];
+	const int32_t* const offsets = fixed ? NULL : waveform->children[0]->buffers[1];
+	const uint16_t* const samples = waveform->children[0]->children[0]->buffers[1];
+	const size_t* const sizes = waveformSize->children[0]->buffers[1];
+	for (int64_t i = 0; i < rows; ++i) {
+		const struct event* const e = &events[first + (size_t)i];
+		TESTS_CHECK(timestamps[i] == e->timestamp);
+		TESTS_CHECK(triggerIds[i] == e->triggerId);
+		for (size_t ch = 0; ch < N_CHANNELS; ++ch) {
+			const size_t w = (size_t)i * N_CHANNELS + ch;
+			TESTS_CHECK(sizes[w] == e->waveformSize[ch]);
+			if (offsets != NULL) {
+				TESTS_CHECK(offsets[w] == (int32_t)(w * RECORD_LENGTH));
+				TESTS_CHECK(offsets[w + 1] == (int32_t)((w + 1) * RECORD_LENGTH));
+			}
+			TESTS_CHECK(memcmp(&samples[w * RECORD_LENGTH], e->waveform[ch], sizeof(e->waveform[ch])) == 0);
+		}
+	}
+	return 0;
+}
+
+// read the reference events with CAEN_FELib_ReadData
+static int _readEvents(struct event* events) {
+	uint64_t dev;
+	uint64_t ep;
+	TESTS_CHECK_RET(tests_startMock(MOCK_OPTIONS, &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	for (size_t i = 0; i < N_EVENTS; ++i) {
+		uint16_t* waveform[N_CHANNELS];
+		for (size_t ch = 0; ch < N_CHANNELS; ++ch)
+			waveform[ch] = events[i].waveform[ch];
+		TESTS_CHECK_RET(CAEN_FELib_ReadData(ep, 1000, &events[i].timestamp, &events[i].triggerId, waveform, events[i].waveformSize));
+	}
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+static int _checkBatch(const struct event* events, int fixed) {
+	uint64_t dev;
+	uint64_t ep;
+	CAEN_FELib_Batch_t* batch;
+	TESTS_CHECK_RET(tests_startMock(MOCK_OPTIONS, &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_CreateBatch(ep, CAPACITY, fixed ? "{\"lists\":\"fixed\"}" : NULL, &batch));
+	size_t total = 0;
+	for (;;) {
+		struct ArrowArray array;
+		struct ArrowSchema schema;
+		const int ret = CAEN_FELib_ReadBatch(batch, 1000, &array, &schema);
+		if (ret == CAEN_FELib_Stop)
+			break;
+		TESTS_CHECK(ret == CAEN_FELib_Success);
+		// full batches, then the tail of the run
+		const int64_t rows = (N_EVENTS - total < CAPACITY) ? (int64_t)(N_EVENTS - total) : CAPACITY;
+		if (_checkSchemas(&schema, fixed) != 0 || _checkArray(&array, events, total, rows, fixed) != 0)
+			return 1;
+		total += (size_t)array.length;
+		array.release(&array);
+		TESTS_CHECK(array.release == NULL);
+		schema.release(&schema);
+		TESTS_CHECK(schema.release == NULL);
+	}
+	TESTS_CHECK(total == N_EVENTS);
+	TESTS_CHECK_RET(CAEN_FELib_DestroyBatch(batch));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+int main(void) {
+	static struct event events[N_EVENTS];
+	if (_readEvents(events) != 0)
+		return 1;
+	if (_checkBatch(events, 0) != 0)
+		return 1;
+	if (_checkBatch(events, 1) != 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,267 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		bench.c
+*	\brief		Benchmark of the dispatcher on the mock
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Benchmark of the dispatcher against the mock implementation library, run by "make check".
+ *
+ * Prints one line per figure of merit, "<name> <value> <unit>":
+ * - overhead of the dispatcher per call, as difference between CAEN_FELib_GetUserRegister() and
+ *   the same function of the mock invoked directly, round robin on several connections; with
+ *   warm caches (mean) and after evicting the caches before each call (median), where the
+ *   dependent loads of the dispatch, from the handle to the function pointer, are misses
+ * - throughput of CAEN_FELib_ReadData() on the RAW endpoint, in events/s and bytes/s
+ * - latency of CAEN_FELib_Open() followed by CAEN_FELib_Close()
+ * - duration of CAEN_FELib_DevicesDiscovery() with only the mock found, if CAEN_FELIB_TEST_LIBDIR
+ *   is set to the directory of libCAEN_Mock
+ *
+ * The optional argument scales the number of iterations (default 1). The figures are not
+ * compared with any threshold: the program fails only if a call fails.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include "tests.h"
+#include "../utils.h"
+
+#define BENCH_CONNECTIONS				16
+#define BENCH_EVICT_SIZE				(64 << 20)	// larger than last level caches
+
+typedef int (*fpMockOpen_t)(const char* url, uint32_t* handle);
+typedef int (*fpMockClose_t)(uint32_t handle);
+typedef int (*fpMockGetUserRegister_t)(uint32_t handle, uint32_t address, uint32_t* value);
+
+static int _compareU64(const void* a, const void* b) {
+	const uint64_t x = *(const uint64_t*)a;
+	const uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static void _evictCaches(volatile uint8_t* buffer) {
+	for (size_t i = 0; i < BENCH_EVICT_SIZE; i += 64)
+		buffer[i]++;
+}
+
+static int _benchDispatcher(unsigned scale) {
+	const size_t n = 1000000 * scale;
+	const size_t nCold = 64 * scale;
+	void* const dl = dlopen("libCAEN_Mock.so", RTLD_NOW);
+	TESTS_CHECK(dl != NULL);
+	const fpMockOpen_t mockOpen = (fpMockOpen_t)dlsym(dl, "CAENMock_Open");
+	const fpMockClose_t mockClose = (fpMockClose_t)dlsym(dl, "CAENMock_Close");
+	const fpMockGetUserRegister_t mockGetUserRegister = (fpMockGetUserRegister_t)dlsym(dl, "CAENMock_GetUserRegister");
+	TESTS_CHECK(mockOpen != NULL && mockClose != NULL && mockGetUserRegister != NULL);
+
+	uint32_t rh[BENCH_CONNECTIONS];
+	uint64_t dev[BENCH_CONNECTIONS];
+	uint32_t value;
+	for (size_t i = 0; i < BENCH_CONNECTIONS; ++i) {
+		TESTS_CHECK_RET(mockOpen("bench", &rh[i]));
+		TESTS_CHECK_RET(CAEN_FELib_Open("mock://bench", &dev[i]));
+	}
+
+	// warm-up, then direct and dispatched calls on the same code of the mock
+	for (size_t i = 0; i < n / 10; ++i) {
+		TESTS_CHECK_RET(mockGetUserRegister(rh[i % BENCH_CONNECTIONS], 0, &value));
+		TESTS_CHECK_RET(CAEN_FELib_GetUserRegister(dev[i % BENCH_CONNECTIONS], 0, &value));
+	}
+	uint64_t t0 = utils_now();
+	for (size_t i = 0; i < n; ++i)
+		TESTS_CHECK_RET(mockGetUserRegister(rh[i % BENCH_CONNECTIONS], 0, &value));
+	const double directNs = (double)(utils_now() - t0) / n;
+	t0 = utils_now();
+	for (size_t i = 0; i < n; ++i)
+		TESTS_CHECK_RET(CAEN_FELib_GetUserRegister(dev[i % BENCH_CONNECTIONS], 0, &value));
+	const double dispatchedNs = (double)(utils_now() - t0) / n;
+
+	uint8_t* const buffer = calloc(BENCH_EVICT_SIZE, 1);
+	uint64_t* const directCold = malloc(nCold * sizeof(*directCold));
+	uint64_t* const dispatchedCold = malloc(nCold * sizeof(*dispatchedCold));
+	int ret = (buffer != NULL && directCold != NULL && dispatchedCold != NULL) ? CAEN_FELib_Success : CAEN_FELib_InternalError;
+	for (size_t i = 0; i < nCold && ret == CAEN_FELib_Success; ++i) {
+		_evictCaches(buffer);
+		t0 = utils_now();
+		ret = mockGetUserRegister(rh[i % BENCH_CONNECTIONS], 0, &value);
+		directCold[i] = utils_now() - t0;
+		if (ret != CAEN_FELib_Success)
+			break;
+		_evictCaches(buffer);
+		t0 = utils_now();
+		ret = CAEN_FELib_GetUserRegister(dev[i % BENCH_CONNECTIONS], 0, &value);
+		dispatchedCold[i] = utils_now() - t0;
+	}
+	double directColdNs = 0.;
+	double dispatchedColdNs = 0.;
+	if (ret == CAEN_FELib_Success) {
+		qsort(directCold, nCold, sizeof(*directCold), _compareU64);
+		qsort(dispatchedCold, nCold, sizeof(*dispatchedCold), _compareU64);
+		directColdNs = (double)directCold[nCold / 2];
+		dispatchedColdNs = (double)dispatchedCold[nCold / 2];
+	}
+	free(dispatchedCold);
+	free(directCold);
+	free(buffer);
+	TESTS_CHECK_RET(ret);
+
+	for (size_t i = 0; i < BENCH_CONNECTIONS; ++i) {
+		TESTS_CHECK_RET(CAEN_FELib_Close(dev[i]));
+		TESTS_CHECK_RET(mockClose(rh[i]));
+	}
+	dlclose(dl);
+
+	printf("call_direct %.1f ns\n", directNs);
+	printf("call_dispatched %.1f ns\n", dispatchedNs);
+	printf("dispatcher_overhead %.1f ns\n", dispatchedNs - directNs);
+	printf("call_direct_cold %.0f ns\n", directColdNs);
+	printf("call_dispatched_cold %.0f ns\n", dispatchedColdNs);
+	printf("dispatcher_overhead_cold %.0f ns\n", dispatchedColdNs - directColdNs);
+	return 0;
+}
+
+static int _benchReadData(unsigned scale) {
+	const size_t maxEvents = 200000 * scale;
+	const size_t rawEventSize = 4096;
+	char options[128];
+	snprintf(options, sizeof(options), "MaxEvents=%zu&RawEventSize=%zu", maxEvents, rawEventSize);
+
+	uint64_t dev;
+	uint64_t ep;
+	TESTS_CHECK_RET(tests_startMock(options, &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/RAW", &ep));
+
+	uint8_t* const data = malloc(rawEventSize);
+	TESTS_CHECK(data != NULL);
+	size_t size;
+	uint32_t nEvents;
+	uint64_t events = 0;
+	uint64_t bytes = 0;
+	const uint64_t t0 = utils_now();
+	int ret;
+	while ((ret = CAEN_FELib_ReadData(ep, 100, data, &size, &nEvents)) == CAEN_FELib_Success) {
+		events += nEvents;
+		bytes += size;
+	}
+	const double s = (double)(utils_now() - t0) * 1e-9;
+	free(data);
+	TESTS_CHECK(ret == CAEN_FELib_Stop);
+	TESTS_CHECK(events == maxEvents);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+
+	printf("readdata_events %.0f events/s\n", events / s);
+	printf("readdata_bytes %.0f bytes/s\n", bytes / s);
+	return 0;
+}
+
+static int _benchOpenClose(unsigned scale) {
+	const size_t n = 1000 * scale;
+	uint64_t* const latency = malloc(n * sizeof(*latency));
+	TESTS_CHECK(latency != NULL);
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t dev;
+		const uint64_t t0 = utils_now();
+		const int ret = CAEN_FELib_Open("mock://bench?NumCh=8", &dev);
+		if (ret == CAEN_FELib_Success)
+			CAEN_FELib_Close(dev);
+		latency[i] = utils_now() - t0;
+		if (ret != CAEN_FELib_Success)
+			free(latency);
+		TESTS_CHECK_RET(ret);
+	}
+	qsort(latency, n, sizeof(*latency), _compareU64);
+	uint64_t sum = 0;
+	for (size_t i = 0; i < n; ++i)
+		sum += latency[i];
+	printf("openclose_mean %.1f us\n", sum * 1e-3 / n);
+	printf("openclose_p50 %.1f us\n", latency[n / 2] * 1e-3);
+	printf("openclose_p99 %.1f us\n", latency[n * 99 / 100] * 1e-3);
+	free(latency);
+	return 0;
+}
+
+// on a scratch directory with only the mock, as other libraries may require a device or a daemon
+static int _benchDiscovery(unsigned scale) {
+	const char* const libdir = getenv("CAEN_FELIB_TEST_LIBDIR");
+	if (libdir == NULL) {
+		printf("# discovery skipped, CAEN_FELIB_TEST_LIBDIR not set\n");
+		return 0;
+	}
+	char cwd[FILENAME_MAX];
+	char dir[] = "/tmp/caen-felib-bench-XXXXXX";
+	char target[FILENAME_MAX];
+	char link[FILENAME_MAX];
+	TESTS_CHECK(getcwd(cwd, sizeof(cwd)) != NULL);
+	TESTS_CHECK(mkdtemp(dir) != NULL);
+	snprintf(target, sizeof(target), "%s/libCAEN_Mock.so", libdir);
+	snprintf(link, sizeof(link), "%s/libCAEN_Mock.so", dir);
+	TESTS_CHECK(symlink(target, link) == 0);
+	TESTS_CHECK(chdir(dir) == 0);
+	const size_t n = 20 * scale;
+	char json[4096];
+	const uint64_t t0 = utils_now();
+	int ret = CAEN_FELib_Success;
+	for (size_t i = 0; i < n && ret == CAEN_FELib_Success; ++i)
+		ret = CAEN_FELib_DevicesDiscovery(json, sizeof(json), 0);
+	const double us = (double)(utils_now() - t0) * 1e-3 / n;
+	TESTS_CHECK(chdir(cwd) == 0);
+	unlink(link);
+	rmdir(dir);
+	TESTS_CHECK_RET(ret);
+	TESTS_CHECK(strstr(json, "mock://") != NULL);
+	printf("discovery %.1f us\n", us);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	const unsigned scale = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 10) : 1;
+	if (scale == 0) {
+		fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+		return 1;
+	}
+	if (_benchDispatcher(scale) != 0)
+		return 1;
+	if (_benchReadData(scale) != 0)
+		return 1;
+	if (_benchOpenClose(scale) != 0)
+		return 1;
+	if (_benchDiscovery(scale) != 0)
+		return 1;
+	return 0;
+}
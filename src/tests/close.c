@@ -0,0 +1,107 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		close.c
+*	\brief		Check of CAEN_FELib_Close with objects using the connection
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Check that CAEN_FELib_Close() fails while mergers, watches or batches use the connection, whose
+ * threads would otherwise use freed resources, and succeeds once they are destroyed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tests.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]"
+#define RAW_FORMAT						"[{\"name\":\"DATA\",\"type\":\"U8\",\"dim\":1},{\"name\":\"SIZE\",\"type\":\"SIZE_T\"}]"
+
+static void CAEN_FELIB_API _onChange(const CAEN_FELib_WatchEvent_t* events, size_t n, void* ctx) {
+	(void)events;
+	(void)n;
+	(void)ctx;
+}
+
+static int _checkMerger(void) {
+	uint64_t dev;
+	uint64_t ep;
+	CAEN_FELib_Merger_t* merger;
+	TESTS_CHECK_RET(tests_startMock("MaxEvents=100000&RecordLengthS=64", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_CreateMerger(&ep, 1, NULL, &merger));
+	TESTS_CHECK(CAEN_FELib_Close(dev) == CAEN_FELib_CommandError);
+	CAEN_FELib_MergedEvent_t event;
+	TESTS_CHECK_RET(CAEN_FELib_MergerReadData(merger, 1000, &event));
+	TESTS_CHECK_RET(CAEN_FELib_MergerReleaseEvent(merger, &event));
+	TESTS_CHECK_RET(CAEN_FELib_DestroyMerger(merger));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+static int _checkWatch(void) {
+	uint64_t dev;
+	CAEN_FELib_Watch_t* watch;
+	const char* const paths[] = { "/par/EventCount" };
+	TESTS_CHECK_RET(tests_startMock("MaxEvents=100000", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_Watch(dev, paths, 1, 1, _onChange, NULL, &watch));
+	TESTS_CHECK(CAEN_FELib_Close(dev) == CAEN_FELib_CommandError);
+	TESTS_CHECK_RET(CAEN_FELib_Unwatch(watch));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+static int _checkBatch(void) {
+	uint64_t dev;
+	uint64_t ep;
+	CAEN_FELib_Batch_t* batch;
+	TESTS_CHECK_RET(tests_startMock("MaxEvents=100000", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/RAW", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, RAW_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_CreateBatch(ep, 16, NULL, &batch));
+	TESTS_CHECK(CAEN_FELib_Close(dev) == CAEN_FELib_CommandError);
+	TESTS_CHECK_RET(CAEN_FELib_DestroyBatch(batch));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+int main(void) {
+	if (_checkMerger() != 0)
+		return 1;
+	if (_checkWatch() != 0)
+		return 1;
+	if (_checkBatch() != 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,264 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		fanout.c
+*	\brief		Check of shared memory fan-out
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of the fan-out of the events of a mock run: events and end of run received by readers
+ * opened on the same process, sampling, losses of readers with drop_oldest policy and events not
+ * published because of readers with block policy, on a ring smaller than the run.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "tests.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]"
+#define MOCK_OPTIONS					"MaxEvents=100&NumCh=1&RecordLengthS=1024"
+#define N_EVENTS						100
+#define RECORD_LENGTH					1024
+#define SAMPLING						10
+#define LARGE_RING						"{\"size\":1048576}"
+#define SMALL_RING						"{\"size\":65536}"		// about 30 events
+
+struct event {
+	uint32_t						triggerId;
+	uint16_t						waveform[RECORD_LENGTH];
+	size_t							waveformSize;
+};
+
+struct fanout_test {
+	char							name[64];
+	uint64_t						dev;
+	uint64_t						ep;
+};
+
+static int _start(struct fanout_test* t, const char* options) {
+	snprintf(t->name, sizeof(t->name), "/caen_felib_test_fanout_%ld", (long)getpid());
+	TESTS_CHECK_RET(tests_startMock(MOCK_OPTIONS, &t->dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(t->dev, "/endpoint/SCOPE", &t->ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(t->ep, SCOPE_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_StartFanout(t->ep, t->name, options));
+	return 0;
+}
+
+// read and publish the whole run, events can be null
+static int _publish(struct fanout_test* t, struct event* events) {
+	for (size_t i = 0; i < N_EVENTS; ++i) {
+		struct event e;
+		uint16_t* waveform[1] = { e.waveform };
+		TESTS_CHECK_RET(CAEN_FELib_ReadData(t->ep, 1000, &e.triggerId, waveform, &e.waveformSize));
+		if (events != NULL)
+			events[i] = e;
+	}
+	struct event e;
+	uint16_t* waveform[1] = { e.waveform };
+	TESTS_CHECK(CAEN_FELib_ReadData(t->ep, 1000, &e.triggerId, waveform, &e.waveformSize) == CAEN_FELib_Stop);
+	return 0;
+}
+
+static int _getTriggerId(CAEN_FELib_FanoutReader_t* r, const CAEN_FELib_Event_t* event, uint32_t* triggerId) {
+	const void* data;
+	size_t count;
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutEventField(r, event, "TRIGGER_ID", 0, &data, &count));
+	TESTS_CHECK(count == 1);
+	memcpy(triggerId, data, sizeof(*triggerId));
+	return 0;
+}
+
+// read the next event, and compare it with the reference, if any
+static int _readEvent(CAEN_FELib_FanoutReader_t* r, const struct event* expected, uint32_t* triggerId) {
+	CAEN_FELib_Event_t event;
+	TESTS_CHECK_RET(CAEN_FELib_ReadFanoutEvent(r, 0, &event));
+	TESTS_CHECK(strcmp(event.format, SCOPE_FORMAT) == 0);
+	if (_getTriggerId(r, &event, triggerId) != 0)
+		return 1;
+	const void* data;
+	size_t count;
+	TESTS_CHECK(event.index == *triggerId);
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutEventField(r, &event, "WAVEFORM", 0, &data, &count));
+	TESTS_CHECK(count == RECORD_LENGTH);
+	if (expected != NULL) {
+		TESTS_CHECK(*triggerId == expected->triggerId);
+		TESTS_CHECK(memcmp(data, expected->waveform, sizeof(expected->waveform)) == 0);
+	}
+	return 0;
+}
+
+static int _readStop(CAEN_FELib_FanoutReader_t* r) {
+	CAEN_FELib_Event_t event;
+	TESTS_CHECK(CAEN_FELib_ReadFanoutEvent(r, 0, &event) == CAEN_FELib_Stop);
+	TESTS_CHECK(event.payload == NULL && event.size == 0);
+	TESTS_CHECK(CAEN_FELib_ReadFanoutEvent(r, 0, &event) == CAEN_FELib_Timeout);
+	return 0;
+}
+
+static int _stop(struct fanout_test* t, CAEN_FELib_FanoutReader_t* r) {
+	CAEN_FELib_Event_t event;
+	TESTS_CHECK_RET(CAEN_FELib_StopFanout(t->ep));
+	TESTS_CHECK(CAEN_FELib_ReadFanoutEvent(r, 0, &event) == CAEN_FELib_Disabled);
+	CAEN_FELib_FanoutStatus_t status;
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutStatus(r, &status));
+	TESTS_CHECK(status.closed == 1);
+	TESTS_CHECK_RET(CAEN_FELib_CloseFanout(r));
+	TESTS_CHECK_RET(CAEN_FELib_Close(t->dev));
+	return 0;
+}
+
+// every event to a reader, one every SAMPLING to another
+static int _checkEvents(void) {
+	static struct event events[N_EVENTS];
+	struct fanout_test t;
+	CAEN_FELib_FanoutReader_t* all;
+	CAEN_FELib_FanoutReader_t* sampled;
+	if (_start(&t, LARGE_RING) != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_OpenFanout(t.name, NULL, &all));
+	TESTS_CHECK_RET(CAEN_FELib_OpenFanout(t.name, "{\"sampling\":10}", &sampled));
+	if (_publish(&t, events) != 0)
+		return 1;
+	for (size_t i = 0; i < N_EVENTS; ++i) {
+		uint32_t triggerId;
+		if (_readEvent(all, &events[i], &triggerId) != 0)
+			return 1;
+	}
+	if (_readStop(all) != 0)
+		return 1;
+	// the last event of each group of SAMPLING is returned
+	for (size_t i = SAMPLING - 1; i < N_EVENTS; i += SAMPLING) {
+		uint32_t triggerId;
+		if (_readEvent(sampled, &events[i], &triggerId) != 0)
+			return 1;
+	}
+	if (_readStop(sampled) != 0)
+		return 1;
+	CAEN_FELib_FanoutStatus_t status;
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutStatus(all, &status));
+	TESTS_CHECK(status.read == N_EVENTS);
+	TESTS_CHECK(status.lost == 0 && status.skipped == 0);
+	TESTS_CHECK(status.published == N_EVENTS + 1 && status.dropped == 0);
+	TESTS_CHECK(status.backlog == 0);
+	TESTS_CHECK(status.pid == (int64_t)getpid());
+	TESTS_CHECK(status.closed == 0);
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutStatus(sampled, &status));
+	TESTS_CHECK(status.read == N_EVENTS / SAMPLING);
+	TESTS_CHECK(status.lost == 0);
+	TESTS_CHECK(status.skipped == N_EVENTS - N_EVENTS / SAMPLING);
+	TESTS_CHECK_RET(CAEN_FELib_CloseFanout(sampled));
+	return _stop(&t, all);
+}
+
+// the oldest events are overwritten before being read
+static int _checkDropOldest(void) {
+	struct fanout_test t;
+	CAEN_FELib_FanoutReader_t* r;
+	if (_start(&t, SMALL_RING) != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_OpenFanout(t.name, "{\"policy\":\"drop_oldest\"}", &r));
+	if (_publish(&t, NULL) != 0)
+		return 1;
+	size_t read = 0;
+	uint32_t triggerId = 0;
+	for (;;) {
+		CAEN_FELib_Event_t event;
+		const int ret = CAEN_FELib_ReadFanoutEvent(r, 0, &event);
+		if (ret == CAEN_FELib_Stop)
+			break;
+		TESTS_CHECK(ret == CAEN_FELib_Success);
+		uint32_t next;
+		if (_getTriggerId(r, &event, &next) != 0)
+			return 1;
+		TESTS_CHECK(read == 0 || next > triggerId);
+		triggerId = next;
+		++read;
+	}
+	CAEN_FELib_FanoutStatus_t status;
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutStatus(r, &status));
+	TESTS_CHECK(status.backlog == 0);
+	// the last event and the end of run are never overwritten
+	TESTS_CHECK(triggerId == N_EVENTS - 1);
+	TESTS_CHECK(status.read == read);
+	TESTS_CHECK(status.lost != 0);
+	TESTS_CHECK(status.read + status.lost == N_EVENTS);
+	TESTS_CHECK(status.published == N_EVENTS + 1 && status.dropped == 0);
+	return _stop(&t, r);
+}
+
+// new events are not published while a reader with block policy has not read the ring
+static int _checkBlock(void) {
+	struct fanout_test t;
+	CAEN_FELib_FanoutReader_t* r;
+	if (_start(&t, SMALL_RING) != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_OpenFanout(t.name, "{\"policy\":\"block\"}", &r));
+	if (_publish(&t, NULL) != 0)
+		return 1;
+	CAEN_FELib_FanoutStatus_t status;
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutStatus(r, &status));
+	TESTS_CHECK(status.dropped != 0);
+	TESTS_CHECK(status.published + status.dropped == N_EVENTS + 1);
+	// the first events, without gaps, and the end of run if there was room left
+	uint32_t read = 0;
+	CAEN_FELib_Event_t event;
+	int ret;
+	while ((ret = CAEN_FELib_ReadFanoutEvent(r, 0, &event)) == CAEN_FELib_Success) {
+		uint32_t triggerId;
+		if (_getTriggerId(r, &event, &triggerId) != 0)
+			return 1;
+		TESTS_CHECK(triggerId == read++);
+	}
+	if (ret == CAEN_FELib_Stop)
+		ret = CAEN_FELib_ReadFanoutEvent(r, 0, &event);
+	TESTS_CHECK(ret == CAEN_FELib_Timeout);
+	TESTS_CHECK_RET(CAEN_FELib_GetFanoutStatus(r, &status));
+	TESTS_CHECK(status.lost == 0);
+	TESTS_CHECK(status.read == read);
+	TESTS_CHECK(read == status.published || read + 1 == status.published);
+	return _stop(&t, r);
+}
+
+int main(void) {
+	if (_checkEvents() != 0)
+		return 1;
+	if (_checkDropOldest() != 0)
+		return 1;
+	if (_checkBlock() != 0)
+		return 1;
+	return 0;
+}
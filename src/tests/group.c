@@ -0,0 +1,105 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		group.c
+*	\brief		Check of group commands
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of CAEN_FELib_SendCommandMany() on mock devices with a call latency: commands issued in
+ * parallel, results of each board, and errors of a single board.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+#include "../utils.h"
+
+#define N_BOARDS						4
+#define LATENCY_US						20000
+
+static int _checkStatus(const uint64_t* devs, const char* expected) {
+	for (size_t i = 0; i < N_BOARDS; ++i) {
+		char value[256];
+		TESTS_CHECK_RET(CAEN_FELib_GetValue(devs[i], "/par/AcqStatus", value));
+		TESTS_CHECK(strcmp(value, expected) == 0);
+	}
+	return 0;
+}
+
+static int _checkResults(const CAEN_FELib_CommandResult_t* results, size_t failed) {
+	uint64_t minSkew = UINT64_MAX;
+	for (size_t i = 0; i < N_BOARDS; ++i) {
+		TESTS_CHECK(results[i].ret == ((i == failed) ? CAEN_FELib_CommandError : CAEN_FELib_Success));
+		TESTS_CHECK(results[i].durationNs >= LATENCY_US * UINT64_C(1000));
+		if (results[i].skewNs < minSkew)
+			minSkew = results[i].skewNs;
+	}
+	// skews are relative to the first board issued
+	TESTS_CHECK(minSkew == 0);
+	return 0;
+}
+
+int main(void) {
+	uint64_t devs[N_BOARDS];
+	for (size_t i = 0; i < N_BOARDS; ++i) {
+		char url[64];
+		snprintf(url, sizeof(url), "mock://board%zu?EventRate=0&CallLatencyUs=%d", i, LATENCY_US);
+		TESTS_CHECK_RET(CAEN_FELib_Open(url, &devs[i]));
+	}
+	CAEN_FELib_CommandResult_t results[N_BOARDS];
+	// in parallel: much less than the latency of the sequence of commands
+	const uint64_t start = utils_now();
+	TESTS_CHECK_RET(CAEN_FELib_SendCommandMany(devs, N_BOARDS, "/cmd/ArmAcquisition", results));
+	const uint64_t elapsed = utils_now() - start;
+	TESTS_CHECK(elapsed < (N_BOARDS - 1) * LATENCY_US * UINT64_C(1000));
+	if (_checkResults(results, N_BOARDS) != 0 || _checkStatus(devs, "armed") != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_SendCommandMany(devs, N_BOARDS, "/cmd/SwStartAcquisition", NULL));
+	if (_checkStatus(devs, "running") != 0)
+		return 1;
+	// a board not armed fails, the others start
+	TESTS_CHECK_RET(CAEN_FELib_SendCommandMany(devs, N_BOARDS, "/cmd/DisarmAcquisition", results));
+	TESTS_CHECK_RET(CAEN_FELib_SendCommandMany(devs, N_BOARDS - 1, "/cmd/ArmAcquisition", results));
+	TESTS_CHECK(CAEN_FELib_SendCommandMany(devs, N_BOARDS, "/cmd/SwStartAcquisition", results) == CAEN_FELib_CommandError);
+	if (_checkResults(results, N_BOARDS - 1) != 0)
+		return 1;
+	const uint64_t repeated[2] = { devs[0], devs[0] };
+	TESTS_CHECK(CAEN_FELib_SendCommandMany(repeated, 2, "/cmd/SwStopAcquisition", NULL) == CAEN_FELib_InvalidParam);
+	TESTS_CHECK(CAEN_FELib_SendCommandMany(devs, 0, "/cmd/SwStopAcquisition", NULL) == CAEN_FELib_InvalidParam);
+	for (size_t i = 0; i < N_BOARDS; ++i)
+		TESTS_CHECK_RET(CAEN_FELib_Close(devs[i]));
+	return 0;
+}
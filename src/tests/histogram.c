@@ -0,0 +1,135 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		histogram.c
+*	\brief		Check of online histograms
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of the online histograms: 1D, 2D and delta axes filled with the events of a mock run, read
+ * by two threads, whose partial histograms must be summed by CAEN_FELib_GetHistogram().
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "tests.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"},{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"}]"
+#define N_EVENTS						150
+
+// TRIGGER_ID is the event number; events from 100 are out of range
+#define HISTOGRAMS \
+	"{\"histograms\":[" \
+	"{\"name\":\"trg\",\"x\":{\"field\":\"TRIGGER_ID\",\"bins\":10,\"min\":0,\"max\":100}}," \
+	"{\"name\":\"dt\",\"x\":{\"field\":\"TIMESTAMP\",\"bins\":4,\"min\":0,\"max\":200,\"delta\":true}}," \
+	"{\"name\":\"xy\",\"x\":{\"field\":\"TRIGGER_ID\",\"bins\":2,\"min\":0,\"max\":100},\"y\":{\"field\":\"TIMESTAMP\",\"bins\":2,\"min\":0,\"max\":12500}}" \
+	"]}"
+
+struct reader {
+	uint64_t						ep;
+	size_t							n;
+	int								ret;
+};
+
+static int _read(uint64_t ep, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t timestamp;
+		uint32_t triggerId;
+		TESTS_CHECK_RET(CAEN_FELib_ReadData(ep, 1000, &timestamp, &triggerId));
+	}
+	return 0;
+}
+
+static void* _readerMain(void* arg) {
+	struct reader* const r = arg;
+	r->ret = _read(r->ep, r->n);
+	return NULL;
+}
+
+static int _checkHistogram(uint64_t ep, const char* name, const uint64_t* expected, size_t binsX, size_t binsY, uint64_t entries, uint64_t outOfRange) {
+	uint64_t bins[16];
+	CAEN_FELib_HistogramInfo_t info;
+	TESTS_CHECK_RET(CAEN_FELib_GetHistogram(ep, name, 0, bins, binsX * binsY, &info));
+	TESTS_CHECK(info.binsX == binsX);
+	TESTS_CHECK(info.binsY == binsY);
+	TESTS_CHECK(info.entries == entries);
+	TESTS_CHECK(info.outOfRange == outOfRange);
+	for (size_t i = 0; i < binsX * binsY; ++i)
+		TESTS_CHECK(bins[i] == expected[i]);
+	return 0;
+}
+
+int main(void) {
+	uint64_t dev;
+	uint64_t ep;
+	char options[64];
+	snprintf(options, sizeof(options), "MaxEvents=%d", N_EVENTS);
+	TESTS_CHECK_RET(tests_startMock(options, &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_StartHistograms(ep, HISTOGRAMS));
+	// half of the events on another thread, with its own partial histograms
+	TESTS_CHECK(_read(ep, N_EVENTS / 2) == 0);
+	struct reader r = { ep, N_EVENTS - N_EVENTS / 2, 0 };
+	pthread_t thread;
+	TESTS_CHECK(pthread_create(&thread, NULL, _readerMain, &r) == 0);
+	TESTS_CHECK(pthread_join(thread, NULL) == 0);
+	TESTS_CHECK(r.ret == 0);
+	uint64_t timestamp;
+	uint32_t triggerId;
+	TESTS_CHECK(CAEN_FELib_ReadData(ep, 1000, &timestamp, &triggerId) == CAEN_FELib_Stop);
+	// 10 events per bin
+	const uint64_t trg[10] = { 10, 10, 10, 10, 10, 10, 10, 10, 10, 10 };
+	if (_checkHistogram(ep, "trg", trg, 10, 1, 100, N_EVENTS - 100) != 0)
+		return 1;
+	// a delta of 125 ticks (1 us) on the third bin, except for the first event that has no previous one
+	const uint64_t dt[4] = { 0, 0, N_EVENTS - 1, 0 };
+	if (_checkHistogram(ep, "dt", dt, 4, 1, N_EVENTS - 1, 0) != 0)
+		return 1;
+	// events 0-49 on the first bin of both axes, 50-99 on the second
+	const uint64_t xy[4] = { 50, 0, 0, 50 };
+	if (_checkHistogram(ep, "xy", xy, 2, 2, 100, N_EVENTS - 100) != 0)
+		return 1;
+	TESTS_CHECK(CAEN_FELib_GetHistogram(ep, "none", 0, NULL, 0, NULL) != CAEN_FELib_Success);
+	TESTS_CHECK_RET(CAEN_FELib_ResetHistograms(ep));
+	const uint64_t zero[10] = { 0 };
+	if (_checkHistogram(ep, "trg", zero, 10, 1, 0, 0) != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_StopHistograms(ep));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
@@ -0,0 +1,145 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		interrupt.c
+*	\brief		Check of CAEN_FELib_Interrupt
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Check of CAEN_FELib_Interrupt(): it wakes a read blocked with infinite timeout, and it does not
+ * abort the reader threads of recordings and mergers, that treat it like a timeout.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "tests.h"
+#include "../utils.h"
+
+#define RAW_FORMAT						"[{\"name\":\"DATA\",\"type\":\"U8\",\"dim\":1},{\"name\":\"SIZE\",\"type\":\"SIZE_T\"}]"
+#define SCOPE_FORMAT					"[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]"
+#define INTERRUPT_DELAY_US				100000
+#define MAX_WAKEUP_NS					UINT64_C(2000000000)
+
+static void* _interrupterMain(void* arg) {
+	const uint64_t* const ep = arg;
+	usleep(INTERRUPT_DELAY_US);
+	CAEN_FELib_Interrupt(*ep);
+	return NULL;
+}
+
+// an event per 1000 s, the first one at start: the second read can only return when interrupted
+static int _checkBlockingRead(void) {
+	uint64_t dev;
+	uint64_t ep;
+	uint8_t data[4096];
+	size_t size;
+	pthread_t interrupter;
+	TESTS_CHECK_RET(tests_startMock("EventRate=0.001&RawEventSize=4096", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/RAW", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, RAW_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_ReadData(ep, 1000, data, &size));
+	TESTS_CHECK(pthread_create(&interrupter, NULL, _interrupterMain, &ep) == 0);
+	const uint64_t t0 = utils_now();
+	const int ret = CAEN_FELib_ReadData(ep, -1, data, &size);
+	const uint64_t elapsed = utils_now() - t0;
+	pthread_join(interrupter, NULL);
+	TESTS_CHECK(ret == CAEN_FELib_Interrupted);
+	TESTS_CHECK(elapsed < MAX_WAKEUP_NS);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	printf("blocking read interrupted after %.1f ms\n", elapsed * 1e-6);
+	return 0;
+}
+
+static int _checkRecording(void) {
+	const char filename[] = "interrupt.evf";
+	uint64_t dev;
+	uint64_t ep;
+	CAEN_FELib_RecordingStatus_t status;
+	TESTS_CHECK_RET(CAEN_FELib_Open("mock://test?EventRate=1000&RawEventSize=256", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/RAW", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, RAW_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_StartRecording(ep, filename, NULL));
+	TESTS_CHECK_RET(CAEN_FELib_SendCommand(dev, "/cmd/ArmAcquisition"));
+	TESTS_CHECK_RET(CAEN_FELib_SendCommand(dev, "/cmd/SwStartAcquisition"));
+	for (int i = 0; i < 10; ++i) {
+		TESTS_CHECK_RET(CAEN_FELib_Interrupt(ep));
+		usleep(10000);
+	}
+	TESTS_CHECK_RET(CAEN_FELib_GetRecordingStatus(ep, &status));
+	TESTS_CHECK(status.error == CAEN_FELib_Success);
+	const uint64_t events = status.events;
+	usleep(50000);
+	TESTS_CHECK_RET(CAEN_FELib_GetRecordingStatus(ep, &status));
+	TESTS_CHECK(status.events > events);
+	TESTS_CHECK_RET(CAEN_FELib_StopRecording(ep));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	unlink(filename);
+	return 0;
+}
+
+static int _checkMerger(void) {
+	uint64_t dev;
+	uint64_t ep;
+	CAEN_FELib_Merger_t* merger;
+	CAEN_FELib_MergedEvent_t event;
+	TESTS_CHECK_RET(CAEN_FELib_Open("mock://test?EventRate=1000&RecordLengthS=64", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_CreateMerger(&ep, 1, NULL, &merger));
+	TESTS_CHECK_RET(CAEN_FELib_SendCommand(dev, "/cmd/ArmAcquisition"));
+	TESTS_CHECK_RET(CAEN_FELib_SendCommand(dev, "/cmd/SwStartAcquisition"));
+	for (int i = 0; i < 10; ++i) {
+		TESTS_CHECK_RET(CAEN_FELib_Interrupt(ep));
+		usleep(10000);
+	}
+	for (int i = 0; i < 10; ++i) {
+		TESTS_CHECK_RET(CAEN_FELib_MergerReadData(merger, 1000, &event));
+		TESTS_CHECK_RET(CAEN_FELib_MergerReleaseEvent(merger, &event));
+	}
+	TESTS_CHECK_RET(CAEN_FELib_DestroyMerger(merger));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+int main(void) {
+	if (_checkBlockingRead() != 0)
+		return 1;
+	if (_checkRecording() != 0)
+		return 1;
+	if (_checkMerger() != 0)
+		return 1;
+	return 0;
+}
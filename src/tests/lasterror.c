@@ -0,0 +1,89 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		lasterror.c
+*	\brief		Check of the last error record
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Check of the last error record, filled by the dispatcher only on failure.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+
+// functions returning a count must not be recorded as failed
+static int _checkPositiveReturn(void) {
+	uint64_t dev;
+	uint64_t handles[16];
+	CAEN_FELib_TreeNode_t nodes[64];
+	CAEN_FELib_ErrorInfo_t info;
+	char description[1024];
+	TESTS_CHECK_RET(CAEN_FELib_Open("mock://lasterror", &dev));
+	CAEN_FELib_GetLastError(description); // reset the record
+	TESTS_CHECK(CAEN_FELib_GetChildHandles(dev, "/endpoint", handles, 16) > 0);
+	TESTS_CHECK(CAEN_FELib_WalkTree(dev, "", -1, nodes, 64) > 0);
+	TESTS_CHECK_RET(CAEN_FELib_GetLastErrorInfo(&info));
+	TESTS_CHECK(info.code == CAEN_FELib_Success);
+	TESTS_CHECK(info.function[0] == '\0');
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+// the description of an error of an unloaded library must not be queried to the library loaded later on the same slot
+static int _checkReloadedLibrary(void) {
+	uint64_t dev;
+	char value[256];
+	char description[1024];
+	TESTS_CHECK_RET(CAEN_FELib_Open("mock://lasterror", &dev));
+	TESTS_CHECK(CAEN_FELib_GetValue(dev, "/par/NotExisting", value) != CAEN_FELib_Success);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	TESTS_CHECK_RET(CAEN_FELib_Open("mock://lasterror", &dev));
+	CAEN_FELib_GetLastError(description);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	if (strstr(description, "unloaded") == NULL) {
+		fprintf(stderr, "unexpected description after reload: \"%s\"\n", description);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+	if (_checkPositiveReturn() != 0)
+		return 1;
+	if (_checkReloadedLibrary() != 0)
+		return 1;
+	return 0;
+}
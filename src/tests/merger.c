@@ -0,0 +1,203 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		merger.c
+*	\brief		Check of the events returned by the merger
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of the events returned by mergers of mock devices, whose timestamps are 125 ticks apart:
+ * order of CAEN_FELib_MergerReadData, and groups of CAEN_FELib_MergerReadGroup, including the
+ * groups closed by the end of run, groups larger than the caller array and than the event pools.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tests.h"
+#include "../utils.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"}]"
+#define MAX_BOARDS						4
+#define N_EVENTS						2000
+#define TIMESTAMP_STEP					125		// 1 us of the mock, in 8 ns ticks
+
+struct merger_test {
+	size_t							n;
+	uint64_t						devs[MAX_BOARDS];
+	CAEN_FELib_Merger_t*			merger;
+};
+
+static int _create(struct merger_test* t, size_t n, const char* options) {
+	uint64_t eps[MAX_BOARDS];
+	t->n = n;
+	for (size_t i = 0; i < n; ++i) {
+		char mockOptions[64];
+		snprintf(mockOptions, sizeof(mockOptions), "MaxEvents=%d", N_EVENTS);
+		TESTS_CHECK_RET(tests_startMock(mockOptions, &t->devs[i]));
+		TESTS_CHECK_RET(CAEN_FELib_GetHandle(t->devs[i], "/endpoint/SCOPE", &eps[i]));
+		TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(eps[i], SCOPE_FORMAT));
+	}
+	TESTS_CHECK_RET(CAEN_FELib_CreateMerger(eps, n, options, &t->merger));
+	return 0;
+}
+
+static int _destroy(struct merger_test* t) {
+	TESTS_CHECK_RET(CAEN_FELib_DestroyMerger(t->merger));
+	for (size_t i = 0; i < t->n; ++i)
+		TESTS_CHECK_RET(CAEN_FELib_Close(t->devs[i]));
+	return 0;
+}
+
+// with the default window, events must be returned in timestamp order
+static int _checkOrder(void) {
+	struct merger_test t;
+	if (_create(&t, 2, "{\"offsets\":[0,5],\"max_latency\":10000}") != 0)
+		return 1;
+	size_t count[2] = { 0 };
+	uint64_t last = 0;
+	for (;;) {
+		CAEN_FELib_MergedEvent_t event;
+		const int ret = CAEN_FELib_MergerReadData(t.merger, 10000, &event);
+		if (ret == CAEN_FELib_Stop)
+			break;
+		TESTS_CHECK(ret == CAEN_FELib_Success);
+		TESTS_CHECK(event.timestamp >= last);
+		last = event.timestamp;
+		++count[event.board];
+		TESTS_CHECK_RET(CAEN_FELib_MergerReleaseEvent(t.merger, &event));
+	}
+	TESTS_CHECK(count[0] == N_EVENTS && count[1] == N_EVENTS);
+	return _destroy(&t);
+}
+
+/*
+ * Read groups until the end of run, checking that each group has groupSize events of consecutive
+ * boards starting from a multiple of groupSize, with the same event number. Return the number of
+ * events read on *total.
+ */
+static int _readGroups(struct merger_test* t, size_t groupSize, size_t* total) {
+	CAEN_FELib_MergedEvent_t events[MAX_BOARDS];
+	*total = 0;
+	for (;;) {
+		size_t count;
+		const int ret = CAEN_FELib_MergerReadGroup(t->merger, 10000, events, groupSize, &count);
+		if (ret == CAEN_FELib_Stop)
+			break;
+		TESTS_CHECK(ret == CAEN_FELib_Success);
+		TESTS_CHECK(count == groupSize);
+		const uint64_t number = events[0].timestamp / TIMESTAMP_STEP;
+		for (size_t i = 0; i < count; ++i) {
+			TESTS_CHECK(events[i].board == events[0].board + i);
+			TESTS_CHECK(events[i].board % groupSize == i);
+			TESTS_CHECK(events[i].timestamp / TIMESTAMP_STEP == number);
+			TESTS_CHECK_RET(CAEN_FELib_MergerReleaseEvent(t->merger, &events[i]));
+		}
+		*total += count;
+	}
+	return 0;
+}
+
+// events of the two boards are within the window: one group per event, the last one closed by the end of run
+static int _checkMatch(void) {
+	struct merger_test t;
+	size_t total;
+	if (_create(&t, 2, "{\"offsets\":[0,5],\"max_latency\":10000,\"coincidence\":{\"window\":10}}") != 0)
+		return 1;
+	if (_readGroups(&t, 2, &total) != 0)
+		return 1;
+	TESTS_CHECK(total == 2 * N_EVENTS);
+	return _destroy(&t);
+}
+
+// events of the two boards are not within the window: every event is rejected
+static int _checkReject(void) {
+	struct merger_test t;
+	size_t total;
+	if (_create(&t, 2, "{\"offsets\":[0,60],\"max_latency\":10000,\"coincidence\":{\"window\":10}}") != 0)
+		return 1;
+	if (_readGroups(&t, 2, &total) != 0)
+		return 1;
+	TESTS_CHECK(total == 0);
+	return _destroy(&t);
+}
+
+// groups of four events read with an array of two: the tail is a group of the last two boards
+static int _checkLargerThanSize(void) {
+	struct merger_test t;
+	size_t total;
+	if (_create(&t, 4, "{\"offsets\":[0,1,2,3],\"max_latency\":10000,\"coincidence\":{\"window\":10}}") != 0)
+		return 1;
+	if (_readGroups(&t, 2, &total) != 0)
+		return 1;
+	TESTS_CHECK(total == 4 * N_EVENTS);
+	return _destroy(&t);
+}
+
+// a window covering the whole run: groups are closed when the pool of a board is full; with a
+// multiplicity of 1, as a group may hold the events of one board only, depending on the timing
+static int _checkLargerThanPool(void) {
+	struct merger_test t;
+	if (_create(&t, 2, "{\"max_latency\":10000,\"slots\":4,\"coincidence\":{\"window\":1000000000,\"multiplicity\":1}}") != 0)
+		return 1;
+	CAEN_FELib_MergedEvent_t events[64];
+	size_t total = 0;
+	for (;;) {
+		size_t count;
+		const int ret = CAEN_FELib_MergerReadGroup(t.merger, 10000, events, ARRAY_SIZE(events), &count);
+		if (ret == CAEN_FELib_Stop)
+			break;
+		TESTS_CHECK(ret == CAEN_FELib_Success);
+		// at most a full pool per board
+		TESTS_CHECK(count >= 1 && count <= 2 * 4);
+		for (size_t i = 0; i < count; ++i)
+			TESTS_CHECK_RET(CAEN_FELib_MergerReleaseEvent(t.merger, &events[i]));
+		total += count;
+	}
+	TESTS_CHECK(total == 2 * N_EVENTS);
+	return _destroy(&t);
+}
+
+int main(void) {
+	if (_checkOrder() != 0)
+		return 1;
+	if (_checkMatch() != 0)
+		return 1;
+	if (_checkReject() != 0)
+		return 1;
+	if (_checkLargerThanSize() != 0)
+		return 1;
+	if (_checkLargerThanPool() != 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		pool.c
+*	\brief		Check of the allocations of the event pool
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+/*
+ * Check that the readout on an event pool does not allocate memory, once the pool is created.
+ *
+ * The allocation functions of the C library are replaced by functions that count the calls and
+ * forward them to the glibc implementation, so this test is skipped on other C libraries.
+ * Slots are read and released in a loop on both the endpoints of the mock: after a warm-up, any
+ * allocation is a failure.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tests.h"
+
+#define WARMUP_EVENTS					1000
+#define STEADY_EVENTS					100000
+#define POOL_SLOTS						4
+
+#ifdef __GLIBC__
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+static int counting;
+static unsigned long allocations;
+
+static void _count(void) {
+	if (__atomic_load_n(&counting, __ATOMIC_RELAXED))
+		__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+}
+
+void* malloc(size_t size) {
+	_count();
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+	_count();
+	return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+	_count();
+	return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+	_count();
+	void* const p = __libc_memalign(alignment, size);
+	if (p == NULL)
+		return 12; // ENOMEM
+	*ptr = p;
+	return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	_count();
+	return __libc_memalign(alignment, size);
+}
+
+void free(void* ptr) {
+	__libc_free(ptr);
+}
+
+static int _readSlots(CAEN_FELib_EventPool_t* pool, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		CAEN_FELib_EventSlot_t* slot;
+		const int ret = CAEN_FELib_ReadDataSlot(pool, 100, &slot);
+		if (ret != CAEN_FELib_Success)
+			return ret;
+		const int retRelease = CAEN_FELib_ReleaseSlot(pool, slot);
+		if (retRelease != CAEN_FELib_Success)
+			return retRelease;
+	}
+	return CAEN_FELib_Success;
+}
+
+static int _checkEndpoint(uint64_t dev, const char* path, const char* format) {
+	uint64_t ep;
+	CAEN_FELib_EventPool_t* pool;
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, path, &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, format));
+	TESTS_CHECK_RET(CAEN_FELib_CreateEventPool(ep, POOL_SLOTS, NULL, &pool));
+	TESTS_CHECK_RET(_readSlots(pool, WARMUP_EVENTS));
+	__atomic_store_n(&allocations, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+	const int ret = _readSlots(pool, STEADY_EVENTS);
+	__atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+	TESTS_CHECK_RET(ret);
+	const unsigned long n = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+	if (n != 0) {
+		fprintf(stderr, "%s: %lu allocations on %d events after warm-up\n", path, n, STEADY_EVENTS);
+		return 1;
+	}
+	TESTS_CHECK_RET(CAEN_FELib_DestroyEventPool(pool));
+	printf("%s: no allocations on %d events after warm-up\n", path, STEADY_EVENTS);
+	return 0;
+}
+
+int main(void) {
+	uint64_t dev;
+	TESTS_CHECK_RET(tests_startMock("MaxEvents=1000000&NumCh=4&RecordLengthS=256&RawEventSize=1024", &dev));
+	if (_checkEndpoint(dev, "/endpoint/RAW", "[{\"name\":\"DATA\",\"type\":\"U8\",\"dim\":1},{\"name\":\"SIZE\",\"type\":\"SIZE_T\"},{\"name\":\"N_EVENTS\",\"type\":\"U32\"}]") != 0)
+		return 1;
+	if (_checkEndpoint(dev, "/endpoint/SCOPE", "[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"},{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]") != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+#else
+
+int main(void) {
+	printf("allocation functions can be replaced only on glibc\n");
+	return TESTS_SKIP;
+}
+
+#endif
@@ -0,0 +1,212 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		recording.c
+*	\brief		Round trip of recorded events
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Round trip of the events of a mock device: recorded with CAEN_FELib_StartRecording(), read back
+ * with CAEN_FELib_OpenEventFile() and, if built, played back by the replay library. Events are
+ * compared with those read with CAEN_FELib_ReadData() from a second mock device, whose events are
+ * the same.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TIMESTAMP\",\"type\":\"U64\"},{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]"
+#define MOCK_OPTIONS					"MaxEvents=200&NumCh=2&RecordLengthS=64"
+#define N_EVENTS						200
+#define N_CHANNELS						2
+#define RECORD_LENGTH					64
+#define RECORDING_TIMEOUT_US			10000000
+
+struct event {
+	uint64_t						timestamp;
+	uint32_t						triggerId;
+	uint16_t						waveform[N_CHANNELS][RECORD_LENGTH];
+	size_t							waveformSize[N_CHANNELS];
+};
+
+static struct event events[N_EVENTS];
+
+static int _readEvent(uint64_t ep, struct event* e) {
+	uint16_t* waveform[N_CHANNELS];
+	for (size_t ch = 0; ch < N_CHANNELS; ++ch)
+		waveform[ch] = e->waveform[ch];
+	return CAEN_FELib_ReadData(ep, 1000, &e->timestamp, &e->triggerId, waveform, e->waveformSize);
+}
+
+static int _openMock(uint64_t* dev, uint64_t* ep) {
+	TESTS_CHECK_RET(tests_startMock(MOCK_OPTIONS, dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(*dev, "/endpoint/SCOPE", ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(*ep, SCOPE_FORMAT));
+	return 0;
+}
+
+// read the reference events with CAEN_FELib_ReadData
+static int _readEvents(void) {
+	uint64_t dev;
+	uint64_t ep;
+	if (_openMock(&dev, &ep) != 0)
+		return 1;
+	for (size_t i = 0; i < N_EVENTS; ++i)
+		TESTS_CHECK_RET(_readEvent(ep, &events[i]));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+// record a whole run, waiting for its end
+static int _record(const char* filename) {
+	uint64_t dev;
+	uint64_t ep;
+	CAEN_FELib_RecordingStatus_t status;
+	if (_openMock(&dev, &ep) != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_StartRecording(ep, filename, "{\"buffer_size\":65536}"));
+	for (int us = 0; us < RECORDING_TIMEOUT_US; us += 1000) {
+		TESTS_CHECK_RET(CAEN_FELib_GetRecordingStatus(ep, &status));
+		if (status.stops != 0 || status.error != CAEN_FELib_Success)
+			break;
+		usleep(1000);
+	}
+	TESTS_CHECK(status.error == CAEN_FELib_Success);
+	TESTS_CHECK(status.events == N_EVENTS);
+	TESTS_CHECK(status.stops == 1);
+	// pending buffers are written by the stop
+	TESTS_CHECK_RET(CAEN_FELib_StopRecording(ep));
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+static int _checkField(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, const char* name, size_t channel, const void* expected, size_t size, size_t count) {
+	const void* data;
+	size_t n;
+	TESTS_CHECK_RET(CAEN_FELib_GetEventField(file, event, name, channel, &data, &n));
+	TESTS_CHECK(n == count);
+	TESTS_CHECK(memcmp(data, expected, size) == 0);
+	return 0;
+}
+
+static int _checkEvent(CAEN_FELib_EventFile_t* file, const CAEN_FELib_Event_t* event, const struct event* e) {
+	if (_checkField(file, event, "TIMESTAMP", 0, &e->timestamp, sizeof(e->timestamp), 1) != 0)
+		return 1;
+	if (_checkField(file, event, "TRIGGER_ID", 0, &e->triggerId, sizeof(e->triggerId), 1) != 0)
+		return 1;
+	for (size_t ch = 0; ch < N_CHANNELS; ++ch)
+		if (_checkField(file, event, "WAVEFORM", ch, e->waveform[ch], sizeof(e->waveform[ch]), RECORD_LENGTH) != 0)
+			return 1;
+	return 0;
+}
+
+// read the file with the event reader, sequentially and by key
+static int _checkEventFile(const char* filename) {
+	CAEN_FELib_EventFile_t* file;
+	CAEN_FELib_EventFileInfo_t info;
+	CAEN_FELib_Event_t event;
+	TESTS_CHECK_RET(CAEN_FELib_OpenEventFile(filename, &file));
+	TESTS_CHECK_RET(CAEN_FELib_GetEventFileInfo(file, &info));
+	TESTS_CHECK(info.nEvents == N_EVENTS);
+	TESTS_CHECK(info.indexed == 1);
+	TESTS_CHECK(strcmp(info.endpoint, "/endpoint/SCOPE") == 0);
+	TESTS_CHECK_RET(CAEN_FELib_GetEvent(file, 0, &event));
+	for (size_t i = 0; i < N_EVENTS; ++i) {
+		TESTS_CHECK(event.index == i);
+		TESTS_CHECK(strcmp(event.format, SCOPE_FORMAT) == 0);
+		if (_checkEvent(file, &event, &events[i]) != 0)
+			return 1;
+		const int ret = CAEN_FELib_GetNextEvent(file, &event);
+		TESTS_CHECK(ret == ((i + 1 < N_EVENTS) ? CAEN_FELib_Success : CAEN_FELib_Stop));
+	}
+	TESTS_CHECK_RET(CAEN_FELib_FindEvent(file, CAEN_FELib_KEY_TRIGGER_ID, events[N_EVENTS / 2].triggerId, &event));
+	TESTS_CHECK(event.index == N_EVENTS / 2);
+	TESTS_CHECK_RET(CAEN_FELib_FindEvent(file, CAEN_FELib_KEY_TIMESTAMP, events[N_EVENTS / 3].timestamp, &event));
+	TESTS_CHECK(event.index == N_EVENTS / 3);
+	if (_checkEvent(file, &event, &events[N_EVENTS / 3]) != 0)
+		return 1;
+	TESTS_CHECK(CAEN_FELib_FindEvent(file, CAEN_FELib_KEY_TIMESTAMP, events[N_EVENTS - 1].timestamp + 1, &event) == CAEN_FELib_Stop);
+	TESTS_CHECK_RET(CAEN_FELib_CloseEventFile(file));
+	return 0;
+}
+
+#ifdef TESTS_REPLAY
+// play back the file with the replay library, as a device
+static int _checkReplay(const char* filename) {
+	char url[FILENAME_MAX];
+	uint64_t dev;
+	uint64_t ep;
+	// filename is absolute: three slashes
+	snprintf(url, sizeof(url), "replay://%s", filename);
+	TESTS_CHECK_RET(CAEN_FELib_Open(url, &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	TESTS_CHECK_RET(CAEN_FELib_SendCommand(dev, "/cmd/ArmAcquisition"));
+	TESTS_CHECK_RET(CAEN_FELib_SendCommand(dev, "/cmd/SwStartAcquisition"));
+	for (size_t i = 0; i < N_EVENTS; ++i) {
+		struct event e;
+		TESTS_CHECK_RET(_readEvent(ep, &e));
+		TESTS_CHECK(e.timestamp == events[i].timestamp);
+		TESTS_CHECK(e.triggerId == events[i].triggerId);
+		TESTS_CHECK(memcmp(e.waveformSize, events[i].waveformSize, sizeof(e.waveformSize)) == 0);
+		TESTS_CHECK(memcmp(e.waveform, events[i].waveform, sizeof(e.waveform)) == 0);
+	}
+	struct event e;
+	TESTS_CHECK(_readEvent(ep, &e) == CAEN_FELib_Stop);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+#endif
+
+int main(void) {
+	char dir[] = "/tmp/caen-felib-recording-XXXXXX";
+	char filename[FILENAME_MAX];
+	TESTS_CHECK(mkdtemp(dir) != NULL);
+	snprintf(filename, sizeof(filename), "%s/run.evf", dir);
+	int ret = _readEvents();
+	if (ret == 0)
+		ret = _record(filename);
+	if (ret == 0)
+		ret = _checkEventFile(filename);
+#ifdef TESTS_REPLAY
+	if (ret == 0)
+		ret = _checkReplay(filename);
+#endif
+	unlink(filename);
+	rmdir(dir);
+	return ret;
+}
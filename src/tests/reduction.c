@@ -0,0 +1,168 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		reduction.c
+*	\brief		Check of data reduction
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of the data reduction: region of interest, zero suppression and decimation of the
+ * waveforms of a mock run, compared with the same steps applied to the events read without
+ * reduction from a second mock device, whose events are the same, and statistics.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"},{\"name\":\"WAVEFORM\",\"type\":\"U16\",\"dim\":2},{\"name\":\"WAVEFORM_SIZE\",\"type\":\"SIZE_T\",\"dim\":1}]"
+#define MOCK_OPTIONS					"MaxEvents=50&NumCh=2&RecordLengthS=64"
+#define N_EVENTS						50
+#define N_REDUCED						40		// the reduction is disabled after these events
+#define N_CHANNELS						2
+#define RECORD_LENGTH					64
+
+// pulses start at sample 16 with amplitudes from 100 to 1099, so that about half are suppressed;
+// the tail of 2 samples of the region of interest is dropped by the decimation
+#define ROI_START						8
+#define ROI_LENGTH						34
+#define THRESHOLD						600
+#define BASELINE_SAMPLES				8
+#define DECIMATION						4
+#define REDUCTION \
+	"{\"roi\":{\"start\":8,\"length\":34}," \
+	"\"zero_suppression\":{\"threshold\":600,\"polarity\":\"positive\",\"baseline_samples\":8}," \
+	"\"decimation\":4}"
+
+struct event {
+	uint32_t						triggerId;
+	uint16_t						waveform[N_CHANNELS][RECORD_LENGTH];
+	size_t							waveformSize[N_CHANNELS];
+};
+
+static int _readEvent(uint64_t ep, struct event* e) {
+	uint16_t* waveform[N_CHANNELS];
+	for (size_t ch = 0; ch < N_CHANNELS; ++ch)
+		waveform[ch] = e->waveform[ch];
+	TESTS_CHECK_RET(CAEN_FELib_ReadData(ep, 1000, &e->triggerId, waveform, e->waveformSize));
+	return 0;
+}
+
+// read the reference events, without reduction
+static int _readEvents(struct event* events) {
+	uint64_t dev;
+	uint64_t ep;
+	TESTS_CHECK_RET(tests_startMock(MOCK_OPTIONS, &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	for (size_t i = 0; i < N_EVENTS; ++i)
+		if (_readEvent(ep, &events[i]) != 0)
+			return 1;
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+static uint32_t _sum(const uint16_t* samples, size_t n) {
+	uint32_t sum = 0;
+	for (size_t i = 0; i < n; ++i)
+		sum += samples[i];
+	return sum;
+}
+
+// apply the reduction steps to a reference waveform, return the reduced size
+static size_t _reduce(const uint16_t* in, uint16_t* out) {
+	const uint32_t baseline = (_sum(in, BASELINE_SAMPLES) + BASELINE_SAMPLES / 2) / BASELINE_SAMPLES;
+	bool keep = false;
+	for (size_t s = ROI_START; s < ROI_START + ROI_LENGTH; ++s)
+		keep = keep || in[s] > baseline + THRESHOLD;
+	if (!keep)
+		return 0;
+	const size_t size = ROI_LENGTH / DECIMATION;
+	for (size_t i = 0; i < size; ++i)
+		out[i] = (uint16_t)((_sum(&in[ROI_START + i * DECIMATION], DECIMATION) + DECIMATION / 2) / DECIMATION);
+	return size;
+}
+
+int main(void) {
+	static struct event events[N_EVENTS];
+	if (_readEvents(events) != 0)
+		return 1;
+	uint64_t dev;
+	uint64_t ep;
+	TESTS_CHECK_RET(tests_startMock(MOCK_OPTIONS, &dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(dev, "/endpoint/SCOPE", &ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(ep, SCOPE_FORMAT));
+	TESTS_CHECK(CAEN_FELib_SetDataReduction(ep, "{\"decimation\":0}") == CAEN_FELib_InvalidParam);
+	TESTS_CHECK_RET(CAEN_FELib_SetDataReduction(ep, REDUCTION));
+	size_t kept = 0;
+	size_t suppressed = 0;
+	for (size_t i = 0; i < N_REDUCED; ++i) {
+		struct event e;
+		if (_readEvent(ep, &e) != 0)
+			return 1;
+		TESTS_CHECK(e.triggerId == events[i].triggerId);
+		for (size_t ch = 0; ch < N_CHANNELS; ++ch) {
+			uint16_t expected[RECORD_LENGTH];
+			const size_t size = _reduce(events[i].waveform[ch], expected);
+			TESTS_CHECK(e.waveformSize[ch] == size);
+			TESTS_CHECK(memcmp(e.waveform[ch], expected, size * sizeof(*expected)) == 0);
+			if (size != 0)
+				++kept;
+			else
+				++suppressed;
+		}
+	}
+	// both outcomes of the zero suppression must have been checked
+	TESTS_CHECK(kept != 0 && suppressed != 0);
+	CAEN_FELib_ReductionStats_t stats;
+	TESTS_CHECK_RET(CAEN_FELib_GetDataReductionStats(ep, &stats));
+	TESTS_CHECK(stats.events == N_REDUCED);
+	TESTS_CHECK(stats.samplesIn == N_REDUCED * N_CHANNELS * RECORD_LENGTH);
+	TESTS_CHECK(stats.samplesOut == kept * (ROI_LENGTH / DECIMATION));
+	TESTS_CHECK(stats.suppressed == suppressed);
+	// waveforms are returned unchanged once disabled
+	TESTS_CHECK_RET(CAEN_FELib_SetDataReduction(ep, NULL));
+	for (size_t i = N_REDUCED; i < N_EVENTS; ++i) {
+		struct event e;
+		if (_readEvent(ep, &e) != 0)
+			return 1;
+		TESTS_CHECK(e.triggerId == events[i].triggerId);
+		TESTS_CHECK(memcmp(e.waveformSize, events[i].waveformSize, sizeof(e.waveformSize)) == 0);
+		TESTS_CHECK(memcmp(e.waveform, events[i].waveform, sizeof(e.waveform)) == 0);
+	}
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
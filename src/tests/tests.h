@@ -0,0 +1,79 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		tests.h
+*	\brief		Helpers shared by the test programs
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_TESTS_H_
+#define CAEN_INCLUDE_TESTS_H_
+
+/*
+ * Helpers shared by the programs run by "make check", against the mock implementation library.
+ *
+ * Programs return 0 on success, 1 on failure and TESTS_SKIP if the test cannot run here;
+ * the environment set by src/Makefile.am makes libCAEN_Mock loadable by CAEN_FELib_Open().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <CAEN_FELib.h>
+
+#define TESTS_SKIP						77
+
+// on failure, print the location and the last error of the library, then return 1 from the caller
+#define TESTS_CHECK(COND) do { \
+	if (!(COND)) { \
+		char _description[1024]; \
+		CAEN_FELib_GetLastError(_description); \
+		fprintf(stderr, "%s:%d: check failed: %s (last error: %s)\n", __FILE__, __LINE__, #COND, _description); \
+		return 1; \
+	} \
+} while (0)
+
+#define TESTS_CHECK_RET(CALL)			TESTS_CHECK((CALL) == CAEN_FELib_Success)
+
+// open a mock device and arm a run of maxEvents events, generated without delay
+static inline int tests_startMock(const char* options, uint64_t* dev) {
+	char url[256];
+	snprintf(url, sizeof(url), "mock://test?EventRate=0&%s", options);
+	int ret = CAEN_FELib_Open(url, dev);
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	ret = CAEN_FELib_SendCommand(*dev, "/cmd/ArmAcquisition");
+	if (ret != CAEN_FELib_Success)
+		return ret;
+	return CAEN_FELib_SendCommand(*dev, "/cmd/SwStartAcquisition");
+}
+
+#endif
@@ -0,0 +1,132 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		tree.c
+*	\brief		Check of tree walk
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of CAEN_FELib_WalkTree() on the tree of the mock: nodes, order and parents compared with
+ * a walk performed with CAEN_FELib_GetChildHandles() and CAEN_FELib_GetNodeProperties(), and
+ * maximum depth, subtrees and arrays too small for the whole walk.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+#include "../utils.h"
+
+#define MAX_NODES						64
+
+// depth-first walk with a call per node, like the one performed for libraries without WalkTree
+static int _walk(uint64_t handle, uint64_t parent, uint32_t depth, CAEN_FELib_TreeNode_t* nodes, size_t* count) {
+	TESTS_CHECK(*count < MAX_NODES);
+	CAEN_FELib_TreeNode_t* const node = &nodes[(*count)++];
+	node->handle = handle;
+	node->parent = parent;
+	node->depth = depth;
+	TESTS_CHECK_RET(CAEN_FELib_GetNodeProperties(handle, NULL, node->name, &node->type));
+	uint64_t children[MAX_NODES];
+	const int nChildren = CAEN_FELib_GetChildHandles(handle, NULL, children, ARRAY_SIZE(children));
+	TESTS_CHECK(nChildren >= 0 && nChildren <= MAX_NODES);
+	for (int i = 0; i < nChildren; ++i) {
+		uint64_t childParent;
+		TESTS_CHECK_RET(CAEN_FELib_GetParentHandle(children[i], NULL, &childParent));
+		TESTS_CHECK(childParent == handle);
+		if (_walk(children[i], handle, depth + 1, nodes, count) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+static int _checkNode(const CAEN_FELib_TreeNode_t* node, const CAEN_FELib_TreeNode_t* expected, uint32_t depth) {
+	TESTS_CHECK(node->handle == expected->handle);
+	TESTS_CHECK(node->parent == ((node->depth != 0) ? expected->parent : 0));
+	TESTS_CHECK(strcmp(node->name, expected->name) == 0);
+	TESTS_CHECK(node->type == expected->type);
+	TESTS_CHECK(node->depth == expected->depth - depth);
+	return 0;
+}
+
+// check a walk from the n-th expected node, and the expected nodes with at most maxDepth
+static int _checkWalk(uint64_t dev, const char* path, int maxDepth, const CAEN_FELib_TreeNode_t* expected, size_t nExpected, size_t root) {
+	CAEN_FELib_TreeNode_t nodes[MAX_NODES];
+	const uint32_t depth = expected[root].depth;
+	size_t n = 0;
+	for (size_t i = root; i < nExpected && (i == root || expected[i].depth > depth); ++i)
+		if (maxDepth < 0 || expected[i].depth - depth <= (uint32_t)maxDepth)
+			++n;
+	TESTS_CHECK(CAEN_FELib_WalkTree(dev, path, maxDepth, NULL, 0) == (int)n);
+	TESTS_CHECK(CAEN_FELib_WalkTree(dev, path, maxDepth, nodes, ARRAY_SIZE(nodes)) == (int)n);
+	size_t j = 0;
+	for (size_t i = root; j < n; ++i) {
+		if (maxDepth >= 0 && expected[i].depth - depth > (uint32_t)maxDepth)
+			continue;
+		if (_checkNode(&nodes[j++], &expected[i], depth) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+	uint64_t dev;
+	TESTS_CHECK_RET(CAEN_FELib_Open("mock://test", &dev));
+	CAEN_FELib_TreeNode_t expected[MAX_NODES];
+	size_t nExpected = 0;
+	if (_walk(dev, 0, 0, expected, &nExpected) != 0)
+		return 1;
+	// the whole tree, and its first two levels
+	if (_checkWalk(dev, NULL, -1, expected, nExpected, 0) != 0)
+		return 1;
+	if (_checkWalk(dev, NULL, 1, expected, nExpected, 0) != 0)
+		return 1;
+	// a subtree, rooted at one of the folders
+	size_t cmd = 0;
+	while (cmd < nExpected && strcmp(expected[cmd].name, "cmd") != 0)
+		++cmd;
+	TESTS_CHECK(cmd < nExpected);
+	if (_checkWalk(dev, "/cmd", -1, expected, nExpected, cmd) != 0)
+		return 1;
+	// only the first nodes are written, the return value is the size of the whole walk
+	CAEN_FELib_TreeNode_t nodes[3];
+	TESTS_CHECK(CAEN_FELib_WalkTree(dev, NULL, -1, nodes, ARRAY_SIZE(nodes)) == (int)nExpected);
+	for (size_t i = 0; i < ARRAY_SIZE(nodes); ++i)
+		if (_checkNode(&nodes[i], &expected[i], 0) != 0)
+			return 1;
+	TESTS_CHECK(CAEN_FELib_WalkTree(dev, "/none", -1, nodes, ARRAY_SIZE(nodes)) < 0);
+	TESTS_CHECK(CAEN_FELib_WalkTree(dev, NULL, -1, NULL, 1) == CAEN_FELib_InvalidParam);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
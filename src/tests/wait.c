@@ -0,0 +1,142 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		wait.c
+*	\brief		Check of waits in microseconds
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of CAEN_FELib_ReadDataUs() and CAEN_FELib_HasDataUs() on the mock: events read with the
+ * default and block policies, timeouts shorter than a millisecond, and wait statistics.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tests.h"
+#include "../utils.h"
+
+#define SCOPE_FORMAT					"[{\"name\":\"TRIGGER_ID\",\"type\":\"U32\"}]"
+#define N_EVENTS						50
+#define TIMEOUT_US						300
+
+static int _open(const char* options, uint64_t* dev, uint64_t* ep) {
+	TESTS_CHECK_RET(tests_startMock(options, dev));
+	TESTS_CHECK_RET(CAEN_FELib_GetHandle(*dev, "/endpoint/SCOPE", ep));
+	TESTS_CHECK_RET(CAEN_FELib_SetReadDataFormat(*ep, SCOPE_FORMAT));
+	return 0;
+}
+
+// events available without delay, found by the spin or, if the budget has adapted to zero, by the blocking wait
+static int _checkDefault(void) {
+	uint64_t dev;
+	uint64_t ep;
+	if (_open("MaxEvents=50", &dev, &ep) != 0)
+		return 1;
+	// no statistics before the first wait
+	CAEN_FELib_WaitStats_t stats;
+	TESTS_CHECK(CAEN_FELib_GetWaitStats(ep, &stats) != CAEN_FELib_Success);
+	for (uint32_t i = 0; i < N_EVENTS; ++i) {
+		uint32_t triggerId;
+		TESTS_CHECK_RET(CAEN_FELib_ReadDataUs(ep, 1000000, &triggerId));
+		TESTS_CHECK(triggerId == i);
+	}
+	uint32_t triggerId;
+	TESTS_CHECK(CAEN_FELib_ReadDataUs(ep, 1000000, &triggerId) == CAEN_FELib_Stop);
+	TESTS_CHECK_RET(CAEN_FELib_GetWaitStats(ep, &stats));
+	TESTS_CHECK(stats.spinHits + stats.blockHits == N_EVENTS);
+	TESTS_CHECK(stats.timeouts == 0);
+	TESTS_CHECK(stats.interArrivalNs != 0);
+	TESTS_CHECK(stats.spinBudgetNs <= 50000);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+// no spin: every event is found by the blocking wait
+static int _checkBlock(void) {
+	uint64_t dev;
+	uint64_t ep;
+	if (_open("MaxEvents=50", &dev, &ep) != 0)
+		return 1;
+	TESTS_CHECK_RET(CAEN_FELib_SetWaitPolicy(ep, "{\"mode\":\"block\"}"));
+	for (uint32_t i = 0; i < N_EVENTS; ++i) {
+		uint32_t triggerId;
+		TESTS_CHECK_RET(CAEN_FELib_HasDataUs(ep, 1000000));
+		TESTS_CHECK_RET(CAEN_FELib_ReadData(ep, 0, &triggerId));
+		TESTS_CHECK(triggerId == i);
+	}
+	CAEN_FELib_WaitStats_t stats;
+	TESTS_CHECK_RET(CAEN_FELib_GetWaitStats(ep, &stats));
+	TESTS_CHECK(stats.blockHits == N_EVENTS);
+	TESTS_CHECK(stats.spinHits == 0 && stats.spinNs == 0);
+	TESTS_CHECK(stats.spinBudgetNs == 0);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+// a timeout shorter than a millisecond is waited spinning, without blocking
+static int _checkTimeout(void) {
+	uint64_t dev;
+	uint64_t ep;
+	// the second event after a second
+	if (_open("MaxEvents=2&EventRate=1", &dev, &ep) != 0)
+		return 1;
+	uint32_t triggerId;
+	TESTS_CHECK_RET(CAEN_FELib_ReadDataUs(ep, 1000000, &triggerId));
+	TESTS_CHECK(CAEN_FELib_SetWaitPolicy(ep, "{\"mode\":\"spin\"}") == CAEN_FELib_InvalidParam);
+	TESTS_CHECK(CAEN_FELib_SetWaitPolicy(ep, "{\"max_spin_us\":-1}") == CAEN_FELib_InvalidParam);
+	TESTS_CHECK_RET(CAEN_FELib_SetWaitPolicy(ep, "{\"mode\":\"busy\",\"max_spin_us\":100,\"adaptive\":false}"));
+	const uint64_t start = utils_now();
+	TESTS_CHECK(CAEN_FELib_ReadDataUs(ep, TIMEOUT_US, &triggerId) == CAEN_FELib_Timeout);
+	const uint64_t elapsed = utils_now() - start;
+	TESTS_CHECK(elapsed >= TIMEOUT_US * UINT64_C(1000));
+	CAEN_FELib_WaitStats_t stats;
+	TESTS_CHECK_RET(CAEN_FELib_GetWaitStats(ep, &stats));
+	TESTS_CHECK(stats.timeouts == 1);
+	TESTS_CHECK(stats.spinHits == 0 && stats.blockHits == 0);
+	TESTS_CHECK(stats.blockNs == 0);
+	TESTS_CHECK(stats.spinNs >= TIMEOUT_US * UINT64_C(1000) && stats.spinNs <= elapsed);
+	TESTS_CHECK(stats.spinBudgetNs == 100000);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	return 0;
+}
+
+int main(void) {
+	if (_checkDefault() != 0)
+		return 1;
+	if (_checkBlock() != 0)
+		return 1;
+	if (_checkTimeout() != 0)
+		return 1;
+	return 0;
+}
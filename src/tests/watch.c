@@ -0,0 +1,150 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		watch.c
+*	\brief		Check of parameter watches
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of CAEN_FELib_Watch(): the callback of a parameter changing continuously is invoked once
+ * per period, a constant parameter is notified only when set, and no callback is invoked after
+ * CAEN_FELib_Unwatch() returns.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "tests.h"
+
+#define PERIOD_MS						20
+#define RUN_MS							500
+#define MIN_CALLBACKS					(RUN_MS / PERIOD_MS / 4)	// loose, the scheduler thread can be delayed
+#define MAX_CALLBACKS					(RUN_MS / PERIOD_MS + 2)
+
+struct watch_state {
+	pthread_mutex_t					mutex;
+	size_t							callbacks;
+	size_t							events;
+	uint64_t						lastTimestamp;
+	uint64_t						minInterval;
+	int								ret;
+	char							value[256];
+};
+
+static void CAEN_FELIB_API _onChange(const CAEN_FELib_WatchEvent_t* events, size_t n, void* ctx) {
+	struct watch_state* const s = ctx;
+	pthread_mutex_lock(&s->mutex);
+	for (size_t i = 0; i < n; ++i) {
+		if (s->lastTimestamp != 0 && events[i].timestamp - s->lastTimestamp < s->minInterval)
+			s->minInterval = events[i].timestamp - s->lastTimestamp;
+		s->lastTimestamp = events[i].timestamp;
+		s->ret = events[i].ret;
+		snprintf(s->value, sizeof(s->value), "%s", events[i].value);
+	}
+	s->events += n;
+	++s->callbacks;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+static void _init(struct watch_state* s) {
+	memset(s, 0, sizeof(*s));
+	pthread_mutex_init(&s->mutex, NULL);
+	s->minInterval = UINT64_MAX;
+}
+
+static size_t _callbacks(struct watch_state* s) {
+	pthread_mutex_lock(&s->mutex);
+	const size_t callbacks = s->callbacks;
+	pthread_mutex_unlock(&s->mutex);
+	return callbacks;
+}
+
+// the event counter of a running mock changes on every sample
+static int _checkPeriod(void) {
+	uint64_t dev;
+	struct watch_state s;
+	CAEN_FELib_Watch_t* watch;
+	const char* const paths[] = { "/par/EventCount" };
+	_init(&s);
+	TESTS_CHECK_RET(tests_startMock("EventRate=100000", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_Watch(dev, paths, 1, PERIOD_MS, _onChange, &s, &watch));
+	usleep(RUN_MS * 1000);
+	TESTS_CHECK_RET(CAEN_FELib_Unwatch(watch));
+	const size_t callbacks = _callbacks(&s);
+	printf("%zu callbacks in %d ms, period %d ms\n", callbacks, RUN_MS, PERIOD_MS);
+	TESTS_CHECK(callbacks >= MIN_CALLBACKS && callbacks <= MAX_CALLBACKS);
+	TESTS_CHECK(s.events == callbacks);
+	TESTS_CHECK(s.ret == CAEN_FELib_Success);
+	// samples are not taken before the period, with a margin for the clock granularity
+	TESTS_CHECK(s.minInterval >= (uint64_t)PERIOD_MS * 900000);
+	// stopped on remove
+	usleep(5 * PERIOD_MS * 1000);
+	TESTS_CHECK(_callbacks(&s) == callbacks);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	pthread_mutex_destroy(&s.mutex);
+	return 0;
+}
+
+// a constant parameter is notified at the first sample, and then only when changed
+static int _checkChange(void) {
+	uint64_t dev;
+	struct watch_state s;
+	CAEN_FELib_Watch_t* watch;
+	const char* const paths[] = { "/par/NumCh" };
+	_init(&s);
+	TESTS_CHECK_RET(CAEN_FELib_Open("mock://test?NumCh=4", &dev));
+	TESTS_CHECK_RET(CAEN_FELib_Watch(dev, paths, 1, PERIOD_MS, _onChange, &s, &watch));
+	usleep(10 * PERIOD_MS * 1000);
+	TESTS_CHECK(_callbacks(&s) == 1);
+	TESTS_CHECK(strcmp(s.value, "4") == 0);
+	TESTS_CHECK_RET(CAEN_FELib_SetValue(dev, "/par/NumCh", "8"));
+	usleep(10 * PERIOD_MS * 1000);
+	TESTS_CHECK_RET(CAEN_FELib_Unwatch(watch));
+	TESTS_CHECK(_callbacks(&s) == 2);
+	TESTS_CHECK(strcmp(s.value, "8") == 0);
+	TESTS_CHECK_RET(CAEN_FELib_Close(dev));
+	pthread_mutex_destroy(&s.mutex);
+	return 0;
+}
+
+int main(void) {
+	if (_checkPeriod() != 0)
+		return 1;
+	if (_checkChange() != 0)
+		return 1;
+	return 0;
+}
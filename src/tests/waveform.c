@@ -0,0 +1,155 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		waveform.c
+*	\brief		Check of the waveform kernels
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+
+/*
+ * Check of the waveform kernels: each kernel supported by the CPU must give the same result of the
+ * scalar one, on every length (to cover vector tails), on unaligned buffers and with decimation.
+ *
+ * waveform.c is included to reach its kernels, that are selected once and hidden otherwise.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../waveform.c"
+
+#include "tests.h"
+
+#define MAX_SIZE						1031
+#define LONG_SIZE						(2 * WAVEFORM_SUM_BLOCK + 17)
+
+// required by waveform.c, the library one is not exported
+void _setLastLocalError(const char* description, ...) {
+	(void)description;
+}
+
+static uint16_t samples[LONG_SIZE + 1];
+static float expected[MAX_SIZE];
+static float actual[MAX_SIZE];
+
+static uint32_t _random(uint32_t* state) {
+	// xorshift32, deterministic
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static int _checkSum(const struct waveform_kernel* k) {
+	for (size_t n = 0; n <= MAX_SIZE; ++n) {
+		// offset 1 makes the buffer unaligned
+		TESTS_CHECK(k->sum(&samples[1], n, UINT16_MAX) == _sumScalar(&samples[1], n, UINT16_MAX));
+		TESTS_CHECK(k->sum(samples, n, 0x3FFF) == _sumScalar(samples, n, 0x3FFF));
+	}
+	// longer than a block of 32-bit lanes
+	TESTS_CHECK(k->sum(samples, LONG_SIZE, UINT16_MAX) == _sumScalar(samples, LONG_SIZE, UINT16_MAX));
+	return 0;
+}
+
+static int _checkFindOutside(const struct waveform_kernel* k) {
+	static uint16_t flat[MAX_SIZE];
+	for (size_t i = 0; i < MAX_SIZE; ++i)
+		flat[i] = 1000 + (uint16_t)(i % 7);
+	for (size_t n = 0; n <= MAX_SIZE; n += (n < 130) ? 1 : 37) {
+		TESTS_CHECK(k->findOutside(flat, n, 1000, 1006) == n);
+		for (size_t p = 0; p < n; p += (n < 70) ? 1 : 13) {
+			flat[p] = 999;
+			TESTS_CHECK(k->findOutside(flat, n, 1000, 1006) == p);
+			flat[p] = 1007;
+			TESTS_CHECK(k->findOutside(flat, n, 1000, 1006) == p);
+			flat[p] = 1000;
+		}
+	}
+	return 0;
+}
+
+static int _checkConvert(const struct waveform_kernel* k) {
+	const size_t decimations[] = { 0, 1, 2, 3, 7, 16, 33 };
+	const size_t preTriggers[] = { 0, 1, 5, 64 };
+	for (size_t d = 0; d < ARRAY_SIZE(decimations); ++d) {
+		for (size_t t = 0; t < ARRAY_SIZE(preTriggers); ++t) {
+			for (size_t n = preTriggers[t]; n <= MAX_SIZE; n += (n < 80) ? 1 : 29) {
+				const CAEN_FELib_WaveformConversion_t conversion = {
+					.mask = 0x3FFF,
+					.preTrigger = preTriggers[t],
+					.baseline = 8191.5f,
+					.gain = 0.125f,
+					.decimation = decimations[d],
+				};
+				size_t expectedSize;
+				size_t actualSize;
+				float expectedBaseline;
+				float actualBaseline;
+				TESTS_CHECK_RET(_convert(&scalarKernel, &samples[1], n, &conversion, expected, &expectedSize, &expectedBaseline));
+				TESTS_CHECK_RET(_convert(k, &samples[1], n, &conversion, actual, &actualSize, &actualBaseline));
+				TESTS_CHECK(actualSize == expectedSize);
+				TESTS_CHECK(actualBaseline == expectedBaseline);
+				TESTS_CHECK(memcmp(actual, expected, expectedSize * sizeof(*expected)) == 0);
+			}
+		}
+	}
+	return 0;
+}
+
+static int _checkKernel(const struct waveform_kernel* k) {
+	printf("kernel %s\n", k->name);
+	if (_checkSum(k) != 0)
+		return 1;
+	if (_checkFindOutside(k) != 0)
+		return 1;
+	if (_checkConvert(k) != 0)
+		return 1;
+	return 0;
+}
+
+int main(void) {
+	uint32_t state = 2463534242;
+	for (size_t i = 0; i < ARRAY_SIZE(samples); ++i)
+		samples[i] = (uint16_t)_random(&state);
+#ifdef WAVEFORM_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2") && _checkKernel(&sse2Kernel) != 0)
+		return 1;
+	if (__builtin_cpu_supports("avx2") && _checkKernel(&avx2Kernel) != 0)
+		return 1;
+	if (__builtin_cpu_supports("avx512f") && _checkKernel(&avx512Kernel) != 0)
+		return 1;
+#endif
+	return 0;
+}
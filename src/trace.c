@@ -0,0 +1,248 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		trace.c
+*	\brief		Call tracing
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "trace.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h> // _getpid
+#define getpid _getpid
+#else
+#include <unistd.h> // getpid
+#endif
+
+#define TRACE_PATH_SIZE				48		// path is truncated on trace buffer records
+
+struct trace_record {
+	const char*						function;
+	uint64_t						handle;
+	uint64_t						begin;
+	uint64_t						end;
+	int								ret;
+	char							path[TRACE_PATH_SIZE];
+};
+
+// one per thread, written only by the owner thread
+struct trace_buffer {
+	struct trace_buffer*			next;
+	uint_fast32_t					tid;
+	size_t							size;
+	uint64_t						head;	// total number of records written
+	struct trace_record				records[];
+};
+
+bool traceActive;
+
+static struct {
+	CAEN_FELib_TraceHook_t			pre;
+	CAEN_FELib_TraceHook_t			post;
+	void*							ctx;
+} traceHook;
+
+static mutex_t traceMutex = MUTEX_INITIALIZER;
+static struct trace_buffer* traceBuffers;		// list of all thread buffers, protected by traceMutex
+static size_t traceBufferSize;					// zero if buffer is disabled
+static uint_fast32_t traceGeneration;			// incremented when buffers are released
+static uint_fast32_t traceLastTid;
+
+static THREAD_LOCAL struct trace_buffer* localBuffer;
+static THREAD_LOCAL uint_fast32_t localGeneration;
+
+static void _updateActive(void) {
+	traceActive = (traceHook.pre != NULL) || (traceHook.post != NULL) || (traceBufferSize != 0);
+}
+
+// allocate the buffer of the current thread and register it, if not yet done
+static struct trace_buffer* _localBuffer(void) {
+	if (LIKELY(localBuffer != NULL && localGeneration == traceGeneration))
+		return localBuffer;
+	mutex_lock(&traceMutex);
+	struct trace_buffer* buffer = NULL;
+	if (traceBufferSize != 0) {
+		buffer = malloc(sizeof(*buffer) + traceBufferSize * sizeof(buffer->records[0]));
+		if (buffer != NULL) {
+			buffer->tid = ++traceLastTid;
+			buffer->size = traceBufferSize;
+			buffer->head = 0;
+			buffer->next = traceBuffers;
+			traceBuffers = buffer;
+		}
+	}
+	localBuffer = buffer;
+	localGeneration = traceGeneration;
+	mutex_unlock(&traceMutex);
+	return buffer;
+}
+
+static void _record(const CAEN_FELib_TraceInfo_t* info) {
+	struct trace_buffer* const buffer = _localBuffer();
+	if (buffer == NULL)
+		return;
+	struct trace_record* const r = &buffer->records[buffer->head % buffer->size];
+	r->function = info->function;
+	r->handle = info->handle;
+	r->begin = info->begin;
+	r->end = info->end;
+	r->ret = info->ret;
+	r->path[0] = '\0';
+	if (info->path != NULL)
+		strncat(r->path, info->path, ARRAY_SIZE(r->path) - 1);
+	++buffer->head;
+}
+
+void trace_begin(CAEN_FELib_TraceInfo_t* info, const char* function, uint64_t handle, const char* path) {
+	info->function = function;
+	info->handle = handle;
+	info->path = path;
+	info->ret = CAEN_FELib_Success;
+	info->end = 0;
+	if (traceHook.pre != NULL) {
+		info->begin = utils_now();
+		traceHook.pre(info, traceHook.ctx);
+	}
+	info->begin = utils_now(); // do not account pre hook duration
+}
+
+void trace_end(CAEN_FELib_TraceInfo_t* info, int ret) {
+	info->end = utils_now();
+	info->ret = ret;
+	if (traceBufferSize != 0)
+		_record(info);
+	if (traceHook.post != NULL)
+		traceHook.post(info, traceHook.ctx);
+}
+
+int trace_setHook(CAEN_FELib_TraceHook_t pre, CAEN_FELib_TraceHook_t post, void* ctx) {
+	traceHook.pre = pre;
+	traceHook.post = post;
+	traceHook.ctx = ctx;
+	_updateActive();
+	return CAEN_FELib_Success;
+}
+
+static void _releaseBuffers(void) {
+	while (traceBuffers != NULL) {
+		struct trace_buffer* const next = traceBuffers->next;
+		free(traceBuffers);
+		traceBuffers = next;
+	}
+	++traceGeneration; // invalidate thread local pointers
+}
+
+int trace_setBuffer(size_t size) {
+	if (size > SIZE_MAX / sizeof(struct trace_record)) {
+		_setLastLocalError("trace buffer size too large (%zu)", size);
+		return CAEN_FELib_InvalidParam;
+	}
+	mutex_lock(&traceMutex);
+	_releaseBuffers();
+	traceBufferSize = size;
+	mutex_unlock(&traceMutex);
+	_updateActive();
+	return CAEN_FELib_Success;
+}
+
+static void _printEscaped(FILE* f, const char* s) {
+	for (; *s != '\0'; ++s) {
+		const unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+}
+
+int trace_dump(const char* filename) {
+	if (filename == NULL) {
+		_setLastLocalError("NULL argument");
+		return CAEN_FELib_InvalidParam;
+	}
+	FILE* const f = fopen(filename, "w");
+	if (f == NULL) {
+		_setLastLocalError("cannot open '%s': %s", filename, strerror(errno));
+		return CAEN_FELib_GenericError;
+	}
+	const long pid = (long)getpid();
+	bool first = true;
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", f);
+	mutex_lock(&traceMutex);
+	for (const struct trace_buffer* b = traceBuffers; b != NULL; b = b->next) {
+		const uint64_t head = b->head;
+		const uint64_t count = (head < b->size) ? head : b->size;
+		// chronological order, from the oldest record
+		for (uint64_t i = head - count; i != head; ++i) {
+			const struct trace_record* const r = &b->records[i % b->size];
+			// timestamps in microseconds, as required by the format
+			fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"felib\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%"PRIuFAST32",\"ts\":%"PRIu64".%03"PRIu64",\"dur\":%"PRIu64".%03"PRIu64",",
+				first ? "" : ",",
+				r->function,
+				pid,
+				b->tid,
+				r->begin / 1000, r->begin % 1000,
+				(r->end - r->begin) / 1000, (r->end - r->begin) % 1000
+			);
+			fprintf(f, "\"args\":{\"handle\":\"0x%016"PRIx64"\",\"ret\":%d,\"path\":\"", r->handle, r->ret);
+			_printEscaped(f, r->path);
+			fputs("\"}}", f);
+			first = false;
+		}
+	}
+	mutex_unlock(&traceMutex);
+	fputs("\n]}\n", f);
+	if (fclose(f) != 0) {
+		_setLastLocalError("cannot write '%s': %s", filename, strerror(errno));
+		return CAEN_FELib_GenericError;
+	}
+	return CAEN_FELib_Success;
+}
+
+void trace_deinit(void) {
+	traceHook.pre = NULL;
+	traceHook.post = NULL;
+	traceHook.ctx = NULL;
+	mutex_lock(&traceMutex);
+	_releaseBuffers();
+	traceBufferSize = 0;
+	mutex_unlock(&traceMutex);
+	_updateActive();
+}
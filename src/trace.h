@@ -0,0 +1,62 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		trace.h
+*	\brief		Call tracing
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_TRACE_H_
+#define CAEN_INCLUDE_TRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "utils.h"
+
+// true if either a hook or the trace buffer is enabled
+extern bool traceActive;
+
+static inline bool trace_isActive(void) {
+	return UNLIKELY(traceActive);
+}
+
+void trace_begin(CAEN_FELib_TraceInfo_t* info, const char* function, uint64_t handle, const char* path);
+void trace_end(CAEN_FELib_TraceInfo_t* info, int ret);
+
+int trace_setHook(CAEN_FELib_TraceHook_t pre, CAEN_FELib_TraceHook_t post, void* ctx);
+int trace_setBuffer(size_t size);
+int trace_dump(const char* filename);
+void trace_deinit(void);
+
+#endif /* CAEN_INCLUDE_TRACE_H_ */
@@ -0,0 +1,277 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		utils.h
+*	\brief		Utilities shared by internal modules
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_UTILS_H_
+#define CAEN_INCLUDE_UTILS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "CAEN_FELib.h"
+
+// _Thread_local is C11 with thread support
+#if (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
+#define THREAD_LOCAL				_Thread_local
+#elif defined(_WIN32)
+#define THREAD_LOCAL				__declspec(thread)
+#elif defined(__GNUC__)
+#define THREAD_LOCAL				__thread
+#else
+#error unsupported compiler
+#endif
+
+// _Static_assert is C11
+#if (__STDC_VERSION__ >= 201112L)
+#define STATIC_ASSERT(COND, MSG)	_Static_assert(COND, CAEN_FELIB_STR(MSG))
+#else
+#define STATIC_ASSERT(COND, MSG)	typedef char _static_assertion_##MSG[(COND) ? 1 : -1]
+#endif
+
+// branch prediction hints
+#if defined(__GNUC__)
+#define LIKELY(x)					__builtin_expect(!!(x), 1)
+#define UNLIKELY(x)					__builtin_expect(!!(x), 0)
+#else
+#define LIKELY(x)					(x)
+#define UNLIKELY(x)					(x)
+#endif
+
+#define ARRAY_SIZE(x)				(sizeof(x)/sizeof((x)[0]))
+
+// size of cache line, used to avoid false sharing (128 on Apple M1, but 64 is fine)
+#define CACHE_LINE_SIZE				64
+
+// alignment of variables and members
+#if defined(_MSC_VER)
+#define ALIGNED(n)					__declspec(align(n))
+#else
+#define ALIGNED(n)					__attribute__((aligned(n)))
+#endif
+
+// atomic operations on variables shared with other threads or processes
+#if defined(__GNUC__) || defined(__clang__)
+#define ATOMIC_LOAD_RELAXED(p)		__atomic_load_n(p, __ATOMIC_RELAXED)
+#define ATOMIC_LOAD_ACQUIRE(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE_RELAXED(p, v)	__atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define ATOMIC_STORE_RELEASE(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ATOMIC_FETCH_ADD(p, v)		__atomic_fetch_add(p, v, __ATOMIC_SEQ_CST)
+#define ATOMIC_CAS_WEAK(p, e, d)	__atomic_compare_exchange_n(p, e, d, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ATOMIC_FENCE_ACQUIRE()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define ATOMIC_FENCE_RELEASE()		__atomic_thread_fence(__ATOMIC_RELEASE)
+#define ATOMIC_FENCE_SEQ_CST()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(_MSC_VER)
+/*
+ * MSVC has no atomic builtins for variables not declared _Atomic: operations are dispatched on the
+ * type of the variable with _Generic (Visual Studio 2019 16.8 or later, with /std:c11 or /std:c17),
+ * pointers being the default case. Loads and stores of aligned variables are single-copy atomic,
+ * and are ordered by _atomicBarrier() where required; read-modify-write operations are full barriers.
+ */
+#include <intrin.h>
+
+static inline void _atomicBarrier(void) {
+#if defined(_M_ARM) || defined(_M_ARM64)
+	__dmb(0xB); // ISH
+#else
+	_ReadWriteBarrier(); // x86 and x64 loads have acquire and stores have release semantics
+#endif
+}
+
+#define ATOMIC_DEFINE_MSVC(NAME, TYPE, ITYPE, BITS) \
+	static inline TYPE _atomicLoad##NAME(const volatile void* p) { return (TYPE)__iso_volatile_load##BITS((const volatile ITYPE*)p); } \
+	static inline TYPE _atomicLoadAcquire##NAME(const volatile void* p) { const TYPE v = _atomicLoad##NAME(p); _atomicBarrier(); return v; } \
+	static inline void _atomicStore##NAME(volatile void* p, const TYPE v) { __iso_volatile_store##BITS((volatile ITYPE*)p, (ITYPE)v); } \
+	static inline void _atomicStoreRelease##NAME(volatile void* p, const TYPE v) { _atomicBarrier(); _atomicStore##NAME(p, v); }
+#define ATOMIC_DEFINE_MSVC_RMW(NAME, TYPE, ITYPE, ADD, CAS) \
+	static inline TYPE _atomicFetchAdd##NAME(volatile void* p, TYPE v) { return (TYPE)ADD((volatile ITYPE*)p, (ITYPE)v); } \
+	static inline bool _atomicCas##NAME(volatile void* p, void* expected, TYPE desired) { \
+		const TYPE e = *(TYPE*)expected; \
+		const TYPE old = (TYPE)CAS((volatile ITYPE*)p, (ITYPE)desired, (ITYPE)e); \
+		*(TYPE*)expected = old; \
+		return old == e; \
+	}
+
+ATOMIC_DEFINE_MSVC(Bool, bool, __int8, 8)
+ATOMIC_DEFINE_MSVC(Int, int, __int32, 32)
+ATOMIC_DEFINE_MSVC(UInt, unsigned int, __int32, 32)
+ATOMIC_DEFINE_MSVC(Long, long, __int32, 32)
+ATOMIC_DEFINE_MSVC(ULong, unsigned long, __int32, 32)
+ATOMIC_DEFINE_MSVC(LLong, long long, __int64, 64)
+ATOMIC_DEFINE_MSVC(ULLong, unsigned long long, __int64, 64)
+ATOMIC_DEFINE_MSVC_RMW(Int, int, long, _InterlockedExchangeAdd, _InterlockedCompareExchange)
+ATOMIC_DEFINE_MSVC_RMW(UInt, unsigned int, long, _InterlockedExchangeAdd, _InterlockedCompareExchange)
+ATOMIC_DEFINE_MSVC_RMW(Long, long, long, _InterlockedExchangeAdd, _InterlockedCompareExchange)
+ATOMIC_DEFINE_MSVC_RMW(ULong, unsigned long, long, _InterlockedExchangeAdd, _InterlockedCompareExchange)
+ATOMIC_DEFINE_MSVC_RMW(LLong, long long, LONG64, InterlockedExchangeAdd64, InterlockedCompareExchange64)
+ATOMIC_DEFINE_MSVC_RMW(ULLong, unsigned long long, LONG64, InterlockedExchangeAdd64, InterlockedCompareExchange64)
+
+static inline void* _atomicLoadPtr(const volatile void* p) {
+#ifdef _WIN64
+	return (void*)__iso_volatile_load64((const volatile __int64*)p);
+#else
+	return (void*)__iso_volatile_load32((const volatile __int32*)p);
+#endif
+}
+
+static inline void* _atomicLoadAcquirePtr(const volatile void* p) {
+	void* const v = _atomicLoadPtr(p);
+	_atomicBarrier();
+	return v;
+}
+
+static inline void _atomicStorePtr(volatile void* p, const void* v) {
+#ifdef _WIN64
+	__iso_volatile_store64((volatile __int64*)p, (__int64)v);
+#else
+	__iso_volatile_store32((volatile __int32*)p, (__int32)v);
+#endif
+}
+
+static inline void _atomicStoreReleasePtr(volatile void* p, const void* v) {
+	_atomicBarrier();
+	_atomicStorePtr(p, v);
+}
+
+static inline bool _atomicCasPtr(volatile void* p, void* expected, const void* desired) {
+	void* const e = *(void**)expected;
+	void* const old = InterlockedCompareExchangePointer((void* volatile*)p, (void*)desired, e);
+	*(void**)expected = old;
+	return old == e;
+}
+
+#define ATOMIC_SELECT_MSVC(p, OP)	_Generic(*(p), \
+	bool: _atomic##OP##Bool, \
+	int: _atomic##OP##Int, \
+	unsigned int: _atomic##OP##UInt, \
+	long: _atomic##OP##Long, \
+	unsigned long: _atomic##OP##ULong, \
+	long long: _atomic##OP##LLong, \
+	unsigned long long: _atomic##OP##ULLong, \
+	default: _atomic##OP##Ptr)
+#define ATOMIC_SELECT_INT_MSVC(p, OP)	_Generic(*(p), \
+	int: _atomic##OP##Int, \
+	unsigned int: _atomic##OP##UInt, \
+	long: _atomic##OP##Long, \
+	unsigned long: _atomic##OP##ULong, \
+	long long: _atomic##OP##LLong, \
+	unsigned long long: _atomic##OP##ULLong)
+
+#define ATOMIC_LOAD_RELAXED(p)		ATOMIC_SELECT_MSVC(p, Load)(p)
+#define ATOMIC_LOAD_ACQUIRE(p)		ATOMIC_SELECT_MSVC(p, LoadAcquire)(p)
+#define ATOMIC_STORE_RELAXED(p, v)	ATOMIC_SELECT_MSVC(p, Store)(p, v)
+#define ATOMIC_STORE_RELEASE(p, v)	ATOMIC_SELECT_MSVC(p, StoreRelease)(p, v)
+#define ATOMIC_FETCH_ADD(p, v)		ATOMIC_SELECT_INT_MSVC(p, FetchAdd)(p, v)
+#define ATOMIC_CAS_WEAK(p, e, d)	_Generic(*(p), \
+	int: _atomicCasInt, \
+	unsigned int: _atomicCasUInt, \
+	long: _atomicCasLong, \
+	unsigned long: _atomicCasULong, \
+	long long: _atomicCasLLong, \
+	unsigned long long: _atomicCasULLong, \
+	default: _atomicCasPtr)(p, e, d)
+#define ATOMIC_FENCE_ACQUIRE()		_atomicBarrier()
+#define ATOMIC_FENCE_RELEASE()		_atomicBarrier()
+#define ATOMIC_FENCE_SEQ_CST()		MemoryBarrier()
+#else
+#error unsupported compiler
+#endif
+
+/*
+ * Minimal mutex wrapper, statically initializable on both platforms.
+ */
+#ifdef _WIN32
+typedef SRWLOCK						mutex_t;
+#define MUTEX_INITIALIZER			SRWLOCK_INIT
+#define mutex_lock(m)				AcquireSRWLockExclusive(m)
+#define mutex_unlock(m)				ReleaseSRWLockExclusive(m)
+#else
+typedef pthread_mutex_t				mutex_t;
+#define MUTEX_INITIALIZER			PTHREAD_MUTEX_INITIALIZER
+#define mutex_lock(m)				pthread_mutex_lock(m)
+#define mutex_unlock(m)				pthread_mutex_unlock(m)
+#endif
+
+// monotonic clock, in nanoseconds
+static inline uint64_t utils_now(void) {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency; // QueryPerformanceFrequency is fixed at boot, benign race
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)((counter.QuadPart / frequency.QuadPart) * 1000000000 + ((counter.QuadPart % frequency.QuadPart) * 1000000000) / frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// wall clock, in nanoseconds since Epoch
+static inline uint64_t utils_realtime(void) {
+#ifdef _WIN32
+	FILETIME ft; // 100 ns intervals since 1601-01-01
+	GetSystemTimePreciseAsFileTime(&ft);
+	const uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	return (t - UINT64_C(116444736000000000)) * 100;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// hint to the processor that the caller is spinning
+static inline void utils_pause(void) {
+#ifdef _WIN32
+	YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+// defined in CAEN_FELib.c, store an error message for CAEN_FELib_GetLastError()
+void _setLastLocalError(const char* description, ...);
+
+#endif /* CAEN_INCLUDE_UTILS_H_ */
@@ -0,0 +1,250 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		wait.c
+*	\brief		Hybrid spin-then-block waiting
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "wait.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+#include "json.h"
+
+#define WAIT_NS_PER_MS				UINT64_C(1000000)
+#define WAIT_DEFAULT_MAX_SPIN_US	50
+#define WAIT_LIMIT_MAX_SPIN_US		1000000
+#define WAIT_EWMA_SHIFT				3		// weight of new inter-arrival samples: 1/8
+
+enum wait_mode {
+	WaitModeBusy,		// poll back to back, with a CPU relax hint
+	WaitModeYield,		// yield the processor between polls
+	WaitModeBlock,		// never spin, sub-millisecond remainders rounded up
+};
+
+struct wait_policy {
+	enum wait_mode					mode;
+	bool							adaptive;
+	uint64_t						maxSpin;			// ns
+	uint64_t						lastEvent;			// time of the last event, 0 if none
+	bool							hasInterArrival;
+
+	// updated by the reading thread, read by any thread
+	uint64_t						spinBudget;			// ns
+	uint64_t						interArrival;		// exponentially weighted moving average, ns
+	uint64_t						spinNs;
+	uint64_t						blockNs;
+	uint64_t						spinHits;
+	uint64_t						blockHits;
+	uint64_t						timeouts;
+};
+
+static inline void _add(uint64_t* counter, uint64_t value) {
+	ATOMIC_STORE_RELAXED(counter, *counter + value);
+}
+
+static inline uint64_t _min(uint64_t a, uint64_t b) {
+	return (a < b) ? a : b;
+}
+
+static uint64_t _budget(const struct wait_policy* p) {
+	if (p->mode == WaitModeBlock)
+		return 0;
+	if (!p->adaptive || !p->hasInterArrival)
+		return p->maxSpin;
+	if (p->interArrival > p->maxSpin)
+		return 0;
+	return _min(2 * p->interArrival, p->maxSpin);
+}
+
+static void _relax(const struct wait_policy* p) {
+	if (p->mode == WaitModeYield) {
+#ifdef _WIN32
+		SwitchToThread();
+#else
+		sched_yield();
+#endif
+		return;
+	}
+	utils_pause();
+}
+
+int wait_create(struct wait_policy** policy, const char* options) {
+	struct json* root = NULL;
+	if (options != NULL) {
+		root = json_parse(options);
+		if (root == NULL || root->type != JsonObject) {
+			json_free(root);
+			_setLastLocalError("invalid wait policy options: not a JSON object");
+			return CAEN_FELib_InvalidParam;
+		}
+	}
+	struct wait_policy* const p = calloc(1, sizeof(*p));
+	if (p == NULL) {
+		json_free(root);
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	const char* const mode = json_string(json_get(root, "mode"), "yield");
+	const double maxSpinUs = json_number(json_get(root, "max_spin_us"), WAIT_DEFAULT_MAX_SPIN_US);
+	p->adaptive = json_bool(json_get(root, "adaptive"), true);
+	bool valid = (maxSpinUs >= 0 && maxSpinUs <= WAIT_LIMIT_MAX_SPIN_US);
+	if (strcmp(mode, "busy") == 0)
+		p->mode = WaitModeBusy;
+	else if (strcmp(mode, "yield") == 0)
+		p->mode = WaitModeYield;
+	else if (strcmp(mode, "block") == 0)
+		p->mode = WaitModeBlock;
+	else
+		valid = false;
+	json_free(root);
+	if (!valid) {
+		free(p);
+		_setLastLocalError("invalid wait policy options: invalid mode or max_spin_us");
+		return CAEN_FELib_InvalidParam;
+	}
+	p->maxSpin = (uint64_t)(maxSpinUs * 1000.);
+	p->spinBudget = _budget(p);
+	wait_destroy(policy);
+	*policy = p;
+	return CAEN_FELib_Success;
+}
+
+void wait_destroy(struct wait_policy** policy) {
+	struct wait_policy* const p = *policy;
+	if (p == NULL)
+		return;
+	*policy = NULL;
+	free(p);
+}
+
+void wait_getStats(const struct wait_policy* policy, CAEN_FELib_WaitStats_t* stats) {
+	stats->spinNs = ATOMIC_LOAD_RELAXED(&policy->spinNs);
+	stats->blockNs = ATOMIC_LOAD_RELAXED(&policy->blockNs);
+	stats->spinHits = ATOMIC_LOAD_RELAXED(&policy->spinHits);
+	stats->blockHits = ATOMIC_LOAD_RELAXED(&policy->blockHits);
+	stats->timeouts = ATOMIC_LOAD_RELAXED(&policy->timeouts);
+	stats->spinBudgetNs = ATOMIC_LOAD_RELAXED(&policy->spinBudget);
+	stats->interArrivalNs = ATOMIC_LOAD_RELAXED(&policy->interArrival);
+}
+
+static void _onEvent(struct wait_policy* p, uint64_t now) {
+	if (p->lastEvent != 0) {
+		// samples are capped, so that a pause in the run does not disable spinning for long
+		const uint64_t sample = _min(now - p->lastEvent, 4 * p->maxSpin + WAIT_NS_PER_MS);
+		uint64_t ia = sample;
+		if (p->hasInterArrival)
+			ia = (uint64_t)((int64_t)p->interArrival + (((int64_t)sample - (int64_t)p->interArrival) >> WAIT_EWMA_SHIFT));
+		p->hasInterArrival = true;
+		ATOMIC_STORE_RELAXED(&p->interArrival, ia);
+		ATOMIC_STORE_RELAXED(&p->spinBudget, _budget(p));
+	}
+	p->lastEvent = now;
+}
+
+static int _done(struct wait_policy* p, int ret, uint64_t now, bool spinning) {
+	switch (ret) {
+	case CAEN_FELib_Success:
+		_add(spinning ? &p->spinHits : &p->blockHits, 1);
+		_onEvent(p, now);
+		break;
+	case CAEN_FELib_Timeout:
+		_add(&p->timeouts, 1);
+		break;
+	default:
+		break;
+	}
+	return ret;
+}
+
+// poll at least once, until an event or the end of the spin
+static int _spin(struct wait_policy* p, wait_poll_t poll, uint32_t handle, uint64_t end, uint64_t* now) {
+	const uint64_t start = *now;
+	int ret;
+	for (;;) {
+		ret = poll(handle, 0);
+		*now = utils_now();
+		if (ret != CAEN_FELib_Timeout || *now >= end)
+			break;
+		_relax(p);
+	}
+	_add(&p->spinNs, *now - start);
+	return ret;
+}
+
+static int _block(struct wait_policy* p, wait_poll_t poll, uint32_t handle, int timeout, uint64_t* now) {
+	const int ret = poll(handle, timeout);
+	const uint64_t t = utils_now();
+	_add(&p->blockNs, t - *now);
+	*now = t;
+	return ret;
+}
+
+int wait_data(struct wait_policy* policy, wait_poll_t poll, uint32_t handle, int64_t timeoutUs) {
+	uint64_t now = utils_now();
+	const bool infinite = (timeoutUs < 0 || (uint64_t)timeoutUs > (UINT64_MAX - now) / 1000);
+	const uint64_t deadline = infinite ? UINT64_MAX : now + (uint64_t)timeoutUs * 1000;
+	int ret = CAEN_FELib_Timeout;
+	bool polled = false;
+
+	// 1. spin for the budget
+	const uint64_t budget = policy->spinBudget;
+	if (budget != 0) {
+		ret = _spin(policy, poll, handle, _min(deadline, now + budget), &now);
+		if (ret != CAEN_FELib_Timeout)
+			return _done(policy, ret, now, true);
+		polled = true;
+	}
+
+	// 2. block, in whole milliseconds
+	while (now < deadline && deadline - now >= WAIT_NS_PER_MS) {
+		const int timeout = infinite ? -1 : (int)_min((deadline - now) / WAIT_NS_PER_MS, INT_MAX);
+		ret = _block(policy, poll, handle, timeout, &now);
+		if (ret != CAEN_FELib_Timeout)
+			return _done(policy, ret, now, false);
+		polled = true;
+	}
+
+	// 3. sub-millisecond remainder, or a single poll if the timeout is zero
+	if (now < deadline || !polled) {
+		if (policy->mode == WaitModeBlock)
+			return _done(policy, _block(policy, poll, handle, (now < deadline) ? 1 : 0, &now), now, false);
+		return _done(policy, _spin(policy, poll, handle, deadline, &now), now, true);
+	}
+	return _done(policy, ret, now, false);
+}
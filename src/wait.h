@@ -0,0 +1,71 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		wait.h
+*	\brief		Hybrid spin-then-block waiting
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_WAIT_H_
+#define CAEN_INCLUDE_WAIT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+#include "utils.h"
+
+/*
+ * Hybrid waiting of CAEN_FELib_ReadDataUs() and CAEN_FELib_HasDataUs(), on top of the HasData of
+ * the implementation library, whose timeout is in milliseconds. Each wait is made of:
+ * 1. a spin phase, polling with zero timeout for at most the spin budget
+ * 2. a block phase, in whole milliseconds
+ * 3. a final spin phase on the sub-millisecond remainder of the timeout
+ *
+ * When adaptive, the spin budget follows the mean inter-arrival time of the events: twice the
+ * mean, up to the maximum, or zero if the mean exceeds the maximum, so that sparse events are
+ * waited blocking.
+ */
+
+// HasData of the implementation library
+typedef int (CAEN_FELIB_API* wait_poll_t)(uint32_t handle, int timeout);
+
+struct wait_policy;
+
+// options can be NULL for the default policy; return a CAEN_FELib_ErrorCode, set last error on failure
+int wait_create(struct wait_policy** policy, const char* options);
+void wait_destroy(struct wait_policy** policy);
+void wait_getStats(const struct wait_policy* policy, CAEN_FELib_WaitStats_t* stats);
+
+// invoked on the reading thread; timeout in microseconds, -1 for infinite; return the result of the last poll
+int wait_data(struct wait_policy* policy, wait_poll_t poll, uint32_t handle, int64_t timeoutUs);
+
+#endif /* CAEN_INCLUDE_WAIT_H_ */
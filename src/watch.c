@@ -0,0 +1,552 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		watch.c
+*	\brief		Parameter watches
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "watch.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "utils.h"
+
+#ifndef _WIN32
+
+#define WATCH_MAX_PATH_SIZE			256
+
+// parameter shared by the watches with the same handle and path
+struct watch_item {
+	uint64_t						handle;
+	char							path[WATCH_MAX_PATH_SIZE];
+	uint64_t						period;		// ns, shortest period of the watches
+	uint64_t						due;		// monotonic time of the next sample, ns
+	size_t							nWatches;
+	bool							pinned;		// being sampled, freed by the scheduler if released meanwhile
+	size_t							rank;		// order within the connection on the current batch
+	// written by the scheduler thread, with mutex locked
+	uint64_t						version;	// incremented on changes, zero if never sampled
+	int								ret;
+	char							value[256];
+	uint64_t						timestamp;
+	struct watch_item*				next;
+};
+
+struct watch_entry {
+	struct watch_item*				item;
+	uint64_t						version;	// version of the last notification
+};
+
+struct CAEN_FELib_Watch {
+	uint64_t						handle;
+	uint64_t						period;		// ns
+	CAEN_FELib_WatchCallback_t		callback;
+	void*							ctx;
+	size_t							n;
+	struct watch_entry*				entries;
+	CAEN_FELib_WatchEvent_t*		events;		// notifications of the current batch
+	size_t							nEvents;
+	bool							removed;
+	struct CAEN_FELib_Watch*		next;
+};
+
+struct watch_sample {
+	struct watch_item*				item;
+	int								ret;
+	char							value[256];
+	uint64_t						timestamp;
+};
+
+static struct {
+	pthread_mutex_t					mutex;			// protects the following fields, except the scratch buffers
+	pthread_cond_t					cond;			// signaled on new watches, budget changes and stop requests
+	pthread_mutex_t					callbackMutex;	// locked by the scheduler while invoking callbacks
+	pthread_mutex_t					sampleMutex;	// locked by the scheduler while sampling pinned items
+	struct watch_item*				items;
+	struct CAEN_FELib_Watch*		watches;
+	struct CAEN_FELib_Watch*		removed;		// removed from callbacks, freed by the scheduler
+	uint32_t						budget;			// GetValue calls per second, zero if unlimited
+	double							tokens;
+	uint64_t						refill;			// monotonic time of the last token refill, ns
+	pthread_t						thread;
+	bool							started;
+	bool							stopRequested;
+	// scratch buffers of the scheduler thread
+	struct watch_item**				due;
+	struct watch_sample*			samples;
+	size_t							capacity;
+	struct CAEN_FELib_Watch**		notified;
+	size_t							notifiedCapacity;
+} scheduler = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.callbackMutex = PTHREAD_MUTEX_INITIALIZER,
+	.sampleMutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t _connection(uint64_t handle) {
+	return handle >> 32;
+}
+
+static int _compareDue(uint64_t a, uint64_t b) {
+	return (a < b) ? -1 : (a > b);
+}
+
+static int _compareConnection(const void* a, const void* b) {
+	const struct watch_item* const ia = *(struct watch_item* const*)a;
+	const struct watch_item* const ib = *(struct watch_item* const*)b;
+	const uint64_t ca = _connection(ia->handle);
+	const uint64_t cb = _connection(ib->handle);
+	return (ca != cb) ? ((ca < cb) ? -1 : 1) : _compareDue(ia->due, ib->due);
+}
+
+static int _compareRank(const void* a, const void* b) {
+	const struct watch_item* const ia = *(struct watch_item* const*)a;
+	const struct watch_item* const ib = *(struct watch_item* const*)b;
+	return (ia->rank != ib->rank) ? ((ia->rank < ib->rank) ? -1 : 1) : _compareDue(ia->due, ib->due);
+}
+
+// order due items so that the most overdue item of each connection comes first
+static void _interleave(struct watch_item** due, size_t n) {
+	qsort(due, n, sizeof(*due), _compareConnection);
+	for (size_t i = 0; i < n; ++i)
+		due[i]->rank = (i != 0 && _connection(due[i]->handle) == _connection(due[i - 1]->handle)) ? due[i - 1]->rank + 1 : 0;
+	qsort(due, n, sizeof(*due), _compareRank);
+}
+
+static void _freeWatch(CAEN_FELib_Watch_t* w) {
+	free(w->entries);
+	free(w->events);
+	free(w);
+}
+
+// release the items of a removed watch, to be called with mutex locked
+static void _releaseItems(CAEN_FELib_Watch_t* w) {
+	for (size_t i = 0; i < w->n; ++i) {
+		struct watch_item* const item = w->entries[i].item;
+		if (item == NULL || --item->nWatches != 0)
+			continue;
+		for (struct watch_item** p = &scheduler.items; *p != NULL; p = &(*p)->next) {
+			if (*p == item) {
+				*p = item->next;
+				break;
+			}
+		}
+		if (!item->pinned)
+			free(item);
+	}
+	// periods of items still watched are recomputed from the remaining watches
+	for (struct watch_item* item = scheduler.items; item != NULL; item = item->next)
+		item->period = UINT64_MAX;
+	for (CAEN_FELib_Watch_t* o = scheduler.watches; o != NULL; o = o->next)
+		for (size_t i = 0; i < o->n; ++i)
+			if (o->entries[i].item->period > o->period)
+				o->entries[i].item->period = o->period;
+}
+
+static void _unlinkWatch(CAEN_FELib_Watch_t* w) {
+	for (CAEN_FELib_Watch_t** p = &scheduler.watches; *p != NULL; p = &(*p)->next) {
+		if (*p == w) {
+			*p = w->next;
+			break;
+		}
+	}
+}
+
+static bool _reserve(size_t n) {
+	if (n <= scheduler.capacity)
+		return true;
+	struct watch_item** const due = realloc(scheduler.due, n * sizeof(*due));
+	if (due == NULL)
+		return false;
+	scheduler.due = due;
+	struct watch_sample* const samples = realloc(scheduler.samples, n * sizeof(*samples));
+	if (samples == NULL)
+		return false;
+	scheduler.samples = samples;
+	scheduler.capacity = n;
+	return true;
+}
+
+// number of calls allowed by the budget, to be called with mutex locked
+static size_t _availableCalls(uint64_t now, size_t n) {
+	if (scheduler.budget == 0)
+		return n;
+	scheduler.tokens += (double)(now - scheduler.refill) * 1e-9 * scheduler.budget;
+	if (scheduler.tokens > scheduler.budget)
+		scheduler.tokens = scheduler.budget;
+	scheduler.refill = now;
+	const double available = (scheduler.tokens < (double)n) ? scheduler.tokens : (double)n;
+	return (size_t)available;
+}
+
+// sample due items, with mutex locked (released during GetValue calls); return the number of samples
+static size_t _sample(uint64_t now) {
+	size_t nDue = 0;
+	for (struct watch_item* item = scheduler.items; item != NULL; item = item->next)
+		nDue += (item->due <= now);
+	if (nDue == 0 || !_reserve(nDue))
+		return 0;
+	nDue = 0;
+	for (struct watch_item* item = scheduler.items; item != NULL; item = item->next)
+		if (item->due <= now)
+			scheduler.due[nDue++] = item;
+	const size_t n = _availableCalls(now, nDue);
+	if (n == 0)
+		return 0;
+	_interleave(scheduler.due, nDue);
+	if (scheduler.budget != 0)
+		scheduler.tokens -= (double)n;
+	for (size_t i = 0; i < n; ++i) {
+		struct watch_item* const item = scheduler.due[i];
+		item->pinned = true;
+		scheduler.samples[i].item = item;
+	}
+	pthread_mutex_lock(&scheduler.sampleMutex);
+	pthread_mutex_unlock(&scheduler.mutex);
+	// handle and path of pinned items are not modified
+	for (size_t i = 0; i < n; ++i) {
+		struct watch_sample* const s = &scheduler.samples[i];
+		s->ret = CAEN_FELib_GetValue(s->item->handle, s->item->path, s->value);
+		if (s->ret != CAEN_FELib_Success)
+			s->value[0] = '\0';
+		s->timestamp = utils_realtime();
+	}
+	pthread_mutex_unlock(&scheduler.sampleMutex);
+	pthread_mutex_lock(&scheduler.mutex);
+	const uint64_t end = utils_now();
+	for (size_t i = 0; i < n; ++i) {
+		struct watch_sample* const s = &scheduler.samples[i];
+		struct watch_item* const item = s->item;
+		item->pinned = false;
+		if (item->nWatches == 0) {
+			free(item);
+			continue;
+		}
+		// period is UINT64_MAX if the item is watched only by watches pending removal
+		item->due = (item->period != UINT64_MAX) ? end + item->period : UINT64_MAX;
+		if (item->version == 0 || item->ret != s->ret || strcmp(item->value, s->value) != 0) {
+			++item->version;
+			item->ret = s->ret;
+			memcpy(item->value, s->value, sizeof(item->value));
+			item->timestamp = s->timestamp;
+		}
+	}
+	return n;
+}
+
+/*
+ * Prepare the notifications of the watches with changed items, with mutex locked. Items are
+ * written only by this thread, so that events can be read after the mutex is released.
+ */
+static size_t _prepareNotifications(void) {
+	size_t nWatches = 0;
+	for (CAEN_FELib_Watch_t* w = scheduler.watches; w != NULL; w = w->next)
+		++nWatches;
+	if (nWatches > scheduler.notifiedCapacity) {
+		CAEN_FELib_Watch_t** const notified = realloc(scheduler.notified, nWatches * sizeof(*notified));
+		if (notified == NULL)
+			return 0;
+		scheduler.notified = notified;
+		scheduler.notifiedCapacity = nWatches;
+	}
+	size_t n = 0;
+	for (CAEN_FELib_Watch_t* w = scheduler.watches; w != NULL; w = w->next) {
+		w->nEvents = 0;
+		for (size_t i = 0; i < w->n; ++i) {
+			struct watch_entry* const e = &w->entries[i];
+			const struct watch_item* const item = e->item;
+			if (item->version == 0 || item->version == e->version)
+				continue;
+			e->version = item->version;
+			CAEN_FELib_WatchEvent_t* const event = &w->events[w->nEvents++];
+			event->index = i;
+			event->handle = item->handle;
+			event->path = item->path;
+			event->value = item->value;
+			event->ret = item->ret;
+			event->timestamp = item->timestamp;
+		}
+		if (w->nEvents != 0)
+			scheduler.notified[n++] = w;
+	}
+	return n;
+}
+
+// wait until a monotonic deadline, UINT64_MAX to wait forever
+static void _waitUntil(uint64_t deadline) {
+	if (deadline == UINT64_MAX) {
+		pthread_cond_wait(&scheduler.cond, &scheduler.mutex);
+		return;
+	}
+	const uint64_t now = utils_now();
+	if (deadline <= now)
+		return;
+	const uint64_t t = utils_realtime() + (deadline - now);
+	struct timespec ts;
+	ts.tv_sec = (time_t)(t / UINT64_C(1000000000));
+	ts.tv_nsec = (long)(t % UINT64_C(1000000000));
+	pthread_cond_timedwait(&scheduler.cond, &scheduler.mutex, &ts);
+}
+
+static uint64_t _nextDeadline(uint64_t now) {
+	uint64_t deadline = UINT64_MAX;
+	for (const struct watch_item* item = scheduler.items; item != NULL; item = item->next)
+		if (item->due < deadline)
+			deadline = item->due;
+	// with the budget exhausted, wait for the next token
+	if (deadline <= now && scheduler.budget != 0 && scheduler.tokens < 1.)
+		deadline = now + (uint64_t)((1. - scheduler.tokens) * 1e9 / scheduler.budget) + 1;
+	return deadline;
+}
+
+static void* _schedulerMain(void* arg) {
+	pthread_mutex_lock(&scheduler.mutex);
+	while (!scheduler.stopRequested) {
+		_sample(utils_now());
+		const size_t n = _prepareNotifications();
+		if (n != 0) {
+			// watches being notified are freed only after callbacks, see watch_destroy
+			pthread_mutex_lock(&scheduler.callbackMutex);
+			pthread_mutex_unlock(&scheduler.mutex);
+			for (size_t i = 0; i < n; ++i) {
+				CAEN_FELib_Watch_t* const w = scheduler.notified[i];
+				if (!ATOMIC_LOAD_RELAXED(&w->removed))
+					w->callback(w->events, w->nEvents, w->ctx);
+			}
+			pthread_mutex_unlock(&scheduler.callbackMutex);
+			pthread_mutex_lock(&scheduler.mutex);
+			while (scheduler.removed != NULL) {
+				CAEN_FELib_Watch_t* const w = scheduler.removed;
+				scheduler.removed = w->next;
+				_releaseItems(w);
+				_freeWatch(w);
+			}
+		}
+		const uint64_t now = utils_now();
+		const uint64_t deadline = _nextDeadline(now);
+		if (deadline > now)
+			_waitUntil(deadline);
+	}
+	pthread_mutex_unlock(&scheduler.mutex);
+	return arg;
+}
+
+static struct watch_item* _findItem(uint64_t handle, const char* path) {
+	for (struct watch_item* item = scheduler.items; item != NULL; item = item->next)
+		if (item->handle == handle && strcmp(item->path, path) == 0)
+			return item;
+	return NULL;
+}
+
+// add the items of a new watch, to be called with mutex locked
+static int _addItems(CAEN_FELib_Watch_t* w, const char* const* paths) {
+	const uint64_t now = utils_now();
+	for (size_t i = 0; i < w->n; ++i) {
+		struct watch_item* item = _findItem(w->handle, paths[i]);
+		if (item == NULL) {
+			item = calloc(1, sizeof(*item));
+			if (item == NULL) {
+				_setLastLocalError("calloc failed");
+				return CAEN_FELib_InternalError;
+			}
+			item->handle = w->handle;
+			strcpy(item->path, paths[i]);
+			item->period = w->period;
+			item->due = now;
+			item->next = scheduler.items;
+			scheduler.items = item;
+		} else if (w->period < item->period) {
+			item->period = w->period;
+			if (item->due > now + w->period)
+				item->due = now + w->period;
+		}
+		++item->nWatches;
+		w->entries[i].item = item;
+	}
+	return CAEN_FELib_Success;
+}
+
+int watch_create(CAEN_FELib_Watch_t** watch, uint64_t handle, const char* const* paths, size_t n, int periodMs, CAEN_FELib_WatchCallback_t callback, void* ctx) {
+	if (n == 0 || periodMs <= 0) {
+		_setLastLocalError("invalid watch: no paths or period not positive");
+		return CAEN_FELib_InvalidParam;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		if (paths[i] == NULL) {
+			_setLastLocalError("NULL argument");
+			return CAEN_FELib_InvalidParam;
+		}
+		if (strlen(paths[i]) >= WATCH_MAX_PATH_SIZE) {
+			_setLastLocalError("invalid watch: path %zu too long", i);
+			return CAEN_FELib_InvalidParam;
+		}
+	}
+	CAEN_FELib_Watch_t* const w = calloc(1, sizeof(*w));
+	if (w == NULL) {
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	w->handle = handle;
+	w->period = (uint64_t)periodMs * UINT64_C(1000000);
+	w->callback = callback;
+	w->ctx = ctx;
+	w->n = n;
+	w->entries = calloc(n, sizeof(*w->entries));
+	w->events = calloc(n, sizeof(*w->events));
+	if (w->entries == NULL || w->events == NULL) {
+		_freeWatch(w);
+		_setLastLocalError("calloc failed");
+		return CAEN_FELib_InternalError;
+	}
+	pthread_mutex_lock(&scheduler.mutex);
+	int ret = CAEN_FELib_Success;
+	if (scheduler.stopRequested) {
+		_setLastLocalError("watch scheduler stopped");
+		ret = CAEN_FELib_GenericError;
+	}
+	if (ret == CAEN_FELib_Success && !scheduler.started) {
+		if (pthread_create(&scheduler.thread, NULL, _schedulerMain, NULL) == 0) {
+			scheduler.started = true;
+			scheduler.refill = utils_now();
+			scheduler.tokens = scheduler.budget;
+		} else {
+			_setLastLocalError("watch scheduler start failed: cannot create thread");
+			ret = CAEN_FELib_InternalError;
+		}
+	}
+	if (ret == CAEN_FELib_Success)
+		ret = _addItems(w, paths);
+	if (ret != CAEN_FELib_Success) {
+		_releaseItems(w);
+		pthread_mutex_unlock(&scheduler.mutex);
+		_freeWatch(w);
+		return ret;
+	}
+	w->next = scheduler.watches;
+	scheduler.watches = w;
+	pthread_cond_signal(&scheduler.cond);
+	pthread_mutex_unlock(&scheduler.mutex);
+	*watch = w;
+	return CAEN_FELib_Success;
+}
+
+int watch_destroy(CAEN_FELib_Watch_t* watch) {
+	pthread_mutex_lock(&scheduler.mutex);
+	_unlinkWatch(watch);
+	ATOMIC_STORE_RELAXED(&watch->removed, true);
+	if (scheduler.started && pthread_equal(pthread_self(), scheduler.thread)) {
+		// invoked from a callback: freed by the scheduler after the callbacks
+		watch->next = scheduler.removed;
+		scheduler.removed = watch;
+		pthread_mutex_unlock(&scheduler.mutex);
+		return CAEN_FELib_Success;
+	}
+	pthread_mutex_unlock(&scheduler.mutex);
+	// wait for pending callbacks, that can read items
+	pthread_mutex_lock(&scheduler.callbackMutex);
+	pthread_mutex_unlock(&scheduler.callbackMutex);
+	pthread_mutex_lock(&scheduler.mutex);
+	_releaseItems(watch);
+	pthread_mutex_unlock(&scheduler.mutex);
+	// wait for pending GetValue on released items, so that the connection can be closed on return
+	pthread_mutex_lock(&scheduler.sampleMutex);
+	pthread_mutex_unlock(&scheduler.sampleMutex);
+	_freeWatch(watch);
+	return CAEN_FELib_Success;
+}
+
+uint64_t watch_getHandle(const CAEN_FELib_Watch_t* watch) {
+	return watch->handle;
+}
+
+int watch_setBudget(uint32_t callsPerSecond) {
+	pthread_mutex_lock(&scheduler.mutex);
+	scheduler.budget = callsPerSecond;
+	scheduler.tokens = callsPerSecond;
+	scheduler.refill = utils_now();
+	pthread_cond_signal(&scheduler.cond);
+	pthread_mutex_unlock(&scheduler.mutex);
+	return CAEN_FELib_Success;
+}
+
+void watch_deinit(void) {
+	pthread_mutex_lock(&scheduler.mutex);
+	const bool started = scheduler.started;
+	scheduler.stopRequested = true;
+	pthread_cond_signal(&scheduler.cond);
+	pthread_mutex_unlock(&scheduler.mutex);
+	if (started)
+		pthread_join(scheduler.thread, NULL);
+	while (scheduler.watches != NULL) {
+		CAEN_FELib_Watch_t* const w = scheduler.watches;
+		scheduler.watches = w->next;
+		_releaseItems(w);
+		_freeWatch(w);
+	}
+	free(scheduler.due);
+	free(scheduler.samples);
+	free(scheduler.notified);
+}
+
+#else
+
+int watch_create(CAEN_FELib_Watch_t** watch, uint64_t handle, const char* const* paths, size_t n, int periodMs, CAEN_FELib_WatchCallback_t callback, void* ctx) {
+	_setLastLocalError("watch not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+int watch_destroy(CAEN_FELib_Watch_t* watch) {
+	_setLastLocalError("watch not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+uint64_t watch_getHandle(const CAEN_FELib_Watch_t* watch) {
+	return 0;
+}
+
+int watch_setBudget(uint32_t callsPerSecond) {
+	_setLastLocalError("watch not supported on this platform");
+	return CAEN_FELib_NotImplemented;
+}
+
+void watch_deinit(void) {}
+
+#endif
@@ -0,0 +1,63 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		watch.h
+*	\brief		Parameter watches
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_WATCH_H_
+#define CAEN_INCLUDE_WATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+
+/*
+ * Parameter watches, sampled by a single scheduler thread started with the first watch.
+ *
+ * Watches of the same handle and path share the same item, sampled at the shortest period among
+ * them. Due items are sampled in batches, interleaved across connections, within the global
+ * budget of GetValue calls per second. After each batch, each watch gets the values changed
+ * since its last notification, with a single callback invocation.
+ */
+
+// return a CAEN_FELib_ErrorCode, set last error on failure
+int watch_create(CAEN_FELib_Watch_t** watch, uint64_t handle, const char* const* paths, size_t n, int periodMs, CAEN_FELib_WatchCallback_t callback, void* ctx);
+int watch_destroy(CAEN_FELib_Watch_t* watch);
+uint64_t watch_getHandle(const CAEN_FELib_Watch_t* watch);
+int watch_setBudget(uint32_t callsPerSecond);
+
+// stop the scheduler and release all watches, invoked at library unload
+void watch_deinit(void);
+
+#endif /* CAEN_INCLUDE_WATCH_H_ */
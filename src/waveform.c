@@ -0,0 +1,292 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		waveform.c
+*	\brief		Conversion of raw waveforms
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#include "waveform.h"
+
+#include <stdbool.h>
+
+#include "utils.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define WAVEFORM_X86
+#include <immintrin.h>
+#define TARGET(ISA)						__attribute__((target(ISA)))
+#endif
+
+// samples summed on 32-bit lanes before moving to 64 bits, so that lanes cannot overflow
+#define WAVEFORM_SUM_BLOCK				(UINT32_C(1) << 15)
+
+struct waveform_kernel {
+	const char*						name;
+	uint64_t						(*sum)(const uint16_t* samples, size_t n, uint16_t mask);
+	void							(*convert)(const uint16_t* samples, size_t n, uint16_t mask, float baseline, float gain, float* out);
+	size_t							(*findOutside)(const uint16_t* samples, size_t n, uint16_t low, uint16_t high);
+};
+
+static uint64_t _sumScalar(const uint16_t* samples, size_t n, uint16_t mask) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < n; ++i)
+		sum += samples[i] & mask;
+	return sum;
+}
+
+static void _convertScalar(const uint16_t* samples, size_t n, uint16_t mask, float baseline, float gain, float* out) {
+	for (size_t i = 0; i < n; ++i)
+		out[i] = ((float)(samples[i] & mask) - baseline) * gain;
+}
+
+static size_t _findOutsideScalar(const uint16_t* samples, size_t n, uint16_t low, uint16_t high) {
+	for (size_t i = 0; i < n; ++i)
+		if (samples[i] < low || samples[i] > high)
+			return i;
+	return n;
+}
+
+static const struct waveform_kernel scalarKernel = { "scalar", _sumScalar, _convertScalar, _findOutsideScalar };
+
+#ifdef WAVEFORM_X86
+
+TARGET("sse2")
+static uint64_t _sumSSE2(const uint16_t* samples, size_t n, uint16_t mask) {
+	const __m128i m = _mm_set1_epi16((short)mask);
+	const __m128i zero = _mm_setzero_si128();
+	uint64_t sum = 0;
+	size_t i = 0;
+	while (n - i >= 8) {
+		const size_t end = i + ((n - i) / 8 < WAVEFORM_SUM_BLOCK ? (n - i) / 8 : WAVEFORM_SUM_BLOCK) * 8;
+		__m128i acc = _mm_setzero_si128();
+		for (; i < end; i += 8) {
+			const __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)&samples[i]), m);
+			acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero)));
+		}
+		uint32_t lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, acc);
+		for (size_t j = 0; j < ARRAY_SIZE(lanes); ++j)
+			sum += lanes[j];
+	}
+	return sum + _sumScalar(&samples[i], n - i, mask);
+}
+
+TARGET("sse2")
+static void _convertSSE2(const uint16_t* samples, size_t n, uint16_t mask, float baseline, float gain, float* out) {
+	const __m128i m = _mm_set1_epi16((short)mask);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 b = _mm_set1_ps(baseline);
+	const __m128 g = _mm_set1_ps(gain);
+	size_t i = 0;
+	for (; n - i >= 8; i += 8) {
+		const __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)&samples[i]), m);
+		const __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+		const __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+		_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_sub_ps(lo, b), g));
+		_mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_sub_ps(hi, b), g));
+	}
+	_convertScalar(&samples[i], n - i, mask, baseline, gain, &out[i]);
+}
+
+// unsigned comparisons with saturating subtractions: (v - high) and (low - v) are zero within the range
+TARGET("sse2")
+static size_t _findOutsideSSE2(const uint16_t* samples, size_t n, uint16_t low, uint16_t high) {
+	const __m128i l = _mm_set1_epi16((short)low);
+	const __m128i h = _mm_set1_epi16((short)high);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; n - i >= 8; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)&samples[i]);
+		const __m128i outside = _mm_or_si128(_mm_subs_epu16(v, h), _mm_subs_epu16(l, v));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(outside, zero)) != 0xFFFF)
+			break;
+	}
+	return i + _findOutsideScalar(&samples[i], n - i, low, high);
+}
+
+static const struct waveform_kernel sse2Kernel = { "sse2", _sumSSE2, _convertSSE2, _findOutsideSSE2 };
+
+TARGET("avx2")
+static uint64_t _sumAVX2(const uint16_t* samples, size_t n, uint16_t mask) {
+	const __m128i m = _mm_set1_epi16((short)mask);
+	uint64_t sum = 0;
+	size_t i = 0;
+	while (n - i >= 8) {
+		const size_t end = i + ((n - i) / 8 < WAVEFORM_SUM_BLOCK ? (n - i) / 8 : WAVEFORM_SUM_BLOCK) * 8;
+		__m256i acc = _mm256_setzero_si256();
+		for (; i < end; i += 8) {
+			const __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)&samples[i]), m);
+			acc = _mm256_add_epi32(acc, _mm256_cvtepu16_epi32(v));
+		}
+		uint32_t lanes[8];
+		_mm256_storeu_si256((__m256i*)lanes, acc);
+		for (size_t j = 0; j < ARRAY_SIZE(lanes); ++j)
+			sum += lanes[j];
+	}
+	return sum + _sumScalar(&samples[i], n - i, mask);
+}
+
+TARGET("avx2")
+static void _convertAVX2(const uint16_t* samples, size_t n, uint16_t mask, float baseline, float gain, float* out) {
+	const __m256i m = _mm256_set1_epi16((short)mask);
+	const __m256 b = _mm256_set1_ps(baseline);
+	const __m256 g = _mm256_set1_ps(gain);
+	size_t i = 0;
+	for (; n - i >= 16; i += 16) {
+		const __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&samples[i]), m);
+		const __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)));
+		const __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)));
+		// no FMA, to round as the other kernels
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_sub_ps(lo, b), g));
+		_mm256_storeu_ps(&out[i + 8], _mm256_mul_ps(_mm256_sub_ps(hi, b), g));
+	}
+	_convertSSE2(&samples[i], n - i, mask, baseline, gain, &out[i]);
+}
+
+TARGET("avx2")
+static size_t _findOutsideAVX2(const uint16_t* samples, size_t n, uint16_t low, uint16_t high) {
+	const __m256i l = _mm256_set1_epi16((short)low);
+	const __m256i h = _mm256_set1_epi16((short)high);
+	size_t i = 0;
+	for (; n - i >= 16; i += 16) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)&samples[i]);
+		const __m256i outside = _mm256_or_si256(_mm256_subs_epu16(v, h), _mm256_subs_epu16(l, v));
+		if (!_mm256_testz_si256(outside, outside))
+			break;
+	}
+	return i + _findOutsideSSE2(&samples[i], n - i, low, high);
+}
+
+static const struct waveform_kernel avx2Kernel = { "avx2", _sumAVX2, _convertAVX2, _findOutsideAVX2 };
+
+TARGET("avx512f")
+static uint64_t _sumAVX512(const uint16_t* samples, size_t n, uint16_t mask) {
+	const __m256i m = _mm256_set1_epi16((short)mask);
+	uint64_t sum = 0;
+	size_t i = 0;
+	while (n - i >= 16) {
+		const size_t end = i + ((n - i) / 16 < WAVEFORM_SUM_BLOCK ? (n - i) / 16 : WAVEFORM_SUM_BLOCK) * 16;
+		__m512i acc = _mm512_setzero_si512();
+		for (; i < end; i += 16) {
+			const __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&samples[i]), m);
+			acc = _mm512_add_epi32(acc, _mm512_cvtepu16_epi32(v));
+		}
+		uint32_t lanes[16];
+		_mm512_storeu_si512(lanes, acc);
+		for (size_t j = 0; j < ARRAY_SIZE(lanes); ++j)
+			sum += lanes[j];
+	}
+	return sum + _sumScalar(&samples[i], n - i, mask);
+}
+
+TARGET("avx512f")
+static void _convertAVX512(const uint16_t* samples, size_t n, uint16_t mask, float baseline, float gain, float* out) {
+	const __m256i m = _mm256_set1_epi16((short)mask);
+	const __m512 b = _mm512_set1_ps(baseline);
+	const __m512 g = _mm512_set1_ps(gain);
+	size_t i = 0;
+	for (; n - i >= 16; i += 16) {
+		const __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&samples[i]), m);
+		const __m512 x = _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(v));
+		_mm512_storeu_ps(&out[i], _mm512_mul_ps(_mm512_sub_ps(x, b), g));
+	}
+	_convertSSE2(&samples[i], n - i, mask, baseline, gain, &out[i]);
+}
+
+// 16-bit operations on 512-bit vectors require AVX-512BW: the AVX2 scan is used
+static const struct waveform_kernel avx512Kernel = { "avx512", _sumAVX512, _convertAVX512, _findOutsideAVX2 };
+
+#endif
+
+static const struct waveform_kernel* _selectKernel(void) {
+#ifdef WAVEFORM_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return &avx512Kernel;
+	if (__builtin_cpu_supports("avx2"))
+		return &avx2Kernel;
+	if (__builtin_cpu_supports("sse2"))
+		return &sse2Kernel;
+#endif
+	return &scalarKernel;
+}
+
+static const struct waveform_kernel* _getKernel(void) {
+	static const struct waveform_kernel* kernel; // selection is deterministic, benign race
+	const struct waveform_kernel* k = ATOMIC_LOAD_ACQUIRE(&kernel);
+	if (UNLIKELY(k == NULL)) {
+		k = _selectKernel();
+		ATOMIC_STORE_RELEASE(&kernel, k);
+	}
+	return k;
+}
+
+uint64_t waveform_sum(const uint16_t* samples, size_t n) {
+	return _getKernel()->sum(samples, n, UINT16_MAX);
+}
+
+size_t waveform_findOutside(const uint16_t* samples, size_t n, uint16_t low, uint16_t high) {
+	return _getKernel()->findOutside(samples, n, low, high);
+}
+
+// conversion with a given kernel, used also by tests to compare each kernel with the scalar one
+static int _convert(const struct waveform_kernel* k, const uint16_t* samples, size_t n, const CAEN_FELib_WaveformConversion_t* conversion, float* out, size_t* outSize, float* baseline) {
+	if (conversion->preTrigger > n) {
+		_setLastLocalError("pre-trigger (%zu) larger than the waveform (%zu)", conversion->preTrigger, n);
+		return CAEN_FELib_InvalidParam;
+	}
+	const uint16_t mask = (conversion->mask != 0) ? conversion->mask : UINT16_MAX;
+	const float gain = conversion->gain;
+	float b = conversion->baseline;
+	if (conversion->preTrigger != 0)
+		b = (float)((double)k->sum(samples, conversion->preTrigger, mask) / (double)conversion->preTrigger);
+	if (baseline != NULL)
+		*baseline = b;
+	const size_t decimation = (conversion->decimation > 1) ? conversion->decimation : 1;
+	if (decimation == 1) {
+		k->convert(samples, n, mask, b, gain, out);
+		*outSize = n;
+		return CAEN_FELib_Success;
+	}
+	// each output sample is the mean of decimation input samples, an incomplete tail is dropped
+	const size_t size = n / decimation;
+	for (size_t i = 0; i < size; ++i) {
+		const uint64_t sum = k->sum(&samples[i * decimation], decimation, mask);
+		out[i] = ((float)((double)sum / (double)decimation) - b) * gain;
+	}
+	*outSize = size;
+	return CAEN_FELib_Success;
+}
+
+int waveform_convert(const uint16_t* samples, size_t n, const CAEN_FELib_WaveformConversion_t* conversion, float* out, size_t* outSize, float* baseline) {
+	return _convert(_getKernel(), samples, n, conversion, out, outSize, baseline);
+}
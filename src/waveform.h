@@ -0,0 +1,59 @@
+/******************************************************************************
+*
+*	CAEN SpA - Software Division
+*	Via Vetraia, 11 - 55049 - Viareggio ITALY
+*	+39 0594 388 398 - www.caen.it
+*
+*******************************************************************************
+*
+*	Copyright (C) 2020-2023 CAEN SpA
+*
+*	This file is part of the CAEN FE Library.
+*
+*	The CAEN FE Library is free software; you can redistribute it and/or
+*	modify it under the terms of the GNU Lesser General Public
+*	License as published by the Free Software Foundation; either
+*	version 3 of the License, or (at your option) any later version.
+*
+*	The CAEN FE Library is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*	Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with the CAEN FE Library; if not, see
+*	https://www.gnu.org/licenses/.
+*
+*	SPDX-License-Identifier: LGPL-3.0-or-later
+*
+***************************************************************************//*!
+*
+*	\file		waveform.h
+*	\brief		Conversion of raw waveforms
+*	\author		Giovanni Cerretani, Matteo Fusco, Alberto Lucchesi
+*
+******************************************************************************/
+
+#ifndef CAEN_INCLUDE_WAVEFORM_H_
+#define CAEN_INCLUDE_WAVEFORM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CAEN_FELib.h"
+
+/*
+ * Conversion of raw waveform samples to calibrated float samples. Kernels are selected at the
+ * first call, according to the instruction sets supported by the CPU: AVX-512, AVX2 and SSE2 on
+ * x86, a portable scalar version on other architectures. Every kernel gives the same result.
+ */
+
+uint64_t waveform_sum(const uint16_t* samples, size_t n);
+
+// index of the first sample lower than low or greater than high, n if none
+size_t waveform_findOutside(const uint16_t* samples, size_t n, uint16_t low, uint16_t high);
+
+// return a CAEN_FELib_ErrorCode, set last error on failure
+int waveform_convert(const uint16_t* samples, size_t n, const CAEN_FELib_WaveformConversion_t* conversion, float* out, size_t* outSize, float* baseline);
+
+#endif /* CAEN_INCLUDE_WAVEFORM_H_ */